@@ -6,16 +6,23 @@ TOP_DIR := ${LOCAL_PATH}/../..
 
 LOCAL_SRC_FILES := \
     ${TOP_DIR}/source/cutils/memory_debug.c \
+    ${TOP_DIR}/source/cutils/memory_report.cpp \
+    ${TOP_DIR}/source/cutils/os_arena.c \
+    ${TOP_DIR}/source/cutils/os_threadpool.c \
+    ${TOP_DIR}/source/cutils/pipeline.c \
+    ${TOP_DIR}/source/cutils/mem_pool.c \
     ${TOP_DIR}/source/cutils/msglooper.c \
     ${TOP_DIR}/source/cutils/msgqueue.c \
     ${TOP_DIR}/source/cutils/ringbuf.c \
     ${TOP_DIR}/source/cutils/sw_timer.c \
+    ${TOP_DIR}/source/cutils/timer_wheel.c \
     ${TOP_DIR}/source/cutils/sw_watchdog.c \
     ${TOP_DIR}/osal/os_logger.c \
     ${TOP_DIR}/osal/os_thread.c \
     ${TOP_DIR}/osal/os_time.c \
     ${TOP_DIR}/osal/os_timer.c \
     ${TOP_DIR}/source/utils/Looper.cpp \
+    ${TOP_DIR}/source/utils/ThreadPool.cpp \
     ${TOP_DIR}/source/utils/Thread.cpp \
     ${TOP_DIR}/source/utils/cJSON.cpp \
     ${TOP_DIR}/source/utils/JsonWrapper.cpp \
@@ -17,6 +17,9 @@
 #ifndef __ANDROID_LIST_H__
 #define __ANDROID_LIST_H__
 
+#include <stddef.h>
+#include <stdbool.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -100,6 +103,239 @@ static inline void list_remove(struct listnode *delnode)
 #define list_head(list) ((list)->next)
 #define list_tail(list) ((list)->prev)
 
+/*
+ * Lock-free companions of listnode, embed the node in the item and get the
+ * item back with node_to_item() as above. The container doesn't own items,
+ * an item must stay alive until it's taken out.
+ */
+#define LF_CACHE_LINE_SIZE 64
+
+/*
+ * Treiber stack (LIFO). Any number of threads may push concurrently, but
+ * to stay clear of ABA without double width CAS, the take side is either
+ * one thread calling lfstack_pop(), or any threads calling lfstack_pop_all(),
+ * never both at the same time (same rules as linux llist).
+ */
+struct lfnode {
+    struct lfnode *next;
+};
+
+struct lfstack {
+    struct lfnode *top;
+};
+
+#define LFSTACK_INITIALIZER { NULL }
+
+static inline void lfstack_init(struct lfstack *stack)
+{
+    stack->top = NULL;
+}
+
+// Return true if the stack was empty, e.g. to wake up the consumer
+static inline bool lfstack_push(struct lfstack *stack, struct lfnode *node)
+{
+    struct lfnode *top = __atomic_load_n(&stack->top, __ATOMIC_RELAXED);
+    do {
+        node->next = top;
+    } while (!__atomic_compare_exchange_n(&stack->top, &top, node, true,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    return top == NULL;
+}
+
+// Single consumer, NULL if empty
+static inline struct lfnode *lfstack_pop(struct lfstack *stack)
+{
+    struct lfnode *top = __atomic_load_n(&stack->top, __ATOMIC_ACQUIRE);
+    while (top != NULL &&
+           !__atomic_compare_exchange_n(&stack->top, &top, top->next, true,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+        ;
+    return top;
+}
+
+// Take all nodes at once, returned as a chain linked by next, newest first
+static inline struct lfnode *lfstack_pop_all(struct lfstack *stack)
+{
+    return __atomic_exchange_n(&stack->top, NULL, __ATOMIC_ACQUIRE);
+}
+
+static inline bool lfstack_empty(struct lfstack *stack)
+{
+    return __atomic_load_n(&stack->top, __ATOMIC_RELAXED) == NULL;
+}
+
+/*
+ * Intrusive MPSC queue (FIFO, Dmitry Vyukov's). Push is wait-free, one
+ * xchg, for any number of producers, pop is for one consumer only.
+ * mpscq_pop() may return NULL while a push is halfway (the producer is
+ * preempted between its two steps), the item shows up when the push
+ * completes, so a consumer waiting on a signal from the producer must
+ * retry rather than assume the queue is empty.
+ */
+struct mpscq {
+    struct lfnode *head; // producers side, last pushed node
+    char pad[LF_CACHE_LINE_SIZE - sizeof(struct lfnode *)];
+    struct lfnode *tail; // consumer side, next node to pop
+    struct lfnode stub;
+};
+
+static inline void mpscq_init(struct mpscq *queue)
+{
+    queue->stub.next = NULL;
+    queue->head = &queue->stub;
+    queue->tail = &queue->stub;
+}
+
+// Return true if the queue was empty, e.g. to wake up the consumer
+static inline bool mpscq_push(struct mpscq *queue, struct lfnode *node)
+{
+    struct lfnode *prev;
+
+    node->next = NULL;
+    prev = __atomic_exchange_n(&queue->head, node, __ATOMIC_ACQ_REL);
+    // consumer can't see the node until linked, see mpscq_pop()
+    __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+    return prev == &queue->stub;
+}
+
+// Single consumer, NULL if empty (or a push isn't completed yet)
+static inline struct lfnode *mpscq_pop(struct mpscq *queue)
+{
+    struct lfnode *tail = queue->tail;
+    struct lfnode *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+    if (tail == &queue->stub) {
+        if (next == NULL)
+            return NULL;
+        queue->tail = next;
+        tail = next;
+        next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+    }
+    if (next != NULL) {
+        queue->tail = next;
+        return tail;
+    }
+    if (tail != __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE))
+        return NULL; // a push is in progress behind tail
+    // tail is the last node, push stub behind it so that tail can be taken
+    mpscq_push(queue, &queue->stub);
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (next != NULL) {
+        queue->tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+static inline bool mpscq_empty(struct mpscq *queue)
+{
+    return queue->tail == &queue->stub &&
+           __atomic_load_n(&queue->stub.next, __ATOMIC_ACQUIRE) == NULL &&
+           __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) == &queue->stub;
+}
+
+/*
+ * Bounded MPMC ring of pointers (Dmitry Vyukov's), for any number of
+ * producers and consumers. Each cell carries a sequence number, so a
+ * slot is claimed with one CAS on the position and neither side waits
+ * for the other except on the very cell it uses. The caller provides
+ * the cells, count must be power of 2. Push a pointer to the embedded
+ * node (or the item itself), NULL can't be told apart from empty.
+ */
+struct mpmc_cell {
+    size_t seq;
+    void *data;
+};
+
+struct mpmc_ring {
+    struct mpmc_cell *cells;
+    size_t mask;
+    char pad0[LF_CACHE_LINE_SIZE - sizeof(struct mpmc_cell *) - sizeof(size_t)];
+    size_t enqueue_pos;
+    char pad1[LF_CACHE_LINE_SIZE - sizeof(size_t)];
+    size_t dequeue_pos;
+    char pad2[LF_CACHE_LINE_SIZE - sizeof(size_t)];
+};
+
+// Return false if count isn't power of 2
+static inline bool mpmc_ring_init(struct mpmc_ring *ring, struct mpmc_cell *cells, size_t count)
+{
+    if (count < 2 || (count & (count - 1)) != 0)
+        return false;
+    for (size_t i = 0; i < count; i++) {
+        cells[i].seq = i;
+        cells[i].data = NULL;
+    }
+    ring->cells = cells;
+    ring->mask = count - 1;
+    ring->enqueue_pos = 0;
+    ring->dequeue_pos = 0;
+    return true;
+}
+
+// Return false if full
+static inline bool mpmc_ring_push(struct mpmc_ring *ring, void *data)
+{
+    size_t pos = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED);
+    struct mpmc_cell *cell;
+
+    while (1) {
+        cell = &ring->cells[pos & ring->mask];
+        size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        long diff = (long)(seq - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&ring->enqueue_pos, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+        else if (diff < 0) {
+            return false; // the cell is still taken by last round
+        }
+        else {
+            pos = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+    cell->data = data;
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+// Return NULL if empty
+static inline void *mpmc_ring_pop(struct mpmc_ring *ring)
+{
+    size_t pos = __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED);
+    struct mpmc_cell *cell;
+    void *data;
+
+    while (1) {
+        cell = &ring->cells[pos & ring->mask];
+        size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        long diff = (long)(seq - (pos + 1));
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&ring->dequeue_pos, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+        else if (diff < 0) {
+            return NULL; // the cell isn't filled yet
+        }
+        else {
+            pos = __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED);
+        }
+    }
+    data = cell->data;
+    __atomic_store_n(&cell->seq, pos + ring->mask + 1, __ATOMIC_RELEASE);
+    return data;
+}
+
+// Approximate, exact only if no push/pop in progress
+static inline size_t mpmc_ring_count(struct mpmc_ring *ring)
+{
+    size_t enqueue = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED);
+    size_t dequeue = __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED);
+    return enqueue > dequeue ? enqueue - dequeue : 0;
+}
+
 #ifdef __cplusplus
 };
 #endif
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SYSUTILS_MEM_POOL_H__
+#define __SYSUTILS_MEM_POOL_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Size-class pool allocator, OS_MALLOC family is backed by it when built
+ * with ENABLE_MEMORY_POOL.
+ *
+ * Requests up to 512 bytes are rounded up to one of the size classes and
+ * served from a per-thread cache without lock. A cache that runs empty
+ * fetches a batch of blocks from the central list of the class, and a cache
+ * that grows too long (e.g. a consumer thread freeing blocks allocated by a
+ * producer) returns a batch to it. Central lists carve blocks from 64KB spans
+ * that are never returned to system. Larger requests go to malloc().
+ */
+#define MEMPOOL_MAX_SIZE    512
+#define MEMPOOL_CLASS_COUNT 16
+
+struct mempool_class_stats {
+    size_t size;          // block size of the class
+    size_t span_bytes;    // bytes of spans carved for the class
+    size_t total_blocks;  // blocks carved from spans
+    size_t central_free;  // free blocks in central list
+    size_t thread_cached; // free blocks in thread caches
+    size_t fetch_count;   // batches moved from central to thread caches
+    size_t release_count; // batches moved from thread caches to central
+};
+
+struct mempool_stats {
+    struct mempool_class_stats classes[MEMPOOL_CLASS_COUNT];
+    size_t large_count;   // live allocations larger than MEMPOOL_MAX_SIZE
+    size_t large_bytes;
+};
+
+void *mempool_malloc(size_t size);
+void *mempool_calloc(size_t n, size_t size);
+void *mempool_realloc(void *ptr, size_t size);
+void mempool_free(void *ptr);
+char *mempool_strdup(const char *str);
+
+// Return blocks cached by the calling thread to central lists
+void mempool_thread_flush();
+
+void mempool_get_stats(struct mempool_stats *stats);
+
+void mempool_dump();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SYSUTILS_MEM_POOL_H__ */
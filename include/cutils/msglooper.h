@@ -68,12 +68,24 @@ struct message *message_obtain(int what, int arg1, int arg2, void *data);
 struct message *message_obtain2(int what, int arg1, int arg2, void *data, unsigned long timeout_ms,
                                 message_handle_cb handle_cb, message_free_cb free_cb, message_timeout_cb timeout_cb);
 
+// attr->sched is ignored, so attr declared without initializer is fine, see mlooper_set_sched()
 mlooper_t mlooper_create(struct os_threadattr *attr, message_handle_cb handle_cb, message_free_cb free_cb);
 void mlooper_destroy(mlooper_t looper);
 
+/*
+ * Scheduling policy, cpu affinity and numa node of the looper thread, applied
+ * by the next mlooper_start(). Return -1 if sched is invalid (unknown policy,
+ * nice out of -20 ~ 19 or set without OS_THREAD_POLICY_OTHER) or the looper
+ * is running.
+ */
+int mlooper_set_sched(mlooper_t looper, const struct os_threadsched *sched);
+
 int mlooper_start(mlooper_t looper);
 void mlooper_stop(mlooper_t looper);
 
+// Whether called on the looper thread, e.g. to handle a message inline instead of posting it
+bool mlooper_is_current(mlooper_t looper);
+
 int mlooper_message_count(mlooper_t looper);
 void mlooper_dump(mlooper_t looper);
 
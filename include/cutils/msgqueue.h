@@ -41,6 +41,16 @@ unsigned int mqueue_count_available(mqueue_t queue);
 
 unsigned int mqueue_count_filled(mqueue_t queue);
 
+/*
+ * Set reader readiness hook, @notify is called each time a msg is sent to the
+ * queue (or to a member of the set), it lets an event driven reader (e.g. a
+ * coroutine on a looper) wait without blocking a thread in mqueue_receive().
+ *
+ * The hook runs in the sender's context with the queue lock held, it must not
+ * block nor call any mqueue_xxx api on the same queue. Pass NULL to clear.
+ */
+void mqueue_set_notify(mqueue_t queue, void (*notify)(void *arg), void *arg);
+
 /*
  * Queue sets provide a mechanism to allow a task to block (pend) on a read
  * operation from multiple queues or simultaneously.
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SYSUTILS_OS_ARENA_H__
+#define __SYSUTILS_OS_ARENA_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Bump-pointer arena for request-scoped work, e.g. parsing a JSON command
+ * and building the reply. Allocation is a pointer increment in the current
+ * chunk, a new chunk is chained when it runs out, and everything is freed at
+ * once by os_arena_reset(). An arena is not thread-safe.
+ *
+ * os_arena_scope_enter() routes OS_MALLOC family (built with
+ * ENABLE_MEMORY_ARENA) and cJSON (by default with ENABLE_MEMORY_ARENA, or
+ * after cJSON_InitHooks() with os_arena_scoped_malloc/os_arena_scoped_free)
+ * of the calling thread to the arena:
+ *
+ * os_arena_t arena = os_arena_create(0);
+ * while (...) {
+ *     os_arena_t prev = os_arena_scope_enter(arena);
+ *     cJSON *cmd = cJSON_Parse(request);
+ *     ...
+ *     os_arena_scope_leave(prev);
+ *     os_arena_reset(arena); // free the whole request in O(1)
+ * }
+ * os_arena_destroy(arena);
+ *
+ * Memory from the arena must not be used after os_arena_reset().
+ */
+typedef struct os_arena *os_arena_t;
+
+// chunk_size 0 for default (16KB), allocations larger than chunk_size/4 get a dedicated chunk,
+// which is freed by os_arena_reset(), so keep chunk_size above 4 times the largest block
+os_arena_t os_arena_create(size_t chunk_size);
+
+void *os_arena_alloc(os_arena_t arena, size_t size);
+
+void *os_arena_calloc(os_arena_t arena, size_t n, size_t size);
+
+char *os_arena_strdup(os_arena_t arena, const char *str);
+
+// Free all allocations, regular chunks are kept for reuse
+void os_arena_reset(os_arena_t arena);
+
+// Return the chunks kept by os_arena_reset() to system
+void os_arena_trim(os_arena_t arena);
+
+// Bytes allocated from the arena since created or reset
+size_t os_arena_used(os_arena_t arena);
+
+void os_arena_destroy(os_arena_t arena);
+
+// Route scoped allocations of the calling thread to arena, returns previous arena for nesting
+os_arena_t os_arena_scope_enter(os_arena_t arena);
+
+void os_arena_scope_leave(os_arena_t prev);
+
+os_arena_t os_arena_scope_current();
+
+/*
+ * Allocate from the arena of current scope, or from heap if no scope. Blocks
+ * are tagged, so os_arena_scoped_free() knows arena blocks (no-op) from heap
+ * blocks, no matter which scope frees them.
+ */
+void *os_arena_scoped_malloc(size_t size);
+void *os_arena_scoped_calloc(size_t n, size_t size);
+void *os_arena_scoped_realloc(void *ptr, size_t size);
+void os_arena_scoped_free(void *ptr);
+char *os_arena_scoped_strdup(const char *str);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SYSUTILS_OS_ARENA_H__ */
@@ -0,0 +1,524 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SYSUTILS_OS_FUTEX_H__
+#define __SYSUTILS_OS_FUTEX_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include "os_thread.h"
+
+#if defined(__linux__)
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Mutex, condition, reader-writer lock and seqlock that can be embedded by value, no allocation and no
+ * indirection. On Linux they are built on futex: lock and unlock are one
+ * atomic op when uncontended, a contended lock spins a while before it
+ * sleeps in kernel, since our locks are mostly held very briefly.
+ * Elsewhere they fall back to pthread mutex/cond embedded by value.
+ * Return values follow OS_THREAD_MUTEX_xxx()/OS_THREAD_COND_xxx().
+ */
+
+#if defined(__linux__)
+
+#if defined(__x86_64__) || defined(__i386__)
+#define OS_CPU_RELAX() __builtin_ia32_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+#define OS_CPU_RELAX() __asm__ __volatile__("yield" ::: "memory")
+#else
+#define OS_CPU_RELAX() __asm__ __volatile__("" ::: "memory")
+#endif
+
+#define OS_FMUTEX_SPIN_COUNT 100
+
+typedef struct {
+    int state; // 0: unlocked, 1: locked, 2: locked and maybe waiters
+} os_fmutex_t;
+
+typedef struct {
+    unsigned int seq;     // bumped by signal/broadcast
+    unsigned int waiters;
+} os_fcond_t;
+
+#define OS_FMUTEX_INITIALIZER { 0 }
+
+static inline long os_futex(void *addr, int op, int val, const struct timespec *timeout)
+{
+    return syscall(SYS_futex, addr, op, val, timeout, NULL, 0);
+}
+
+static inline void OS_FMUTEX_INIT(os_fmutex_t *mutex)
+{
+    mutex->state = 0;
+}
+
+static inline void OS_FMUTEX_DESTROY(os_fmutex_t *mutex)
+{
+    (void)mutex;
+}
+
+static inline int OS_FMUTEX_TRYLOCK(os_fmutex_t *mutex)
+{
+    int c = 0;
+    return __atomic_compare_exchange_n(&mutex->state, &c, 1, false,
+                                       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED) ? 0 : EBUSY;
+}
+
+static inline void os_fmutex_lock_slow(os_fmutex_t *mutex)
+{
+    int c;
+
+    for (int i = 0; i < OS_FMUTEX_SPIN_COUNT; i++) {
+        c = __atomic_load_n(&mutex->state, __ATOMIC_RELAXED);
+        if (c == 2)
+            break; // others are sleeping already, don't jump the queue
+        if (c == 0 && __atomic_compare_exchange_n(&mutex->state, &c, 1, false,
+                                                  __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return;
+        OS_CPU_RELAX();
+    }
+
+    while (__atomic_exchange_n(&mutex->state, 2, __ATOMIC_ACQUIRE) != 0)
+        os_futex(&mutex->state, FUTEX_WAIT_PRIVATE, 2, NULL);
+}
+
+static inline int OS_FMUTEX_LOCK(os_fmutex_t *mutex)
+{
+    int c = 0;
+    if (!__atomic_compare_exchange_n(&mutex->state, &c, 1, false,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        os_fmutex_lock_slow(mutex);
+    return 0;
+}
+
+static inline int OS_FMUTEX_UNLOCK(os_fmutex_t *mutex)
+{
+    if (__atomic_exchange_n(&mutex->state, 0, __ATOMIC_RELEASE) == 2)
+        os_futex(&mutex->state, FUTEX_WAKE_PRIVATE, 1, NULL);
+    return 0;
+}
+
+static inline void OS_FCOND_INIT(os_fcond_t *cond)
+{
+    cond->seq = 0;
+    cond->waiters = 0;
+}
+
+static inline void OS_FCOND_DESTROY(os_fcond_t *cond)
+{
+    (void)cond;
+}
+
+static inline int os_fcond_wait(os_fcond_t *cond, os_fmutex_t *mutex, const struct timespec *timeout)
+{
+    unsigned int seq;
+    int err = 0;
+
+    // waiters is raised before seq is read, pairs with OS_FCOND_SIGNAL(),
+    // either signal sees the waiter, or the waiter sees the new seq
+    __atomic_add_fetch(&cond->waiters, 1, __ATOMIC_SEQ_CST);
+    seq = __atomic_load_n(&cond->seq, __ATOMIC_SEQ_CST);
+    OS_FMUTEX_UNLOCK(mutex);
+
+    if (os_futex(&cond->seq, FUTEX_WAIT_PRIVATE, (int)seq, timeout) != 0 && errno == ETIMEDOUT)
+        err = ETIMEDOUT;
+
+    // relock as contended, other waiters may be woken up together
+    while (__atomic_exchange_n(&mutex->state, 2, __ATOMIC_ACQUIRE) != 0)
+        os_futex(&mutex->state, FUTEX_WAIT_PRIVATE, 2, NULL);
+    __atomic_sub_fetch(&cond->waiters, 1, __ATOMIC_RELAXED);
+    return err;
+}
+
+static inline int OS_FCOND_WAIT(os_fcond_t *cond, os_fmutex_t *mutex)
+{
+    return os_fcond_wait(cond, mutex, NULL);
+}
+
+static inline int OS_FCOND_TIMEDWAIT(os_fcond_t *cond, os_fmutex_t *mutex, unsigned long usec)
+{
+    // FUTEX_WAIT takes relative timeout measured by CLOCK_MONOTONIC
+    struct timespec ts;
+    ts.tv_sec = usec / 1000000;
+    ts.tv_nsec = (usec % 1000000) * 1000;
+    return os_fcond_wait(cond, mutex, &ts);
+}
+
+static inline int OS_FCOND_SIGNAL(os_fcond_t *cond)
+{
+    __atomic_add_fetch(&cond->seq, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&cond->waiters, __ATOMIC_SEQ_CST) > 0)
+        os_futex(&cond->seq, FUTEX_WAKE_PRIVATE, 1, NULL);
+    return 0;
+}
+
+static inline int OS_FCOND_BROADCAST(os_fcond_t *cond)
+{
+    __atomic_add_fetch(&cond->seq, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&cond->waiters, __ATOMIC_SEQ_CST) > 0)
+        os_futex(&cond->seq, FUTEX_WAKE_PRIVATE, INT_MAX, NULL);
+    return 0;
+}
+
+
+/*
+ * Writer-preferring reader-writer lock: readers share the lock with one
+ * CAS, once a writer is waiting new readers queue behind it, so writers
+ * are not starved by a steady stream of readers.
+ */
+#define OS_RWLOCK_WRITER       0x80000000U // write locked
+#define OS_RWLOCK_WAITERS      0x40000000U // someone sleeps in kernel
+#define OS_RWLOCK_READERS_MASK 0x3fffffffU
+
+typedef struct {
+    unsigned int state;           // OS_RWLOCK_xxx bits and readers count
+    unsigned int writers_waiting;
+} os_rwlock_t;
+
+#define OS_RWLOCK_INITIALIZER { 0, 0 }
+
+static inline void OS_RWLOCK_INIT(os_rwlock_t *rwlock)
+{
+    rwlock->state = 0;
+    rwlock->writers_waiting = 0;
+}
+
+static inline void OS_RWLOCK_DESTROY(os_rwlock_t *rwlock)
+{
+    (void)rwlock;
+}
+
+static inline bool os_rwlock_read_allowed(os_rwlock_t *rwlock, unsigned int state)
+{
+    return !(state & OS_RWLOCK_WRITER) &&
+           __atomic_load_n(&rwlock->writers_waiting, __ATOMIC_SEQ_CST) == 0;
+}
+
+// Mark waiters and sleep until state changes, return false if state changed already
+static inline bool os_rwlock_sleep(os_rwlock_t *rwlock, unsigned int state, bool reader)
+{
+    if (!(state & OS_RWLOCK_WAITERS) &&
+        !__atomic_compare_exchange_n(&rwlock->state, &state, state | OS_RWLOCK_WAITERS, false,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        return false;
+    // writers_waiting isn't covered by the futex word: a reader held off only by
+    // a waiting writer rechecks it once waiters bit is visible. If the writer is
+    // still counted, its unlock comes later and sees the bit, otherwise retry.
+    if (reader && !(state & OS_RWLOCK_WRITER) &&
+        __atomic_load_n(&rwlock->writers_waiting, __ATOMIC_SEQ_CST) == 0)
+        return false;
+    os_futex(&rwlock->state, FUTEX_WAIT_PRIVATE, (int)(state | OS_RWLOCK_WAITERS), NULL);
+    return true;
+}
+
+static inline int OS_RWLOCK_TRYRDLOCK(os_rwlock_t *rwlock)
+{
+    unsigned int state = __atomic_load_n(&rwlock->state, __ATOMIC_RELAXED);
+    while (os_rwlock_read_allowed(rwlock, state)) {
+        if (__atomic_compare_exchange_n(&rwlock->state, &state, state + 1, true,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return 0;
+    }
+    return EBUSY;
+}
+
+static inline int OS_RWLOCK_RDLOCK(os_rwlock_t *rwlock)
+{
+    for (int spin = 0; ; spin++) {
+        unsigned int state = __atomic_load_n(&rwlock->state, __ATOMIC_SEQ_CST);
+        if (os_rwlock_read_allowed(rwlock, state)) {
+            if (__atomic_compare_exchange_n(&rwlock->state, &state, state + 1, true,
+                                            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+                return 0;
+        }
+        else if (spin < OS_FMUTEX_SPIN_COUNT) {
+            OS_CPU_RELAX();
+        }
+        else {
+            os_rwlock_sleep(rwlock, state, true);
+        }
+    }
+}
+
+static inline int OS_RWLOCK_TRYWRLOCK(os_rwlock_t *rwlock)
+{
+    unsigned int state = __atomic_load_n(&rwlock->state, __ATOMIC_RELAXED);
+    while ((state & ~OS_RWLOCK_WAITERS) == 0) {
+        if (__atomic_compare_exchange_n(&rwlock->state, &state, state | OS_RWLOCK_WRITER, true,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return 0;
+    }
+    return EBUSY;
+}
+
+static inline int OS_RWLOCK_WRLOCK(os_rwlock_t *rwlock)
+{
+    if (OS_RWLOCK_TRYWRLOCK(rwlock) == 0)
+        return 0;
+
+    // hold off new readers while waiting
+    __atomic_add_fetch(&rwlock->writers_waiting, 1, __ATOMIC_SEQ_CST);
+    for (int spin = 0; ; spin++) {
+        unsigned int state = __atomic_load_n(&rwlock->state, __ATOMIC_RELAXED);
+        if ((state & ~OS_RWLOCK_WAITERS) == 0) {
+            // keep waiters bit, they're woken up by unlock
+            if (__atomic_compare_exchange_n(&rwlock->state, &state, state | OS_RWLOCK_WRITER, true,
+                                            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+                break;
+        }
+        else if (spin < OS_FMUTEX_SPIN_COUNT) {
+            OS_CPU_RELAX();
+        }
+        else {
+            os_rwlock_sleep(rwlock, state, false);
+        }
+    }
+    // uncounted while still holding the lock, so the unlock follows it
+    __atomic_sub_fetch(&rwlock->writers_waiting, 1, __ATOMIC_SEQ_CST);
+    return 0;
+}
+
+static inline int OS_RWLOCK_UNLOCK(os_rwlock_t *rwlock)
+{
+    unsigned int state = __atomic_load_n(&rwlock->state, __ATOMIC_RELAXED);
+    unsigned int next;
+
+    if (state & OS_RWLOCK_WRITER) {
+        state = __atomic_exchange_n(&rwlock->state, 0, __ATOMIC_SEQ_CST);
+        next = 0;
+    }
+    else {
+        // last reader out clears waiters bit and wakes all, sleepers mark it again if needed
+        do {
+            next = state - 1;
+            if ((next & OS_RWLOCK_READERS_MASK) == 0)
+                next &= ~OS_RWLOCK_WAITERS;
+        } while (!__atomic_compare_exchange_n(&rwlock->state, &state, next, true,
+                                              __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    }
+    if ((state & OS_RWLOCK_WAITERS) && !(next & OS_RWLOCK_WAITERS))
+        os_futex(&rwlock->state, FUTEX_WAKE_PRIVATE, INT_MAX, NULL);
+    return 0;
+}
+
+#else
+
+typedef struct {
+    pthread_mutex_t mutex;
+} os_fmutex_t;
+
+typedef struct {
+    pthread_cond_t cond;
+} os_fcond_t;
+
+#define OS_FMUTEX_INITIALIZER { PTHREAD_MUTEX_INITIALIZER }
+
+static inline void OS_FMUTEX_INIT(os_fmutex_t *mutex)
+{
+    pthread_mutex_init(&mutex->mutex, NULL);
+}
+
+static inline void OS_FMUTEX_DESTROY(os_fmutex_t *mutex)
+{
+    pthread_mutex_destroy(&mutex->mutex);
+}
+
+static inline int OS_FMUTEX_TRYLOCK(os_fmutex_t *mutex)
+{
+    return OS_THREAD_MUTEX_TRYLOCK((os_mutex_t)&mutex->mutex);
+}
+
+static inline int OS_FMUTEX_LOCK(os_fmutex_t *mutex)
+{
+    return OS_THREAD_MUTEX_LOCK((os_mutex_t)&mutex->mutex);
+}
+
+static inline int OS_FMUTEX_UNLOCK(os_fmutex_t *mutex)
+{
+    return OS_THREAD_MUTEX_UNLOCK((os_mutex_t)&mutex->mutex);
+}
+
+static inline void OS_FCOND_INIT(os_fcond_t *cond)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+#if !defined(OS_MACOSX) && !defined(OS_IOS)
+    // same clock as OS_THREAD_COND_TIMEDWAIT()
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+#endif
+    pthread_cond_init(&cond->cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static inline void OS_FCOND_DESTROY(os_fcond_t *cond)
+{
+    pthread_cond_destroy(&cond->cond);
+}
+
+static inline int OS_FCOND_WAIT(os_fcond_t *cond, os_fmutex_t *mutex)
+{
+    return OS_THREAD_COND_WAIT((os_cond_t)&cond->cond, (os_mutex_t)&mutex->mutex);
+}
+
+static inline int OS_FCOND_TIMEDWAIT(os_fcond_t *cond, os_fmutex_t *mutex, unsigned long usec)
+{
+    return OS_THREAD_COND_TIMEDWAIT((os_cond_t)&cond->cond, (os_mutex_t)&mutex->mutex, usec);
+}
+
+static inline int OS_FCOND_SIGNAL(os_fcond_t *cond)
+{
+    return OS_THREAD_COND_SIGNAL((os_cond_t)&cond->cond);
+}
+
+static inline int OS_FCOND_BROADCAST(os_fcond_t *cond)
+{
+    return OS_THREAD_COND_BROADCAST((os_cond_t)&cond->cond);
+}
+
+typedef struct {
+    pthread_rwlock_t rwlock;
+} os_rwlock_t;
+
+#define OS_RWLOCK_INITIALIZER { PTHREAD_RWLOCK_INITIALIZER }
+
+static inline void OS_RWLOCK_INIT(os_rwlock_t *rwlock)
+{
+    pthread_rwlock_init(&rwlock->rwlock, NULL);
+}
+
+static inline void OS_RWLOCK_DESTROY(os_rwlock_t *rwlock)
+{
+    pthread_rwlock_destroy(&rwlock->rwlock);
+}
+
+static inline int OS_RWLOCK_TRYRDLOCK(os_rwlock_t *rwlock)
+{
+    return pthread_rwlock_tryrdlock(&rwlock->rwlock);
+}
+
+static inline int OS_RWLOCK_RDLOCK(os_rwlock_t *rwlock)
+{
+    return pthread_rwlock_rdlock(&rwlock->rwlock);
+}
+
+static inline int OS_RWLOCK_TRYWRLOCK(os_rwlock_t *rwlock)
+{
+    return pthread_rwlock_trywrlock(&rwlock->rwlock);
+}
+
+static inline int OS_RWLOCK_WRLOCK(os_rwlock_t *rwlock)
+{
+    return pthread_rwlock_wrlock(&rwlock->rwlock);
+}
+
+static inline int OS_RWLOCK_UNLOCK(os_rwlock_t *rwlock)
+{
+    return pthread_rwlock_unlock(&rwlock->rwlock);
+}
+
+#endif
+
+#if !defined(OS_CPU_RELAX)
+#define OS_CPU_RELAX() do {} while (0)
+#endif
+
+/*
+ * Seqlock for small plain-old-data snapshots read far more often than
+ * written: readers never write shared memory, they copy the data and retry
+ * if a writer ran meanwhile. Writers are serialized by the embedded mutex.
+ *
+ *     struct route_table snapshot;
+ *     OS_SEQLOCK_READ(&lock, &snapshot, &g_table, sizeof(snapshot));
+ *     OS_SEQLOCK_WRITE(&lock, &g_table, &new_table, sizeof(g_table));
+ */
+typedef struct {
+    unsigned int seq; // odd while writing
+    os_fmutex_t writer;
+} os_seqlock_t;
+
+static inline void OS_SEQLOCK_INIT(os_seqlock_t *seqlock)
+{
+    seqlock->seq = 0;
+    OS_FMUTEX_INIT(&seqlock->writer);
+}
+
+static inline void OS_SEQLOCK_DESTROY(os_seqlock_t *seqlock)
+{
+    OS_FMUTEX_DESTROY(&seqlock->writer);
+}
+
+static inline unsigned int OS_SEQLOCK_READ_BEGIN(os_seqlock_t *seqlock)
+{
+    unsigned int seq;
+    while ((seq = __atomic_load_n(&seqlock->seq, __ATOMIC_ACQUIRE)) & 1)
+        OS_CPU_RELAX();
+    return seq;
+}
+
+// Return true if the data read since OS_SEQLOCK_READ_BEGIN() may be torn
+static inline bool OS_SEQLOCK_READ_RETRY(os_seqlock_t *seqlock, unsigned int seq)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&seqlock->seq, __ATOMIC_RELAXED) != seq;
+}
+
+static inline void OS_SEQLOCK_WRITE_BEGIN(os_seqlock_t *seqlock)
+{
+    OS_FMUTEX_LOCK(&seqlock->writer);
+    __atomic_store_n(&seqlock->seq, seqlock->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void OS_SEQLOCK_WRITE_END(os_seqlock_t *seqlock)
+{
+    __atomic_store_n(&seqlock->seq, seqlock->seq + 1, __ATOMIC_RELEASE);
+    OS_FMUTEX_UNLOCK(&seqlock->writer);
+}
+
+static inline void OS_SEQLOCK_READ(os_seqlock_t *seqlock, void *dst, const void *src, size_t size)
+{
+    unsigned int seq;
+    do {
+        seq = OS_SEQLOCK_READ_BEGIN(seqlock);
+        memcpy(dst, src, size);
+    } while (OS_SEQLOCK_READ_RETRY(seqlock, seq));
+}
+
+static inline void OS_SEQLOCK_WRITE(os_seqlock_t *seqlock, void *dst, const void *src, size_t size)
+{
+    OS_SEQLOCK_WRITE_BEGIN(seqlock);
+    memcpy(dst, src, size);
+    OS_SEQLOCK_WRITE_END(seqlock);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SYSUTILS_OS_FUTEX_H__ */
@@ -35,12 +35,111 @@ enum os_logprio {
     OS_LOG_VERBOSE,
 };
 
+// Global switch and level, applies to the tags without their own level
 void os_logger_config(bool enable, enum os_logprio prio);
 
-// [date] [time] [pid] [tid] [prio] [tag]:[func]:[line]: [log]
+// Level of the tag, overrides the global level set by os_logger_config()
+void os_logger_set_level(const char *tag, enum os_logprio prio);
+
+/*
+ * Limit each call site of the tag to rate lines per second, at most burst
+ * lines in a row, suppressed lines are counted and reported with the next
+ * line allowed. NULL tag sets the default of all tags, rate 0 means no limit.
+ * Fatal lines are never limited.
+ */
+void os_logger_set_ratelimit(const char *tag, unsigned int rate, unsigned int burst);
+
+// Timestamp lines with the coarse realtime clock, cheaper but only 1~10ms resolution
+void os_logger_use_coarse_clock(bool coarse);
+
+enum os_logger_full_policy {
+    OS_LOGGER_FULL_DROP = 0, // drop the new line and count it, never block the caller (default)
+    OS_LOGGER_FULL_BLOCK,    // wait for the writer thread to make room
+};
+
+struct os_logger_async_attr {
+    size_t ring_size;               // per-thread ring buffer size in bytes, rounded up to power of 2
+    unsigned int flush_interval_ms; // max delay before the writer thread outputs buffered lines
+    enum os_logger_full_policy full_policy;
+};
+
+/*
+ * Async mode: the caller formats the line into a lock-free ring buffer
+ * owned by its thread, one writer thread drains all rings and outputs
+ * to stdout (and log file) in batches. Lines from one thread keep their
+ * order, lines from different threads may be interleaved out of order
+ * in one batch, rely on the timestamp to sort them. Fatal lines flush
+ * the buffered lines and are output synchronously.
+ * Pass NULL attr to use the defaults.
+ */
+int os_logger_async_start(struct os_logger_async_attr *attr);
+
+// Flush buffered lines and back to synchronous mode
+void os_logger_async_stop();
+
+// Output all buffered lines before return
+void os_logger_flush();
+
+// Number of lines dropped because the ring buffer was full
+unsigned long long os_logger_dropped();
+
+struct os_logger_file_attr {
+    const char *path;               // directory of log files
+    const char *prefix;             // current file is [path]/[prefix].txt, rotated to [prefix].1.txt ...
+    size_t limit_size;              // rotate when current file reaches the size, it's preallocated
+    unsigned int rotate_sec;        // rotate when current file is older than this, 0 to disable
+    unsigned int keep_count;        // number of rotated files to keep, the oldest is removed
+    unsigned int flush_interval_ms; // group commit, flush to file at most once per interval, 0 for each line
+    bool crash_safe;                // mmap current file, written lines survive process crash (SIGSEGV...)
+};
+
+/*
+ * Save lines to file as well, only supported if built with ENABLE_LOG_SAVE.
+ * The file left by last run is rotated as [prefix].1.txt on first write.
+ * In buffered mode, a crash loses the lines not flushed yet, in crash safe
+ * mode the file is filled with zeros behind the last line until it's closed
+ * (rotated or reconfigured). Lines still in async ring buffers are lost anyway.
+ * In async mode the writer thread flushes lines buffered longer than
+ * flush_interval_ms. In sync mode nothing runs in the background, buffered
+ * lines are flushed by the next write after the interval, or os_logger_flush().
+ * Pass NULL attr to keep current settings.
+ */
+int os_logger_file_config(bool enable, struct os_logger_file_attr *attr);
+
+// [date] [time] [prio] [thread] [tag]:[func]:[line]: [log]
 void os_logger_trace(enum os_logprio prio, const char *tag, const char *func, unsigned int line,
                      const char *format, ...);
 
+/*
+ * Deferred mode, only for debug/verbose lines in async mode: the caller
+ * doesn't format the line, it records the format pointer, a timestamp
+ * and the raw arguments (strings are copied), and the writer thread
+ * formats them later. Lines with a conversion that can't be recorded
+ * (%n, %ls, %Lf ...) are formatted by the caller as usual.
+ */
+void os_logger_set_deferred(const char *tag, bool deferred);
+
+/*
+ * Per call site state, the config of the tag is resolved on first use and
+ * pushed to the site when config changes, so a disabled line costs one
+ * relaxed load of level in the OS_LOGx macros.
+ */
+struct os_logsite {
+    const char *tag;
+    int level;                // effective level of the tag
+    unsigned int flags;
+    unsigned int interval_us; // rate limit, 0 for no limit
+    unsigned int burst;
+    unsigned long long tat;   // rate limiter state
+    unsigned int suppressed;  // lines suppressed by rate limit since last line
+    struct os_logsite *next;
+};
+#define OS_LOGSITE_UNRESOLVED 0x7fffffff
+#define OS_LOGSITE_DEFERRED   0x1
+
+void os_logger_trace_site(struct os_logsite *site, enum os_logprio prio,
+                          const char *func, unsigned int line, const char *format, ...);
+
 #if defined(OS_ANDROID)
     #include <android/log.h>
     #define OS_LOGF(tag, format, ...) __android_log_print(ANDROID_LOG_FATAL, tag, format, ##__VA_ARGS__)
@@ -68,18 +167,29 @@ void os_logger_trace(enum os_logprio prio, const char *tag, const char *func, un
     #define OS_LOG_COLOR_V       "\033[1;30m"
     #define OS_LOG_FORMAT(letter, format)  OS_LOG_COLOR_ ## letter format OS_LOG_COLOR_RESET
 
-    #define OS_LOGF(tag, format, ...) \
-        os_logger_trace(OS_LOG_FATAL, tag, __FUNCTION__, __LINE__, OS_LOG_FORMAT(F, format), ##__VA_ARGS__)
-    #define OS_LOGE(tag, format, ...) \
-        os_logger_trace(OS_LOG_ERROR, tag, __FUNCTION__, __LINE__, OS_LOG_FORMAT(E, format), ##__VA_ARGS__)
-    #define OS_LOGW(tag, format, ...) \
-        os_logger_trace(OS_LOG_WARN, tag, __FUNCTION__, __LINE__, OS_LOG_FORMAT(W, format), ##__VA_ARGS__)
-    #define OS_LOGI(tag, format, ...) \
-        os_logger_trace(OS_LOG_INFO, tag, __FUNCTION__, __LINE__, OS_LOG_FORMAT(I, format), ##__VA_ARGS__)
-    #define OS_LOGD(tag, format, ...) \
-        os_logger_trace(OS_LOG_DEBUG, tag, __FUNCTION__, __LINE__, OS_LOG_FORMAT(D, format), ##__VA_ARGS__)
-    #define OS_LOGV(tag, format, ...) \
-        os_logger_trace(OS_LOG_VERBOSE, tag, __FUNCTION__, __LINE__, OS_LOG_FORMAT(V, format), ##__VA_ARGS__)
+    // Only a constant tag (string literal) can be cached by the call site, a
+    // tag computed at runtime is looked up on each call by os_logger_trace()
+    #define OS_LOG_SITE(prio, letter, tag, format, ...) do { \
+        if (__builtin_constant_p(tag)) { \
+            static struct os_logsite __os_logsite = { \
+                __builtin_constant_p(tag) ? (tag) : NULL, OS_LOGSITE_UNRESOLVED, 0, 0, 0, 0, 0, NULL \
+            }; \
+            if ((int)(prio) <= __atomic_load_n(&__os_logsite.level, __ATOMIC_RELAXED)) \
+                os_logger_trace_site(&__os_logsite, prio, __FUNCTION__, __LINE__, \
+                                     OS_LOG_FORMAT(letter, format), ##__VA_ARGS__); \
+        } \
+        else { \
+            os_logger_trace(prio, tag, __FUNCTION__, __LINE__, \
+                            OS_LOG_FORMAT(letter, format), ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+    #define OS_LOGF(tag, format, ...) OS_LOG_SITE(OS_LOG_FATAL, F, tag, format, ##__VA_ARGS__)
+    #define OS_LOGE(tag, format, ...) OS_LOG_SITE(OS_LOG_ERROR, E, tag, format, ##__VA_ARGS__)
+    #define OS_LOGW(tag, format, ...) OS_LOG_SITE(OS_LOG_WARN, W, tag, format, ##__VA_ARGS__)
+    #define OS_LOGI(tag, format, ...) OS_LOG_SITE(OS_LOG_INFO, I, tag, format, ##__VA_ARGS__)
+    #define OS_LOGD(tag, format, ...) OS_LOG_SITE(OS_LOG_DEBUG, D, tag, format, ##__VA_ARGS__)
+    #define OS_LOGV(tag, format, ...) OS_LOG_SITE(OS_LOG_VERBOSE, V, tag, format, ##__VA_ARGS__)
 #endif
 
 #if 1
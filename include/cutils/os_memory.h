@@ -24,6 +24,9 @@
 
 //#define ENABLE_MEMORY_LEAK_DETECT
 //#define ENABLE_MEMORY_OVERFLOW_DETECT
+//#define ENABLE_MEMORY_SAMPLING
+//#define ENABLE_MEMORY_ARENA
+//#define ENABLE_MEMORY_POOL
 //#define ENABLE_CLASS_LEAK_DETECT
 
 // ---------------------------------------------------------------------------
@@ -82,6 +85,84 @@ void memory_debug_dump(bool overflow_detect);
     #define OS_STREQUAL(str1, str2) (((str1) && (str2)) ? (strcmp((str1), (str2)) == 0) : false)
     #define OS_MEMORY_DUMP() memory_debug_dump(false)
 
+#elif defined(ENABLE_MEMORY_SAMPLING)
+/*
+ * Sampling allocation profiler, cheap enough for production builds. About one
+ * allocation per MEMORY_SAMPLE_INTERVAL bytes (512KB by default, Poisson
+ * distributed) is recorded, and the stats of each call site are scaled up to
+ * estimate the real usage. Freeing an allocation that isn't sampled costs an
+ * atomic load only.
+ */
+void *memory_sample_malloc(size_t size, const char *file, const char *func, int line);
+void *memory_sample_calloc(size_t n, size_t size, const char *file, const char *func, int line);
+void *memory_sample_realloc(void *ptr, size_t size, const char *file, const char *func, int line);
+void memory_sample_free(void *ptr);
+char *memory_sample_strdup(const char *str, const char *file, const char *func, int line);
+void memory_sample_set_interval(size_t bytes);
+void memory_sample_dump();
+
+    #define OS_MALLOC(size) \
+        memory_sample_malloc((size_t)(size), __FILE__, __FUNCTION__, __LINE__)
+    #define OS_CALLOC(n, size) \
+        memory_sample_calloc((size_t)(n), (size_t)(size), __FILE__, __FUNCTION__, __LINE__)
+    #define OS_REALLOC(ptr, size) \
+        memory_sample_realloc((void *)(ptr), (size_t)(size), __FILE__, __FUNCTION__, __LINE__)
+    #define OS_FREE(ptr) \
+        do {\
+            if (ptr) {\
+                memory_sample_free((void *)(ptr));\
+                (ptr) = NULL;\
+            }\
+        } while (0)
+    #define OS_STRDUP(str) memory_sample_strdup((const char *)(str), __FILE__, __FUNCTION__, __LINE__)
+    #define OS_STREQUAL(str1, str2) (((str1) && (str2)) ? (strcmp((str1), (str2)) == 0) : false)
+    #define OS_MEMORY_DUMP() memory_sample_dump()
+
+#elif defined(ENABLE_MEMORY_ARENA)
+// Route to the arena of current scope, see os_arena.h
+void *os_arena_scoped_malloc(size_t size);
+void *os_arena_scoped_calloc(size_t n, size_t size);
+void *os_arena_scoped_realloc(void *ptr, size_t size);
+void os_arena_scoped_free(void *ptr);
+char *os_arena_scoped_strdup(const char *str);
+
+    #define OS_MALLOC(size) os_arena_scoped_malloc((size_t)(size))
+    #define OS_CALLOC(n, size) os_arena_scoped_calloc((size_t)(n), (size_t)(size))
+    #define OS_REALLOC(ptr, size) os_arena_scoped_realloc((void *)(ptr), (size_t)(size))
+    #define OS_FREE(ptr) \
+        do {\
+            if (ptr) {\
+                os_arena_scoped_free((void *)(ptr));\
+                (ptr) = NULL;\
+            }\
+        } while (0)
+    #define OS_STRDUP(str) os_arena_scoped_strdup((const char *)(str))
+    #define OS_STREQUAL(str1, str2) (((str1) && (str2)) ? (strcmp((str1), (str2)) == 0) : false)
+    #define OS_MEMORY_DUMP() do {} while (0)
+
+#elif defined(ENABLE_MEMORY_POOL)
+// Size-class pool with thread caches, see mem_pool.h
+void *mempool_malloc(size_t size);
+void *mempool_calloc(size_t n, size_t size);
+void *mempool_realloc(void *ptr, size_t size);
+void mempool_free(void *ptr);
+char *mempool_strdup(const char *str);
+void mempool_dump();
+
+    #define OS_MALLOC(size) mempool_malloc((size_t)(size))
+    #define OS_CALLOC(n, size) mempool_calloc((size_t)(n), (size_t)(size))
+    #define OS_REALLOC(ptr, size) mempool_realloc((void *)(ptr), (size_t)(size))
+    #define OS_FREE(ptr) \
+        do {\
+            if (ptr) {\
+                mempool_free((void *)(ptr));\
+                (ptr) = NULL;\
+            }\
+        } while (0)
+    #define OS_STRDUP(str) mempool_strdup((const char *)(str))
+    #define OS_STREQUAL(str1, str2) (((str1) && (str2)) ? (strcmp((str1), (str2)) == 0) : false)
+    #define OS_MEMORY_DUMP() mempool_dump()
+
 #else
 char *memory_strdup(const char *str);
 
@@ -102,6 +183,54 @@ char *memory_strdup(const char *str);
 
 // ---------------------------------------------------------------------------
 
+/*
+ * Per call site statistics, only recorded with ENABLE_MEMORY_LEAK_DETECT or
+ * ENABLE_MEMORY_OVERFLOW_DETECT. Take snapshots periodically and diff them to
+ * find which call site's footprint grows, e.g.:
+ *
+ * struct mem_snapshot *prev = memory_debug_snapshot();
+ * ...
+ * struct mem_snapshot *cur = memory_debug_snapshot();
+ * struct mem_snapshot *diff = memory_debug_snapshot_diff(prev, cur);
+ * char *json = memory_debug_snapshot_json(diff);
+ * ...
+ * free(json);
+ */
+struct mem_site_stat {
+    const char *file;
+    const char *func;
+    int line;
+    long long live_bytes;
+    long long live_count;
+    long long total_bytes; // total allocated bytes, including freed
+    long long total_count;
+    long long peak_bytes;  // peak of live_bytes
+};
+
+struct mem_snapshot {
+    unsigned long long time_ms; // monotonic time, or duration for a diff
+    long long cur_used;
+    long long max_used;
+    size_t site_count;
+    struct mem_site_stat sites[]; // sorted by live_bytes, largest first
+};
+
+// Free the snapshot by memory_debug_snapshot_free()
+struct mem_snapshot *memory_debug_snapshot();
+
+// cur - prev, only the call sites that changed are kept, sorted by growth of live_bytes
+struct mem_snapshot *memory_debug_snapshot_diff(const struct mem_snapshot *prev, const struct mem_snapshot *cur);
+
+void memory_debug_snapshot_free(struct mem_snapshot *snapshot);
+
+// Print top max_sites call sites to logger, 0 for all
+void memory_debug_snapshot_dump(const struct mem_snapshot *snapshot, size_t max_sites);
+
+// Serialize snapshot as JSON, free the result with free()
+char *memory_debug_snapshot_json(const struct mem_snapshot *snapshot, bool formatted);
+
+// ---------------------------------------------------------------------------
+
 #if !defined(ENABLE_CLASS_LEAK_DETECT)
     #define OS_NEW(ptr, Class, ...)        ptr = new Class(__VA_ARGS__)
     #define OS_DELETE(ptr) \
@@ -53,7 +53,7 @@ enum os_threadprio {
     OS_THREAD_PRIO_HARD_REALTIME = 8,
 };
 
-#else // NOT USED FOR Linux/MacosX/Android, DON'T MODIFY
+#else // Linux only with OS_THREAD_POLICY_FIFO/RR, mapped to range of the policy, DON'T MODIFY
 enum os_threadprio {
     OS_THREAD_PRIO_INVALID = -1,
     OS_THREAD_PRIO_HARD_REALTIME,
@@ -65,22 +65,72 @@ enum os_threadprio {
 };
 #endif
 
+enum os_threadpolicy {
+    OS_THREAD_POLICY_DEFAULT = 0, // inherit policy of the creator
+    OS_THREAD_POLICY_OTHER,       // time sharing, weighted by nice
+    OS_THREAD_POLICY_FIFO,        // real-time, needs CAP_SYS_NICE or RLIMIT_RTPRIO
+    OS_THREAD_POLICY_RR,          // real-time with time slice, same as above
+};
+
+// Linux only, zero means no change from the creator
+struct os_threadsched {
+    enum os_threadpolicy policy;
+    int nice;                   // -20 (highest) ~ 19 (lowest), for OS_THREAD_POLICY_OTHER
+    unsigned long long cpumask; // bit n allows the thread on cpu n
+    unsigned long long nodemask;// bit n allows the cpus of numa node n (if no cpumask),
+                                // memory is preferred from the lowest node of the mask
+};
+
 struct os_threadattr {
     const char *name;
     enum os_threadprio priority;
     unsigned int stacksize;
     bool joinable;
+    struct os_threadsched sched;
 };
 
+#define OS_THREAD_NAME_MAX 16
+
+// Descriptor of a thread, cached in thread local storage
+struct os_threadinfo {
+    os_thread_t id;
+    char name[OS_THREAD_NAME_MAX]; // name given to OS_THREAD_CREATE, or the system name
+    void *looper;                  // mlooper_t running on the thread, NULL if none
+    void *handler_looper;          // sysutils::Looper running on the thread, NULL if none
+};
+
+/*
+ * Descriptor of the calling thread, never NULL. It's filled when the thread
+ * is started by OS_THREAD_CREATE() (or on first call for other threads), so
+ * reading the id/name doesn't need a syscall, and checking if a looper runs
+ * on the calling thread is a compare of pointers.
+ */
+struct os_threadinfo *OS_THREAD_INFO();
+
+#if defined(OS_FREERTOS)
+// No thread local storage, the descriptor is one for all threads, only
+// OS_THREAD_SELF() tells threads apart
+#define OS_THREAD_INFO_SHARED
+#endif
+
 void OS_THREAD_SLEEP_USEC(unsigned long usec);
 void OS_THREAD_SLEEP_MSEC(unsigned long msec);
 
 os_thread_t OS_THREAD_CREATE(struct os_threadattr *attr, void *(*cb)(void *arg), void *arg);
 void OS_THREAD_CANCEL(os_thread_t tid);
 int OS_THREAD_JOIN(os_thread_t tid, void **retval);
-os_thread_t OS_THREAD_SELF();
+os_thread_t OS_THREAD_SELF(); // cached, see OS_THREAD_INFO()
+// Name longer than OS_THREAD_NAME_MAX - 1 is truncated
 int OS_THREAD_SET_NAME(os_thread_t tid, const char *name);
 
+/*
+ * Apply sched to the calling thread, priority is used by real-time policies.
+ * OS_THREAD_CREATE() does it in the new thread before cb is called, when a
+ * step is refused (no permission for real-time, cpu offline...) the thread
+ * still runs with a warning. Return 0 if all steps succeed.
+ */
+int OS_THREAD_SET_SCHED(const struct os_threadsched *sched, enum os_threadprio priority);
+
 os_mutex_t OS_THREAD_MUTEX_CREATE();
 int OS_THREAD_MUTEX_LOCK(os_mutex_t mutex);
 int OS_THREAD_MUTEX_TRYLOCK(os_mutex_t mutex);
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef __SYSUTILS_OS_THREADPOOL_H__
+#define __SYSUTILS_OS_THREADPOOL_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "os_thread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Thread pool for short tasks. Tasks submitted from outside go to a
+ * lock-free global queue, tasks submitted from a worker go to its own
+ * deque (LIFO for the owner, cache friendly for recursive work), and idle
+ * workers steal from the other deques before they sleep.
+ *
+ * os_threadpool_t pool = os_threadpool_create(NULL);
+ * os_threadpool_submit(pool, do_work, arg);               // fire and forget
+ * os_future_t future = os_threadpool_async(pool, compute, arg);
+ * void *result = os_future_get(future);                   // wait and release future
+ * os_threadpool_parallel_for(pool, 0, count, 0, sum_range, &ctx);
+ * os_threadpool_destroy(pool);                            // drain and stop
+ *
+ * Tasks must not block for long, a blocked task holds a worker.
+ */
+typedef struct os_threadpool *os_threadpool_t;
+typedef struct os_future *os_future_t;
+
+struct os_threadpool_attr {
+    const char *name;             // name of worker threads
+    unsigned int min_threads;     // workers always running, 0 for number of cpus
+    unsigned int max_threads;     // more workers are started when all are busy, <= min_threads for fixed pool
+    unsigned int idle_timeout_ms; // extra workers exit after idle this long
+    unsigned int queue_size;      // capacity of global queue and each deque, rounded up to power of 2
+    enum os_threadprio priority;
+    unsigned int stacksize;
+    struct os_threadsched sched;
+};
+
+// Pass NULL attr to use the defaults: fixed pool of number of cpus workers
+os_threadpool_t os_threadpool_create(struct os_threadpool_attr *attr);
+
+// Run fn(arg) on a worker, blocks while the global queue is full, return -1 after os_threadpool_destroy() started
+int os_threadpool_submit(os_threadpool_t pool, void (*fn)(void *arg), void *arg);
+
+// Run fn(arg) on a worker, the return value is got by os_future_get(), return NULL on error
+os_future_t os_threadpool_async(os_threadpool_t pool, void *(*fn)(void *arg), void *arg);
+
+bool os_future_ready(os_future_t future);
+
+/*
+ * Wait fn to return, release the future and return what fn returns. Called
+ * on a worker, it runs other tasks while waiting, so nested waits don't
+ * deadlock the pool (not on FreeRTOS, which has no thread local storage to
+ * know the worker, a nested wait holds the worker there).
+ */
+void *os_future_get(os_future_t future);
+
+/*
+ * Call fn(begin, end, arg) on subranges of [begin, end) of about grain
+ * indexes in parallel, the caller takes part, and return when the whole
+ * range is done. grain 0 to split the range into 4 chunks per worker.
+ */
+void os_threadpool_parallel_for(os_threadpool_t pool, size_t begin, size_t end, size_t grain,
+                                void (*fn)(size_t begin, size_t end, void *arg), void *arg);
+
+// Wait until all submitted tasks (and tasks they submit) have run, not from a task
+void os_threadpool_drain(os_threadpool_t pool);
+
+// Number of workers running now
+unsigned int os_threadpool_threads(os_threadpool_t pool);
+
+// Refuse new tasks from outside, drain the queued ones and stop workers
+void os_threadpool_destroy(os_threadpool_t pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SYSUTILS_OS_THREADPOOL_H__ */
@@ -45,6 +45,11 @@ unsigned long long OS_MONOTONIC_USEC();
 // realtime: system-wide clock that measures real time (utc timestamp) since 1970.1.1-00:00:00
 unsigned long long OS_REALTIME_USEC();
 
+// coarse clocks: cheaper than above, but the resolution is the kernel tick (1~10ms),
+// same as above on platforms without CLOCK_MONOTONIC_COARSE/CLOCK_REALTIME_COARSE
+unsigned long long OS_MONOTONIC_COARSE_USEC();
+unsigned long long OS_REALTIME_COARSE_USEC();
+
 #ifdef __cplusplus
 }
 #endif
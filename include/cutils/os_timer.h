@@ -36,6 +36,9 @@ struct os_timerattr {
 
 os_timer_t OS_TIMER_CREATE(struct os_timerattr *attr, void (*cb)());
 
+// Same as OS_TIMER_CREATE(), and arg is passed to cb
+os_timer_t OS_TIMER_CREATE2(struct os_timerattr *attr, void (*cb)(void *arg), void *arg);
+
 int OS_TIMER_START(os_timer_t timer);
 
 int OS_TIMER_STOP(os_timer_t timer);
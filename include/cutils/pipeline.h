@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef __SYSUTILS_PIPELINE_H__
+#define __SYSUTILS_PIPELINE_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "os_thread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Pipeline of stages linked by bounded queues, each stage is a function
+ * run by its own worker threads:
+ *
+ * pipeline_push() -> [queue] -> stage 0 -> [queue] -> stage 1 -> ... -> stage N -> free_cb
+ *
+ * A stage returns the item to pass downstream (the same or a new one), or
+ * NULL if it has consumed the item. The last stage is the sink, a non-NULL
+ * item returned by it is released by free_cb. When a queue is full, the
+ * stage in front of it blocks, and so on up to pipeline_push(), so a slow
+ * stage throttles the whole pipeline instead of growing memory.
+ *
+ * A stage with several workers processes items in parallel, if ordered is
+ * set the items still leave the stage in the order they came in. The number
+ * of workers can be changed while running, use the stats to find the
+ * bottleneck: the stage whose upstream is blocked and whose queue is full.
+ */
+typedef struct pipeline *pipeline_t;
+
+typedef void *(*pipeline_stage_cb)(void *item, void *arg);
+
+struct pipeline_stage_attr {
+    const char *name;
+    pipeline_stage_cb handle;
+    void *arg;
+    unsigned int workers;    // threads running handle, 0 for 1
+    bool ordered;            // keep input order on output with several workers
+    unsigned int queue_size; // capacity of the input queue, 0 for default (64)
+    enum os_threadprio priority;
+    struct os_threadsched sched;
+};
+
+struct pipeline_stage_stats {
+    const char *name;
+    unsigned int workers;
+    unsigned long long items;          // items handled
+    unsigned long long items_per_sec;  // since started or stats reset
+    unsigned long long busy_us;        // time spent in handle, all workers
+    unsigned long long blocked_us;     // time blocked on a full downstream queue, all workers
+    unsigned int queue_depth;          // items waiting in the input queue
+    unsigned int queue_depth_max;
+    unsigned int queue_size;
+};
+
+// free_cb releases the items out of the last stage, and the items left in queues by pipeline_stop()
+pipeline_t pipeline_create(const char *name, void (*free_cb)(void *item));
+
+// Append a stage before pipeline_start(), return its index or -1
+int pipeline_add_stage(pipeline_t pipeline, struct pipeline_stage_attr *attr);
+
+int pipeline_start(pipeline_t pipeline);
+
+// Feed an item to the first stage, wait timeout_ms for space (0 to wait forever), return -1 on timeout or stopped
+int pipeline_push(pipeline_t pipeline, void *item, unsigned int timeout_ms);
+
+// Wait until all pushed items have left the pipeline
+void pipeline_drain(pipeline_t pipeline);
+
+// Change parallelism of a running stage, extra workers exit after their current item
+int pipeline_set_workers(pipeline_t pipeline, int stage, unsigned int workers);
+
+int pipeline_get_stats(pipeline_t pipeline, int stage, struct pipeline_stage_stats *stats);
+
+void pipeline_reset_stats(pipeline_t pipeline);
+
+unsigned int pipeline_stage_count(pipeline_t pipeline);
+
+// Log stats of all stages
+void pipeline_dump(pipeline_t pipeline);
+
+// Stop workers after their current item, items left in queues are released by free_cb
+void pipeline_stop(pipeline_t pipeline);
+
+void pipeline_destroy(pipeline_t pipeline);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SYSUTILS_PIPELINE_H__ */
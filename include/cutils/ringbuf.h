@@ -42,6 +42,8 @@ extern "C" {
 #define RB_ABORT        (-3)
 #define RB_TIMEOUT      (-4)
 
+#define RB_RECORD_HEADER_SIZE ((int)sizeof(int))
+
 typedef struct ringbuf *ringbuf_handle_t;
 
 /**
@@ -151,6 +153,50 @@ int rb_read_chunk(ringbuf_handle_t rb, char *buf, int size, unsigned int timeout
  */
 int rb_write_chunk(ringbuf_handle_t rb, char *buf, int size, unsigned int timeout_ms);
 
+/**
+ * @brief      Write one record to Ringbuffer from `buf` with `len`, wait `timeout_ms` milliseconds until
+ *             enough contiguous space to write the whole record.
+ *
+ *             Record mode frames each record with a length header, a record is never torn across the
+ *             end of the buffer: if it doesn't fit in the tail, the tail is skipped (a wrap marker is
+ *             written if there is room for it) and the record is written at the beginning.
+ *             Don't mix record mode with rb_read/rb_write/rb_read_chunk/rb_write_chunk on the same
+ *             ringbuffer, and note that threshold is ignored in record mode.
+ *
+ * @param[in]  rb             The Ringbuffer handle
+ * @param      buf            The record buffer
+ * @param[in]  len            The record length, (len + RB_RECORD_HEADER_SIZE) must not exceed the ringbuffer size
+ * @param[in]  timeout_ms     The time to wait, if zero, wait forever
+ *
+ * @return     Length of record written, or RB_FAIL/RB_DONE/RB_ABORT/RB_TIMEOUT
+ */
+int rb_write_record(ringbuf_handle_t rb, char *buf, int len, unsigned int timeout_ms);
+
+/**
+ * @brief      Read one record from Ringbuffer to `buf`, wait `timeout_ms` milliseconds until a record
+ *             is available. If `len` is less than the record length, the record is left in ringbuffer
+ *             and RB_FAIL is returned, use rb_peek_record() to get the length of next record.
+ *
+ * @param[in]  rb             The Ringbuffer handle
+ * @param      buf            The buffer pointer to read out record
+ * @param[in]  len            The length of buffer
+ * @param[in]  timeout_ms     The time to wait, if zero, wait forever
+ *
+ * @return     Length of record read, or RB_FAIL/RB_DONE/RB_ABORT/RB_TIMEOUT
+ */
+int rb_read_record(ringbuf_handle_t rb, char *buf, int len, unsigned int timeout_ms);
+
+/**
+ * @brief      Get length of next record without copying or consuming it, wait `timeout_ms` milliseconds
+ *             until a record is available.
+ *
+ * @param[in]  rb             The Ringbuffer handle
+ * @param[in]  timeout_ms     The time to wait, if zero, wait forever
+ *
+ * @return     Length of next record, or RB_DONE/RB_ABORT/RB_TIMEOUT
+ */
+int rb_peek_record(ringbuf_handle_t rb, unsigned int timeout_ms);
+
 /**
  * @brief      Set status of writing to ringbuffer is done
  *
@@ -193,6 +239,27 @@ int rb_get_threshold(ringbuf_handle_t rb);
  */
 bool rb_reach_threshold(ringbuf_handle_t rb);
 
+/**
+ * @brief      Check whether writing to ringbuffer is done
+ *
+ * @param[in]  rb    The Ringbuffer handle
+ */
+bool rb_is_done_write(ringbuf_handle_t rb);
+
+/**
+ * @brief      Set reader readiness hook, `notify` is called whenever a blocked reader would be
+ *             woken up: data written (threshold reached), done write, abort or unblock reader.
+ *
+ *             The hook runs in the writer's context with the ringbuffer lock held, it must not
+ *             block nor call any rb_xxx api on the same ringbuffer, just hand the event over
+ *             (e.g. post a message to a looper). Pass NULL to clear the hook.
+ *
+ * @param[in]  rb        The Ringbuffer handle
+ * @param[in]  notify    The hook, NULL to clear
+ * @param[in]  arg       The argument passed to hook
+ */
+void rb_set_notify(ringbuf_handle_t rb, void (*notify)(void *arg), void *arg);
+
 #ifdef __cplusplus
 }
 #endif
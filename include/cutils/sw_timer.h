@@ -19,6 +19,8 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include "msglooper.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -28,13 +30,60 @@ typedef struct swtimer *swtimer_t;
 
 struct swtimer_attr {
     const char *name;        // name is assigned to the timer, purely to assist debugging
-    unsigned long period_ms; // the timer period in milliseconds
+    unsigned long period_ms; // the timer period in milliseconds, 0 is invalid for reload timer
     bool reload;             // if reload set to true then the timer will expire repeatedly
                              // if reload set to false then the timer will be a one-shot timer
 };
 
+enum swtimer_overrun_policy {
+    SWTIMER_OVERRUN_SKIP = 0, // skip missed expiries, stay on the period grid (default)
+    SWTIMER_OVERRUN_CATCHUP,  // run callback back to back for each missed expiry
+    SWTIMER_OVERRUN_REPORT,   // skip missed expiries, callback gets the count by swtimer_get_overrun()
+};
+
+struct swtimer_stats {
+    unsigned long long expire_count;  // number of expiries that callback is run
+    unsigned long long overrun_count; // number of expiries missed because of late wakeup or long callback
+    unsigned long long late_last_us;  // lateness of the last expiry to its deadline
+    unsigned long long late_max_us;   // max lateness
+    unsigned long long late_avg_us;   // average lateness
+};
+
+/*
+ * All timers are driven by one timer service thread, callbacks run on the
+ * service thread by default, so they must not block for long, otherwise
+ * other timers are delayed. Use swtimer_set_looper() to run the callbacks
+ * of a timer on a looper thread instead.
+ */
 swtimer_t swtimer_create(struct swtimer_attr *attr, void (*swtimer_callback)());
 
+/*
+ * Scheduling policy, cpu affinity and numa node of the timer service thread,
+ * priority is used by real-time policies. Only takes effect before the first
+ * timer is created, return -1 if the service is already running.
+ */
+int swtimer_service_sched(const struct os_threadsched *sched, enum os_threadprio priority);
+
+// Same as swtimer_create(), and arg is passed to callback
+swtimer_t swtimer_create2(struct swtimer_attr *attr, void (*swtimer_callback)(void *arg), void *arg);
+
+// Post callback to looper when the timer expires, NULL to run callback on timer service thread
+int swtimer_set_looper(swtimer_t timer, mlooper_t looper);
+
+/*
+ * Periodic timers are anchored to absolute deadlines (next += period), so
+ * jitter doesn't accumulate. If the service thread wakes up late or the
+ * callback overruns the period, missed expiries are handled as the policy.
+ */
+int swtimer_set_overrun_policy(swtimer_t timer, enum swtimer_overrun_policy policy);
+
+// Number of expiries skipped before current callback, only valid when called from the callback
+unsigned int swtimer_get_overrun(swtimer_t timer);
+
+int swtimer_get_stats(swtimer_t timer, struct swtimer_stats *stats);
+
+void swtimer_reset_stats(swtimer_t timer);
+
 int swtimer_start(swtimer_t timer);
 
 int swtimer_stop(swtimer_t timer);
@@ -19,6 +19,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -26,6 +27,14 @@ extern "C" {
 
 typedef struct swwatchdog_node *swwatch_t;
 
+/*
+ * swwatchdog_start()/swwatchdog_feed()/swwatchdog_stop() are lock-free, so they
+ * can be called on hot paths such as around every looper message. The watchdog
+ * thread sleeps until the earliest deadline of armed nodes, so timeouts are
+ * precise and there is no wakeup when nothing is armed. The minimum timeout is
+ * 10ms. A timed out node is disarmed after timeout_cb is called, and it stays
+ * valid until swwatchdog_destroy().
+ */
 swwatch_t swwatchdog_create(const char *name, unsigned long long timeout_ms, void (*timeout_cb)(void *arg), void *arg);
 
 int swwatchdog_start(swwatch_t node);
@@ -36,6 +45,17 @@ int swwatchdog_stop(swwatch_t node);
 
 void swwatchdog_destroy(swwatch_t node);
 
+/*
+ * Diagnostic mode, for finding the handlers behind latency spikes. When a node
+ * times out, its dump_cb is called to log the owner's state, and the thread
+ * that called swwatchdog_start() is signaled (SIGUSR2 by default, override by
+ * SWWATCHDOG_DUMP_SIGNAL) to capture its backtrace, which is logged before
+ * timeout_cb. Backtrace is only supported on glibc and macosx.
+ */
+int swwatchdog_set_diagnostic(bool enable);
+
+int swwatchdog_set_dump_cb(swwatch_t node, void (*dump_cb)(void *arg), void *arg);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SYSUTILS_TIMER_WHEEL_H__
+#define __SYSUTILS_TIMER_WHEEL_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "common_list.h"
+#include "msglooper.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Hashed timing wheel for a large number of cheap one-shot timers, such as
+ * an idle timeout per connection.
+ *
+ * A twtimer is embedded by the user in its own struct, no allocation, thread
+ * or kernel object is created per timer, and twtimer_start()/twtimer_stop()/
+ * twtimer_reset() are O(1). The wheel is driven by one sw_timer ticking at
+ * tick_ms, which only runs while there are active timers. Timeouts are
+ * rounded up to tick_ms, and callbacks run on the timer service thread, or
+ * on the looper set by twheel_set_looper().
+ *
+ * Usage example:
+ *
+ * struct connection {
+ *     struct twtimer idle_timer;
+ *     ...
+ * };
+ *
+ * static void connection_idle_timeout(void *arg)
+ * {
+ *     struct connection *conn = arg;
+ *     // todo: close connection
+ * }
+ *
+ * wheel = twheel_create("conn_idle", 100, 0);
+ * twtimer_init(&conn->idle_timer, connection_idle_timeout, conn);
+ * twtimer_start(wheel, &conn->idle_timer, 30000);
+ * // on traffic
+ * twtimer_reset(&conn->idle_timer);
+ * // on close
+ * twtimer_stop(&conn->idle_timer);
+ */
+
+typedef struct timerwheel *twheel_t;
+
+struct twtimer {
+    // private members, initialized by twtimer_init()
+    struct listnode listnode;
+    void (*cb)(void *arg);
+    void *arg;
+    twheel_t wheel;
+    unsigned long long expires; // absolute tick to expire
+    unsigned long ticks;        // timeout in ticks, for twtimer_reset()
+    bool active;
+};
+
+// slot_count is rounded up to power of 2, 0 for default
+twheel_t twheel_create(const char *name, unsigned long tick_ms, unsigned int slot_count);
+
+// Active timers are stopped at once. If a looper is set, the wheel memory is
+// released on the looper after ticks already queued, so the looper must be
+// destroyed after the wheel. It may be called from a timer callback, then
+// the wheel is released when the tick running the callback returns
+void twheel_destroy(twheel_t wheel);
+
+// Post callbacks to looper, NULL to run callbacks on timer service thread.
+// Set it once before starting timers, don't move the wheel between loopers
+int twheel_set_looper(twheel_t wheel, mlooper_t looper);
+
+void twtimer_init(struct twtimer *timer, void (*cb)(void *arg), void *arg);
+
+// Start timer with timeout_ms, restart it if it's already active
+int twtimer_start(twheel_t wheel, struct twtimer *timer, unsigned long timeout_ms);
+
+int twtimer_stop(struct twtimer *timer);
+
+// Restart timer with the timeout_ms of the last twtimer_start()
+int twtimer_reset(struct twtimer *timer);
+
+bool twtimer_is_active(struct twtimer *timer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SYSUTILS_TIMER_WHEEL_H__ */
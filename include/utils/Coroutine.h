@@ -0,0 +1,353 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SYSUTILS_COROUTINE_H__
+#define __SYSUTILS_COROUTINE_H__
+
+#include "Looper.h"
+
+#if defined(SYSUTILS_COROUTINE)
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include "cutils/mem_pool.h"
+#include "cutils/msgqueue.h"
+#include "cutils/ringbuf.h"
+#include "Namespace.h"
+
+SYSUTILS_NAMESPACE_BEGIN
+
+/**
+ * C++20 coroutines on top of Looper, header only and compiled in C++20 translation
+ * units only, the library itself stays C++11.
+ *
+ * A coroutine runs on the looper thread that resumes it, a suspended one costs a
+ * frame and no thread, so a looper can run many flows written as straight-line code
+ * instead of onHandle() state machines:
+ *
+ *     Task<int> fetch(ringbuf_handle_t rb) {
+ *         int value;
+ *         co_await sleepFor(100);                       // postMessageDelay
+ *         int ret = co_await asyncRead(rb, (char *)&value, sizeof(value));
+ *         co_return ret == sizeof(value) ? value : -1;
+ *     }
+ *     Task<void> flow(Looper *looper, ringbuf_handle_t rb) {
+ *         co_await looper->schedule();                  // hop to looper thread
+ *         int value = co_await fetch(rb);
+ *         ...
+ *     }
+ *     spawn(looper, flow(looper, rb));
+ *
+ * Coroutines must not throw. Awaiting coroutines are resumed by looper messages, quit
+ * the looper only after they finished, otherwise their frames are leaked.
+ */
+
+// Posts a message that resumes a suspended coroutine on the looper. Unlike Handler, it
+// doesn't scan the looper messages on destruction, it lives in the coroutine frame and
+// the frame outlives the resume message.
+class CoroutineHandler : public HandlerCallback {
+public:
+    explicit CoroutineHandler(Looper *looper) : mLooper(looper) {}
+    virtual ~CoroutineHandler() {}
+
+    Looper *getLooper() { return mLooper; }
+
+    bool resumeLater(std::coroutine_handle<> handle, unsigned long delayMs) {
+        if (mLooper == NULL)
+            return false;
+        Message *msg = Message::obtain(0);
+        msg->handlerCallback = this;
+        mHandle = handle;
+        if (mLooper->postMessageDelay(msg, delayMs))
+            return true;
+        msg->recycle();
+        return false;
+    }
+
+    virtual void onHandle(Message *msg) {
+        // the frame owning this handler may be destroyed when the coroutine ends
+        mHandle.resume();
+    }
+
+private:
+    Looper *mLooper;
+    std::coroutine_handle<> mHandle;
+};
+
+// co_await resumes the coroutine on the looper after delayMs
+class LooperAwaiter {
+public:
+    LooperAwaiter(Looper *looper, unsigned long delayMs) : mHandler(looper), mDelayMs(delayMs) {}
+
+    bool await_ready() const { return false; }
+    // go on inline if there is no looper to resume on
+    bool await_suspend(std::coroutine_handle<> handle) { return mHandler.resumeLater(handle, mDelayMs); }
+    void await_resume() const {}
+
+private:
+    CoroutineHandler mHandler;
+    unsigned long mDelayMs;
+};
+
+inline LooperAwaiter Looper::schedule(unsigned long delayMs)
+{
+    return LooperAwaiter(this, delayMs);
+}
+
+// Suspend for delayMs, must be awaited on a looper thread
+inline LooperAwaiter sleepFor(unsigned long delayMs)
+{
+    return LooperAwaiter(Looper::myLooper(), delayMs);
+}
+
+/**
+ * Suspends until a mqueue/ringbuf becomes readable without blocking the looper: the
+ * readiness hook of the queue posts the resume message from the writer thread. One
+ * awaiting reader per queue at a time (the hook is single slot), and nobody else may
+ * read it concurrently, otherwise the read after resuming may block.
+ * Awaited outside a looper thread, it doesn't suspend and reads at once.
+ */
+class ReadyAwaiter {
+public:
+    bool await_ready() { return mHandler.getLooper() == NULL || isReady(); }
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+        mHandle = handle;
+        setNotify(true);
+        // became readable before the hook was set, the hook can't have posted then
+        if (isReady() && claim()) {
+            setNotify(false);
+            return false;
+        }
+        return true;
+    }
+
+protected:
+    ReadyAwaiter() : mHandler(Looper::myLooper()), mFired(false) {}
+    virtual ~ReadyAwaiter() {}
+
+    virtual bool isReady() = 0;
+    virtual void setNotify(bool enable) = 0;
+
+    // called after resuming, no hook call may touch the awaiter once it returns
+    void finish() {
+        if (mHandle)
+            setNotify(false);
+    }
+
+    // called by the queue with its lock held
+    static void onNotify(void *arg) {
+        ReadyAwaiter *thiz = static_cast<ReadyAwaiter *>(arg);
+        if (thiz->isReady() && thiz->claim())
+            thiz->mHandler.resumeLater(thiz->mHandle, 0);
+    }
+
+private:
+    // the hook and the suspending thread race for the wakeup, only one may resume
+    bool claim() { return !__atomic_exchange_n(&mFired, true, __ATOMIC_ACQ_REL); }
+
+    CoroutineHandler mHandler;
+    std::coroutine_handle<> mHandle;
+    bool mFired;
+};
+
+// co_await returns the result of mqueue_receive(), works on a queue set too
+class MQueueAwaiter : public ReadyAwaiter {
+public:
+    MQueueAwaiter(mqueue_t queue, void *msg) : mQueue(queue), mMsg(msg) {}
+
+    int await_resume() {
+        finish();
+        return mqueue_receive(mQueue, static_cast<char *>(mMsg), 0);
+    }
+
+private:
+    virtual bool isReady() { return mqueue_count_filled(mQueue) > 0; }
+    virtual void setNotify(bool enable) { mqueue_set_notify(mQueue, enable ? onNotify : NULL, this); }
+
+    mqueue_t mQueue;
+    void *mMsg;
+};
+
+// co_await returns the result of rb_read(), resumes once len bytes (not more than the
+// ringbuf size) are readable or writing is done. rb_abort() doesn't resume it.
+class RingbufAwaiter : public ReadyAwaiter {
+public:
+    RingbufAwaiter(ringbuf_handle_t rb, char *buf, int len) : mRb(rb), mBuf(buf), mLen(len) {}
+
+    int await_resume() {
+        finish();
+        return rb_read(mRb, mBuf, mLen, 0);
+    }
+
+private:
+    virtual bool isReady() {
+        return (rb_bytes_filled(mRb) >= mLen && rb_reach_threshold(mRb)) || rb_is_done_write(mRb);
+    }
+    virtual void setNotify(bool enable) { rb_set_notify(mRb, enable ? onNotify : NULL, this); }
+
+    ringbuf_handle_t mRb;
+    char *mBuf;
+    int mLen;
+};
+
+inline MQueueAwaiter asyncReceive(mqueue_t queue, void *msg)
+{
+    return MQueueAwaiter(queue, msg);
+}
+
+inline RingbufAwaiter asyncRead(ringbuf_handle_t rb, char *buf, int len)
+{
+    return RingbufAwaiter(rb, buf, len);
+}
+
+// Coroutine frames come from mem_pool size classes, frames of the same coroutine
+// reuse blocks from the thread cache instead of going to malloc()
+struct CoroutineFrame {
+    static void *operator new(size_t size) noexcept { return mempool_malloc(size); }
+    static void operator delete(void *ptr) { mempool_free(ptr); }
+};
+
+template <typename T> class Task;
+
+struct TaskPromiseBase : public CoroutineFrame {
+    // resumes the awaiting coroutine by symmetric transfer, no stack growth on long chains
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> handle) noexcept {
+            std::coroutine_handle<> next = handle.promise().mContinuation;
+            return next ? next : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { std::terminate(); }
+
+    std::coroutine_handle<> mContinuation;
+};
+
+template <typename T>
+struct TaskPromise : public TaskPromiseBase {
+    Task<T> get_return_object();
+    static Task<T> get_return_object_on_allocation_failure() { return Task<T>(); }
+    void return_value(T value) { mResult = std::move(value); }
+    T take() { return std::move(mResult); }
+
+    T mResult;
+};
+
+template <>
+struct TaskPromise<void> : public TaskPromiseBase {
+    Task<void> get_return_object();
+    static Task<void> get_return_object_on_allocation_failure();
+    void return_void() {}
+    void take() {}
+};
+
+/**
+ * Lazy coroutine returning T (default constructible), it starts when awaited and
+ * resumes the awaiter when done. Invalid if the frame can't be allocated.
+ */
+template <typename T>
+class Task {
+public:
+    typedef TaskPromise<T> promise_type;
+    typedef std::coroutine_handle<promise_type> handle_type;
+
+    Task() : mHandle() {}
+    explicit Task(handle_type handle) : mHandle(handle) {}
+    Task(Task &&other) : mHandle(other.mHandle) { other.mHandle = nullptr; }
+    ~Task() { if (mHandle) mHandle.destroy(); }
+
+    Task &operator=(Task &&other) {
+        if (this != &other) {
+            if (mHandle)
+                mHandle.destroy();
+            mHandle = other.mHandle;
+            other.mHandle = nullptr;
+        }
+        return *this;
+    }
+
+    bool valid() const { return (bool)mHandle; }
+
+    struct Awaiter {
+        handle_type mHandle;
+
+        bool await_ready() { return !mHandle || mHandle.done(); }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) {
+            mHandle.promise().mContinuation = awaiting;
+            return mHandle;
+        }
+        T await_resume() { return mHandle ? mHandle.promise().take() : T(); }
+    };
+
+    Awaiter operator co_await() && { return Awaiter{mHandle}; }
+    Awaiter operator co_await() & { return Awaiter{mHandle}; }
+
+private:
+    Task(const Task &);
+    Task &operator=(const Task &);
+
+    handle_type mHandle;
+};
+
+template <typename T>
+inline Task<T> TaskPromise<T>::get_return_object()
+{
+    return Task<T>(Task<T>::handle_type::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object()
+{
+    return Task<void>(Task<void>::handle_type::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object_on_allocation_failure()
+{
+    return Task<void>();
+}
+
+// Eager fire-and-forget coroutine, the frame frees itself when done
+struct DetachedTask {
+    struct promise_type : public CoroutineFrame {
+        DetachedTask get_return_object() { return DetachedTask(); }
+        static DetachedTask get_return_object_on_allocation_failure() { return DetachedTask(); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void unhandled_exception() { std::terminate(); }
+        void return_void() {}
+    };
+};
+
+// Run task on looper, it owns the task until done
+inline DetachedTask spawn(Looper *looper, Task<void> task)
+{
+    co_await looper->schedule();
+    co_await std::move(task);
+}
+
+SYSUTILS_NAMESPACE_END
+
+#endif /* SYSUTILS_COROUTINE */
+
+#endif /* __SYSUTILS_COROUTINE_H__ */
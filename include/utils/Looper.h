@@ -25,6 +25,11 @@
 #include "Mutex.h"
 #include "Namespace.h"
 
+// Coroutine awaitables (Coroutine.h) are only available to C++20 translation units
+#if __cplusplus >= 202002L && defined(__cpp_impl_coroutine)
+#define SYSUTILS_COROUTINE 1
+#endif
+
 SYSUTILS_NAMESPACE_BEGIN
 
 /**
@@ -48,6 +53,9 @@ SYSUTILS_NAMESPACE_BEGIN
 class Message;
 class Looper;
 class Handler;
+#if defined(SYSUTILS_COROUTINE)
+class LooperAwaiter;
+#endif
 
 class HandlerCallback {
 public:
@@ -68,6 +76,7 @@ protected:
 class Message {
     friend class Looper;
     friend class Handler;
+    friend class CoroutineHandler;
 
 public:
     int   what;
@@ -116,9 +125,26 @@ public:
     bool hasMessage(int what, HandlerCallback *handlerCallback);
     void dump();
 
+    // Looper running on the calling thread, NULL if the thread isn't in loop()
+    static Looper *myLooper();
+    // Whether called on the thread running loop(), a compare with the cached thread descriptor
+    // (or with the thread id if the descriptor is shared, see OS_THREAD_INFO_SHARED)
+    bool isCurrentThread();
+
+#if defined(SYSUTILS_COROUTINE)
+    // co_await looper->schedule() resumes the coroutine on this looper, see Coroutine.h
+    LooperAwaiter schedule(unsigned long delayMs = 0);
+#endif
+
 private:
+    friend class Handler;
+    // Handler::sendMessage() waits for done set by the looper, or fails when it quits
+    void signalSyncDone(bool *done);
+    bool waitSyncDone(HandlerCallback *handlerCallback, bool *done);
+
     std::string mLooperName;
     std::list<Message *> mMsgList;
+    os_thread_t mLoopThread; // thread running loop(), NULL if not running
     Mutex mMsgMutex;
     Mutex mStateMutex;
     bool mExitPending;
@@ -170,12 +196,18 @@ public:
     bool postMessage(Message *msg);
     bool postMessageDelay(Message *msg, unsigned long delayMs);
     bool postMessageFront(Message *msg);
+    // Handle msg and return when done: inline if called on the looper thread, otherwise
+    // post it and wait, also for a looper whose loop() isn't started yet. False if the
+    // looper quits before handling it, then the message is removed.
+    bool sendMessage(Message *msg);
     void removeMessage(int what);
     void removeMessage();
     bool hasMessage(int what);
     void dump();
 
 private:
+    class SyncCall;
+
     HandlerCallback *mHandlerCallback;
     Looper *mLooper;
 };
@@ -191,6 +223,9 @@ public:
                   unsigned int stacksize = 1024);
     ~HandlerThread();
 
+    // Scheduling policy, cpu affinity and numa node of the thread, call it before run()
+    void setThreadSched(const struct os_threadsched &sched);
+
     bool run();
     void requestExit();
     void requestExitAndWait();
@@ -203,6 +238,7 @@ private:
     std::string mThreadName;
     enum os_threadprio mThreadPriority;
     unsigned int mThreadStacksize;
+    struct os_threadsched mThreadSched;
     Mutex mThreadMutex;
     bool mRunning;
     static void *threadEntry(void *arg);
@@ -210,4 +246,8 @@ private:
 
 SYSUTILS_NAMESPACE_END
 
+#if defined(SYSUTILS_COROUTINE)
+#include "Coroutine.h"
+#endif
+
 #endif /* __SYSUTILS_LOOPER_H__ */
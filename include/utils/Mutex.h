@@ -19,6 +19,7 @@
 
 #include <stdbool.h>
 #include "cutils/os_thread.h"
+#include "cutils/os_futex.h"
 #include "Namespace.h"
 
 SYSUTILS_NAMESPACE_BEGIN
@@ -26,23 +27,23 @@ SYSUTILS_NAMESPACE_BEGIN
 class Mutex {
 public:
     Mutex() {
-        mMutex = OS_THREAD_MUTEX_CREATE();
-        mCond  = OS_THREAD_COND_CREATE();
+        OS_FMUTEX_INIT(&mMutex);
+        OS_FCOND_INIT(&mCond);
     }
 
     ~Mutex() {
-        OS_THREAD_MUTEX_DESTROY(mMutex);
-        OS_THREAD_COND_DESTROY(mCond);
+        OS_FMUTEX_DESTROY(&mMutex);
+        OS_FCOND_DESTROY(&mCond);
     }
 
-    void lock() { OS_THREAD_MUTEX_LOCK(mMutex); }
-    bool tryLock() { return (0 == OS_THREAD_MUTEX_TRYLOCK(mMutex)); }
-    void unlock() { OS_THREAD_MUTEX_UNLOCK(mMutex); }
+    void lock() { OS_FMUTEX_LOCK(&mMutex); }
+    bool tryLock() { return (0 == OS_FMUTEX_TRYLOCK(&mMutex)); }
+    void unlock() { OS_FMUTEX_UNLOCK(&mMutex); }
 
-    void condWait() { OS_THREAD_COND_WAIT(mCond, mMutex); }
-    bool condWait(unsigned long usec) { return (0 == OS_THREAD_COND_TIMEDWAIT(mCond, mMutex, usec)); }
-    void condSignal() { OS_THREAD_COND_SIGNAL(mCond); }
-    void condBroadcast() { OS_THREAD_COND_BROADCAST(mCond); }
+    void condWait() { OS_FCOND_WAIT(&mCond, &mMutex); }
+    bool condWait(unsigned long usec) { return (0 == OS_FCOND_TIMEDWAIT(&mCond, &mMutex, usec)); }
+    void condSignal() { OS_FCOND_SIGNAL(&mCond); }
+    void condBroadcast() { OS_FCOND_BROADCAST(&mCond); }
 
     // Manages the mutex automatically. It'll be locked when Autolock is
     // constructed and released when Autolock goes out of scope.
@@ -56,8 +57,73 @@ public:
     };
 
 private:
-    os_mutex_t mMutex;
-    os_cond_t  mCond;
+    // embedded by value, no allocation and no indirection per lock
+    os_fmutex_t mMutex;
+    os_fcond_t  mCond;
+};
+
+// Writer-preferring reader-writer lock, for data read often and written rarely.
+class RWLock {
+public:
+    RWLock() { OS_RWLOCK_INIT(&mLock); }
+    ~RWLock() { OS_RWLOCK_DESTROY(&mLock); }
+
+    void readLock() { OS_RWLOCK_RDLOCK(&mLock); }
+    bool tryReadLock() { return (0 == OS_RWLOCK_TRYRDLOCK(&mLock)); }
+    void writeLock() { OS_RWLOCK_WRLOCK(&mLock); }
+    bool tryWriteLock() { return (0 == OS_RWLOCK_TRYWRLOCK(&mLock)); }
+    void unlock() { OS_RWLOCK_UNLOCK(&mLock); }
+
+    class AutoRLock {
+    public:
+        inline explicit AutoRLock(RWLock& rwlock) : mLock(rwlock)  { mLock.readLock(); }
+        inline explicit AutoRLock(RWLock* rwlock) : mLock(*rwlock) { mLock.readLock(); }
+        inline ~AutoRLock() { mLock.unlock(); }
+    private:
+        RWLock& mLock;
+    };
+
+    class AutoWLock {
+    public:
+        inline explicit AutoWLock(RWLock& rwlock) : mLock(rwlock)  { mLock.writeLock(); }
+        inline explicit AutoWLock(RWLock* rwlock) : mLock(*rwlock) { mLock.writeLock(); }
+        inline ~AutoWLock() { mLock.unlock(); }
+    private:
+        RWLock& mLock;
+    };
+
+private:
+    RWLock(const RWLock&);
+    RWLock& operator=(const RWLock&);
+
+    os_rwlock_t mLock;
+};
+
+// Seqlock protected value, T must be a small trivially copyable type.
+// Readers get a consistent copy without writing shared memory.
+template <typename T>
+class SeqLock {
+public:
+    SeqLock() : mValue() { OS_SEQLOCK_INIT(&mLock); }
+    explicit SeqLock(const T& value) : mValue(value) { OS_SEQLOCK_INIT(&mLock); }
+    ~SeqLock() { OS_SEQLOCK_DESTROY(&mLock); }
+
+    T read() {
+        T value;
+        OS_SEQLOCK_READ(&mLock, &value, &mValue, sizeof(T));
+        return value;
+    }
+
+    void write(const T& value) {
+        OS_SEQLOCK_WRITE(&mLock, &mValue, &value, sizeof(T));
+    }
+
+private:
+    SeqLock(const SeqLock&);
+    SeqLock& operator=(const SeqLock&);
+
+    os_seqlock_t mLock;
+    T mValue;
 };
 
 SYSUTILS_NAMESPACE_END
@@ -39,6 +39,9 @@ public:
                                 enum os_threadprio priority = OS_THREAD_PRIO_NORMAL,
                                 unsigned int stack = 1024);
 
+    // Scheduling policy, cpu affinity and numa node of the thread, call it before run().
+            void        setThreadSched(const struct os_threadsched &sched);
+
     // Ask this object's thread to exit. This function is asynchronous, when the
     // function returns the thread might still be running. Of course, this
     // function can be called from a different thread.
@@ -78,6 +81,7 @@ private:
     // always hold mLock when reading or writing
             os_thread_t     mThread;
             Mutex           mLock;
+            struct os_threadsched mSched;
     // note that all accesses of mExitPending and mRunning need to hold mLock
     volatile bool           mExitPending;
     volatile bool           mRunning;
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef __SYSUTILS_THREAD_POOL_H__
+#define __SYSUTILS_THREAD_POOL_H__
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <functional>
+#include <utility>
+#include "cutils/os_memory.h"
+#include "cutils/os_threadpool.h"
+#include "Namespace.h"
+
+SYSUTILS_NAMESPACE_BEGIN
+
+template <typename R>
+struct ThreadPoolCall {
+    std::function<R()> mFunc;
+    R mResult;
+
+    explicit ThreadPoolCall(const std::function<R()> &func) : mFunc(func), mResult() {}
+    static void *run(void *arg) {
+        ThreadPoolCall *call = static_cast<ThreadPoolCall *>(arg);
+        call->mResult = call->mFunc();
+        return call;
+    }
+    static R take(ThreadPoolCall *call) {
+        R result = std::move(call->mResult);
+        OS_DELETE(call);
+        return result;
+    }
+};
+
+template <>
+struct ThreadPoolCall<void> {
+    std::function<void()> mFunc;
+
+    explicit ThreadPoolCall(const std::function<void()> &func) : mFunc(func) {}
+    static void *run(void *arg) {
+        ThreadPoolCall *call = static_cast<ThreadPoolCall *>(arg);
+        call->mFunc();
+        return call;
+    }
+    static void take(ThreadPoolCall *call) {
+        OS_DELETE(call);
+    }
+};
+
+// Result of ThreadPool::submit(), get() it once, the destructor waits if not got yet.
+template <typename R>
+class ThreadPoolFuture {
+public:
+    ThreadPoolFuture() : mFuture(NULL) {}
+    explicit ThreadPoolFuture(os_future_t future) : mFuture(future) {}
+    ThreadPoolFuture(ThreadPoolFuture &&other) : mFuture(other.mFuture) { other.mFuture = NULL; }
+    ~ThreadPoolFuture() { if (mFuture != NULL) get(); }
+
+    ThreadPoolFuture &operator=(ThreadPoolFuture &&other) {
+        if (this != &other) {
+            if (mFuture != NULL)
+                get();
+            mFuture = other.mFuture;
+            other.mFuture = NULL;
+        }
+        return *this;
+    }
+
+    bool valid() const { return mFuture != NULL; }
+    bool ready() const { return mFuture != NULL && os_future_ready(mFuture); }
+
+    // Wait and return the result, runs other tasks meanwhile if called from a task
+    R get() {
+        ThreadPoolCall<R> *call = static_cast<ThreadPoolCall<R> *>(os_future_get(mFuture));
+        mFuture = NULL;
+        return ThreadPoolCall<R>::take(call);
+    }
+
+private:
+    ThreadPoolFuture(const ThreadPoolFuture &);
+    ThreadPoolFuture &operator=(const ThreadPoolFuture &);
+
+    os_future_t mFuture;
+};
+
+/**
+ * C++ wrapper of os_threadpool, see cutils/os_threadpool.h. Tasks must not
+ * throw, an exception escaping from a task terminates the process.
+ */
+class ThreadPool {
+public:
+    // minThreads 0 for number of cpus, maxThreads > minThreads for elastic pool
+    explicit ThreadPool(const char *name = 0, unsigned int minThreads = 0, unsigned int maxThreads = 0);
+    explicit ThreadPool(struct os_threadpool_attr *attr);
+    // Drain the queued tasks and stop workers
+    ~ThreadPool();
+
+    bool post(const std::function<void()> &task);
+
+    // R must be default constructible, invalid future if the pool is stopping
+    template <typename R>
+    ThreadPoolFuture<R> submit(const std::function<R()> &func) {
+        ThreadPoolCall<R> *call;
+        OS_NEW(call, ThreadPoolCall<R>, func);
+        os_future_t future = os_threadpool_async(mPool, ThreadPoolCall<R>::run, call);
+        if (future == NULL)
+            OS_DELETE(call);
+        return ThreadPoolFuture<R>(future);
+    }
+
+    // Call fn(begin, end) on subranges in parallel and return when all are done
+    void parallelFor(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)> &fn);
+
+    void drain();
+    unsigned int threads();
+    os_threadpool_t pool() { return mPool; }
+
+private:
+    ThreadPool(const ThreadPool &);
+    ThreadPool &operator=(const ThreadPool &);
+
+    static void postEntry(void *arg);
+    static void rangeEntry(size_t begin, size_t end, void *arg);
+
+    os_threadpool_t mPool;
+};
+
+SYSUTILS_NAMESPACE_END
+
+#endif /* __SYSUTILS_THREAD_POOL_H__ */
@@ -14,10 +14,24 @@
  * limitations under the License.
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // fallocate()
+#endif
+
+#include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#if defined(ENABLE_LOG_SAVE)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+#include "cutils/common_list.h"
 #include "cutils/os_thread.h"
 #include "cutils/os_time.h"
 #include "cutils/os_logger.h"
@@ -33,26 +47,49 @@ OS_MUTEX_DECLARE(log_config_mutex);
 #define LOG_FILE_PATH      "/tmp"
 #define LOG_FILE_PREFIX    "log"
 #define LOG_FILE_LIMITSIZE (4*1024*1024)
+#define LOG_FILE_ROTATE_SEC     0    // no time based rotation
+#define LOG_FILE_KEEP_COUNT     4
+#define LOG_FILE_FLUSH_INTERVAL 1000 // ms
+#define LOG_FILE_BUFFER_SIZE    (64*1024)
+
+#if !defined(OS_FREERTOS)
+#define LOG_ASYNC_SUPPORT
+#define LOG_TIME_CACHE
+#endif
+
+#define LOG_ASYNC_RING_SIZE      (64*1024)
+#define LOG_ASYNC_FLUSH_INTERVAL 10        // ms
+#define LOG_ASYNC_BATCH_SIZE     (64*1024)
 
 struct log_config {
     bool enable;
     enum os_logprio prio;
+    bool coarse_clock;
 
     bool file_enable;
-    const char *file_path;
-    const char *file_prefix;
+    char file_path[128];
+    char file_prefix[32];
     size_t file_limitsize;
+    unsigned int file_rotate_sec;
+    unsigned int file_keep_count;
+    unsigned int file_flush_interval_ms;
+    bool file_crash_safe;
     os_mutex_t file_mutex;
 };
 
 static struct log_config log_config = {
     .enable = true,
     .prio   = OS_LOG_VERBOSE,
+    .coarse_clock = false,
 
     .file_enable    = LOG_FILE_ENABLE,
     .file_path      = LOG_FILE_PATH,
     .file_prefix    = LOG_FILE_PREFIX,
     .file_limitsize = LOG_FILE_LIMITSIZE,
+    .file_rotate_sec = LOG_FILE_ROTATE_SEC,
+    .file_keep_count = LOG_FILE_KEEP_COUNT,
+    .file_flush_interval_ms = LOG_FILE_FLUSH_INTERVAL,
+    .file_crash_safe = false,
     .file_mutex     = NULL,
 };
 
@@ -65,32 +102,39 @@ static const char *log_prio_string[] = {
     [OS_LOG_VERBOSE] = "V",
 };
 
-void os_logger_config(bool enable, enum os_logprio prio)
+void os_logger_use_coarse_clock(bool coarse)
 {
-    log_config.enable = enable;
-    log_config.prio = prio;
+    log_config.coarse_clock = coarse;
 }
 
-#if defined(ENABLE_LOG_SAVE)
-static int file_size(const char *filename, size_t *size)
+static unsigned long long log_realtime_usec()
 {
-    struct stat statbuf;
+    return log_config.coarse_clock ? OS_REALTIME_COARSE_USEC() : OS_REALTIME_USEC();
+}
 
-    if (stat(filename, &statbuf) < 0)
-        return -1;
+#if defined(ENABLE_LOG_SAVE)
+// Current file is [path]/[prefix].txt, rotated files are [prefix].1.txt (newest)
+// to [prefix].N.txt (oldest). Size is tracked in memory, file is preallocated
+// to the limit size, and is mmap'ed in crash safe mode.
+struct log_file {
+    bool opened;
+    int fd;
+    FILE *fp;     // buffered mode
+    char *map;    // crash safe mode
+    size_t map_size;
+    size_t size;  // bytes written to current file
+    bool dirty;   // written since last flush
+    unsigned long long opened_us;
+    unsigned long long flushed_us;
+};
 
-    *size = statbuf.st_size;
-    return 0;
-}
+static struct log_file log_file = {
+    .opened = false,
+    .fd = -1,
+};
 
-static void os_logger_save(const char *data, size_t len)
+static os_mutex_t log_file_mutex()
 {
-    static bool init = false;
-    static FILE *fp = NULL;
-    static char filepath[64];
-    size_t filesize;
-    int ret;
-
     if (log_config.file_mutex == NULL) {
         if (log_config_mutex != NULL)
             OS_THREAD_MUTEX_LOCK(log_config_mutex);
@@ -101,47 +145,1196 @@ static void os_logger_save(const char *data, size_t len)
         if (log_config_mutex != NULL)
             OS_THREAD_MUTEX_UNLOCK(log_config_mutex);
     }
+    return log_config.file_mutex;
+}
+
+static void log_file_name(char *filepath, size_t size, unsigned int index)
+{
+    if (index == 0)
+        snprintf(filepath, size, "%s/%s.txt", log_config.file_path, log_config.file_prefix);
+    else
+        snprintf(filepath, size, "%s/%s.%u.txt", log_config.file_path, log_config.file_prefix, index);
+}
+
+// Called with file mutex held
+static void log_file_rotate_l()
+{
+    char from[192], to[192];
+
+    if (log_config.file_keep_count == 0) {
+        log_file_name(from, sizeof(from), 0);
+        remove(from);
+        return;
+    }
+    for (unsigned int i = log_config.file_keep_count; i > 0; i--) {
+        log_file_name(from, sizeof(from), i - 1);
+        log_file_name(to, sizeof(to), i);
+        rename(from, to); // missing files are fine
+    }
+}
+
+// Called with file mutex held
+static void log_file_flush_l(unsigned long long now)
+{
+    if (log_file.dirty && log_file.fp != NULL)
+        fflush(log_file.fp);
+    // nothing to do in crash safe mode, the page cache outlives the process
+    log_file.dirty = false;
+    log_file.flushed_us = now;
+}
+
+// Called with file mutex held
+static void log_file_close_l()
+{
+    if (!log_file.opened)
+        return;
 
-    OS_THREAD_MUTEX_LOCK(log_config.file_mutex);
+    if (log_file.map != NULL) {
+        munmap(log_file.map, log_file.map_size);
+        // cut off the preallocated tail
+        if (ftruncate(log_file.fd, log_file.size) != 0)
+            fprintf(stderr, "Failed to truncate log file\n");
+        close(log_file.fd);
+    }
+    else if (log_file.fp != NULL) {
+        fclose(log_file.fp);
+    }
+    log_file.fp = NULL;
+    log_file.map = NULL;
+    log_file.fd = -1;
+    log_file.opened = false;
+}
 
-    if (!init) {
-        struct os_realtime ts;
-        OS_TIMESTAMP_TO_LOCAL(&ts);
+// Called with file mutex held
+static int log_file_open_l(unsigned long long now)
+{
+    char filepath[192];
+    size_t limit = log_config.file_limitsize;
 
-        memset(filepath, 0x0, sizeof(filepath));
-        snprintf(filepath, sizeof(filepath),
-                 "%s/%s-%04d%02d%02d-%02d%02d%02d.txt",
-                 log_config.file_path, log_config.file_prefix,
-                 ts.year, ts.mon, ts.day, ts.hour, ts.min, ts.sec
-        );
+    // keep the current file, it may be left by last run
+    log_file_rotate_l();
 
-        fp = fopen(filepath, "w+");
-        init = true;
+    log_file_name(filepath, sizeof(filepath), 0);
+    log_file.fd = open(filepath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (log_file.fd < 0) {
+        fprintf(stderr, "Failed to open log file [%s]\n", filepath);
+        return -1;
     }
 
-    ret = file_size(filepath, &filesize);
-    if (ret < 0) {
-        fprintf(stderr, "Failed to get file size\n");
+#if defined(__linux__)
+    // reserve blocks upfront, so the file won't be fragmented by appends,
+    // buffered mode keeps the file size, readers don't see the zeros
+    if (fallocate(log_file.fd, log_config.file_crash_safe ? 0 : FALLOC_FL_KEEP_SIZE, 0, limit) != 0)
+        fprintf(stderr, "Failed to preallocate log file, continue anyway\n");
+#endif
+
+    if (log_config.file_crash_safe) {
+        if (ftruncate(log_file.fd, limit) != 0)
+            goto error;
+        log_file.map = mmap(NULL, limit, PROT_READ | PROT_WRITE, MAP_SHARED, log_file.fd, 0);
+        if (log_file.map == MAP_FAILED) {
+            log_file.map = NULL;
+            goto error;
+        }
+        log_file.map_size = limit;
+    }
+    else {
+        log_file.fp = fdopen(log_file.fd, "w");
+        if (log_file.fp == NULL)
+            goto error;
+        setvbuf(log_file.fp, NULL, _IOFBF, LOG_FILE_BUFFER_SIZE);
+    }
+
+    log_file.size = 0;
+    log_file.dirty = false;
+    log_file.opened_us = now;
+    log_file.flushed_us = now;
+    log_file.opened = true;
+    return 0;
+
+error:
+    fprintf(stderr, "Failed to setup log file [%s]\n", filepath);
+    close(log_file.fd);
+    log_file.fd = -1;
+    return -1;
+}
+
+static void os_logger_save(const char *data, size_t len)
+{
+    unsigned long long now = OS_MONOTONIC_USEC();
+
+    if (data == NULL || len == 0)
+        return;
+
+    OS_THREAD_MUTEX_LOCK(log_file_mutex());
+
+    if (!log_config.file_enable)
+        goto out;
+
+    if (log_file.opened &&
+        (log_file.size + len > log_config.file_limitsize ||
+         (log_config.file_rotate_sec > 0 &&
+          now - log_file.opened_us >= log_config.file_rotate_sec * 1000000ULL)))
+        log_file_close_l();
+
+    if (!log_file.opened && log_file_open_l(now) != 0)
         goto out;
+
+    if (log_file.map != NULL) {
+        if (len > log_file.map_size - log_file.size)
+            len = log_file.map_size - log_file.size;
+        memcpy(log_file.map + log_file.size, data, len);
+    }
+    else {
+        fwrite(data, len, 1, log_file.fp);
+    }
+    log_file.size += len;
+    log_file.dirty = true;
+
+    // group commit: flush at most once per interval
+    if (now - log_file.flushed_us >= log_config.file_flush_interval_ms * 1000ULL)
+        log_file_flush_l(now);
+
+out:
+    OS_THREAD_MUTEX_UNLOCK(log_config.file_mutex);
+}
+
+// Flush lines buffered longer than the interval, or all lines if force
+static void log_file_flush(bool force)
+{
+    unsigned long long now;
+
+    if (!log_config.file_enable || !__atomic_load_n(&log_file.dirty, __ATOMIC_RELAXED))
+        return;
+
+    OS_THREAD_MUTEX_LOCK(log_file_mutex());
+    now = OS_MONOTONIC_USEC();
+    if (force || now - log_file.flushed_us >= log_config.file_flush_interval_ms * 1000ULL)
+        log_file_flush_l(now);
+    OS_THREAD_MUTEX_UNLOCK(log_config.file_mutex);
+}
+
+int os_logger_file_config(bool enable, struct os_logger_file_attr *attr)
+{
+    OS_THREAD_MUTEX_LOCK(log_file_mutex());
+
+    // settings apply to the next file
+    log_file_close_l();
+
+    if (attr != NULL) {
+        if (attr->path != NULL)
+            snprintf(log_config.file_path, sizeof(log_config.file_path), "%s", attr->path);
+        if (attr->prefix != NULL)
+            snprintf(log_config.file_prefix, sizeof(log_config.file_prefix), "%s", attr->prefix);
+        if (attr->limit_size > 0)
+            log_config.file_limitsize = attr->limit_size;
+        log_config.file_rotate_sec = attr->rotate_sec;
+        log_config.file_keep_count = attr->keep_count;
+        log_config.file_flush_interval_ms = attr->flush_interval_ms;
+        log_config.file_crash_safe = attr->crash_safe;
+    }
+    log_config.file_enable = enable;
+
+    OS_THREAD_MUTEX_UNLOCK(log_config.file_mutex);
+    return 0;
+}
+
+#else
+int os_logger_file_config(bool enable, struct os_logger_file_attr *attr)
+{
+    // log file is only supported if ENABLE_LOG_SAVE defined
+    return -1;
+}
+#endif
+
+#define LOG_TAG_TABLE_SIZE 64
+
+// Entries are only appended, so they can be looked up without lock
+struct log_tag_config {
+    const char *tag;
+    bool has_level;
+    int level;
+    bool has_ratelimit;
+    unsigned int interval_us;
+    unsigned int burst;
+    unsigned int flags;
+};
+
+OS_MUTEX_DECLARE(log_tag_mutex);
+static struct log_tag_config log_tag_table[LOG_TAG_TABLE_SIZE];
+static unsigned int log_tag_count = 0;
+static unsigned int log_default_interval_us = 0;
+static unsigned int log_default_burst = 0;
+static struct os_logsite *log_sites = NULL; // resolved call sites
+
+static struct log_tag_config *log_tag_find(const char *tag)
+{
+    unsigned int count = __atomic_load_n(&log_tag_count, __ATOMIC_ACQUIRE);
+    for (unsigned int i = 0; i < count; i++) {
+        if (strcmp(log_tag_table[i].tag, tag) == 0)
+            return &log_tag_table[i];
+    }
+    return NULL;
+}
+
+// Called with log_tag_mutex held
+static struct log_tag_config *log_tag_get_l(const char *tag)
+{
+    struct log_tag_config *config = log_tag_find(tag);
+    if (config == NULL) {
+        if (log_tag_count >= LOG_TAG_TABLE_SIZE || (tag = strdup(tag)) == NULL) {
+            fprintf(stderr, "Failed to add log tag config\n");
+            return NULL;
+        }
+        config = &log_tag_table[log_tag_count];
+        memset(config, 0x0, sizeof(*config));
+        config->tag = tag;
+        __atomic_store_n(&log_tag_count, log_tag_count + 1, __ATOMIC_RELEASE);
+    }
+    return config;
+}
+
+static int log_tag_level(const struct log_tag_config *config)
+{
+    if (!log_config.enable)
+        return -1;
+    if (config != NULL && config->has_level)
+        return config->level;
+    return log_config.prio;
+}
+
+// Called with log_tag_mutex held, the level is stored last, it's what the macros check
+static void log_site_resolve_l(struct os_logsite *site)
+{
+    struct log_tag_config *config = log_tag_find(site->tag);
+    unsigned int interval_us = log_default_interval_us;
+    unsigned int burst = log_default_burst;
+
+    if (config != NULL && config->has_ratelimit) {
+        interval_us = config->interval_us;
+        burst = config->burst;
+    }
+    __atomic_store_n(&site->interval_us, interval_us, __ATOMIC_RELAXED);
+    __atomic_store_n(&site->burst, burst, __ATOMIC_RELAXED);
+    __atomic_store_n(&site->flags, config != NULL ? config->flags : 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&site->level, log_tag_level(config), __ATOMIC_RELEASE);
+}
+
+// Called with log_tag_mutex held
+static void log_sites_update_l()
+{
+    for (struct os_logsite *site = log_sites; site != NULL; site = site->next)
+        log_site_resolve_l(site);
+}
+
+static void log_site_register(struct os_logsite *site)
+{
+    OS_THREAD_MUTEX_LOCK(log_tag_mutex);
+    if (__atomic_load_n(&site->level, __ATOMIC_ACQUIRE) == OS_LOGSITE_UNRESOLVED) {
+        site->next = log_sites;
+        log_sites = site;
+        log_site_resolve_l(site);
+    }
+    OS_THREAD_MUTEX_UNLOCK(log_tag_mutex);
+}
+
+// Generic cell rate algorithm: tat is the time the bucket becomes full again,
+// a line is allowed if tat isn't more than burst intervals ahead of now
+static bool log_site_ratelimit(struct os_logsite *site)
+{
+    unsigned long long interval = __atomic_load_n(&site->interval_us, __ATOMIC_RELAXED);
+    unsigned long long burst = __atomic_load_n(&site->burst, __ATOMIC_RELAXED);
+    unsigned long long tolerance, now, tat, new_tat;
+
+    if (interval == 0)
+        return true;
+
+    tolerance = burst > 1 ? interval * (burst - 1) : 0;
+    now = OS_MONOTONIC_COARSE_USEC();
+    tat = __atomic_load_n(&site->tat, __ATOMIC_RELAXED);
+    do {
+        if (tat > now + tolerance) {
+            __atomic_add_fetch(&site->suppressed, 1, __ATOMIC_RELAXED);
+            return false;
+        }
+        new_tat = (tat > now ? tat : now) + interval;
+    } while (!__atomic_compare_exchange_n(&site->tat, &tat, new_tat, true,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    return true;
+}
+
+void os_logger_config(bool enable, enum os_logprio prio)
+{
+    OS_THREAD_MUTEX_LOCK(log_tag_mutex);
+    log_config.enable = enable;
+    log_config.prio = prio;
+    log_sites_update_l();
+    OS_THREAD_MUTEX_UNLOCK(log_tag_mutex);
+}
+
+void os_logger_set_level(const char *tag, enum os_logprio prio)
+{
+    OS_THREAD_MUTEX_LOCK(log_tag_mutex);
+    struct log_tag_config *config = log_tag_get_l(tag);
+    if (config != NULL) {
+        config->level = prio;
+        config->has_level = true;
+        log_sites_update_l();
+    }
+    OS_THREAD_MUTEX_UNLOCK(log_tag_mutex);
+}
+
+void os_logger_set_ratelimit(const char *tag, unsigned int rate, unsigned int burst)
+{
+    unsigned int interval_us = rate > 0 ? 1000000 / rate : 0;
+    if (rate > 0 && interval_us == 0)
+        interval_us = 1;
+
+    OS_THREAD_MUTEX_LOCK(log_tag_mutex);
+    if (tag == NULL) {
+        log_default_interval_us = interval_us;
+        log_default_burst = burst;
+    }
+    else {
+        struct log_tag_config *config = log_tag_get_l(tag);
+        if (config != NULL) {
+            config->interval_us = interval_us;
+            config->burst = burst;
+            config->has_ratelimit = true;
+        }
+    }
+    log_sites_update_l();
+    OS_THREAD_MUTEX_UNLOCK(log_tag_mutex);
+}
+
+void os_logger_set_deferred(const char *tag, bool deferred)
+{
+    OS_THREAD_MUTEX_LOCK(log_tag_mutex);
+    struct log_tag_config *config = log_tag_get_l(tag);
+    if (config != NULL) {
+        if (deferred)
+            config->flags |= OS_LOGSITE_DEFERRED;
+        else
+            config->flags &= ~OS_LOGSITE_DEFERRED;
+        log_sites_update_l();
+    }
+    OS_THREAD_MUTEX_UNLOCK(log_tag_mutex);
+}
+
+// "yyyy-mm-dd hh:mm:ss:" of the last second formatted by this thread,
+// localtime_r() takes the timezone lock, so only call it when the second changes
+struct log_time_cache {
+    time_t sec;
+    size_t len;
+    char prefix[32];
+};
+
+#if defined(LOG_TIME_CACHE)
+static __thread struct log_time_cache t_log_time;
+#endif
+
+static size_t log_append(char *log_entry, size_t valid_size, size_t offset,
+                         const char *data, size_t len)
+{
+    if (offset + len > valid_size)
+        len = valid_size > offset ? valid_size - offset : 0;
+    memcpy(log_entry + offset, data, len);
+    return offset + len;
+}
+
+// [date] [time]:[msec] [prio] [thread] [tag]:[func]:[line]:
+// Name of the calling thread, or its id formatted to buf (OS_THREAD_NAME_MAX
+// bytes) if threads share one descriptor
+static const char *log_thread_name(char *buf)
+{
+#if defined(OS_THREAD_INFO_SHARED)
+    snprintf(buf, OS_THREAD_NAME_MAX, "%p", OS_THREAD_SELF());
+    return buf;
+#else
+    return OS_THREAD_INFO()->name;
+#endif
+}
+
+static size_t log_format_header(char *log_entry, size_t valid_size, unsigned long long realtime_us,
+                                enum os_logprio prio, const char *thread, const char *tag,
+                                const char *func, unsigned int line)
+{
+    time_t sec = (time_t)(realtime_us / 1000000);
+    unsigned int msec = (unsigned int)((realtime_us / 1000) % 1000);
+    char digits[16];
+    size_t offset = 0, pos = sizeof(digits);
+#if defined(LOG_TIME_CACHE)
+    struct log_time_cache *cache = &t_log_time;
+#else
+    struct log_time_cache local_cache = { .len = 0 };
+    struct log_time_cache *cache = &local_cache;
+#endif
+
+    // add data & time to header
+    if (cache->len == 0 || cache->sec != sec) {
+        struct tm now;
+        int len;
+        localtime_r(&sec, &now);
+        len = snprintf(cache->prefix, sizeof(cache->prefix), "%4d-%02d-%02d %02d:%02d:%02d:",
+                       now.tm_year + 1900, now.tm_mon + 1, now.tm_mday,
+                       now.tm_hour, now.tm_min, now.tm_sec);
+        cache->len = (len > 0 && len < (int)sizeof(cache->prefix)) ? len : 0;
+        cache->sec = sec;
+    }
+    offset = log_append(log_entry, valid_size, offset, cache->prefix, cache->len);
+
+    // patch msec and priority
+    digits[0] = '0' + msec / 100;
+    digits[1] = '0' + msec / 10 % 10;
+    digits[2] = '0' + msec % 10;
+    digits[3] = ' ';
+    digits[4] = log_prio_string[prio][0];
+    digits[5] = ' ';
+    digits[6] = '[';
+    offset = log_append(log_entry, valid_size, offset, digits, 7);
+
+    // add thread name (cached by the thread, no syscall), tag, function and line to header
+    offset = log_append(log_entry, valid_size, offset, thread, strlen(thread));
+    offset = log_append(log_entry, valid_size, offset, "] ", 2);
+    offset = log_append(log_entry, valid_size, offset, tag, strlen(tag));
+    offset = log_append(log_entry, valid_size, offset, ":", 1);
+    offset = log_append(log_entry, valid_size, offset, func, strlen(func));
+    digits[--pos] = ' ';
+    digits[--pos] = ':';
+    do {
+        digits[--pos] = '0' + line % 10;
+        line /= 10;
+    } while (line > 0);
+    digits[--pos] = ':';
+    return log_append(log_entry, valid_size, offset, digits + pos, sizeof(digits) - pos);
+}
+
+static size_t log_terminate_entry(char *log_entry, size_t valid_size, size_t offset)
+{
+    if (offset >= valid_size)
+        offset = valid_size - 1;
+    log_entry[offset++] = '\n';
+    log_entry[offset] = '\0';
+    return offset;
+}
+
+static void os_logger_output(const char *data, size_t len)
+{
+    // print log to console
+    fwrite(data, len, 1, stdout);
+
+#if defined(ENABLE_LOG_SAVE)
+    // save log to file if need
+    if (log_config.file_enable)
+        os_logger_save(data, len);
+#endif
+}
+
+#if defined(LOG_ASYNC_SUPPORT)
+// Single producer (owner thread) single consumer (writer thread) ring,
+// each line is stored as [unsigned int len][data], may wrap around.
+struct log_ring {
+    char *buffer;
+    size_t size;   // power of 2
+    size_t head;   // written by owner thread only
+    size_t tail;   // written by consumer only
+    bool exited;   // owner thread exited, ring is freed once drained
+    struct listnode listnode;
+};
+
+struct log_async {
+    bool running;
+    bool kicked;
+    size_t ring_size;
+    unsigned int flush_interval_ms;
+    enum os_logger_full_policy full_policy;
+    unsigned long long dropped;
+    unsigned long long dropped_reported;
+
+    os_thread_t writer;
+    os_mutex_t mutex;      // protects rings and serializes consumers
+    os_mutex_t cond_mutex;
+    os_cond_t cond;
+    struct listnode rings;
+    char batch[LOG_ASYNC_BATCH_SIZE];
+    size_t batch_len;
+};
+
+OS_MUTEX_DECLARE(log_async_mutex);
+static struct log_async log_async;
+static __thread struct log_ring *t_log_ring = NULL;
+static __thread bool t_log_ring_exited = false;
+static pthread_key_t log_ring_key;
+static bool log_ring_key_created = false;
+
+static void log_ring_destructor(void *arg)
+{
+    struct log_ring *ring = (struct log_ring *)arg;
+    // lines from later key destructors (e.g. mem_pool thread cache) on this
+    // thread go out synchronously, the writer may free the ring from now on
+    t_log_ring = NULL;
+    t_log_ring_exited = true;
+    __atomic_store_n(&ring->exited, true, __ATOMIC_RELEASE);
+}
+
+static struct log_ring *log_ring_attach()
+{
+    struct log_ring *ring = calloc(1, sizeof(struct log_ring));
+    if (ring == NULL)
+        return NULL;
+    ring->size = log_async.ring_size;
+    ring->buffer = malloc(ring->size);
+    if (ring->buffer == NULL) {
+        free(ring);
+        return NULL;
+    }
+
+    OS_THREAD_MUTEX_LOCK(log_async.mutex);
+    list_add_tail(&log_async.rings, &ring->listnode);
+    OS_THREAD_MUTEX_UNLOCK(log_async.mutex);
+
+    pthread_setspecific(log_ring_key, ring);
+    t_log_ring = ring;
+    return ring;
+}
+
+static void log_ring_copy_in(struct log_ring *ring, size_t pos, const void *data, size_t len)
+{
+    size_t offset = pos & (ring->size - 1);
+    size_t first = ring->size - offset;
+    if (first > len)
+        first = len;
+    memcpy(ring->buffer + offset, data, first);
+    memcpy(ring->buffer, (const char *)data + first, len - first);
+}
+
+static void log_ring_copy_out(struct log_ring *ring, size_t pos, void *data, size_t len)
+{
+    size_t offset = pos & (ring->size - 1);
+    size_t first = ring->size - offset;
+    if (first > len)
+        first = len;
+    memcpy(data, ring->buffer + offset, first);
+    memcpy((char *)data + first, ring->buffer, len - first);
+}
+
+// Deferred record: [struct log_record][args], each integer/double/pointer
+// argument takes 8 bytes, string takes [unsigned short len][bytes]['\0']
+#define LOG_ENTRY_DEFERRED 0x80000000U
+#define LOG_ENTRY_LEN_MASK 0x7fffffffU
+
+struct log_record {
+    unsigned long long realtime_us;
+    const char *tag;
+    const char *func;
+    const char *format;
+    unsigned int line;
+    unsigned int prio;
+    char thread[OS_THREAD_NAME_MAX]; // copied, the thread may exit before the line is formatted
+};
+
+struct log_spec {
+    const char *flags;
+    const char *width;
+    const char *prec;
+    size_t flags_len;
+    size_t width_len;
+    size_t prec_len;
+    bool has_prec;
+    char length; // 'H' for hh, 'q' for ll
+    char conv;
+};
+
+// Parse conversion spec after '%', return NULL if it can't be deferred
+static const char *log_spec_parse(const char *p, struct log_spec *spec)
+{
+    memset(spec, 0x0, sizeof(*spec));
+
+    spec->flags = p;
+    while (*p != '\0' && strchr("-+ #0", *p) != NULL)
+        p++;
+    spec->flags_len = p - spec->flags;
+
+    spec->width = p;
+    if (*p == '*')
+        p++;
+    else
+        while (*p >= '0' && *p <= '9')
+            p++;
+    spec->width_len = p - spec->width;
+
+    if (*p == '.') {
+        spec->has_prec = true;
+        spec->prec = ++p;
+        if (*p == '*')
+            p++;
+        else
+            while (*p >= '0' && *p <= '9')
+                p++;
+        spec->prec_len = p - spec->prec;
+    }
+
+    switch (*p) {
+    case 'h':
+        spec->length = (*++p == 'h') ? (p++, 'H') : 'h';
+        break;
+    case 'l':
+        spec->length = (*++p == 'l') ? (p++, 'q') : 'l';
+        break;
+    case 'z':
+    case 'j':
+    case 't':
+        spec->length = *p++;
+        break;
+    default:
+        break;
     }
-    if (filesize > log_config.file_limitsize) {
-        fprintf(stderr, "Max size occur, remove the old log\n");
-        if (fp != NULL) {
-            fclose(fp);
-            fp = NULL;
+
+    if (*p == '\0' || strchr("diuoxXceEfFgGaAsp", *p) == NULL)
+        return NULL;
+    if ((*p == 'c' || *p == 's') && spec->length != 0)
+        return NULL;
+    if (spec->flags_len + spec->width_len + spec->prec_len > 32)
+        return NULL;
+    spec->conv = *p;
+    return p + 1;
+}
+
+static bool log_record_put(char *record, size_t *len, const void *data, size_t size)
+{
+    if (*len + size > LOG_BUFFER_SIZE)
+        return false;
+    memcpy(record + *len, data, size);
+    *len += size;
+    return true;
+}
+
+static bool log_record_get(const char **args, const char *end, void *data, size_t size)
+{
+    if (*args + size > end)
+        return false;
+    memcpy(data, *args, size);
+    *args += size;
+    return true;
+}
+
+// Encode the arguments to record, return record length or 0 if not supported
+static size_t log_record_encode(char *record, const char *format, va_list arg_ptr)
+{
+    size_t len = sizeof(struct log_record);
+    const char *p = format;
+    struct log_spec spec;
+
+    while ((p = strchr(p, '%')) != NULL) {
+        long long ival;
+        double dval;
+        int star, prec = -1;
+
+        if (p[1] == '%') {
+            p += 2;
+            continue;
         }
-        remove(filepath);
-        init = false;
+        if ((p = log_spec_parse(p + 1, &spec)) == NULL)
+            return 0;
+
+        if (spec.width_len == 1 && spec.width[0] == '*') {
+            star = va_arg(arg_ptr, int);
+            if (!log_record_put(record, &len, &star, sizeof(star)))
+                return 0;
+        }
+        if (spec.prec_len == 1 && spec.prec[0] == '*') {
+            star = va_arg(arg_ptr, int);
+            if (!log_record_put(record, &len, &star, sizeof(star)))
+                return 0;
+            prec = star; // negative is taken as if precision were omitted
+        }
+        else if (spec.has_prec) {
+            prec = atoi(spec.prec); // "%.s" is precision 0
+        }
+
+        switch (spec.conv) {
+        case 'd':
+        case 'i':
+            switch (spec.length) {
+            case 'l': ival = va_arg(arg_ptr, long); break;
+            case 'q': ival = va_arg(arg_ptr, long long); break;
+            case 'z': ival = va_arg(arg_ptr, ssize_t); break;
+            case 'j': ival = va_arg(arg_ptr, intmax_t); break;
+            case 't': ival = va_arg(arg_ptr, ptrdiff_t); break;
+            default:  ival = va_arg(arg_ptr, int); break;
+            }
+            if (!log_record_put(record, &len, &ival, sizeof(ival)))
+                return 0;
+            break;
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+            switch (spec.length) {
+            case 'l': ival = (long long)va_arg(arg_ptr, unsigned long); break;
+            case 'q': ival = (long long)va_arg(arg_ptr, unsigned long long); break;
+            case 'z': ival = (long long)va_arg(arg_ptr, size_t); break;
+            case 'j': ival = (long long)va_arg(arg_ptr, uintmax_t); break;
+            case 't': ival = (long long)va_arg(arg_ptr, ptrdiff_t); break;
+            default:  ival = (long long)va_arg(arg_ptr, unsigned int); break;
+            }
+            if (!log_record_put(record, &len, &ival, sizeof(ival)))
+                return 0;
+            break;
+        case 'c':
+            ival = va_arg(arg_ptr, int);
+            if (!log_record_put(record, &len, &ival, sizeof(ival)))
+                return 0;
+            break;
+        case 'p':
+            ival = (long long)(uintptr_t)va_arg(arg_ptr, void *);
+            if (!log_record_put(record, &len, &ival, sizeof(ival)))
+                return 0;
+            break;
+        case 's': {
+            const char *str = va_arg(arg_ptr, const char *);
+            size_t str_len;
+            unsigned short str_size;
+            if (str == NULL)
+                str = (prec < 0 || prec >= 6) ? "(null)" : ""; // as glibc
+            // with precision the string needn't be terminated, copy only what is printed
+            str_len = prec >= 0 ? strnlen(str, prec) : strlen(str);
+            if (str_len > LOG_BUFFER_SIZE)
+                return 0;
+            str_size = (unsigned short)str_len;
+            if (!log_record_put(record, &len, &str_size, sizeof(str_size)) ||
+                !log_record_put(record, &len, str, str_len) ||
+                !log_record_put(record, &len, "", 1))
+                return 0;
+            break;
+        }
+        default: // floating point
+            dval = va_arg(arg_ptr, double);
+            if (!log_record_put(record, &len, &dval, sizeof(dval)))
+                return 0;
+            break;
+        }
+    }
+    return len;
+}
+
+// Format the message of record, return the length
+static size_t log_record_format(char *buffer, size_t size, const char *format,
+                                const char *args, const char *end)
+{
+    size_t offset = 0;
+    const char *p = format;
+    struct log_spec spec;
+
+    while (*p != '\0' && offset + 1 < size) {
+        char spec_format[64];
+        size_t spec_len = 0;
+        long long ival;
+        double dval;
+        int star, ret = 0;
+
+        if (*p != '%' || p[1] == '%') {
+            buffer[offset++] = *p;
+            p += (*p == '%') ? 2 : 1;
+            continue;
+        }
+        if ((p = log_spec_parse(p + 1, &spec)) == NULL)
+            break;
+
+        // rebuild the spec with '*' replaced, and integers passed as int or long long
+        spec_format[spec_len++] = '%';
+        memcpy(spec_format + spec_len, spec.flags, spec.flags_len);
+        spec_len += spec.flags_len;
+        if (spec.width_len == 1 && spec.width[0] == '*') {
+            if (!log_record_get(&args, end, &star, sizeof(star)))
+                break;
+            spec_len += snprintf(spec_format + spec_len, sizeof(spec_format) - spec_len,
+                                 star < 0 ? "-%d" : "%d", star < 0 ? -star : star);
+        }
+        else {
+            memcpy(spec_format + spec_len, spec.width, spec.width_len);
+            spec_len += spec.width_len;
+        }
+        if (spec.prec_len == 1 && spec.prec[0] == '*') {
+            if (!log_record_get(&args, end, &star, sizeof(star)))
+                break;
+            if (star >= 0)
+                spec_len += snprintf(spec_format + spec_len, sizeof(spec_format) - spec_len,
+                                     ".%d", star);
+        }
+        else if (spec.has_prec) {
+            spec_format[spec_len++] = '.';
+            memcpy(spec_format + spec_len, spec.prec, spec.prec_len);
+            spec_len += spec.prec_len;
+        }
+
+        switch (spec.conv) {
+        case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c':
+            if (!log_record_get(&args, end, &ival, sizeof(ival)))
+                goto out;
+            if (spec.length == 0 || spec.length == 'h' || spec.length == 'H') {
+                if (spec.length != 0)
+                    spec_format[spec_len++] = 'h';
+                if (spec.length == 'H')
+                    spec_format[spec_len++] = 'h';
+                spec_format[spec_len++] = spec.conv;
+                spec_format[spec_len] = '\0';
+                ret = snprintf(buffer + offset, size - offset, spec_format, (int)ival);
+            }
+            else {
+                spec_format[spec_len++] = 'l';
+                spec_format[spec_len++] = 'l';
+                spec_format[spec_len++] = spec.conv;
+                spec_format[spec_len] = '\0';
+                ret = snprintf(buffer + offset, size - offset, spec_format, ival);
+            }
+            break;
+        case 'p':
+            if (!log_record_get(&args, end, &ival, sizeof(ival)))
+                goto out;
+            spec_format[spec_len++] = 'p';
+            spec_format[spec_len] = '\0';
+            ret = snprintf(buffer + offset, size - offset, spec_format, (void *)(uintptr_t)ival);
+            break;
+        case 's': {
+            unsigned short str_size;
+            if (!log_record_get(&args, end, &str_size, sizeof(str_size)) ||
+                args + str_size + 1 > end)
+                goto out;
+            spec_format[spec_len++] = 's';
+            spec_format[spec_len] = '\0';
+            ret = snprintf(buffer + offset, size - offset, spec_format, args);
+            args += str_size + 1;
+            break;
+        }
+        default:
+            if (!log_record_get(&args, end, &dval, sizeof(dval)))
+                goto out;
+            spec_format[spec_len++] = spec.conv;
+            spec_format[spec_len] = '\0';
+            ret = snprintf(buffer + offset, size - offset, spec_format, dval);
+            break;
+        }
+        if (ret < 0)
+            break;
+        offset += ret;
+    }
+
+out:
+    if (offset >= size)
+        offset = size - 1;
+    buffer[offset] = '\0';
+    return offset;
+}
+
+static size_t log_record_decode(const char *record, size_t record_len, char *log_entry)
+{
+    struct log_record header;
+    size_t valid_size = LOG_BUFFER_SIZE - 2;
+    size_t offset;
+
+    memcpy(&header, record, sizeof(header));
+    offset = log_format_header(log_entry, valid_size, header.realtime_us, (enum os_logprio)header.prio,
+                               header.thread, header.tag, header.func, header.line);
+    if (offset < valid_size)
+        offset += log_record_format(log_entry + offset, valid_size - offset, header.format,
+                                    record + sizeof(header), record + record_len);
+    return log_terminate_entry(log_entry, valid_size, offset);
+}
+
+static void log_async_kick()
+{
+    // only the first kick after the writer wakes up pays for the mutex,
+    // plain load first to keep the flag cache line shared while it's set
+    if (__atomic_load_n(&log_async.kicked, __ATOMIC_RELAXED) ||
+        __atomic_exchange_n(&log_async.kicked, true, __ATOMIC_ACQ_REL))
+        return;
+    OS_THREAD_MUTEX_LOCK(log_async.cond_mutex);
+    OS_THREAD_COND_SIGNAL(log_async.cond);
+    OS_THREAD_MUTEX_UNLOCK(log_async.cond_mutex);
+}
+
+// Return false if the line should be output synchronously
+static bool log_async_write(const char *data, size_t len, unsigned int entry_flags)
+{
+    struct log_ring *ring = t_log_ring;
+    unsigned int entry_len = (unsigned int)len | entry_flags;
+    size_t need = sizeof(entry_len) + len;
+    size_t head, tail;
+
+    if (ring == NULL && (t_log_ring_exited || (ring = log_ring_attach()) == NULL))
+        return false;
+    if (need > ring->size)
+        return false;
+
+    head = ring->head;
+    for (;;) {
+        tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        if (ring->size - (head - tail) >= need)
+            break;
+        if (log_async.full_policy == OS_LOGGER_FULL_DROP) {
+            __atomic_add_fetch(&log_async.dropped, 1, __ATOMIC_RELAXED);
+            log_async_kick();
+            return true;
+        }
+        if (!__atomic_load_n(&log_async.running, __ATOMIC_ACQUIRE))
+            return false;
+        log_async_kick();
+        OS_THREAD_SLEEP_USEC(100);
+    }
+
+    log_ring_copy_in(ring, head, &entry_len, sizeof(entry_len));
+    log_ring_copy_in(ring, head + sizeof(entry_len), data, len);
+    __atomic_store_n(&ring->head, head + need, __ATOMIC_RELEASE);
+
+    // wake up writer early when the ring is half full
+    if (head + need - tail > ring->size / 2)
+        log_async_kick();
+    return true;
+}
+
+static void log_async_batch_output()
+{
+    if (log_async.batch_len > 0) {
+        os_logger_output(log_async.batch, log_async.batch_len);
+        log_async.batch_len = 0;
+    }
+}
+
+// Called with log_async.mutex held
+static void log_async_drain_l()
+{
+    struct listnode *node, *n;
+    unsigned long long dropped;
+
+    list_for_each_safe(node, n, &log_async.rings) {
+        struct log_ring *ring = node_to_item(node, struct log_ring, listnode);
+        // head is final once exited is seen
+        bool exited = __atomic_load_n(&ring->exited, __ATOMIC_ACQUIRE);
+        size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        size_t tail = ring->tail;
+
+        while (tail != head) {
+            unsigned int entry_len, entry_flags;
+            log_ring_copy_out(ring, tail, &entry_len, sizeof(entry_len));
+            entry_flags = entry_len & ~LOG_ENTRY_LEN_MASK;
+            entry_len &= LOG_ENTRY_LEN_MASK;
+            if (entry_flags & LOG_ENTRY_DEFERRED) {
+                char record[LOG_BUFFER_SIZE];
+                char log_entry[LOG_BUFFER_SIZE];
+                size_t len;
+                log_ring_copy_out(ring, tail + sizeof(entry_len), record, entry_len);
+                len = log_record_decode(record, entry_len, log_entry);
+                if (log_async.batch_len + len > sizeof(log_async.batch))
+                    log_async_batch_output();
+                memcpy(log_async.batch + log_async.batch_len, log_entry, len);
+                log_async.batch_len += len;
+            }
+            else {
+                if (log_async.batch_len + entry_len > sizeof(log_async.batch))
+                    log_async_batch_output();
+                log_ring_copy_out(ring, tail + sizeof(entry_len),
+                                  log_async.batch + log_async.batch_len, entry_len);
+                log_async.batch_len += entry_len;
+            }
+            tail += sizeof(entry_len) + entry_len;
+        }
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+        if (exited) {
+            list_remove(&ring->listnode);
+            free(ring->buffer);
+            free(ring);
+        }
+    }
+
+    dropped = __atomic_load_n(&log_async.dropped, __ATOMIC_RELAXED);
+    if (dropped != log_async.dropped_reported) {
+        int len = snprintf(log_async.batch + log_async.batch_len,
+                           sizeof(log_async.batch) - log_async.batch_len,
+                           "logger: [%llu] lines dropped because of full ring buffer\n",
+                           dropped - log_async.dropped_reported);
+        if (len > 0 && log_async.batch_len + len < sizeof(log_async.batch))
+            log_async.batch_len += len;
+        log_async.dropped_reported = dropped;
+    }
+
+    log_async_batch_output();
+    fflush(stdout);
+}
+
+static void *log_async_writer(void *arg)
+{
+    bool running = true;
+
+    while (running) {
+        OS_THREAD_MUTEX_LOCK(log_async.cond_mutex);
+        running = __atomic_load_n(&log_async.running, __ATOMIC_ACQUIRE);
+        if (running && !__atomic_load_n(&log_async.kicked, __ATOMIC_ACQUIRE))
+            OS_THREAD_COND_TIMEDWAIT(log_async.cond, log_async.cond_mutex,
+                                     log_async.flush_interval_ms * 1000);
+        __atomic_store_n(&log_async.kicked, false, __ATOMIC_RELEASE);
+        OS_THREAD_MUTEX_UNLOCK(log_async.cond_mutex);
+
+        // drain outside of cond_mutex, so kick never waits for I/O
+        OS_THREAD_MUTEX_LOCK(log_async.mutex);
+        log_async_drain_l();
+        OS_THREAD_MUTEX_UNLOCK(log_async.mutex);
+#if defined(ENABLE_LOG_SAVE)
+        // flush file of an idle logger in time
+        log_file_flush(false);
+#endif
+    }
+    return NULL;
+}
+
+static void log_async_atexit()
+{
+    os_logger_flush();
+}
+
+int os_logger_async_start(struct os_logger_async_attr *attr)
+{
+    struct os_threadattr thread_attr = {
+        .name = "logger",
+        .priority = OS_THREAD_PRIO_NORMAL,
+        .stacksize = 4096,
+        .joinable = true,
+    };
+    size_t ring_size = LOG_ASYNC_RING_SIZE;
+    int ret = -1;
+
+    OS_THREAD_MUTEX_LOCK(log_async_mutex);
+    if (log_async.running) {
+        ret = 0;
         goto out;
     }
 
-    if (fp != NULL && data != NULL && len > 0) {
-        fwrite(data, len, 1, fp);
-        fflush(fp);
+    if (attr != NULL && attr->ring_size > 0) {
+        ring_size = 1024;
+        while (ring_size < attr->ring_size)
+            ring_size <<= 1;
+    }
+    log_async.ring_size = ring_size;
+    log_async.flush_interval_ms = (attr != NULL && attr->flush_interval_ms > 0) ?
+            attr->flush_interval_ms : LOG_ASYNC_FLUSH_INTERVAL;
+    log_async.full_policy = (attr != NULL) ? attr->full_policy : OS_LOGGER_FULL_DROP;
+
+    if (log_async.mutex == NULL) {
+        list_init(&log_async.rings);
+        log_async.mutex = OS_THREAD_MUTEX_CREATE();
+        log_async.cond_mutex = OS_THREAD_MUTEX_CREATE();
+        log_async.cond = OS_THREAD_COND_CREATE();
+        if (log_async.mutex == NULL || log_async.cond_mutex == NULL || log_async.cond == NULL) {
+            fprintf(stderr, "Failed to create logger mutex/cond\n");
+            goto out;
+        }
+    }
+    if (!log_ring_key_created) {
+        if (pthread_key_create(&log_ring_key, log_ring_destructor) != 0) {
+            fprintf(stderr, "Failed to create logger thread key\n");
+            goto out;
+        }
+        log_ring_key_created = true;
+        atexit(log_async_atexit);
+    }
+
+    __atomic_store_n(&log_async.running, true, __ATOMIC_RELEASE);
+    log_async.writer = OS_THREAD_CREATE(&thread_attr, log_async_writer, NULL);
+    if (log_async.writer == NULL) {
+        fprintf(stderr, "Failed to create logger writer thread\n");
+        __atomic_store_n(&log_async.running, false, __ATOMIC_RELEASE);
+        goto out;
     }
+    ret = 0;
 
 out:
-    OS_THREAD_MUTEX_UNLOCK(log_config.file_mutex);
+    OS_THREAD_MUTEX_UNLOCK(log_async_mutex);
+    return ret;
+}
+
+void os_logger_async_stop()
+{
+    OS_THREAD_MUTEX_LOCK(log_async_mutex);
+    if (log_async.running) {
+        __atomic_store_n(&log_async.running, false, __ATOMIC_RELEASE);
+        OS_THREAD_MUTEX_LOCK(log_async.cond_mutex);
+        OS_THREAD_COND_SIGNAL(log_async.cond);
+        OS_THREAD_MUTEX_UNLOCK(log_async.cond_mutex);
+        // writer drains all rings before exit
+        OS_THREAD_JOIN(log_async.writer, NULL);
+        log_async.writer = NULL;
+    }
+    OS_THREAD_MUTEX_UNLOCK(log_async_mutex);
+}
+
+void os_logger_flush()
+{
+    if (log_async.mutex != NULL) {
+        OS_THREAD_MUTEX_LOCK(log_async.mutex);
+        log_async_drain_l();
+        OS_THREAD_MUTEX_UNLOCK(log_async.mutex);
+    }
+    else {
+        fflush(stdout);
+    }
+#if defined(ENABLE_LOG_SAVE)
+    log_file_flush(true);
+#endif
+}
+
+unsigned long long os_logger_dropped()
+{
+    return __atomic_load_n(&log_async.dropped, __ATOMIC_RELAXED);
+}
+
+#else
+int os_logger_async_start(struct os_logger_async_attr *attr)
+{
+    // thread local storage is required by async mode
+    return -1;
+}
+
+void os_logger_async_stop()
+{
+}
+
+void os_logger_flush()
+{
+    fflush(stdout);
+#if defined(ENABLE_LOG_SAVE)
+    log_file_flush(true);
+#endif
+}
+
+unsigned long long os_logger_dropped()
+{
+    return 0;
+}
+#endif
+
+#if defined(LOG_ASYNC_SUPPORT)
+static bool log_deferred_write(enum os_logprio prio, const char *tag,
+                               const char *func, unsigned int line,
+                               const char *format, va_list arg_ptr)
+{
+    char record[LOG_BUFFER_SIZE];
+    char thread[OS_THREAD_NAME_MAX];
+    struct log_record header;
+    size_t len = log_record_encode(record, format, arg_ptr);
+
+    if (len == 0)
+        return false;
+
+    header.realtime_us = log_realtime_usec();
+    header.tag = tag;
+    header.func = func;
+    header.format = format;
+    header.line = line;
+    header.prio = prio;
+    memcpy(header.thread, log_thread_name(thread), sizeof(header.thread));
+    memcpy(record, &header, sizeof(header));
+    return log_async_write(record, len, LOG_ENTRY_DEFERRED);
 }
 #endif
 
@@ -154,56 +1347,48 @@ static void os_logger_print(enum os_logprio prio, const char *tag,
     char log_entry[LOG_BUFFER_SIZE];
     size_t valid_size = LOG_BUFFER_SIZE - 2;
 
-    struct os_realtime ts;
-    // add data & time to header
-    OS_TIMESTAMP_TO_LOCAL(&ts);
-    if ((int)(valid_size - offset) > 0)
-        offset += snprintf(log_entry + offset, valid_size - offset,
-                           "%4d-%02d-%02d %02d:%02d:%02d:%03d",
-                           ts.year, ts.mon, ts.day, ts.hour, ts.min, ts.sec, ts.msec);
-
-    // add priority to header
-    if ((int)(valid_size - offset) > 0)
-        offset += snprintf(log_entry + offset, valid_size - offset,
-                           " %s", log_prio_string[prio]);
-
-    // add tag, function and line to header
-    if ((int)(valid_size - offset) > 0)
-        offset += snprintf(log_entry + offset, valid_size - offset,
-                           " %s:%s:%u: ", tag, func, line);
-
-    if ((int)(valid_size - offset) > 0) {
+    char thread[OS_THREAD_NAME_MAX];
+
+    offset = log_format_header(log_entry, valid_size, log_realtime_usec(),
+                               prio, log_thread_name(thread), tag, func, line);
+
+    if (offset < valid_size) {
         arg_size = vsnprintf(log_entry + offset, valid_size - offset,
                              format, arg_ptr);
-        if (arg_size > 0) {
+        if (arg_size > 0)
             offset += arg_size;
-            if (offset > valid_size)
-                offset = valid_size - 1;
-        }
-        log_entry[offset++] = '\n';
-        log_entry[offset] = '\0';
     }
-    else {
-        offset = valid_size - 1;
-        log_entry[offset++] = '\n';
-        log_entry[offset] = '\0';
+    offset = log_terminate_entry(log_entry, valid_size, offset);
+
+#if defined(LOG_ASYNC_SUPPORT)
+    if (__atomic_load_n(&log_async.running, __ATOMIC_ACQUIRE)) {
+        if (prio != OS_LOG_FATAL && log_async_write(log_entry, offset, 0))
+            return;
+        // fatal line is usually followed by assert, output buffered lines first
+        os_logger_flush();
     }
+#endif
 
-    // print log to console
-    fprintf(stdout, "%s", log_entry);
+    os_logger_output(log_entry, offset);
+}
 
-#if defined(ENABLE_LOG_SAVE)
-    // save log to file if need
-    if (log_config.file_enable)
-        os_logger_save(log_entry, offset);
-#endif
+static void log_print(enum os_logprio prio, const char *tag,
+                      const char *func, unsigned int line,
+                      const char *format, ...)
+{
+    va_list arg_ptr;
+    va_start(arg_ptr, format);
+    os_logger_print(prio, tag, func, line, format, arg_ptr);
+    va_end(arg_ptr);
 }
 
 void os_logger_trace(enum os_logprio prio, const char *tag,
                      const char *func, unsigned int line,
                      const char *format, ...)
 {
-    if (!log_config.enable || prio > log_config.prio)
+    if (!log_config.enable)
+        return;
+    if ((int)prio > log_tag_level(log_tag_find(tag)))
         return;
 
     va_list arg_ptr;
@@ -211,3 +1396,42 @@ void os_logger_trace(enum os_logprio prio, const char *tag,
     os_logger_print(prio, tag, func, line, format, arg_ptr);
     va_end(arg_ptr);
 }
+
+void os_logger_trace_site(struct os_logsite *site, enum os_logprio prio,
+                          const char *func, unsigned int line,
+                          const char *format, ...)
+{
+    unsigned int suppressed;
+
+    if (__atomic_load_n(&site->level, __ATOMIC_ACQUIRE) == OS_LOGSITE_UNRESOLVED) {
+        log_site_register(site);
+        if ((int)prio > __atomic_load_n(&site->level, __ATOMIC_ACQUIRE))
+            return;
+    }
+
+    if (prio != OS_LOG_FATAL && !log_site_ratelimit(site))
+        return;
+    if (__atomic_load_n(&site->suppressed, __ATOMIC_RELAXED) > 0 &&
+        (suppressed = __atomic_exchange_n(&site->suppressed, 0, __ATOMIC_RELAXED)) > 0)
+        log_print(prio, site->tag, func, line, "[%u] lines suppressed by rate limit", suppressed);
+
+    va_list arg_ptr;
+    va_start(arg_ptr, format);
+#if defined(LOG_ASYNC_SUPPORT)
+    if (prio >= OS_LOG_DEBUG &&
+        (__atomic_load_n(&site->flags, __ATOMIC_RELAXED) & OS_LOGSITE_DEFERRED) &&
+        __atomic_load_n(&log_async.running, __ATOMIC_ACQUIRE)) {
+        va_list arg_copy;
+        bool done;
+        va_copy(arg_copy, arg_ptr);
+        done = log_deferred_write(prio, site->tag, func, line, format, arg_copy);
+        va_end(arg_copy);
+        if (done) {
+            va_end(arg_ptr);
+            return;
+        }
+    }
+#endif
+    os_logger_print(prio, site->tag, func, line, format, arg_ptr);
+    va_end(arg_ptr);
+}
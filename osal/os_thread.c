@@ -14,15 +14,230 @@
  * limitations under the License.
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // sched_setaffinity, CPU_SET
+#endif
 #include <string.h>
 #include <unistd.h>
 #include <time.h>
+#include <errno.h>
 #include <pthread.h>
 #if defined(OS_ANDROID)
 #include <sys/signal.h>
 #endif
+#if defined(__linux__) && !defined(OS_FREERTOS)
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#define THREAD_SCHED_SUPPORT
+#define THREAD_NAME_SUPPORT
+#endif
+#include "cutils/os_logger.h"
 #include "cutils/os_thread.h"
 
+#define LOG_TAG "thread"
+
+#if defined(OS_FREERTOS)
+#define THREAD_TLS
+#else
+#define THREAD_TLS __thread
+#endif
+
+static THREAD_TLS struct os_threadinfo t_info;
+static THREAD_TLS bool t_info_ready = false;
+
+struct thread_start {
+    void *(*cb)(void *arg);
+    void *arg;
+    char name[OS_THREAD_NAME_MAX];
+    struct os_threadsched sched;
+    enum os_threadprio priority;
+};
+
+static void thread_info_init(const char *name)
+{
+    memset(&t_info, 0x0, sizeof(t_info));
+    t_info.id = (os_thread_t)pthread_self();
+    if (name != NULL && name[0] != '\0')
+        snprintf(t_info.name, sizeof(t_info.name), "%s", name);
+#if defined(THREAD_NAME_SUPPORT)
+    else if (pthread_getname_np(pthread_self(), t_info.name, sizeof(t_info.name)) != 0)
+        snprintf(t_info.name, sizeof(t_info.name), "%lu", (unsigned long)syscall(SYS_gettid));
+#else
+    else
+        snprintf(t_info.name, sizeof(t_info.name), "%p", t_info.id);
+#endif
+    t_info_ready = true;
+}
+
+#if defined(THREAD_SCHED_SUPPORT)
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+#define THREAD_MAX_NODES 64
+
+// Map os_threadprio to the priority range of the policy, HARD_REALTIME is the highest
+static int thread_rt_priority(int policy, enum os_threadprio priority)
+{
+    int min = sched_get_priority_min(policy);
+    int max = sched_get_priority_max(policy);
+    if (priority < OS_THREAD_PRIO_HARD_REALTIME || priority > OS_THREAD_PRIO_IDLE)
+        priority = OS_THREAD_PRIO_NORMAL;
+    return max - (max - min) * (int)priority / (int)OS_THREAD_PRIO_IDLE;
+}
+
+// Add cpus of numa node to set, cpulist is like "0-3,8-11"
+static int thread_node_cpus(int node, cpu_set_t *set)
+{
+    char path[64], list[256];
+    FILE *file;
+    char *p;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    file = fopen(path, "r");
+    if (file == NULL)
+        return -1;
+    p = fgets(list, sizeof(list), file);
+    fclose(file);
+    if (p == NULL)
+        return -1;
+
+    while (*p >= '0' && *p <= '9') {
+        long first = strtol(p, &p, 10), last = first;
+        if (*p == '-')
+            last = strtol(p + 1, &p, 10);
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+            CPU_SET(cpu, set);
+        if (*p == ',')
+            p++;
+    }
+    return 0;
+}
+
+static int thread_set_affinity(const struct os_threadsched *sched)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    if (sched->cpumask != 0) {
+        for (int cpu = 0; cpu < 64; cpu++) {
+            if (sched->cpumask & (1ULL << cpu))
+                CPU_SET(cpu, &set);
+        }
+    }
+    else {
+        for (int node = 0; node < THREAD_MAX_NODES; node++) {
+            if ((sched->nodemask & (1ULL << node)) && thread_node_cpus(node, &set) != 0) {
+                OS_LOGW(LOG_TAG, "Failed to get cpus of numa node [%d]", node);
+                return -1;
+            }
+        }
+    }
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        OS_LOGW(LOG_TAG, "Failed to set cpu affinity: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static int thread_set_mempolicy(unsigned long long nodemask)
+{
+    // preferred mode takes one node, the lowest of the mask. the kernel reads
+    // maxnode - 1 bits as an array of longs, so long is 32 bits on 32-bit builds
+    unsigned long mask[THREAD_MAX_NODES / (8 * sizeof(unsigned long))];
+    unsigned long long node = nodemask & (~nodemask + 1);
+
+    for (size_t i = 0; i < sizeof(mask) / sizeof(mask[0]); i++)
+        mask[i] = (unsigned long)(node >> (i * 8 * sizeof(unsigned long)));
+    if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, THREAD_MAX_NODES + 1) != 0) {
+        OS_LOGW(LOG_TAG, "Failed to set numa memory policy: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static int thread_set_policy(const struct os_threadsched *sched, enum os_threadprio priority)
+{
+    struct sched_param param;
+    int policy;
+
+    switch (sched->policy) {
+    case OS_THREAD_POLICY_FIFO:
+        policy = SCHED_FIFO;
+        break;
+    case OS_THREAD_POLICY_RR:
+        policy = SCHED_RR;
+        break;
+    default:
+        policy = SCHED_OTHER;
+        break;
+    }
+
+    memset(&param, 0, sizeof(param));
+    if (policy != SCHED_OTHER)
+        param.sched_priority = thread_rt_priority(policy, priority);
+    if (sched_setscheduler(0, policy, &param) != 0) {
+        OS_LOGW(LOG_TAG, "Failed to set sched policy [%d] priority [%d]: %s",
+                policy, param.sched_priority, strerror(errno));
+        return -1;
+    }
+    // nice is per thread on Linux, who 0 is the calling thread
+    if (policy == SCHED_OTHER && setpriority(PRIO_PROCESS, 0, sched->nice) != 0) {
+        OS_LOGW(LOG_TAG, "Failed to set nice [%d]: %s", sched->nice, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static bool thread_sched_is_default(const struct os_threadsched *sched)
+{
+    return sched->policy == OS_THREAD_POLICY_DEFAULT && sched->cpumask == 0 && sched->nodemask == 0;
+}
+
+#endif
+
+static void *thread_start_entry(void *arg)
+{
+    struct thread_start start = *(struct thread_start *)arg;
+    free(arg);
+
+    thread_info_init(start.name);
+#if defined(THREAD_NAME_SUPPORT)
+    // shown by top/gdb, set by the thread itself so it's there before cb runs
+    if (start.name[0] != '\0')
+        pthread_setname_np(pthread_self(), start.name);
+#endif
+#if defined(THREAD_SCHED_SUPPORT)
+    if (!thread_sched_is_default(&start.sched))
+        OS_THREAD_SET_SCHED(&start.sched, start.priority);
+#endif
+    return start.cb(start.arg);
+}
+
+struct os_threadinfo *OS_THREAD_INFO()
+{
+    if (!t_info_ready)
+        thread_info_init(NULL);
+    return &t_info;
+}
+
+int OS_THREAD_SET_SCHED(const struct os_threadsched *sched, enum os_threadprio priority)
+{
+#if defined(THREAD_SCHED_SUPPORT)
+    int ret = 0;
+
+    if ((sched->cpumask != 0 || sched->nodemask != 0) && thread_set_affinity(sched) != 0)
+        ret = -1;
+    if (sched->nodemask != 0 && thread_set_mempolicy(sched->nodemask) != 0)
+        ret = -1;
+    if (sched->policy != OS_THREAD_POLICY_DEFAULT && thread_set_policy(sched, priority) != 0)
+        ret = -1;
+    return ret;
+#else
+    return -1;
+#endif
+}
+
 void OS_THREAD_SLEEP_USEC(unsigned long usec)
 {
     usleep(usec);
@@ -50,7 +265,22 @@ os_thread_t OS_THREAD_CREATE(struct os_threadattr *attr, void *(*cb)(void *arg),
     pthread_attr_setstacksize(&tattr, attr->stacksize);
 #endif
 
-    ret = pthread_create(&tid, &tattr, cb, arg);
+    // descriptor, name and sched are set up by the thread itself,
+    // nice and memory policy can't be set from outside
+    struct thread_start *start = calloc(1, sizeof(struct thread_start));
+    if (start == NULL) {
+        pthread_attr_destroy(&tattr);
+        return NULL;
+    }
+    start->cb = cb;
+    start->arg = arg;
+    if (attr->name != NULL)
+        snprintf(start->name, sizeof(start->name), "%s", attr->name);
+    start->sched = attr->sched;
+    start->priority = attr->priority;
+    ret = pthread_create(&tid, &tattr, thread_start_entry, start);
+    if (ret != 0)
+        free(start);
     pthread_attr_destroy(&tattr);
     if (ret != 0)
         return NULL;
@@ -78,15 +308,26 @@ int OS_THREAD_JOIN(os_thread_t tid, void **retval)
 
 os_thread_t OS_THREAD_SELF()
 {
+#if defined(OS_FREERTOS)
+    // no thread local storage, the descriptor is shared
     return (os_thread_t)pthread_self();
+#else
+    return OS_THREAD_INFO()->id;
+#endif
 }
 
 int OS_THREAD_SET_NAME(os_thread_t tid, const char *name)
 {
-#if defined(OS_FREERTOS)
-    return pthread_setname_np((pthread_t)tid, name);
+    char buf[OS_THREAD_NAME_MAX];
+
+    if (tid == NULL)
+        return -1;
+    snprintf(buf, sizeof(buf), "%s", name != NULL ? name : "");
+    if (tid == OS_THREAD_SELF())
+        memcpy(OS_THREAD_INFO()->name, buf, sizeof(buf));
+#if defined(OS_FREERTOS) || defined(THREAD_NAME_SUPPORT)
+    return pthread_setname_np((pthread_t)tid, buf);
 #else
-    // TODO
     return -1;
 #endif
 }
@@ -80,3 +80,38 @@ unsigned long long OS_REALTIME_USEC()
     cputime = ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
     return cputime;
 }
+
+// CLOCK_*_COARSE are served from vDSO without reading the clock source
+#if defined(CLOCK_MONOTONIC_COARSE)
+#define OS_CLOCK_MONOTONIC_COARSE CLOCK_MONOTONIC_COARSE
+#else
+#define OS_CLOCK_MONOTONIC_COARSE CLOCK_MONOTONIC
+#endif
+
+#if defined(CLOCK_REALTIME_COARSE)
+#define OS_CLOCK_REALTIME_COARSE CLOCK_REALTIME_COARSE
+#else
+#define OS_CLOCK_REALTIME_COARSE CLOCK_REALTIME
+#endif
+
+unsigned long long OS_MONOTONIC_COARSE_USEC()
+{
+    struct timespec ts;
+    unsigned long long cputime;
+
+    clock_gettime(OS_CLOCK_MONOTONIC_COARSE, &ts);
+
+    cputime = ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    return cputime;
+}
+
+unsigned long long OS_REALTIME_COARSE_USEC()
+{
+    struct timespec ts;
+    unsigned long long cputime;
+
+    clock_gettime(OS_CLOCK_REALTIME_COARSE, &ts);
+
+    cputime = ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    return cputime;
+}
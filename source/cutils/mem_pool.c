@@ -0,0 +1,503 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "cutils/common_list.h"
+#include "cutils/os_thread.h"
+#include "cutils/os_logger.h"
+#include "cutils/mem_pool.h"
+
+#define LOG_TAG "mempool"
+
+#define SPAN_SIZE           (64 * 1024)
+#define BLOCK_MAGIC         0x504f4f4cU // "POOL"
+#define LARGE_CLASS         0xffffffffU
+
+#if !defined(OS_FREERTOS)
+#define MEMPOOL_THREAD_CACHE
+#endif
+
+#define BLOCK_ALIGN         16
+
+// Every block has a header, so free() finds the class without lookup.
+// Padded to BLOCK_ALIGN on 32-bit targets too, with class sizes multiple of
+// it every block stride is, so user pointers are aligned as malloc() does
+struct block_header {
+    unsigned int cls;
+    unsigned int magic;
+    size_t size;  // requested size
+} __attribute__((aligned(BLOCK_ALIGN)));
+
+_Static_assert(sizeof(struct block_header) % BLOCK_ALIGN == 0, "block header breaks alignment");
+
+struct free_block {
+    struct free_block *next;
+};
+
+struct central_list {
+    os_mutex_t mutex;
+    struct free_block *head;
+    size_t free_count;
+    size_t span_bytes;
+    size_t total_blocks;
+    // updated atomically
+    size_t fetch_count;
+    size_t release_count;
+};
+
+struct thread_list {
+    struct free_block *head;
+    unsigned int count; // written by owner thread only, read by mempool_get_stats()
+};
+
+struct thread_cache {
+    struct thread_list lists[MEMPOOL_CLASS_COUNT];
+    struct listnode listnode; // in g_caches
+};
+
+static const unsigned int g_class_size[MEMPOOL_CLASS_COUNT] = {
+    16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 448, 512,
+};
+
+OS_MUTEX_DECLARE(g_mempool_mutex);
+static struct central_list *g_central = NULL;
+static size_t g_large_count = 0;
+static size_t g_large_bytes = 0;
+
+#if defined(MEMPOOL_THREAD_CACHE)
+static __thread struct thread_cache *t_cache = NULL;
+static pthread_key_t g_cache_key;
+OS_MUTEX_DECLARE(g_caches_mutex);
+static list_declare(g_caches); // all thread caches, for stats
+#endif
+
+static unsigned int mempool_size_class(size_t size)
+{
+    if (size <= 128)
+        return size == 0 ? 0 : (unsigned int)((size - 1) >> 4);
+    if (size <= 256)
+        return 8 + (unsigned int)((size - 129) >> 5);
+    return 12 + (unsigned int)((size - 257) >> 6);
+}
+
+static unsigned int mempool_batch_count(unsigned int cls)
+{
+    // move about 4KB per batch, at least 8 blocks
+    unsigned int count = 4096 / (g_class_size[cls] + sizeof(struct block_header));
+    return count < 8 ? 8 : count;
+}
+
+#if defined(MEMPOOL_THREAD_CACHE)
+static void mempool_cache_destructor(void *arg);
+#endif
+
+static struct central_list *mempool_init()
+{
+    if (g_central == NULL) {
+        if (g_mempool_mutex != NULL)
+            OS_THREAD_MUTEX_LOCK(g_mempool_mutex);
+
+        if (g_central == NULL) {
+            struct central_list *central = calloc(MEMPOOL_CLASS_COUNT, sizeof(struct central_list));
+            if (central == NULL) {
+                OS_LOGE(LOG_TAG, "Failed to allocate central lists");
+                if (g_mempool_mutex != NULL)
+                    OS_THREAD_MUTEX_UNLOCK(g_mempool_mutex);
+                return NULL;
+            }
+
+            for (int i = 0; i < MEMPOOL_CLASS_COUNT; i++) {
+                central[i].mutex = OS_THREAD_MUTEX_CREATE();
+                if (central[i].mutex == NULL) {
+                    OS_LOGE(LOG_TAG, "Failed to create central mutex");
+                    for (int j = 0; j < i; j++)
+                        OS_THREAD_MUTEX_DESTROY(central[j].mutex);
+                    free(central);
+                    if (g_mempool_mutex != NULL)
+                        OS_THREAD_MUTEX_UNLOCK(g_mempool_mutex);
+                    return NULL;
+                }
+            }
+
+#if defined(MEMPOOL_THREAD_CACHE)
+            // flush thread cache to central lists when thread exits
+            pthread_key_create(&g_cache_key, mempool_cache_destructor);
+#endif
+            __atomic_store_n(&g_central, central, __ATOMIC_RELEASE);
+        }
+
+        if (g_mempool_mutex != NULL)
+            OS_THREAD_MUTEX_UNLOCK(g_mempool_mutex);
+    }
+
+    return g_central;
+}
+
+// carve a new span into blocks, called with central lock held
+static bool mempool_central_grow_l(struct central_list *list, unsigned int cls)
+{
+    size_t block_size = g_class_size[cls] + sizeof(struct block_header);
+    size_t count = SPAN_SIZE / block_size;
+    char *span = malloc(SPAN_SIZE);
+
+    if (span == NULL)
+        return false;
+
+    for (size_t i = 0; i < count; i++) {
+        struct block_header *header = (struct block_header *)(span + i * block_size);
+        struct free_block *block = (struct free_block *)(header + 1);
+        header->cls = cls;
+        header->magic = BLOCK_MAGIC;
+        block->next = list->head;
+        list->head = block;
+    }
+
+    list->free_count += count;
+    list->total_blocks += count;
+    list->span_bytes += SPAN_SIZE;
+    return true;
+}
+
+// fetch up to count blocks as a chain, returns the number fetched
+static unsigned int mempool_central_fetch(unsigned int cls, unsigned int count, struct free_block **chain)
+{
+    struct central_list *list = &g_central[cls];
+    struct free_block *head = NULL;
+    unsigned int fetched = 0;
+
+    OS_THREAD_MUTEX_LOCK(list->mutex);
+
+    if (list->head == NULL)
+        mempool_central_grow_l(list, cls);
+
+    while (fetched < count && list->head != NULL) {
+        struct free_block *block = list->head;
+        list->head = block->next;
+        block->next = head;
+        head = block;
+        fetched++;
+    }
+    list->free_count -= fetched;
+
+    OS_THREAD_MUTEX_UNLOCK(list->mutex);
+
+    *chain = head;
+    return fetched;
+}
+
+static void mempool_central_release(unsigned int cls, struct free_block *head, struct free_block *tail, unsigned int count)
+{
+    struct central_list *list = &g_central[cls];
+
+    OS_THREAD_MUTEX_LOCK(list->mutex);
+    tail->next = list->head;
+    list->head = head;
+    list->free_count += count;
+    OS_THREAD_MUTEX_UNLOCK(list->mutex);
+}
+
+#if defined(MEMPOOL_THREAD_CACHE)
+static struct thread_cache *mempool_thread_cache()
+{
+    struct thread_cache *cache = t_cache;
+
+    if (cache == NULL) {
+        cache = calloc(1, sizeof(struct thread_cache));
+        if (cache != NULL) {
+            t_cache = cache;
+            pthread_setspecific(g_cache_key, cache);
+            OS_THREAD_MUTEX_LOCK(g_caches_mutex);
+            list_add_tail(&g_caches, &cache->listnode);
+            OS_THREAD_MUTEX_UNLOCK(g_caches_mutex);
+        }
+    }
+    return cache;
+}
+
+// return count blocks from the front of thread list to central
+static void mempool_thread_release(struct thread_list *tlist, unsigned int cls, unsigned int count)
+{
+    struct free_block *head = tlist->head, *tail = head;
+
+    for (unsigned int i = 1; i < count; i++)
+        tail = tail->next;
+    tlist->head = tail->next;
+    __atomic_store_n(&tlist->count, tlist->count - count, __ATOMIC_RELAXED);
+
+    mempool_central_release(cls, head, tail, count);
+    __atomic_add_fetch(&g_central[cls].release_count, 1, __ATOMIC_RELAXED);
+}
+
+static void mempool_cache_flush(struct thread_cache *cache)
+{
+    for (unsigned int cls = 0; cls < MEMPOOL_CLASS_COUNT; cls++) {
+        struct thread_list *tlist = &cache->lists[cls];
+        if (tlist->count > 0)
+            mempool_thread_release(tlist, cls, tlist->count);
+    }
+}
+
+static void mempool_cache_destructor(void *arg)
+{
+    struct thread_cache *cache = (struct thread_cache *)arg;
+
+    mempool_cache_flush(cache);
+    OS_THREAD_MUTEX_LOCK(g_caches_mutex);
+    list_remove(&cache->listnode);
+    OS_THREAD_MUTEX_UNLOCK(g_caches_mutex);
+    t_cache = NULL;
+    free(cache);
+}
+#endif
+
+static void *mempool_small_alloc(unsigned int cls)
+{
+    struct free_block *block = NULL;
+
+#if defined(MEMPOOL_THREAD_CACHE)
+    struct thread_cache *cache = mempool_thread_cache();
+    if (cache != NULL) {
+        struct thread_list *tlist = &cache->lists[cls];
+
+        if (tlist->head == NULL) {
+            unsigned int count = mempool_central_fetch(cls, mempool_batch_count(cls), &tlist->head);
+            if (count == 0)
+                return NULL;
+            tlist->count = count;
+            __atomic_add_fetch(&g_central[cls].fetch_count, 1, __ATOMIC_RELAXED);
+        }
+
+        block = tlist->head;
+        tlist->head = block->next;
+        __atomic_store_n(&tlist->count, tlist->count - 1, __ATOMIC_RELAXED);
+        return block;
+    }
+#endif
+
+    if (mempool_central_fetch(cls, 1, &block) == 0)
+        return NULL;
+    return block;
+}
+
+static void mempool_small_free(unsigned int cls, void *ptr)
+{
+    struct free_block *block = (struct free_block *)ptr;
+
+#if defined(MEMPOOL_THREAD_CACHE)
+    struct thread_cache *cache = mempool_thread_cache();
+    if (cache != NULL) {
+        struct thread_list *tlist = &cache->lists[cls];
+        unsigned int batch = mempool_batch_count(cls);
+
+        block->next = tlist->head;
+        tlist->head = block;
+        __atomic_store_n(&tlist->count, tlist->count + 1, __ATOMIC_RELAXED);
+
+        // keep at most two batches, release one in a batch
+        if (tlist->count > 2 * batch)
+            mempool_thread_release(tlist, cls, batch);
+        return;
+    }
+#endif
+
+    mempool_central_release(cls, block, block, 1);
+}
+
+void *mempool_malloc(size_t size)
+{
+    struct block_header *header;
+
+    if (size <= MEMPOOL_MAX_SIZE && mempool_init() != NULL) {
+        unsigned int cls = mempool_size_class(size);
+        void *ptr = mempool_small_alloc(cls);
+        if (ptr == NULL)
+            return NULL;
+        header = (struct block_header *)ptr - 1;
+        header->size = size;
+        return ptr;
+    }
+
+    if (size > SIZE_MAX - sizeof(struct block_header))
+        return NULL;
+
+    header = malloc(sizeof(struct block_header) + size);
+    if (header == NULL)
+        return NULL;
+    header->cls = LARGE_CLASS;
+    header->magic = BLOCK_MAGIC;
+    header->size = size;
+    __atomic_add_fetch(&g_large_count, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&g_large_bytes, size, __ATOMIC_RELAXED);
+    return header + 1;
+}
+
+void *mempool_calloc(size_t n, size_t size)
+{
+    void *ptr;
+
+    if (size != 0 && n > SIZE_MAX / size)
+        return NULL;
+
+    ptr = mempool_malloc(n * size);
+    if (ptr != NULL)
+        memset(ptr, 0x0, n * size);
+    return ptr;
+}
+
+void *mempool_realloc(void *ptr, size_t size)
+{
+    struct block_header *header;
+    void *new_ptr;
+
+    if (ptr == NULL)
+        return mempool_malloc(size);
+
+    if (size == 0) {
+        mempool_free(ptr);
+        return NULL;
+    }
+
+    header = (struct block_header *)ptr - 1;
+    if (header->cls != LARGE_CLASS && size <= g_class_size[header->cls]) {
+        header->size = size;
+        return ptr;
+    }
+
+    new_ptr = mempool_malloc(size);
+    if (new_ptr != NULL) {
+        memcpy(new_ptr, ptr, header->size < size ? header->size : size);
+        mempool_free(ptr);
+    }
+    return new_ptr;
+}
+
+void mempool_free(void *ptr)
+{
+    struct block_header *header;
+
+    if (ptr == NULL)
+        return;
+
+    header = (struct block_header *)ptr - 1;
+    if (header->magic != BLOCK_MAGIC) {
+        OS_LOGF(LOG_TAG, "Invalid block[%p], not allocated by mempool?", ptr);
+        return;
+    }
+
+    if (header->cls == LARGE_CLASS) {
+        __atomic_sub_fetch(&g_large_count, 1, __ATOMIC_RELAXED);
+        __atomic_sub_fetch(&g_large_bytes, header->size, __ATOMIC_RELAXED);
+        header->magic = 0;
+        free(header);
+        return;
+    }
+
+    mempool_small_free(header->cls, ptr);
+}
+
+char *mempool_strdup(const char *str)
+{
+    size_t len;
+    char *ptr;
+
+    if (str == NULL)
+        return NULL;
+
+    len = strlen(str);
+    ptr = mempool_malloc(len + 1);
+    if (ptr != NULL)
+        memcpy(ptr, str, len + 1);
+    return ptr;
+}
+
+void mempool_thread_flush()
+{
+#if defined(MEMPOOL_THREAD_CACHE)
+    if (t_cache != NULL)
+        mempool_cache_flush(t_cache);
+#endif
+}
+
+void mempool_get_stats(struct mempool_stats *stats)
+{
+    memset(stats, 0x0, sizeof(struct mempool_stats));
+
+    for (int i = 0; i < MEMPOOL_CLASS_COUNT; i++)
+        stats->classes[i].size = g_class_size[i];
+
+    if (mempool_init() != NULL) {
+        for (int i = 0; i < MEMPOOL_CLASS_COUNT; i++) {
+            struct central_list *list = &g_central[i];
+            struct mempool_class_stats *cls = &stats->classes[i];
+
+            OS_THREAD_MUTEX_LOCK(list->mutex);
+            cls->span_bytes = list->span_bytes;
+            cls->total_blocks = list->total_blocks;
+            cls->central_free = list->free_count;
+            OS_THREAD_MUTEX_UNLOCK(list->mutex);
+
+            cls->fetch_count = __atomic_load_n(&list->fetch_count, __ATOMIC_RELAXED);
+            cls->release_count = __atomic_load_n(&list->release_count, __ATOMIC_RELAXED);
+        }
+    }
+
+#if defined(MEMPOOL_THREAD_CACHE)
+    {
+        struct listnode *item;
+
+        OS_THREAD_MUTEX_LOCK(g_caches_mutex);
+        list_for_each(item, &g_caches) {
+            struct thread_cache *cache = node_to_item(item, struct thread_cache, listnode);
+            for (int i = 0; i < MEMPOOL_CLASS_COUNT; i++)
+                stats->classes[i].thread_cached += __atomic_load_n(&cache->lists[i].count, __ATOMIC_RELAXED);
+        }
+        OS_THREAD_MUTEX_UNLOCK(g_caches_mutex);
+    }
+#endif
+
+    stats->large_count = __atomic_load_n(&g_large_count, __ATOMIC_RELAXED);
+    stats->large_bytes = __atomic_load_n(&g_large_bytes, __ATOMIC_RELAXED);
+}
+
+void mempool_dump()
+{
+    struct mempool_stats stats;
+    size_t span_bytes = 0;
+
+    mempool_get_stats(&stats);
+
+    OS_LOGW(LOG_TAG, ">>");
+    OS_LOGW(LOG_TAG, "++++++++++++++++++++ MEMORY POOL ++++++++++++++++++++");
+
+    for (int i = 0; i < MEMPOOL_CLASS_COUNT; i++) {
+        struct mempool_class_stats *cls = &stats.classes[i];
+        if (cls->total_blocks == 0)
+            continue;
+        span_bytes += cls->span_bytes;
+        OS_LOGW(LOG_TAG, "> class [%lu]: in use [%lu], central free [%lu], thread cached [%lu], fetch/release [%lu/%lu] batches",
+                (unsigned long)cls->size,
+                (unsigned long)(cls->total_blocks - cls->central_free - cls->thread_cached),
+                (unsigned long)cls->central_free, (unsigned long)cls->thread_cached,
+                (unsigned long)cls->fetch_count, (unsigned long)cls->release_count);
+    }
+
+    OS_LOGW(LOG_TAG, "Summary: spans [%lu] Bytes, large [%lu] blocks in [%lu] Bytes",
+            (unsigned long)span_bytes, (unsigned long)stats.large_count, (unsigned long)stats.large_bytes);
+    OS_LOGW(LOG_TAG, "-------------------- MEMORY POOL --------------------");
+    OS_LOGW(LOG_TAG, "<<");
+}
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <stdint.h>
 #include <stdbool.h>
 #include "cutils/common_list.h"
 #include "cutils/os_thread.h"
@@ -28,6 +29,25 @@
 #define MEMORY_BOUNDARY_SIZE    8
 #define MEMORY_BOUNDARY_FLAG    '*'
 
+#define MEMORY_BUCKET_BITS      16
+#define MEMORY_BUCKET_COUNT     (1 << MEMORY_BUCKET_BITS)
+#define MEMORY_STRIPE_COUNT     64  // bucket i is guarded by stripe (i % MEMORY_STRIPE_COUNT)
+#define MEMORY_SLAB_NODES       256 // mem_node count allocated from system at a time
+#define MEMORY_SITE_BUCKETS     4096
+
+// statistics of a call site, never freed, counters are updated atomically
+struct mem_site {
+    const char *file;
+    const char *func;
+    int line;
+    size_t live_bytes;
+    size_t live_count;
+    size_t total_bytes;
+    size_t total_count;
+    size_t peak_bytes;
+    struct mem_site *next;
+};
+
 struct mem_node {
     void *ptr;
     size_t size;
@@ -35,18 +55,33 @@ struct mem_node {
     const char *func;
     int line;
     struct os_realtime when;
-    struct listnode listnode;
+    unsigned long long seq;  // allocation order, dump in this order
+    struct mem_site *site;
+    struct mem_node *next;   // hash chain, or slab free list
+};
+
+struct mem_stripe {
+    os_mutex_t mutex;
+    struct mem_node *free_nodes; // slab of unused mem_node
 };
 
 struct mem_info {
-    struct listnode list;
+    // live blocks keyed by pointer, a node is always allocated from and
+    // returned to the slab of the stripe guarding its bucket
+    struct mem_node *buckets[MEMORY_BUCKET_COUNT];
+    struct mem_stripe stripes[MEMORY_STRIPE_COUNT];
+
+    // call sites, chains are read without lock and only inserted under site_mutex
+    struct mem_site *sites[MEMORY_SITE_BUCKETS];
+    size_t site_count;
+    os_mutex_t site_mutex;
 
+    // updated atomically
     long malloc_count;
     long free_count;
     size_t cur_used;
     size_t max_used;
-
-    os_mutex_t mutex;
+    unsigned long long seq;
 };
 
 OS_MUTEX_DECLARE(g_meminfo_mutex);
@@ -59,6 +94,10 @@ void memory_debug_free(void *ptr, const char *file, const char *func, int line,
 char *memory_debug_strdup(const char *str, const char *file, const char *func, int line, bool overflow_detect);
 char *memory_strdup(const char *str);
 void memory_debug_dump(bool overflow_detect);
+struct mem_snapshot *memory_debug_snapshot();
+struct mem_snapshot *memory_debug_snapshot_diff(const struct mem_snapshot *prev, const struct mem_snapshot *cur);
+void memory_debug_snapshot_free(struct mem_snapshot *snapshot);
+void memory_debug_snapshot_dump(const struct mem_snapshot *snapshot, size_t max_sites);
 
 static char *file_name(const char *filepath)
 {
@@ -160,16 +199,23 @@ static struct mem_info *memory_debug_init()
                 return NULL;
             }
 
-            g_meminfo->mutex = OS_THREAD_MUTEX_CREATE();
-            if (g_meminfo->mutex == NULL) {
-                OS_LOGE(LOG_TAG, "Failed to alloc mem_mutex, abort memory debug");
+            g_meminfo->site_mutex = OS_THREAD_MUTEX_CREATE();
+            if (g_meminfo->site_mutex == NULL) {
+                OS_LOGE(LOG_TAG, "Failed to alloc site_mutex, abort memory debug");
                 goto error;
             }
 
+            for (int i = 0; i < MEMORY_STRIPE_COUNT; i++) {
+                g_meminfo->stripes[i].mutex = OS_THREAD_MUTEX_CREATE();
+                if (g_meminfo->stripes[i].mutex == NULL) {
+                    OS_LOGE(LOG_TAG, "Failed to alloc mem_mutex, abort memory debug");
+                    goto error;
+                }
+            }
+
             g_meminfo->malloc_count = 0;
             g_meminfo->free_count = 0;
             g_meminfo->max_used = 0;
-            list_init(&g_meminfo->list);
         }
 
         if (g_meminfo_mutex != NULL)
@@ -179,8 +225,13 @@ static struct mem_info *memory_debug_init()
     return g_meminfo;
 
 error:
-    if (g_meminfo->mutex != NULL)
-        OS_THREAD_MUTEX_DESTROY(g_meminfo->mutex);
+    for (int i = 0; i < MEMORY_STRIPE_COUNT; i++) {
+        if (g_meminfo->stripes[i].mutex != NULL)
+            OS_THREAD_MUTEX_DESTROY(g_meminfo->stripes[i].mutex);
+    }
+
+    if (g_meminfo->site_mutex != NULL)
+        OS_THREAD_MUTEX_DESTROY(g_meminfo->site_mutex);
 
     free(g_meminfo);
     g_meminfo = NULL;
@@ -190,6 +241,129 @@ error:
     return NULL;
 }
 
+static unsigned int memory_bucket(void *ptr)
+{
+    return (unsigned int)(((unsigned long long)(uintptr_t)ptr * 0x9E3779B97F4A7C15ULL) >> (64 - MEMORY_BUCKET_BITS));
+}
+
+static struct mem_stripe *memory_stripe(struct mem_info *info, unsigned int bucket)
+{
+    return &info->stripes[bucket % MEMORY_STRIPE_COUNT];
+}
+
+static struct mem_node *memory_node_alloc_l(struct mem_stripe *stripe)
+{
+    struct mem_node *node = stripe->free_nodes;
+
+    if (node == NULL) {
+        // slab chunks are never returned to system
+        struct mem_node *slab = malloc(sizeof(struct mem_node) * MEMORY_SLAB_NODES);
+        if (slab == NULL)
+            return NULL;
+        for (int i = 1; i < MEMORY_SLAB_NODES - 1; i++)
+            slab[i].next = &slab[i + 1];
+        slab[MEMORY_SLAB_NODES - 1].next = NULL;
+        stripe->free_nodes = &slab[1];
+        return &slab[0];
+    }
+
+    stripe->free_nodes = node->next;
+    return node;
+}
+
+static void memory_node_free_l(struct mem_stripe *stripe, struct mem_node *node)
+{
+    node->next = stripe->free_nodes;
+    stripe->free_nodes = node;
+}
+
+// remove node of ptr from hash, caller must return it to the stripe slab
+static struct mem_node *memory_node_remove_l(struct mem_info *info, unsigned int bucket, void *ptr)
+{
+    struct mem_node **pnode, *node;
+
+    for (pnode = &info->buckets[bucket]; *pnode != NULL; pnode = &(*pnode)->next) {
+        if ((*pnode)->ptr == ptr) {
+            node = *pnode;
+            *pnode = node->next;
+            return node;
+        }
+    }
+    return NULL;
+}
+
+static struct mem_node *memory_node_find_l(struct mem_info *info, unsigned int bucket, void *ptr)
+{
+    struct mem_node *node;
+
+    for (node = info->buckets[bucket]; node != NULL; node = node->next) {
+        if (node->ptr == ptr)
+            return node;
+    }
+    return NULL;
+}
+
+static size_t memory_atomic_max(size_t *target, size_t value)
+{
+    size_t max = __atomic_load_n(target, __ATOMIC_RELAXED);
+
+    while (value > max) {
+        if (__atomic_compare_exchange_n(target, &max, value, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+    }
+    return max;
+}
+
+static struct mem_site *memory_site_find(struct mem_info *info, const char *file, const char *func, int line)
+{
+    unsigned int idx = (unsigned int)((((uintptr_t)file >> 3) ^ (unsigned int)line * 2654435761U) % MEMORY_SITE_BUCKETS);
+    struct mem_site *site;
+
+    // fast path: site already exists, __FILE__/__FUNCTION__ are compared by address
+    for (site = __atomic_load_n(&info->sites[idx], __ATOMIC_ACQUIRE); site != NULL; site = site->next) {
+        if (site->line == line && site->file == file && site->func == func)
+            return site;
+    }
+
+    OS_THREAD_MUTEX_LOCK(info->site_mutex);
+
+    for (site = info->sites[idx]; site != NULL; site = site->next) {
+        if (site->line == line && site->file == file && site->func == func)
+            break;
+    }
+
+    if (site == NULL) {
+        site = calloc(1, sizeof(struct mem_site));
+        if (site != NULL) {
+            site->file = file;
+            site->func = func;
+            site->line = line;
+            site->next = info->sites[idx];
+            __atomic_store_n(&info->sites[idx], site, __ATOMIC_RELEASE);
+            info->site_count++;
+        }
+    }
+
+    OS_THREAD_MUTEX_UNLOCK(info->site_mutex);
+    return site;
+}
+
+static void memory_site_add(struct mem_site *site, size_t size)
+{
+    size_t live = __atomic_add_fetch(&site->live_bytes, size, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&site->live_count, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&site->total_bytes, size, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&site->total_count, 1, __ATOMIC_RELAXED);
+    memory_atomic_max(&site->peak_bytes, live);
+}
+
+static void memory_site_sub(struct mem_site *site, size_t size)
+{
+    __atomic_sub_fetch(&site->live_bytes, size, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&site->live_count, 1, __ATOMIC_RELAXED);
+}
+
 void *memory_debug_malloc(size_t size, const char *file, const char *func, int line, bool overflow_detect)
 {
     void *ptr;
@@ -207,26 +381,38 @@ void *memory_debug_malloc(size_t size, const char *file, const char *func, int l
     }
 
     if (info != NULL) {
-        node = malloc(sizeof(struct mem_node));
+        unsigned int bucket = memory_bucket(ptr);
+        struct mem_stripe *stripe = memory_stripe(info, bucket);
+        struct mem_site *site = memory_site_find(info, file, func, line);
+        struct os_realtime when;
+
+        OS_TIMESTAMP_TO_LOCAL(&when);
+
+        OS_THREAD_MUTEX_LOCK(stripe->mutex);
+
+        node = memory_node_alloc_l(stripe);
         if (node != NULL) {
             node->ptr = ptr;
             node->size = size;
             node->file = file;
             node->func = func;
             node->line = line;
-            OS_TIMESTAMP_TO_LOCAL(&node->when);
+            node->when = when;
+            node->site = site;
+            node->seq = __atomic_fetch_add(&info->seq, 1, __ATOMIC_RELAXED);
+            node->next = info->buckets[bucket];
+            info->buckets[bucket] = node;
 
             //memory_node_print(node, "Malloc");
+        }
 
-            OS_THREAD_MUTEX_LOCK(info->mutex);
+        OS_THREAD_MUTEX_UNLOCK(stripe->mutex);
 
-            list_add_tail(&info->list, &node->listnode);
-            info->malloc_count++;
-            info->cur_used += size;
-            if (info->cur_used > info->max_used)
-                info->max_used = info->cur_used;
-
-            OS_THREAD_MUTEX_UNLOCK(info->mutex);
+        if (node != NULL) {
+            __atomic_add_fetch(&info->malloc_count, 1, __ATOMIC_RELAXED);
+            memory_atomic_max(&info->max_used, __atomic_add_fetch(&info->cur_used, size, __ATOMIC_RELAXED));
+            if (site != NULL)
+                memory_site_add(site, size);
         }
     }
 
@@ -244,7 +430,6 @@ void *memory_debug_calloc(size_t n, size_t size, const char *file, const char *f
 void *memory_debug_realloc(void *ptr, size_t size, const char *file, const char *func, int line, bool overflow_detect)
 {
     struct mem_info *info;
-    struct listnode *item;
 
     if (ptr == NULL) {
         if (size > 0)
@@ -261,28 +446,28 @@ void *memory_debug_realloc(void *ptr, size_t size, const char *file, const char
     info = memory_debug_init();
 
     if (info != NULL) {
+        unsigned int bucket = memory_bucket(ptr);
+        struct mem_stripe *stripe = memory_stripe(info, bucket);
+        struct mem_node *node;
         void *prev_ptr = NULL;
         size_t prev_size = 0;
 
-        OS_THREAD_MUTEX_LOCK(info->mutex);
+        OS_THREAD_MUTEX_LOCK(stripe->mutex);
 
-        list_for_each_reverse(item, &info->list) {
-            struct mem_node *node = node_to_item(item, struct mem_node, listnode);
-            if (node->ptr == ptr) {
-                prev_ptr = node->ptr;
-                prev_size = node->size;
-                break;
-            }
+        node = memory_node_find_l(info, bucket, ptr);
+        if (node != NULL) {
+            prev_ptr = node->ptr;
+            prev_size = node->size;
         }
 
+        OS_THREAD_MUTEX_UNLOCK(stripe->mutex);
+
         if (prev_ptr == NULL) {
             OS_LOGF(LOG_TAG, "%s:%s:%d: failed to find ptr[%p] in list, abort realloc",
                    file_name(file), func, line, ptr);
             return NULL;
         }
 
-        OS_THREAD_MUTEX_UNLOCK(info->mutex);
-
         if (size > prev_size) {
             void *new_ptr = memory_debug_malloc(size, file, func, line, overflow_detect);
             if (new_ptr != NULL)
@@ -311,40 +496,34 @@ void *memory_debug_realloc(void *ptr, size_t size, const char *file, const char
 void memory_debug_free(void *ptr, const char *file, const char *func, int line, bool overflow_detect)
 {
     struct mem_info *info = memory_debug_init();
-    struct listnode *item;
 
     if (info != NULL) {
+        unsigned int bucket = memory_bucket(ptr);
+        struct mem_stripe *stripe = memory_stripe(info, bucket);
         struct mem_node *node;
-        bool found = false;
 
-        OS_THREAD_MUTEX_LOCK(info->mutex);
+        OS_THREAD_MUTEX_LOCK(stripe->mutex);
 
-        list_for_each_reverse(item, &info->list) {
-            node = node_to_item(item, struct mem_node, listnode);
-            if (node->ptr == ptr) {
-                found = true;
-                break;
-            }
-        }
-
-        if (found) {
+        node = memory_node_remove_l(info, bucket, ptr);
+        if (node != NULL) {
             if (overflow_detect)
                 memory_boundary_verify(node);
 
             //memory_node_print(node, "Free");
 
-            info->free_count++;
-            info->cur_used -= node->size;
+            __atomic_add_fetch(&info->free_count, 1, __ATOMIC_RELAXED);
+            __atomic_sub_fetch(&info->cur_used, node->size, __ATOMIC_RELAXED);
+            if (node->site != NULL)
+                memory_site_sub(node->site, node->size);
 
-            list_remove(item);
-            free(node);
+            memory_node_free_l(stripe, node);
         }
         else {
             OS_LOGF(LOG_TAG, "%s:%s:%d: failed to find ptr[%p] in list, double free?",
                    file_name(file), func, line, ptr);
         }
 
-        OS_THREAD_MUTEX_UNLOCK(info->mutex);
+        OS_THREAD_MUTEX_UNLOCK(stripe->mutex);
     }
 
     // free memory
@@ -387,35 +566,609 @@ char *memory_strdup(const char *str)
     return ptr;
 }
 
+static int memory_node_compare(const void *a, const void *b)
+{
+    const struct mem_node *na = *(const struct mem_node **)a;
+    const struct mem_node *nb = *(const struct mem_node **)b;
+    return na->seq < nb->seq ? -1 : (na->seq > nb->seq ? 1 : 0);
+}
+
 void memory_debug_dump(bool overflow_detect)
 {
     struct mem_info *info  = memory_debug_init();
-    struct mem_node *node;
-    struct listnode *item;
+    struct mem_node *node, **nodes;
+    size_t count = 0, capacity;
 
     if (info != NULL) {
         OS_LOGW(LOG_TAG, ">>");
         OS_LOGW(LOG_TAG, "++++++++++++++++++++ MEMORY DEBUG ++++++++++++++++++++");
 
-        OS_THREAD_MUTEX_LOCK(info->mutex);
+        for (int i = 0; i < MEMORY_STRIPE_COUNT; i++)
+            OS_THREAD_MUTEX_LOCK(info->stripes[i].mutex);
 
-        list_for_each(item, &info->list) {
-            node = node_to_item(item, struct mem_node, listnode);
-            memory_node_print(node, "Dump");
-            if (overflow_detect)
-                memory_boundary_verify(node);
+        // print in allocation order, same as the list it used to be
+        capacity = 0;
+        for (int i = 0; i < MEMORY_BUCKET_COUNT; i++) {
+            for (node = info->buckets[i]; node != NULL; node = node->next)
+                capacity++;
+        }
+        nodes = malloc(sizeof(struct mem_node *) * (capacity + 1));
+        if (nodes != NULL) {
+            for (int i = 0; i < MEMORY_BUCKET_COUNT; i++) {
+                for (node = info->buckets[i]; node != NULL; node = node->next)
+                    nodes[count++] = node;
+            }
+            qsort(nodes, count, sizeof(struct mem_node *), memory_node_compare);
+
+            for (size_t i = 0; i < count; i++) {
+                memory_node_print(nodes[i], "Dump");
+                if (overflow_detect)
+                    memory_boundary_verify(nodes[i]);
+            }
+            free(nodes);
         }
 
         OS_LOGW(LOG_TAG, "Summary: malloc [%ld] blocks, free [%ld] blocks, current use [%lu] Bytes, max use [%lu] Bytes",
                 info->malloc_count, info->free_count, (unsigned long)info->cur_used, (unsigned long)info->max_used);
 
-        OS_THREAD_MUTEX_UNLOCK(info->mutex);
+        for (int i = MEMORY_STRIPE_COUNT - 1; i >= 0; i--)
+            OS_THREAD_MUTEX_UNLOCK(info->stripes[i].mutex);
 
         OS_LOGW(LOG_TAG, "-------------------- MEMORY DEBUG --------------------");
         OS_LOGW(LOG_TAG, "<<");
     }
 }
 
+static int memory_site_stat_compare(const void *a, const void *b)
+{
+    const struct mem_site_stat *sa = (const struct mem_site_stat *)a;
+    const struct mem_site_stat *sb = (const struct mem_site_stat *)b;
+
+    if (sa->live_bytes != sb->live_bytes)
+        return sa->live_bytes < sb->live_bytes ? 1 : -1;
+    return sa->total_count < sb->total_count ? 1 : (sa->total_count > sb->total_count ? -1 : 0);
+}
+
+struct mem_snapshot *memory_debug_snapshot()
+{
+    struct mem_info *info = memory_debug_init();
+    struct mem_snapshot *snapshot;
+    struct mem_site *site;
+    size_t count = 0;
+
+    if (info == NULL)
+        return NULL;
+
+    OS_THREAD_MUTEX_LOCK(info->site_mutex);
+
+    snapshot = malloc(sizeof(struct mem_snapshot) + sizeof(struct mem_site_stat) * info->site_count);
+    if (snapshot == NULL) {
+        OS_THREAD_MUTEX_UNLOCK(info->site_mutex);
+        return NULL;
+    }
+
+    for (int i = 0; i < MEMORY_SITE_BUCKETS; i++) {
+        for (site = info->sites[i]; site != NULL; site = site->next) {
+            struct mem_site_stat *stat = &snapshot->sites[count++];
+            stat->file = file_name(site->file);
+            stat->func = site->func;
+            stat->line = site->line;
+            stat->live_bytes = (long long)__atomic_load_n(&site->live_bytes, __ATOMIC_RELAXED);
+            stat->live_count = (long long)__atomic_load_n(&site->live_count, __ATOMIC_RELAXED);
+            stat->total_bytes = (long long)__atomic_load_n(&site->total_bytes, __ATOMIC_RELAXED);
+            stat->total_count = (long long)__atomic_load_n(&site->total_count, __ATOMIC_RELAXED);
+            stat->peak_bytes = (long long)__atomic_load_n(&site->peak_bytes, __ATOMIC_RELAXED);
+        }
+    }
+
+    OS_THREAD_MUTEX_UNLOCK(info->site_mutex);
+
+    snapshot->time_ms = OS_MONOTONIC_USEC() / 1000;
+    snapshot->site_count = count;
+    snapshot->cur_used = (long long)__atomic_load_n(&info->cur_used, __ATOMIC_RELAXED);
+    snapshot->max_used = (long long)__atomic_load_n(&info->max_used, __ATOMIC_RELAXED);
+    qsort(snapshot->sites, count, sizeof(struct mem_site_stat), memory_site_stat_compare);
+    return snapshot;
+}
+
+struct mem_snapshot *memory_debug_snapshot_diff(const struct mem_snapshot *prev, const struct mem_snapshot *cur)
+{
+    struct mem_snapshot *diff;
+    size_t count = 0;
+
+    if (prev == NULL || cur == NULL)
+        return NULL;
+
+    // sites are never removed, so every site of prev is in cur
+    diff = malloc(sizeof(struct mem_snapshot) + sizeof(struct mem_site_stat) * cur->site_count);
+    if (diff == NULL)
+        return NULL;
+
+    for (size_t i = 0; i < cur->site_count; i++) {
+        const struct mem_site_stat *c = &cur->sites[i];
+        struct mem_site_stat *d = &diff->sites[count];
+
+        *d = *c;
+        for (size_t j = 0; j < prev->site_count; j++) {
+            const struct mem_site_stat *p = &prev->sites[j];
+            if (p->line == c->line && p->func == c->func && p->file == c->file) {
+                d->live_bytes -= p->live_bytes;
+                d->live_count -= p->live_count;
+                d->total_bytes -= p->total_bytes;
+                d->total_count -= p->total_count;
+                d->peak_bytes -= p->peak_bytes;
+                break;
+            }
+        }
+
+        // drop the sites that didn't change
+        if (d->live_bytes != 0 || d->live_count != 0 || d->total_count != 0)
+            count++;
+    }
+
+    diff->time_ms = cur->time_ms - prev->time_ms;
+    diff->site_count = count;
+    diff->cur_used = cur->cur_used - prev->cur_used;
+    diff->max_used = cur->max_used - prev->max_used;
+    qsort(diff->sites, count, sizeof(struct mem_site_stat), memory_site_stat_compare);
+    return diff;
+}
+
+void memory_debug_snapshot_free(struct mem_snapshot *snapshot)
+{
+    free(snapshot);
+}
+
+void memory_debug_snapshot_dump(const struct mem_snapshot *snapshot, size_t max_sites)
+{
+    if (snapshot == NULL)
+        return;
+
+    OS_LOGW(LOG_TAG, ">>");
+    OS_LOGW(LOG_TAG, "++++++++++++++++++++ MEMORY SITES ++++++++++++++++++++");
+
+    for (size_t i = 0; i < snapshot->site_count && (max_sites == 0 || i < max_sites); i++) {
+        const struct mem_site_stat *stat = &snapshot->sites[i];
+        OS_LOGW(LOG_TAG, "> [%s:%s:%d]: live [%lld] Bytes in [%lld] blocks, total [%lld] Bytes in [%lld] blocks, peak [%lld] Bytes",
+                stat->file, stat->func, stat->line, stat->live_bytes, stat->live_count,
+                stat->total_bytes, stat->total_count, stat->peak_bytes);
+    }
+
+    OS_LOGW(LOG_TAG, "Summary: [%lu] call sites, current use [%lld] Bytes, max use [%lld] Bytes",
+            (unsigned long)snapshot->site_count, snapshot->cur_used, snapshot->max_used);
+    OS_LOGW(LOG_TAG, "-------------------- MEMORY SITES --------------------");
+    OS_LOGW(LOG_TAG, "<<");
+}
+
+// ---------------------------------------------------------------------------
+
+#ifndef MEMORY_SAMPLE_INTERVAL
+#define MEMORY_SAMPLE_INTERVAL  (512 * 1024)
+#endif
+
+#define SAMPLE_BUCKET_BITS      12
+#define SAMPLE_BUCKET_COUNT     (1 << SAMPLE_BUCKET_BITS)
+#define SAMPLE_STRIPE_COUNT     64 // bucket i is guarded by stripe (i % SAMPLE_STRIPE_COUNT)
+#define SAMPLE_SITE_COUNT       1024
+
+#if defined(OS_FREERTOS)
+#define SAMPLE_TLS
+#else
+#define SAMPLE_TLS __thread
+#endif
+
+struct sample_site {
+    const char *file;
+    const char *func;
+    int line;
+    // estimated by scaling up samples, updated atomically
+    unsigned long long alloc_count;
+    unsigned long long alloc_bytes;
+    unsigned long long live_count;
+    unsigned long long live_bytes;
+    struct sample_site *next;
+};
+
+struct sample_node {
+    void *ptr;
+    size_t size;
+    unsigned long long weight; // estimated bytes this sample stands for
+    unsigned long long count;  // estimated blocks this sample stands for
+    struct sample_site *site;
+    struct sample_node *next;
+};
+
+struct sample_info {
+    // live samples keyed by pointer, bucket head is read atomically by free
+    struct sample_node *buckets[SAMPLE_BUCKET_COUNT];
+    os_mutex_t stripes[SAMPLE_STRIPE_COUNT];
+
+    // call sites, never freed
+    struct sample_site *sites[SAMPLE_SITE_COUNT];
+    unsigned int site_count;
+    os_mutex_t site_mutex;
+
+    size_t interval;
+};
+
+struct sample_state {
+    long long countdown; // bytes until next sample
+    unsigned long long seed;
+    bool init;
+};
+
+OS_MUTEX_DECLARE(g_sampleinfo_mutex);
+static struct sample_info *g_sampleinfo = NULL;
+static size_t g_sample_interval = MEMORY_SAMPLE_INTERVAL;
+static SAMPLE_TLS struct sample_state t_sampler;
+
+void *memory_sample_malloc(size_t size, const char *file, const char *func, int line);
+void *memory_sample_calloc(size_t n, size_t size, const char *file, const char *func, int line);
+void *memory_sample_realloc(void *ptr, size_t size, const char *file, const char *func, int line);
+void memory_sample_free(void *ptr);
+char *memory_sample_strdup(const char *str, const char *file, const char *func, int line);
+void memory_sample_set_interval(size_t bytes);
+void memory_sample_dump();
+
+static struct sample_info *memory_sample_init()
+{
+    struct sample_info *info;
+
+    if (g_sampleinfo == NULL) {
+        if (g_sampleinfo_mutex != NULL)
+            OS_THREAD_MUTEX_LOCK(g_sampleinfo_mutex);
+
+        if (g_sampleinfo == NULL) {
+            info = calloc(1, sizeof(struct sample_info));
+            if (info == NULL) {
+                OS_LOGE(LOG_TAG, "Failed to alloc sample_info, abort memory sampling");
+                if (g_sampleinfo_mutex != NULL)
+                    OS_THREAD_MUTEX_UNLOCK(g_sampleinfo_mutex);
+                return NULL;
+            }
+
+            info->site_mutex = OS_THREAD_MUTEX_CREATE();
+            if (info->site_mutex == NULL) {
+                OS_LOGE(LOG_TAG, "Failed to alloc site_mutex, abort memory sampling");
+                goto error;
+            }
+
+            for (int i = 0; i < SAMPLE_STRIPE_COUNT; i++) {
+                info->stripes[i] = OS_THREAD_MUTEX_CREATE();
+                if (info->stripes[i] == NULL) {
+                    OS_LOGE(LOG_TAG, "Failed to alloc stripe mutex, abort memory sampling");
+                    goto error;
+                }
+            }
+
+            info->interval = g_sample_interval;
+            // free() checks g_sampleinfo without lock
+            __atomic_store_n(&g_sampleinfo, info, __ATOMIC_RELEASE);
+        }
+
+        if (g_sampleinfo_mutex != NULL)
+            OS_THREAD_MUTEX_UNLOCK(g_sampleinfo_mutex);
+    }
+
+    return g_sampleinfo;
+
+error:
+    for (int i = 0; i < SAMPLE_STRIPE_COUNT; i++) {
+        if (info->stripes[i] != NULL)
+            OS_THREAD_MUTEX_DESTROY(info->stripes[i]);
+    }
+
+    if (info->site_mutex != NULL)
+        OS_THREAD_MUTEX_DESTROY(info->site_mutex);
+
+    free(info);
+
+    if (g_sampleinfo_mutex != NULL)
+        OS_THREAD_MUTEX_UNLOCK(g_sampleinfo_mutex);
+    return NULL;
+}
+
+static unsigned int sample_bucket(void *ptr)
+{
+    return (unsigned int)(((unsigned long long)(uintptr_t)ptr * 0x9E3779B97F4A7C15ULL) >> (64 - SAMPLE_BUCKET_BITS));
+}
+
+static unsigned long long sample_random()
+{
+    // xorshift64*
+    unsigned long long x = t_sampler.seed;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    t_sampler.seed = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+// ln(x) for x >= 1, avoids libm on embedded targets: x = 2^k * m, m in [1, 2)
+static double sample_log(double x)
+{
+    double z, z2, sum;
+    int k = 0;
+
+    while (x >= 2.0) {
+        x *= 0.5;
+        k++;
+    }
+    // ln(m) = 2 * atanh((m - 1) / (m + 1)), z <= 1/3
+    z = (x - 1.0) / (x + 1.0);
+    z2 = z * z;
+    sum = z * (1.0 + z2 * (1.0 / 3 + z2 * (1.0 / 5 + z2 * (1.0 / 7 + z2 * (1.0 / 9 + z2 / 11)))));
+    return 2.0 * sum + k * 0.69314718055994531;
+}
+
+// e^(-x) for x >= 0
+static double sample_exp_neg(double x)
+{
+    double r = 1.0, term = 1.0, frac;
+    int n;
+
+    if (x > 40.0)
+        return 0.0;
+    n = (int)x;
+    frac = x - n;
+    for (int i = 1; i <= 12; i++) {
+        term *= -frac / i;
+        r += term;
+    }
+    while (n-- > 0)
+        r *= 0.36787944117144233;
+    return r;
+}
+
+static void sample_rearm()
+{
+    // exponential distributed interval, so every byte has the same chance to be sampled:
+    // -ln(U) * interval, where U = r / 2^53 in (0, 1]
+    unsigned long long r = (sample_random() >> 11) + 1;
+    double interval = (double)__atomic_load_n(&g_sample_interval, __ATOMIC_RELAXED);
+    t_sampler.countdown = (long long)((53 * 0.69314718055994531 - sample_log((double)r)) * interval) + 1;
+}
+
+static bool memory_sample_should(size_t size)
+{
+    t_sampler.countdown -= (long long)size;
+    if (t_sampler.countdown > 0)
+        return false;
+
+    if (!t_sampler.init) {
+        t_sampler.seed = (unsigned long long)(uintptr_t)&t_sampler ^ OS_MONOTONIC_USEC();
+        if (t_sampler.seed == 0)
+            t_sampler.seed = 0x9E3779B97F4A7C15ULL;
+        t_sampler.init = true;
+        sample_rearm();
+        return false;
+    }
+
+    sample_rearm();
+    return true;
+}
+
+static struct sample_site *memory_sample_site(struct sample_info *info, const char *file, const char *func, int line)
+{
+    unsigned int idx = (unsigned int)((((uintptr_t)file >> 3) ^ (unsigned int)line * 2654435761U) % SAMPLE_SITE_COUNT);
+    struct sample_site *site;
+
+    OS_THREAD_MUTEX_LOCK(info->site_mutex);
+
+    for (site = info->sites[idx]; site != NULL; site = site->next) {
+        if (site->line == line && site->file == file && site->func == func)
+            break;
+    }
+
+    if (site == NULL) {
+        site = calloc(1, sizeof(struct sample_site));
+        if (site != NULL) {
+            site->file = file;
+            site->func = func;
+            site->line = line;
+            site->next = info->sites[idx];
+            info->sites[idx] = site;
+            info->site_count++;
+        }
+    }
+
+    OS_THREAD_MUTEX_UNLOCK(info->site_mutex);
+    return site;
+}
+
+static void memory_sample_record(void *ptr, size_t size, const char *file, const char *func, int line)
+{
+    struct sample_info *info = memory_sample_init();
+    struct sample_node *node;
+    unsigned int idx;
+    double p;
+
+    if (info == NULL || size == 0)
+        return;
+
+    node = malloc(sizeof(struct sample_node));
+    if (node == NULL)
+        return;
+
+    node->site = memory_sample_site(info, file, func, line);
+    if (node->site == NULL) {
+        free(node);
+        return;
+    }
+
+    // an allocation of size is sampled with probability 1 - e^(-size/interval)
+    p = 1.0 - sample_exp_neg((double)size / info->interval);
+    node->ptr = ptr;
+    node->size = size;
+    node->weight = (unsigned long long)(size / p);
+    node->count = (unsigned long long)(1.0 / p + 0.5);
+
+    __atomic_add_fetch(&node->site->alloc_count, node->count, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&node->site->alloc_bytes, node->weight, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&node->site->live_count, node->count, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&node->site->live_bytes, node->weight, __ATOMIC_RELAXED);
+
+    idx = sample_bucket(ptr);
+    OS_THREAD_MUTEX_LOCK(info->stripes[idx % SAMPLE_STRIPE_COUNT]);
+    node->next = info->buckets[idx];
+    __atomic_store_n(&info->buckets[idx], node, __ATOMIC_RELEASE);
+    OS_THREAD_MUTEX_UNLOCK(info->stripes[idx % SAMPLE_STRIPE_COUNT]);
+}
+
+static void memory_sample_untrack(void *ptr)
+{
+    struct sample_info *info = __atomic_load_n(&g_sampleinfo, __ATOMIC_ACQUIRE);
+    struct sample_node **pnode, *node = NULL;
+    unsigned int idx;
+
+    if (info == NULL)
+        return;
+
+    // fast path: most buckets are empty as only a few allocations are sampled
+    idx = sample_bucket(ptr);
+    if (__atomic_load_n(&info->buckets[idx], __ATOMIC_ACQUIRE) == NULL)
+        return;
+
+    OS_THREAD_MUTEX_LOCK(info->stripes[idx % SAMPLE_STRIPE_COUNT]);
+    for (pnode = &info->buckets[idx]; *pnode != NULL; pnode = &(*pnode)->next) {
+        if ((*pnode)->ptr == ptr) {
+            node = *pnode;
+            __atomic_store_n(pnode, node->next, __ATOMIC_RELEASE);
+            break;
+        }
+    }
+    OS_THREAD_MUTEX_UNLOCK(info->stripes[idx % SAMPLE_STRIPE_COUNT]);
+
+    if (node != NULL) {
+        __atomic_sub_fetch(&node->site->live_count, node->count, __ATOMIC_RELAXED);
+        __atomic_sub_fetch(&node->site->live_bytes, node->weight, __ATOMIC_RELAXED);
+        free(node);
+    }
+}
+
+void *memory_sample_malloc(size_t size, const char *file, const char *func, int line)
+{
+    void *ptr = malloc(size);
+    if (ptr != NULL && memory_sample_should(size))
+        memory_sample_record(ptr, size, file, func, line);
+    return ptr;
+}
+
+void *memory_sample_calloc(size_t n, size_t size, const char *file, const char *func, int line)
+{
+    void *ptr = calloc(n, size);
+    if (ptr != NULL && memory_sample_should(n * size))
+        memory_sample_record(ptr, n * size, file, func, line);
+    return ptr;
+}
+
+void *memory_sample_realloc(void *ptr, size_t size, const char *file, const char *func, int line)
+{
+    void *new_ptr;
+
+    // untrack before realloc, otherwise the old address may be reused and
+    // sampled by other thread. if realloc fails, the block is left untracked
+    if (ptr != NULL)
+        memory_sample_untrack(ptr);
+
+    new_ptr = realloc(ptr, size);
+    if (new_ptr != NULL && size > 0 && memory_sample_should(size))
+        memory_sample_record(new_ptr, size, file, func, line);
+    return new_ptr;
+}
+
+void memory_sample_free(void *ptr)
+{
+    if (ptr != NULL)
+        memory_sample_untrack(ptr);
+    free(ptr);
+}
+
+char *memory_sample_strdup(const char *str, const char *file, const char *func, int line)
+{
+    char *ptr;
+    size_t len;
+
+    if (str == NULL)
+        return NULL;
+
+    len = strlen(str);
+    ptr = memory_sample_malloc(len + 1, file, func, line);
+    if (ptr != NULL) {
+        memcpy(ptr, str, len);
+        ptr[len] = '\0';
+    }
+
+    return ptr;
+}
+
+void memory_sample_set_interval(size_t bytes)
+{
+    struct sample_info *info = memory_sample_init();
+
+    if (bytes == 0)
+        bytes = MEMORY_SAMPLE_INTERVAL;
+    __atomic_store_n(&g_sample_interval, bytes, __ATOMIC_RELAXED);
+    if (info != NULL) {
+        // samples recorded before keep their weight
+        OS_THREAD_MUTEX_LOCK(info->site_mutex);
+        info->interval = bytes;
+        OS_THREAD_MUTEX_UNLOCK(info->site_mutex);
+    }
+}
+
+static int sample_site_compare(const void *a, const void *b)
+{
+    const struct sample_site *sa = *(const struct sample_site **)a;
+    const struct sample_site *sb = *(const struct sample_site **)b;
+
+    if (sa->live_bytes != sb->live_bytes)
+        return sa->live_bytes < sb->live_bytes ? 1 : -1;
+    return sa->alloc_bytes < sb->alloc_bytes ? 1 : (sa->alloc_bytes > sb->alloc_bytes ? -1 : 0);
+}
+
+void memory_sample_dump()
+{
+    struct sample_info *info = memory_sample_init();
+    struct sample_site **sites, *site;
+    unsigned long long live_bytes = 0;
+    unsigned int count = 0;
+
+    if (info == NULL)
+        return;
+
+    OS_LOGW(LOG_TAG, ">>");
+    OS_LOGW(LOG_TAG, "++++++++++++++++++++ MEMORY SAMPLE ++++++++++++++++++++");
+
+    OS_THREAD_MUTEX_LOCK(info->site_mutex);
+
+    sites = malloc(sizeof(struct sample_site *) * (info->site_count + 1));
+    if (sites != NULL) {
+        for (int i = 0; i < SAMPLE_SITE_COUNT; i++) {
+            for (site = info->sites[i]; site != NULL; site = site->next)
+                sites[count++] = site;
+        }
+        qsort(sites, count, sizeof(struct sample_site *), sample_site_compare);
+
+        for (unsigned int i = 0; i < count; i++) {
+            site = sites[i];
+            live_bytes += site->live_bytes;
+            OS_LOGW(LOG_TAG, "> [%s:%s:%d]: live [%llu] Bytes in [%llu] blocks, total [%llu] Bytes in [%llu] blocks",
+                    file_name(site->file), site->func, site->line,
+                    site->live_bytes, site->live_count, site->alloc_bytes, site->alloc_count);
+        }
+        free(sites);
+    }
+
+    OS_LOGW(LOG_TAG, "Summary: [%u] call sites, estimated current use [%llu] Bytes, sample interval [%lu] Bytes",
+            count, live_bytes, (unsigned long)info->interval);
+
+    OS_THREAD_MUTEX_UNLOCK(info->site_mutex);
+
+    OS_LOGW(LOG_TAG, "-------------------- MEMORY SAMPLE --------------------");
+    OS_LOGW(LOG_TAG, "<<");
+}
+
 // ---------------------------------------------------------------------------
 
 struct class_node {
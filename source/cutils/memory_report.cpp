@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/Namespace.h"
+#include "utils/cJSON.h"
+#include "cutils/os_memory.h"
+
+// cJSON is built as C++, so JSON report of memory_debug.c lives here
+
+SYSUTILS_NAMESPACE_USING
+
+extern "C" char *memory_debug_snapshot_json(const struct mem_snapshot *snapshot, bool formatted)
+{
+    cJSON *root, *sites, *item;
+    char site[256];
+    char *out, *result = NULL;
+
+    if (snapshot == NULL)
+        return NULL;
+
+    root = cJSON_CreateObject();
+    if (root == NULL)
+        return NULL;
+
+    cJSON_AddNumberToObject(root, "time_ms", (double)snapshot->time_ms);
+    cJSON_AddNumberToObject(root, "cur_used", (double)snapshot->cur_used);
+    cJSON_AddNumberToObject(root, "max_used", (double)snapshot->max_used);
+
+    sites = cJSON_AddArrayToObject(root, "sites");
+    if (sites == NULL)
+        goto exit;
+
+    for (size_t i = 0; i < snapshot->site_count; i++) {
+        const struct mem_site_stat *stat = &snapshot->sites[i];
+
+        item = cJSON_CreateObject();
+        if (item == NULL)
+            goto exit;
+        cJSON_AddItemToArray(sites, item);
+
+        snprintf(site, sizeof(site), "%s:%s:%d", stat->file, stat->func, stat->line);
+        cJSON_AddStringToObject(item, "site", site);
+        cJSON_AddNumberToObject(item, "live_bytes", (double)stat->live_bytes);
+        cJSON_AddNumberToObject(item, "live_count", (double)stat->live_count);
+        cJSON_AddNumberToObject(item, "total_bytes", (double)stat->total_bytes);
+        cJSON_AddNumberToObject(item, "total_count", (double)stat->total_count);
+        cJSON_AddNumberToObject(item, "peak_bytes", (double)stat->peak_bytes);
+    }
+
+    out = formatted ? cJSON_Print(root) : cJSON_PrintUnformatted(root);
+    if (out != NULL) {
+        // cJSON hooks may be replaced, hand over a malloc() buffer
+        result = strdup(out);
+        cJSON_free(out);
+    }
+
+exit:
+    cJSON_Delete(root);
+    return result;
+}
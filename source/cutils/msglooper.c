@@ -18,6 +18,7 @@
 #include "cutils/sw_watchdog.h"
 #include "cutils/common_list.h"
 #include "cutils/os_thread.h"
+#include "cutils/os_futex.h"
 #include "cutils/os_time.h"
 #include "cutils/os_memory.h"
 #include "cutils/os_logger.h"
@@ -33,17 +34,22 @@ struct msglooper {
     int msg_count;
     message_handle_cb msg_handle;
     message_free_cb msg_free;
-    os_mutex_t msg_mutex;
-    os_cond_t msg_cond;
+    os_fmutex_t msg_mutex;
+    os_fcond_t msg_cond;
 
     os_thread_t thread_id;
+    os_thread_t loop_thread; // thread running the loop, set by the thread itself
     const char *thread_name;
     struct os_threadattr thread_attr;
     bool thread_exit;
-    os_mutex_t thread_mutex;
+    os_fmutex_t thread_mutex;
 
     bool watchdog_enable;
     swwatch_t watchdog_node;
+
+    // message being dispatched, read by watchdog thread for stall diagnostics
+    int running_what;
+    unsigned long long running_since; // 0 if idle
 };
 
 struct message_node {
@@ -74,7 +80,7 @@ static void mlooper_clear_msglist(mlooper_t looper)
     struct message_node *node = NULL;
     struct listnode *item, *tmp;
 
-    OS_THREAD_MUTEX_LOCK(looper->msg_mutex);
+    OS_FMUTEX_LOCK(&looper->msg_mutex);
 
     list_for_each_safe(item, tmp, &looper->msg_list) {
         node = node_to_item(item, struct message_node, listnode);
@@ -84,7 +90,7 @@ static void mlooper_clear_msglist(mlooper_t looper)
 
     looper->msg_count = 0;
 
-    OS_THREAD_MUTEX_UNLOCK(looper->msg_mutex);
+    OS_FMUTEX_UNLOCK(&looper->msg_mutex);
 }
 
 static void *mlooper_thread_entry(void *arg)
@@ -95,17 +101,19 @@ static void *mlooper_thread_entry(void *arg)
     struct listnode *front = NULL;
     unsigned long long now;
 
+    __atomic_store_n(&looper->loop_thread, OS_THREAD_SELF(), __ATOMIC_RELEASE);
+    OS_THREAD_INFO()->looper = looper;
     OS_LOGD(LOG_TAG, "[%s]: Entry looper thread: thread_id=[%p]", looper->thread_name, looper->thread_id);
 
     while (1) {
         {
-            OS_THREAD_MUTEX_LOCK(looper->msg_mutex);
+            OS_FMUTEX_LOCK(&looper->msg_mutex);
 
             while (list_empty(&looper->msg_list) && !looper->thread_exit)
-                OS_THREAD_COND_WAIT(looper->msg_cond, looper->msg_mutex);
+                OS_FCOND_WAIT(&looper->msg_cond, &looper->msg_mutex);
 
             if (looper->thread_exit) {
-                OS_THREAD_MUTEX_UNLOCK(looper->msg_mutex);
+                OS_FMUTEX_UNLOCK(&looper->msg_mutex);
                 break;
             }
 
@@ -118,7 +126,7 @@ static void *mlooper_thread_entry(void *arg)
                 unsigned long wait = node->when - now;
                 OS_LOGV(LOG_TAG, "[%s]: Waiting message: what=[%d], wait=[%lums]",
                         looper->thread_name, msg->what, wait/1000);
-                OS_THREAD_COND_TIMEDWAIT(looper->msg_cond, looper->msg_mutex, wait);
+                OS_FCOND_TIMEDWAIT(&looper->msg_cond, &looper->msg_mutex, wait);
                 msg = NULL;
             }
             else {
@@ -126,12 +134,15 @@ static void *mlooper_thread_entry(void *arg)
                 looper->msg_count--;
             }
 
-            OS_THREAD_MUTEX_UNLOCK(looper->msg_mutex);
+            OS_FMUTEX_UNLOCK(&looper->msg_mutex);
         }
 
         if (msg != NULL) {
-            if (looper->watchdog_enable)
+            if (looper->watchdog_enable) {
+                __atomic_store_n(&looper->running_what, msg->what, __ATOMIC_RELAXED);
+                __atomic_store_n(&looper->running_since, OS_MONOTONIC_USEC(), __ATOMIC_RELEASE);
                 swwatchdog_start(looper->watchdog_node);
+            }
 
             if (node->timeout > 0 && node->timeout < now) {
                 OS_LOGE(LOG_TAG, "[%s]: Timeout, discard message: what=[%d]", looper->thread_name, msg->what);
@@ -147,8 +158,10 @@ static void *mlooper_thread_entry(void *arg)
                     OS_LOGW(LOG_TAG, "[%s]: No message handler: what=[%d]", looper->thread_name, msg->what);
             }
 
-            if (looper->watchdog_enable)
+            if (looper->watchdog_enable) {
                 swwatchdog_stop(looper->watchdog_node);
+                __atomic_store_n(&looper->running_since, 0, __ATOMIC_RELEASE);
+            }
 
             mlooper_free_msgnode(looper, node);
         }
@@ -157,6 +170,8 @@ static void *mlooper_thread_entry(void *arg)
     mlooper_clear_msglist(looper);
 
     OS_LOGD(LOG_TAG, "[%s]: Leave looper thread: thread_id=[%p]", looper->thread_name, looper->thread_id);
+    OS_THREAD_INFO()->looper = NULL;
+    __atomic_store_n(&looper->loop_thread, NULL, __ATOMIC_RELEASE);
     return NULL;
 }
 
@@ -168,23 +183,9 @@ mlooper_t mlooper_create(struct os_threadattr *attr, message_handle_cb handle_cb
         return NULL;
     }
 
-    looper->msg_mutex = OS_THREAD_MUTEX_CREATE();
-    if (looper->msg_mutex == NULL) {
-        OS_LOGE(LOG_TAG, "Failed to create msg_mutex");
-        goto error;
-    }
-
-    looper->msg_cond = OS_THREAD_COND_CREATE();
-    if (looper->msg_cond == NULL) {
-        OS_LOGE(LOG_TAG, "Failed to create msg_cond");
-        goto error;
-    }
-
-    looper->thread_mutex = OS_THREAD_MUTEX_CREATE();
-    if (looper->thread_mutex == NULL) {
-        OS_LOGE(LOG_TAG, "Failed to create thread_mutex");
-        goto error;
-    }
+    OS_FMUTEX_INIT(&looper->msg_mutex);
+    OS_FCOND_INIT(&looper->msg_cond);
+    OS_FMUTEX_INIT(&looper->thread_mutex);
 
     list_init(&looper->msg_list);
     looper->msg_count = 0;
@@ -197,6 +198,7 @@ mlooper_t mlooper_create(struct os_threadattr *attr, message_handle_cb handle_cb
         looper->thread_attr.priority = attr->priority;
         looper->thread_attr.stacksize = attr->stacksize > 0 ? attr->stacksize : DEFAULT_LOOPER_STACKSIZE;
         looper->thread_attr.joinable = true; // force joinalbe, wait exit when mlooper_stop
+        // attr->sched isn't read, callers may leave it uninitialized, see mlooper_set_sched()
     }
     else {
         looper->thread_attr.priority = DEFAULT_LOOPER_PRIORITY;
@@ -205,22 +207,36 @@ mlooper_t mlooper_create(struct os_threadattr *attr, message_handle_cb handle_cb
     }
 
     return looper;
+}
 
-error:
-    if (looper->thread_mutex != NULL)
-        OS_THREAD_MUTEX_DESTROY(looper->thread_mutex);
-    if (looper->msg_cond != NULL)
-        OS_THREAD_COND_DESTROY(looper->msg_cond);
-    if (looper->msg_mutex != NULL)
-        OS_THREAD_MUTEX_DESTROY(looper->msg_mutex);
-    OS_FREE(looper);
-    return NULL;
+int mlooper_set_sched(mlooper_t looper, const struct os_threadsched *sched)
+{
+    int ret = 0;
+
+    if (sched->policy < OS_THREAD_POLICY_DEFAULT || sched->policy > OS_THREAD_POLICY_RR ||
+        sched->nice < -20 || sched->nice > 19 ||
+        (sched->nice != 0 && sched->policy != OS_THREAD_POLICY_OTHER)) {
+        OS_LOGE(LOG_TAG, "[%s]: Invalid sched policy [%d] nice [%d]",
+                looper->thread_name, (int)sched->policy, sched->nice);
+        return -1;
+    }
+
+    OS_FMUTEX_LOCK(&looper->thread_mutex);
+    if (looper->thread_exit) {
+        looper->thread_attr.sched = *sched;
+    }
+    else {
+        OS_LOGE(LOG_TAG, "[%s]: Looper is running, stop it before setting sched", looper->thread_name);
+        ret = -1;
+    }
+    OS_FMUTEX_UNLOCK(&looper->thread_mutex);
+    return ret;
 }
 
 int mlooper_start(mlooper_t looper)
 {
     int ret = 0;
-    OS_THREAD_MUTEX_LOCK(looper->thread_mutex);
+    OS_FMUTEX_LOCK(&looper->thread_mutex);
 
     if (looper->thread_exit) {
         looper->thread_exit = false;
@@ -235,7 +251,7 @@ int mlooper_start(mlooper_t looper)
         }
     }
 
-    OS_THREAD_MUTEX_UNLOCK(looper->thread_mutex);
+    OS_FMUTEX_UNLOCK(&looper->thread_mutex);
     return ret;
 }
 
@@ -255,7 +271,7 @@ int mlooper_post_message_front(mlooper_t looper, struct message *msg)
         node->timeout = now + msg->timeout_ms * 1000;
 
     {
-        OS_THREAD_MUTEX_LOCK(looper->msg_mutex);
+        OS_FMUTEX_LOCK(&looper->msg_mutex);
 
         if (!list_empty(&looper->msg_list)) {
             temp = node_to_item(list_head(&looper->msg_list), struct message_node, listnode);
@@ -265,9 +281,9 @@ int mlooper_post_message_front(mlooper_t looper, struct message *msg)
         list_add_head(&looper->msg_list, &node->listnode);
         looper->msg_count++;
 
-        OS_THREAD_COND_SIGNAL(looper->msg_cond);
+        OS_FCOND_SIGNAL(&looper->msg_cond);
 
-        OS_THREAD_MUTEX_UNLOCK(looper->msg_mutex);
+        OS_FMUTEX_UNLOCK(&looper->msg_mutex);
     }
 
     return 0;
@@ -292,7 +308,7 @@ int mlooper_post_message_delay(mlooper_t looper, struct message *msg, unsigned l
     }
 
     {
-        OS_THREAD_MUTEX_LOCK(looper->msg_mutex);
+        OS_FMUTEX_LOCK(&looper->msg_mutex);
 
         list_for_each_reverse(item, &looper->msg_list) {
             temp = node_to_item(item, struct message_node, listnode);
@@ -308,9 +324,9 @@ int mlooper_post_message_delay(mlooper_t looper, struct message *msg, unsigned l
             looper->msg_count++;
         }
 
-        OS_THREAD_COND_SIGNAL(looper->msg_cond);
+        OS_FCOND_SIGNAL(&looper->msg_cond);
 
-        OS_THREAD_MUTEX_UNLOCK(looper->msg_mutex);
+        OS_FMUTEX_UNLOCK(&looper->msg_mutex);
     }
 
     return 0;
@@ -321,7 +337,7 @@ int mlooper_remove_message(mlooper_t looper, int what)
     struct message_node *node = NULL;
     struct listnode *item, *tmp;
 
-    OS_THREAD_MUTEX_LOCK(looper->msg_mutex);
+    OS_FMUTEX_LOCK(&looper->msg_mutex);
 
     list_for_each_safe(item, tmp, &looper->msg_list) {
         node = node_to_item(item, struct message_node, listnode);
@@ -332,7 +348,7 @@ int mlooper_remove_message(mlooper_t looper, int what)
         }
     }
 
-    OS_THREAD_MUTEX_UNLOCK(looper->msg_mutex);
+    OS_FMUTEX_UNLOCK(&looper->msg_mutex);
     return 0;
 }
 
@@ -341,7 +357,7 @@ int mlooper_remove_message_if(mlooper_t looper, message_match_cb match_cb)
     struct message_node *node = NULL;
     struct listnode *item, *tmp;
 
-    OS_THREAD_MUTEX_LOCK(looper->msg_mutex);
+    OS_FMUTEX_LOCK(&looper->msg_mutex);
 
     list_for_each_safe(item, tmp, &looper->msg_list) {
         node = node_to_item(item, struct message_node, listnode);
@@ -352,7 +368,7 @@ int mlooper_remove_message_if(mlooper_t looper, message_match_cb match_cb)
         }
     }
 
-    OS_THREAD_MUTEX_UNLOCK(looper->msg_mutex);
+    OS_FMUTEX_UNLOCK(&looper->msg_mutex);
     return 0;
 }
 
@@ -367,7 +383,7 @@ void mlooper_dump(mlooper_t looper)
     struct listnode *item;
     int i = 0;
 
-    OS_THREAD_MUTEX_LOCK(looper->msg_mutex);
+    OS_FMUTEX_LOCK(&looper->msg_mutex);
 
     OS_LOGI(LOG_TAG, "Dump looper thread:");
     OS_LOGI(LOG_TAG, " > thread_name=[%s]", looper->thread_name);
@@ -385,30 +401,41 @@ void mlooper_dump(mlooper_t looper)
         }
     }
 
-    OS_THREAD_MUTEX_UNLOCK(looper->msg_mutex);
+    OS_FMUTEX_UNLOCK(&looper->msg_mutex);
+}
+
+bool mlooper_is_current(mlooper_t looper)
+{
+    if (looper == NULL)
+        return false;
+#if defined(OS_THREAD_INFO_SHARED)
+    return __atomic_load_n(&looper->loop_thread, __ATOMIC_ACQUIRE) == OS_THREAD_SELF();
+#else
+    return OS_THREAD_INFO()->looper == looper;
+#endif
 }
 
 void mlooper_stop(mlooper_t looper)
 {
-    if (looper->thread_id == OS_THREAD_SELF()) {
+    if (mlooper_is_current(looper)) {
         OS_LOGW(LOG_TAG,
                 "Thread (%p:%s): don't call mlooper_stop() from this Thread object's thread. Maybe deadlock!",
                 looper->thread_id, looper->thread_name);
     }
 
     {
-        OS_THREAD_MUTEX_LOCK(looper->thread_mutex);
+        OS_FMUTEX_LOCK(&looper->thread_mutex);
 
         if (!looper->thread_exit) {
-            OS_THREAD_MUTEX_LOCK(looper->msg_mutex);
+            OS_FMUTEX_LOCK(&looper->msg_mutex);
             looper->thread_exit = true;
-            OS_THREAD_COND_SIGNAL(looper->msg_cond);
-            OS_THREAD_MUTEX_UNLOCK(looper->msg_mutex);
+            OS_FCOND_SIGNAL(&looper->msg_cond);
+            OS_FMUTEX_UNLOCK(&looper->msg_mutex);
 
             OS_THREAD_JOIN(looper->thread_id, NULL);
         }
 
-        OS_THREAD_MUTEX_UNLOCK(looper->thread_mutex);
+        OS_FMUTEX_UNLOCK(&looper->thread_mutex);
     }
 }
 
@@ -419,17 +446,31 @@ void mlooper_destroy(mlooper_t looper)
     if (looper->watchdog_node != NULL)
         swwatchdog_destroy(looper->watchdog_node);
 
-    OS_THREAD_MUTEX_DESTROY(looper->thread_mutex);
-    OS_THREAD_COND_DESTROY(looper->msg_cond);
-    OS_THREAD_MUTEX_DESTROY(looper->msg_mutex);
+    OS_FMUTEX_DESTROY(&looper->thread_mutex);
+    OS_FCOND_DESTROY(&looper->msg_cond);
+    OS_FMUTEX_DESTROY(&looper->msg_mutex);
 
     OS_FREE(looper->thread_name);
     OS_FREE(looper);
 }
 
+static void mlooper_watchdog_dump(void *arg)
+{
+    struct msglooper *looper = (struct msglooper *)arg;
+    unsigned long long since = __atomic_load_n(&looper->running_since, __ATOMIC_ACQUIRE);
+
+    // called on watchdog thread while looper thread is stuck, don't take msg_mutex
+    if (since != 0)
+        OS_LOGF(LOG_TAG, "[%s]: Stuck in message: what=[%d], running=[%llums], pending=[%d]",
+                looper->thread_name, __atomic_load_n(&looper->running_what, __ATOMIC_RELAXED),
+                (OS_MONOTONIC_USEC() - since) / 1000, looper->msg_count);
+    else
+        OS_LOGF(LOG_TAG, "[%s]: No message is running", looper->thread_name);
+}
+
 int mlooper_enable_watchdog(mlooper_t looper, unsigned long long timeout_ms, void (*timeout_cb)(void *arg), void *arg)
 {
-    OS_THREAD_MUTEX_LOCK(looper->msg_mutex);
+    OS_FMUTEX_LOCK(&looper->msg_mutex);
 
     if (looper->watchdog_node != NULL)
         swwatchdog_destroy(looper->watchdog_node);
@@ -437,19 +478,20 @@ int mlooper_enable_watchdog(mlooper_t looper, unsigned long long timeout_ms, voi
     looper->watchdog_node = swwatchdog_create(looper->thread_name, timeout_ms, timeout_cb, arg);
     if (looper->watchdog_node == NULL) {
         looper->watchdog_enable = false;
-        OS_THREAD_MUTEX_UNLOCK(looper->msg_mutex);
+        OS_FMUTEX_UNLOCK(&looper->msg_mutex);
         return -1;
     }
 
+    swwatchdog_set_dump_cb(looper->watchdog_node, mlooper_watchdog_dump, looper);
     looper->watchdog_enable = true;
 
-    OS_THREAD_MUTEX_UNLOCK(looper->msg_mutex);
+    OS_FMUTEX_UNLOCK(&looper->msg_mutex);
     return 0;
 }
 
 void mlooper_disable_watchdog(mlooper_t looper)
 {
-    OS_THREAD_MUTEX_LOCK(looper->msg_mutex);
+    OS_FMUTEX_LOCK(&looper->msg_mutex);
 
     if (looper->watchdog_enable) {
         looper->watchdog_enable = false;
@@ -457,7 +499,7 @@ void mlooper_disable_watchdog(mlooper_t looper)
         looper->watchdog_node = NULL;
     }
 
-    OS_THREAD_MUTEX_UNLOCK(looper->msg_mutex);
+    OS_FMUTEX_UNLOCK(&looper->msg_mutex);
 }
 
 struct message *message_obtain(int what, int arg1, int arg2, void *data)
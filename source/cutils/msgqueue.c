@@ -18,6 +18,7 @@
 #include <stdbool.h>
 #include "cutils/os_memory.h"
 #include "cutils/os_thread.h"
+#include "cutils/os_futex.h"
 #include "cutils/os_logger.h"
 #include "cutils/common_list.h"
 #include "cutils/msgqueue.h"
@@ -34,13 +35,16 @@ struct msgqueue {
     unsigned int element_count;/**< Number of total slots */
     unsigned int filled_count; /**< Number of filled slots */
 
-    os_cond_t can_read;
-    os_cond_t can_write;
-    os_mutex_t lock;
+    os_fcond_t can_read;
+    os_fcond_t can_write;
+    os_fmutex_t lock;
 
     bool is_set;            /**< Whether is queue-set */
     struct listnode list;   /**< List node for queue, list head for queue-set */
     mqueueset_t parent_set; /**< Parent queue-set pointer */
+
+    void (*notify)(void *arg); /**< Reader readiness hook, see mqueue_set_notify() */
+    void *notify_arg;
 };
 
 mqueue_t mqueue_create(unsigned int msg_size, unsigned int msg_count)
@@ -51,30 +55,17 @@ mqueue_t mqueue_create(unsigned int msg_size, unsigned int msg_count)
         return NULL;
     }
 
-    queue->lock = OS_THREAD_MUTEX_CREATE();
-    if (queue->lock == NULL) {
-        OS_LOGE(LOG_TAG, "Failed to create queue mutex");
-        goto error;
-    }
-
-    queue->can_read = OS_THREAD_COND_CREATE();
-    if (queue->can_read == NULL) {
-        OS_LOGE(LOG_TAG, "Failed to create queue cond");
-        goto error;
-    }
-
-    queue->can_write = OS_THREAD_COND_CREATE();
-    if (queue->can_write == NULL) {
-        OS_LOGE(LOG_TAG, "Failed to create queue cond");
-        goto error;
-    }
-
     queue->head = OS_CALLOC(msg_count, msg_size);
     if (queue->head == NULL) {
         OS_LOGE(LOG_TAG, "Failed to allocate queue buffer");
-        goto error;
+        OS_FREE(queue);
+        return NULL;
     }
 
+    OS_FMUTEX_INIT(&queue->lock);
+    OS_FCOND_INIT(&queue->can_read);
+    OS_FCOND_INIT(&queue->can_write);
+
     queue->read = queue->head;
     queue->write = queue->head;
     queue->tail = queue->head + msg_size * msg_count;
@@ -86,18 +77,6 @@ mqueue_t mqueue_create(unsigned int msg_size, unsigned int msg_count)
     list_init(&queue->list);
 
     return queue;
-
-error:
-    if (queue->head != NULL)
-        OS_FREE(queue->head);
-    if (queue->can_write != NULL)
-        OS_THREAD_COND_DESTROY(queue->can_write);
-    if (queue->can_read != NULL)
-        OS_THREAD_COND_DESTROY(queue->can_read);
-    if (queue->lock != NULL)
-        OS_THREAD_MUTEX_DESTROY(queue->lock);
-    OS_FREE(queue);
-    return NULL;
 }
 
 int mqueue_destroy(mqueue_t queue)
@@ -108,35 +87,35 @@ int mqueue_destroy(mqueue_t queue)
     }
 
     if (queue->parent_set != NULL) {
-        OS_THREAD_MUTEX_LOCK(queue->parent_set->lock);
+        OS_FMUTEX_LOCK(&queue->parent_set->lock);
         list_remove(&queue->list);
-        OS_THREAD_MUTEX_UNLOCK(queue->parent_set->lock);
+        OS_FMUTEX_UNLOCK(&queue->parent_set->lock);
     }
 
     OS_FREE(queue->head);
-    OS_THREAD_COND_DESTROY(queue->can_write);
-    OS_THREAD_COND_DESTROY(queue->can_read);
-    OS_THREAD_MUTEX_DESTROY(queue->lock);
+    OS_FCOND_DESTROY(&queue->can_write);
+    OS_FCOND_DESTROY(&queue->can_read);
+    OS_FMUTEX_DESTROY(&queue->lock);
     OS_FREE(queue);
     return 0;
 }
 
 int mqueue_reset(mqueue_t queue)
 {
-    OS_THREAD_MUTEX_LOCK(queue->lock);
+    OS_FMUTEX_LOCK(&queue->lock);
 
     if (queue->parent_set != NULL && mqueue_count_filled(queue) > 0) {
         OS_LOGE(LOG_TAG, "Can't reset queue that parent set isn't empty");
-        OS_THREAD_MUTEX_UNLOCK(queue->lock);
+        OS_FMUTEX_UNLOCK(&queue->lock);
         return -1;
     }
 
     queue->read = queue->head;
     queue->write = queue->head;
     queue->filled_count = 0;
-    OS_THREAD_COND_SIGNAL(queue->can_write);
+    OS_FCOND_SIGNAL(&queue->can_write);
 
-    OS_THREAD_MUTEX_UNLOCK(queue->lock);
+    OS_FMUTEX_UNLOCK(&queue->lock);
     return 0;
 }
 
@@ -153,13 +132,13 @@ int mqueue_send(mqueue_t queue, char *msg, unsigned int timeout_ms)
 {
     int ret = -1;
 
-    OS_THREAD_MUTEX_LOCK(queue->lock);
+    OS_FMUTEX_LOCK(&queue->lock);
 
     if (mqueue_count_available(queue) == 0) {
         if (timeout_ms == 0)
             goto write_done;
         else
-            OS_THREAD_COND_TIMEDWAIT(queue->can_write, queue->lock, timeout_ms*1000);
+            OS_FCOND_TIMEDWAIT(&queue->can_write, &queue->lock, timeout_ms*1000);
     }
 
     if (mqueue_count_available(queue) > 0) {
@@ -168,19 +147,21 @@ int mqueue_send(mqueue_t queue, char *msg, unsigned int timeout_ms)
         if (queue->parent_set) {
             mqueueset_t set = queue->parent_set;
 
-            OS_THREAD_MUTEX_LOCK(set->lock);
+            OS_FMUTEX_LOCK(&set->lock);
 
             if (mqueue_count_available(set) > 0) {
                 mqueue_copy_msg(queue, msg);
                 mqueue_copy_msg(set, (char *)&queue);
-                OS_THREAD_COND_SIGNAL(set->can_read);
+                OS_FCOND_SIGNAL(&set->can_read);
+                if (set->notify != NULL)
+                    set->notify(set->notify_arg);
             }
             else {
                 OS_LOGE(LOG_TAG, "Failed to send msg to queue that parent set is full");
                 ret = -1;
             }
 
-            OS_THREAD_MUTEX_UNLOCK(set->lock);
+            OS_FMUTEX_UNLOCK(&set->lock);
         }
         else {
             mqueue_copy_msg(queue, msg);
@@ -188,12 +169,15 @@ int mqueue_send(mqueue_t queue, char *msg, unsigned int timeout_ms)
     }
 
 write_done:
-    if (ret == 0)
-        OS_THREAD_COND_SIGNAL(queue->can_read);
+    if (ret == 0) {
+        OS_FCOND_SIGNAL(&queue->can_read);
+        if (queue->notify != NULL)
+            queue->notify(queue->notify_arg);
+    }
     else
         OS_LOGE(LOG_TAG, "Failed to send msg to full queue");
 
-    OS_THREAD_MUTEX_UNLOCK(queue->lock);
+    OS_FMUTEX_UNLOCK(&queue->lock);
     return ret;
 }
 
@@ -201,13 +185,13 @@ int mqueue_receive(mqueue_t queue, char *msg, unsigned int timeout_ms)
 {
     int ret = -1;
 
-    OS_THREAD_MUTEX_LOCK(queue->lock);
+    OS_FMUTEX_LOCK(&queue->lock);
 
     if (mqueue_count_filled(queue) == 0) {
         if (timeout_ms == 0)
             goto read_done;
         else
-            OS_THREAD_COND_TIMEDWAIT(queue->can_read, queue->lock, timeout_ms*1000);
+            OS_FCOND_TIMEDWAIT(&queue->can_read, &queue->lock, timeout_ms*1000);
     }
 
     if (mqueue_count_filled(queue) > 0) {
@@ -221,12 +205,20 @@ int mqueue_receive(mqueue_t queue, char *msg, unsigned int timeout_ms)
 
 read_done:
     if (ret == 0)
-        OS_THREAD_COND_SIGNAL(queue->can_write);
+        OS_FCOND_SIGNAL(&queue->can_write);
 
-    OS_THREAD_MUTEX_UNLOCK(queue->lock);
+    OS_FMUTEX_UNLOCK(&queue->lock);
     return ret;
 }
 
+void mqueue_set_notify(mqueue_t queue, void (*notify)(void *arg), void *arg)
+{
+    OS_FMUTEX_LOCK(&queue->lock);
+    queue->notify = notify;
+    queue->notify_arg = arg;
+    OS_FMUTEX_UNLOCK(&queue->lock);
+}
+
 unsigned int mqueue_count_available(mqueue_t queue)
 {
     return queue->element_count - queue->filled_count;
@@ -258,9 +250,9 @@ int mqueueset_destroy(mqueueset_t set)
         queue = node_to_item(item, struct msgqueue, list);
         list_remove(&queue->list);
 
-        OS_THREAD_MUTEX_LOCK(queue->lock);
+        OS_FMUTEX_LOCK(&queue->lock);
         queue->parent_set = NULL;
-        OS_THREAD_MUTEX_UNLOCK(queue->lock);
+        OS_FMUTEX_UNLOCK(&queue->lock);
     }
 
     return mqueue_destroy(set);
@@ -278,21 +270,21 @@ int mqueueset_add_queue(mqueueset_t set, mqueue_t queue)
         return -1;
     }
 
-    OS_THREAD_MUTEX_LOCK(queue->lock);
+    OS_FMUTEX_LOCK(&queue->lock);
 
     if (mqueue_count_filled(queue) > 0) {
         OS_LOGE(LOG_TAG, "Can't add queue that isn't empty");
-        OS_THREAD_MUTEX_UNLOCK(queue->lock);
+        OS_FMUTEX_UNLOCK(&queue->lock);
         return -1;
     }
 
     queue->parent_set = set;
 
-    OS_THREAD_MUTEX_LOCK(set->lock);
+    OS_FMUTEX_LOCK(&set->lock);
     list_add_tail(&set->list, &queue->list);
-    OS_THREAD_MUTEX_UNLOCK(set->lock);
+    OS_FMUTEX_UNLOCK(&set->lock);
 
-    OS_THREAD_MUTEX_UNLOCK(queue->lock);
+    OS_FMUTEX_UNLOCK(&queue->lock);
 
     return 0;
 }
@@ -304,21 +296,21 @@ int mqueueset_remove_queue(mqueueset_t set, mqueue_t queue)
         return -1;
     }
 
-    OS_THREAD_MUTEX_LOCK(queue->lock);
+    OS_FMUTEX_LOCK(&queue->lock);
 
     if (mqueue_count_filled(queue) > 0) {
         OS_LOGE(LOG_TAG, "Can't remove queue that isn't empty");
-        OS_THREAD_MUTEX_UNLOCK(queue->lock);
+        OS_FMUTEX_UNLOCK(&queue->lock);
         return -1;
     }
 
     queue->parent_set = NULL;
 
-    OS_THREAD_MUTEX_LOCK(set->lock);
+    OS_FMUTEX_LOCK(&set->lock);
     list_remove(&queue->list);
-    OS_THREAD_MUTEX_UNLOCK(set->lock);
+    OS_FMUTEX_UNLOCK(&set->lock);
 
-    OS_THREAD_MUTEX_UNLOCK(queue->lock);
+    OS_FMUTEX_UNLOCK(&queue->lock);
 
     return 0;
 }
@@ -0,0 +1,337 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "cutils/os_logger.h"
+#include "cutils/os_arena.h"
+
+#define LOG_TAG "arena"
+
+#define DEFAULT_CHUNK_SIZE  (16 * 1024)
+#define ARENA_ALIGN         16
+#define ARENA_ALIGN_UP(x)   (((x) + ARENA_ALIGN - 1) & ~((size_t)ARENA_ALIGN - 1))
+
+#define BLOCK_MAGIC_HEAP    0x48454150UL // "HEAP"
+#define BLOCK_MAGIC_ARENA   0x4152454eUL // "AREN"
+
+#if defined(OS_FREERTOS)
+#define ARENA_TLS
+#else
+#define ARENA_TLS __thread
+#endif
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size;  // capacity of data
+    size_t used;
+    size_t reserved; // pad header to ARENA_ALIGN
+    char data[];
+};
+
+struct os_arena {
+    struct arena_chunk *head; // current chunk, older chunks are chained by next
+    struct arena_chunk *spare; // regular chunks kept by os_arena_reset() for reuse
+    size_t chunk_size;
+    size_t used;
+};
+
+// tag of scoped allocations, keep ARENA_ALIGN alignment
+struct block_header {
+    size_t size;
+    size_t magic;
+};
+
+// malloc()/free() are called directly in this file, as OS_MALLOC may be routed here
+static ARENA_TLS struct os_arena *t_scope = NULL;
+
+static struct arena_chunk *arena_chunk_create(size_t size)
+{
+    struct arena_chunk *chunk = malloc(sizeof(struct arena_chunk) + size);
+    if (chunk == NULL)
+        return NULL;
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    return chunk;
+}
+
+os_arena_t os_arena_create(size_t chunk_size)
+{
+    struct os_arena *arena = calloc(1, sizeof(struct os_arena));
+    if (arena == NULL) {
+        OS_LOGE(LOG_TAG, "Failed to allocate arena");
+        return NULL;
+    }
+
+    arena->chunk_size = ARENA_ALIGN_UP(chunk_size != 0 ? chunk_size : DEFAULT_CHUNK_SIZE);
+    arena->head = arena_chunk_create(arena->chunk_size);
+    if (arena->head == NULL) {
+        OS_LOGE(LOG_TAG, "Failed to allocate arena chunk");
+        free(arena);
+        return NULL;
+    }
+    return arena;
+}
+
+void *os_arena_alloc(os_arena_t arena, size_t size)
+{
+    struct arena_chunk *chunk = arena->head;
+    size_t aligned = ARENA_ALIGN_UP(size);
+    void *ptr;
+
+    if (aligned < size)
+        return NULL; // overflow
+
+    if (chunk == NULL || chunk->size - chunk->used < aligned) {
+        if (chunk != NULL && aligned > arena->chunk_size / 4) {
+            // large block gets a dedicated chunk behind head, so the space left in head isn't wasted
+            chunk = arena_chunk_create(aligned);
+            if (chunk == NULL)
+                return NULL;
+            chunk->next = arena->head->next;
+            arena->head->next = chunk;
+        }
+        else if (arena->spare != NULL && aligned <= arena->chunk_size) {
+            chunk = arena->spare;
+            arena->spare = chunk->next;
+            chunk->used = 0;
+            chunk->next = arena->head;
+            arena->head = chunk;
+        }
+        else {
+            chunk = arena_chunk_create(aligned > arena->chunk_size ? aligned : arena->chunk_size);
+            if (chunk == NULL)
+                return NULL;
+            chunk->next = arena->head;
+            arena->head = chunk;
+        }
+    }
+
+    ptr = chunk->data + chunk->used;
+    chunk->used += aligned;
+    arena->used += aligned;
+    return ptr;
+}
+
+void *os_arena_calloc(os_arena_t arena, size_t n, size_t size)
+{
+    void *ptr;
+
+    if (size != 0 && n > SIZE_MAX / size)
+        return NULL;
+
+    ptr = os_arena_alloc(arena, n * size);
+    if (ptr != NULL)
+        memset(ptr, 0x0, n * size);
+    return ptr;
+}
+
+char *os_arena_strdup(os_arena_t arena, const char *str)
+{
+    size_t len;
+    char *ptr;
+
+    if (str == NULL)
+        return NULL;
+
+    len = strlen(str);
+    ptr = os_arena_alloc(arena, len + 1);
+    if (ptr != NULL)
+        memcpy(ptr, str, len + 1);
+    return ptr;
+}
+
+void os_arena_reset(os_arena_t arena)
+{
+    struct arena_chunk *chunk, *next;
+
+    // keep regular chunks for the next round, free dedicated ones
+    for (chunk = arena->head; chunk != NULL; chunk = next) {
+        next = chunk->next;
+        if (chunk->size == arena->chunk_size) {
+            chunk->next = arena->spare;
+            arena->spare = chunk;
+        }
+        else {
+            free(chunk);
+        }
+    }
+
+    arena->head = arena->spare;
+    if (arena->head != NULL) {
+        arena->spare = arena->head->next;
+        arena->head->next = NULL;
+        arena->head->used = 0;
+    }
+    arena->used = 0; // os_arena_alloc() creates a chunk if head is NULL
+}
+
+void os_arena_trim(os_arena_t arena)
+{
+    struct arena_chunk *chunk, *next;
+
+    for (chunk = arena->spare; chunk != NULL; chunk = next) {
+        next = chunk->next;
+        free(chunk);
+    }
+    arena->spare = NULL;
+}
+
+size_t os_arena_used(os_arena_t arena)
+{
+    return arena->used;
+}
+
+void os_arena_destroy(os_arena_t arena)
+{
+    struct arena_chunk *chunk, *next;
+
+    if (arena == NULL)
+        return;
+
+    if (t_scope == arena)
+        OS_LOGW(LOG_TAG, "Arena[%p] is destroyed in its scope", arena);
+
+    os_arena_trim(arena);
+    for (chunk = arena->head; chunk != NULL; chunk = next) {
+        next = chunk->next;
+        free(chunk);
+    }
+    free(arena);
+}
+
+os_arena_t os_arena_scope_enter(os_arena_t arena)
+{
+    struct os_arena *prev = t_scope;
+    t_scope = arena;
+    return prev;
+}
+
+void os_arena_scope_leave(os_arena_t prev)
+{
+    t_scope = prev;
+}
+
+os_arena_t os_arena_scope_current()
+{
+    return t_scope;
+}
+
+void *os_arena_scoped_malloc(size_t size)
+{
+    struct block_header *header;
+
+    if (size > SIZE_MAX - sizeof(struct block_header))
+        return NULL;
+
+    if (t_scope != NULL) {
+        header = os_arena_alloc(t_scope, sizeof(struct block_header) + size);
+        if (header == NULL)
+            return NULL;
+        header->magic = BLOCK_MAGIC_ARENA;
+    }
+    else {
+        header = malloc(sizeof(struct block_header) + size);
+        if (header == NULL)
+            return NULL;
+        header->magic = BLOCK_MAGIC_HEAP;
+    }
+
+    header->size = size;
+    return header + 1;
+}
+
+void *os_arena_scoped_calloc(size_t n, size_t size)
+{
+    void *ptr;
+
+    if (size != 0 && n > SIZE_MAX / size)
+        return NULL;
+
+    ptr = os_arena_scoped_malloc(n * size);
+    if (ptr != NULL)
+        memset(ptr, 0x0, n * size);
+    return ptr;
+}
+
+void *os_arena_scoped_realloc(void *ptr, size_t size)
+{
+    struct block_header *header;
+    void *new_ptr;
+
+    if (ptr == NULL)
+        return os_arena_scoped_malloc(size);
+
+    header = (struct block_header *)ptr - 1;
+    if (size == 0) {
+        os_arena_scoped_free(ptr);
+        return NULL;
+    }
+
+    if (header->magic == BLOCK_MAGIC_HEAP) {
+        // heap block stays on heap
+        if (size > SIZE_MAX - sizeof(struct block_header))
+            return NULL;
+        header = realloc(header, sizeof(struct block_header) + size);
+        if (header == NULL)
+            return NULL;
+        header->size = size;
+        return header + 1;
+    }
+
+    if (size <= header->size)
+        return ptr;
+
+    new_ptr = os_arena_scoped_malloc(size);
+    if (new_ptr != NULL)
+        memcpy(new_ptr, ptr, header->size);
+    return new_ptr;
+}
+
+void os_arena_scoped_free(void *ptr)
+{
+    struct block_header *header;
+
+    if (ptr == NULL)
+        return;
+
+    header = (struct block_header *)ptr - 1;
+    if (header->magic == BLOCK_MAGIC_HEAP) {
+        header->magic = 0;
+        free(header);
+    }
+    else if (header->magic != BLOCK_MAGIC_ARENA) {
+        OS_LOGF(LOG_TAG, "Invalid block[%p], not allocated by os_arena_scoped_malloc()?", ptr);
+    }
+    // arena block is freed by os_arena_reset()
+}
+
+char *os_arena_scoped_strdup(const char *str)
+{
+    size_t len;
+    char *ptr;
+
+    if (str == NULL)
+        return NULL;
+
+    len = strlen(str);
+    ptr = os_arena_scoped_malloc(len + 1);
+    if (ptr != NULL)
+        memcpy(ptr, str, len + 1);
+    return ptr;
+}
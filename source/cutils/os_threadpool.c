@@ -0,0 +1,775 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <string.h>
+#include <unistd.h>
+#include "cutils/os_memory.h"
+#include "cutils/os_logger.h"
+#include "cutils/os_futex.h"
+#include "cutils/os_threadpool.h"
+
+#define LOG_TAG "threadpool"
+
+#define DEFAULT_QUEUE_SIZE      1024
+#define DEFAULT_IDLE_TIMEOUT_MS 5000
+#define DEFAULT_STACKSIZE       4096
+#define WORKER_SPIN_COUNT       64
+#define CHUNKS_PER_WORKER       4
+#define CACHE_LINE_SIZE         64
+
+// Without thread local storage, workers aren't known to the tasks they
+// run: every task goes to the global queue and waits don't help
+#if !defined(OS_FREERTOS)
+#define THREADPOOL_WORKER_TLS
+#endif
+
+struct threadpool_job {
+    void (*fn)(void *arg);
+    void *arg;
+};
+
+// Bounded MPMC queue (Vyukov), the sequence of a cell tells whose turn it is
+struct threadpool_cell {
+    unsigned long seq;
+    struct threadpool_job job;
+};
+
+struct threadpool_queue {
+    struct threadpool_cell *cells;
+    unsigned long mask;
+    char pad0[CACHE_LINE_SIZE];
+    unsigned long head; // next position to enqueue
+    char pad1[CACHE_LINE_SIZE];
+    unsigned long tail; // next position to dequeue
+    char pad2[CACHE_LINE_SIZE];
+};
+
+// Bounded work-stealing deque (Chase-Lev), the owner works at bottom, thieves take from top
+struct threadpool_deque {
+    struct threadpool_job *jobs;
+    long mask;
+    char pad0[CACHE_LINE_SIZE];
+    long top;
+    char pad1[CACHE_LINE_SIZE];
+    long bottom;
+    char pad2[CACHE_LINE_SIZE];
+};
+
+struct threadpool_worker {
+    struct os_threadpool *pool;
+    struct threadpool_deque deque;
+    os_thread_t thread_id;  // not NULL until joined
+    unsigned int rand;      // victim selection
+    bool active;            // thread is running in this slot
+};
+
+struct os_threadpool {
+    struct threadpool_queue queue;
+    struct threadpool_worker *workers;
+    unsigned int min_threads;
+    unsigned int max_threads; // number of worker slots
+    unsigned int idle_timeout_ms;
+    struct os_threadattr thread_attr;
+
+    unsigned long pending;       // tasks submitted and not finished yet
+    unsigned int threads;        // running workers
+    unsigned int sleepers;       // workers sleeping or about to sleep on work_cond
+    unsigned int space_waiters;  // submitters waiting on space_cond for a full global queue
+    unsigned int drain_waiters;  // waiting on drain_cond for pending to drop to 0
+    bool stopping;
+
+    os_fmutex_t mutex;
+    os_fcond_t work_cond;
+    os_fcond_t space_cond;
+    os_fcond_t drain_cond;
+};
+
+struct os_future {
+    void *(*fn)(void *arg);
+    void *arg;
+    void *result;
+    bool ready;
+    os_fmutex_t mutex;
+    os_fcond_t cond;
+};
+
+struct threadpool_range {
+    void (*fn)(size_t begin, size_t end, void *arg);
+    void *arg;
+    size_t end;
+    size_t grain;
+    size_t next;        // first index of next chunk to take
+    size_t chunks_left; // chunks not finished yet
+    unsigned int refs;  // caller and helper tasks
+    bool done;
+    os_fmutex_t mutex;
+    os_fcond_t cond;
+};
+
+#if defined(THREADPOOL_WORKER_TLS)
+static __thread struct threadpool_worker *t_worker = NULL;
+#endif
+
+// Worker running on this thread, NULL if it isn't a worker
+static struct threadpool_worker *threadpool_current_worker()
+{
+#if defined(THREADPOOL_WORKER_TLS)
+    return t_worker;
+#else
+    return NULL;
+#endif
+}
+
+static unsigned long round_up_pow2(unsigned long size)
+{
+    unsigned long pow2 = 2;
+    while (pow2 < size)
+        pow2 <<= 1;
+    return pow2;
+}
+
+static int threadpool_queue_init(struct threadpool_queue *queue, unsigned long size)
+{
+    queue->cells = OS_CALLOC(size, sizeof(struct threadpool_cell));
+    if (queue->cells == NULL)
+        return -1;
+    for (unsigned long i = 0; i < size; i++)
+        queue->cells[i].seq = i;
+    queue->mask = size - 1;
+    queue->head = 0;
+    queue->tail = 0;
+    return 0;
+}
+
+static bool threadpool_queue_push(struct threadpool_queue *queue, const struct threadpool_job *job)
+{
+    unsigned long pos = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+    struct threadpool_cell *cell;
+
+    for (;;) {
+        cell = &queue->cells[pos & queue->mask];
+        long diff = (long)(__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&queue->head, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+        else if (diff < 0) {
+            return false; // full
+        }
+        else {
+            pos = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+        }
+    }
+    cell->job = *job;
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+static bool threadpool_queue_pop(struct threadpool_queue *queue, struct threadpool_job *job)
+{
+    unsigned long pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+    struct threadpool_cell *cell;
+
+    for (;;) {
+        cell = &queue->cells[pos & queue->mask];
+        long diff = (long)(__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - (pos + 1));
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&queue->tail, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+        else if (diff < 0) {
+            return false; // empty
+        }
+        else {
+            pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+        }
+    }
+    *job = cell->job;
+    __atomic_store_n(&cell->seq, pos + queue->mask + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+static int threadpool_deque_init(struct threadpool_deque *deque, unsigned long size)
+{
+    deque->jobs = OS_CALLOC(size, sizeof(struct threadpool_job));
+    if (deque->jobs == NULL)
+        return -1;
+    deque->mask = (long)size - 1;
+    deque->top = 0;
+    deque->bottom = 0;
+    return 0;
+}
+
+// A slot may be read by a thief while the owner overwrites it, thieves retry if they lose the race
+static void threadpool_deque_load(struct threadpool_deque *deque, long index, struct threadpool_job *job)
+{
+    struct threadpool_job *slot = &deque->jobs[index & deque->mask];
+    job->fn = __atomic_load_n(&slot->fn, __ATOMIC_RELAXED);
+    job->arg = __atomic_load_n(&slot->arg, __ATOMIC_RELAXED);
+}
+
+// Owner only
+static bool threadpool_deque_push(struct threadpool_deque *deque, const struct threadpool_job *job)
+{
+    long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+    long top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    struct threadpool_job *slot;
+
+    if (bottom - top > deque->mask)
+        return false; // full
+    slot = &deque->jobs[bottom & deque->mask];
+    __atomic_store_n(&slot->fn, job->fn, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->arg, job->arg, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+// Owner only, newest job first
+static bool threadpool_deque_pop(struct threadpool_deque *deque, struct threadpool_job *job)
+{
+    long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+    long top;
+    bool found = true;
+
+    __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+    if (top > bottom) {
+        // empty
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    threadpool_deque_load(deque, bottom, job);
+    if (top == bottom) {
+        // last job, race with thieves for it
+        found = __atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+                                            __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    }
+    return found;
+}
+
+// Any thread, oldest job first
+static bool threadpool_deque_steal(struct threadpool_deque *deque, struct threadpool_job *job)
+{
+    long top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+
+    if (top >= bottom)
+        return false;
+    threadpool_deque_load(deque, top, job);
+    return __atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+static bool threadpool_steal(struct os_threadpool *pool, struct threadpool_worker *self,
+                             struct threadpool_job *job)
+{
+    unsigned int start = 0;
+
+    if (self != NULL) {
+        // xorshift, spread thieves over victims
+        self->rand ^= self->rand << 13;
+        self->rand ^= self->rand >> 17;
+        self->rand ^= self->rand << 5;
+        start = self->rand;
+    }
+    for (unsigned int i = 0; i < pool->max_threads; i++) {
+        struct threadpool_worker *victim = &pool->workers[(start + i) % pool->max_threads];
+        if (victim != self && threadpool_deque_steal(&victim->deque, job))
+            return true;
+    }
+    return false;
+}
+
+// Wake up submitters blocked on full global queue after a slot is freed
+static void threadpool_space_notify(struct os_threadpool *pool, bool locked)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&pool->space_waiters, __ATOMIC_RELAXED) > 0) {
+        if (!locked)
+            OS_FMUTEX_LOCK(&pool->mutex);
+        OS_FCOND_BROADCAST(&pool->space_cond);
+        if (!locked)
+            OS_FMUTEX_UNLOCK(&pool->mutex);
+    }
+}
+
+// Own deque first, then global queue, then steal, locked if the caller holds pool mutex
+static bool threadpool_find_job(struct os_threadpool *pool, struct threadpool_worker *self,
+                                struct threadpool_job *job, bool locked)
+{
+    if (self != NULL && threadpool_deque_pop(&self->deque, job))
+        return true;
+    if (threadpool_queue_pop(&pool->queue, job)) {
+        threadpool_space_notify(pool, locked);
+        return true;
+    }
+    return threadpool_steal(pool, self, job);
+}
+
+static void threadpool_run_job(struct os_threadpool *pool, struct threadpool_job *job)
+{
+    job->fn(job->arg);
+
+    if (__atomic_sub_fetch(&pool->pending, 1, __ATOMIC_SEQ_CST) == 0 &&
+        __atomic_load_n(&pool->drain_waiters, __ATOMIC_SEQ_CST) > 0) {
+        OS_FMUTEX_LOCK(&pool->mutex);
+        OS_FCOND_BROADCAST(&pool->drain_cond);
+        OS_FMUTEX_UNLOCK(&pool->mutex);
+    }
+}
+
+static void *threadpool_worker_entry(void *arg)
+{
+    struct threadpool_worker *worker = (struct threadpool_worker *)arg;
+    struct os_threadpool *pool = worker->pool;
+    struct threadpool_job job;
+    int spin = 0;
+
+#if defined(THREADPOOL_WORKER_TLS)
+    t_worker = worker;
+#endif
+
+    for (;;) {
+        if (threadpool_find_job(pool, worker, &job, false)) {
+            threadpool_run_job(pool, &job);
+            spin = 0;
+            continue;
+        }
+        if (spin++ < WORKER_SPIN_COUNT) {
+            OS_CPU_RELAX();
+            continue;
+        }
+        spin = 0;
+
+        OS_FMUTEX_LOCK(&pool->mutex);
+        // announce sleeping before the last check, submitters check sleepers after push
+        __atomic_add_fetch(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+        bool found = threadpool_find_job(pool, worker, &job, true);
+        bool leave = false;
+        if (!found) {
+            if (pool->stopping && __atomic_load_n(&pool->pending, __ATOMIC_SEQ_CST) == 0) {
+                leave = true;
+            }
+            else if (pool->threads > pool->min_threads) {
+                if (OS_FCOND_TIMEDWAIT(&pool->work_cond, &pool->mutex,
+                                       pool->idle_timeout_ms * 1000UL) == ETIMEDOUT &&
+                    pool->threads > pool->min_threads && !pool->stopping)
+                    leave = true; // extra worker idle too long, its deque is empty
+            }
+            else {
+                OS_FCOND_WAIT(&pool->work_cond, &pool->mutex);
+            }
+        }
+        __atomic_sub_fetch(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+        if (leave) {
+            pool->threads--;
+            __atomic_store_n(&worker->active, false, __ATOMIC_RELEASE);
+            OS_FMUTEX_UNLOCK(&pool->mutex);
+            break;
+        }
+        OS_FMUTEX_UNLOCK(&pool->mutex);
+
+        if (found)
+            threadpool_run_job(pool, &job);
+    }
+
+#if defined(THREADPOOL_WORKER_TLS)
+    t_worker = NULL;
+#endif
+    return NULL;
+}
+
+static int threadpool_spawn_l(struct os_threadpool *pool)
+{
+    for (unsigned int i = 0; i < pool->max_threads; i++) {
+        struct threadpool_worker *worker = &pool->workers[i];
+        if (__atomic_load_n(&worker->active, __ATOMIC_ACQUIRE))
+            continue;
+        if (worker->thread_id != NULL) {
+            // the idle worker left this slot, it's exiting or exited
+            OS_THREAD_JOIN(worker->thread_id, NULL);
+            worker->thread_id = NULL;
+        }
+        worker->active = true;
+        worker->thread_id = OS_THREAD_CREATE(&pool->thread_attr, threadpool_worker_entry, worker);
+        if (worker->thread_id == NULL) {
+            OS_LOGE(LOG_TAG, "[%s]: Failed to run worker thread", pool->thread_attr.name);
+            worker->active = false;
+            return -1;
+        }
+        pool->threads++;
+        return 0;
+    }
+    return -1;
+}
+
+// Wake up a sleeping worker after push, or start one more if all are busy
+static void threadpool_notify(struct os_threadpool *pool)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&pool->sleepers, __ATOMIC_RELAXED) > 0) {
+        OS_FMUTEX_LOCK(&pool->mutex);
+        OS_FCOND_SIGNAL(&pool->work_cond);
+        OS_FMUTEX_UNLOCK(&pool->mutex);
+    }
+    else if (__atomic_load_n(&pool->threads, __ATOMIC_RELAXED) < pool->max_threads &&
+             __atomic_load_n(&pool->pending, __ATOMIC_RELAXED) > pool->threads) {
+        OS_FMUTEX_LOCK(&pool->mutex);
+        if (pool->threads < pool->max_threads && pool->sleepers == 0 && !pool->stopping)
+            threadpool_spawn_l(pool);
+        OS_FMUTEX_UNLOCK(&pool->mutex);
+    }
+}
+
+static int threadpool_post(struct os_threadpool *pool, void (*fn)(void *arg), void *arg)
+{
+    struct threadpool_worker *worker = threadpool_current_worker();
+    struct threadpool_job job = { fn, arg };
+
+    // counted before stopping is checked, so destroy either refuses or drains it
+    __atomic_add_fetch(&pool->pending, 1, __ATOMIC_SEQ_CST);
+
+    if (worker != NULL && worker->pool == pool) {
+        // from a worker, it's never refused nor blocked
+        if (!threadpool_deque_push(&worker->deque, &job) &&
+            !threadpool_queue_push(&pool->queue, &job)) {
+            threadpool_run_job(pool, &job);
+            return 0;
+        }
+    }
+    else {
+        if (__atomic_load_n(&pool->stopping, __ATOMIC_SEQ_CST)) {
+            __atomic_sub_fetch(&pool->pending, 1, __ATOMIC_SEQ_CST);
+            return -1;
+        }
+        if (!threadpool_queue_push(&pool->queue, &job)) {
+            OS_FMUTEX_LOCK(&pool->mutex);
+            __atomic_add_fetch(&pool->space_waiters, 1, __ATOMIC_SEQ_CST);
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            while (!threadpool_queue_push(&pool->queue, &job))
+                OS_FCOND_WAIT(&pool->space_cond, &pool->mutex);
+            __atomic_sub_fetch(&pool->space_waiters, 1, __ATOMIC_SEQ_CST);
+            OS_FMUTEX_UNLOCK(&pool->mutex);
+        }
+    }
+
+    threadpool_notify(pool);
+    return 0;
+}
+
+static unsigned int threadpool_cpu_count()
+{
+#if defined(_SC_NPROCESSORS_ONLN)
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (unsigned int)count : 1;
+#else
+    return 2;
+#endif
+}
+
+os_threadpool_t os_threadpool_create(struct os_threadpool_attr *attr)
+{
+    struct os_threadpool *pool = OS_CALLOC(1, sizeof(struct os_threadpool));
+    unsigned long queue_size;
+    const char *name;
+
+    if (pool == NULL) {
+        OS_LOGE(LOG_TAG, "Failed to allocate thread pool");
+        return NULL;
+    }
+
+    pool->min_threads = (attr != NULL && attr->min_threads > 0) ? attr->min_threads : threadpool_cpu_count();
+    pool->max_threads = (attr != NULL && attr->max_threads > pool->min_threads) ? attr->max_threads : pool->min_threads;
+    pool->idle_timeout_ms = (attr != NULL && attr->idle_timeout_ms > 0) ? attr->idle_timeout_ms : DEFAULT_IDLE_TIMEOUT_MS;
+    queue_size = round_up_pow2((attr != NULL && attr->queue_size > 0) ? attr->queue_size : DEFAULT_QUEUE_SIZE);
+    name = (attr != NULL && attr->name != NULL) ? attr->name : "threadpool";
+
+    pool->thread_attr.name = OS_STRDUP(name);
+    pool->thread_attr.priority = attr != NULL ? attr->priority : OS_THREAD_PRIO_NORMAL;
+    pool->thread_attr.stacksize = (attr != NULL && attr->stacksize > 0) ? attr->stacksize : DEFAULT_STACKSIZE;
+    pool->thread_attr.joinable = true;
+    if (attr != NULL)
+        pool->thread_attr.sched = attr->sched;
+
+    OS_FMUTEX_INIT(&pool->mutex);
+    OS_FCOND_INIT(&pool->work_cond);
+    OS_FCOND_INIT(&pool->space_cond);
+    OS_FCOND_INIT(&pool->drain_cond);
+
+    if (pool->thread_attr.name == NULL || threadpool_queue_init(&pool->queue, queue_size) != 0) {
+        OS_LOGE(LOG_TAG, "Failed to allocate global queue");
+        goto error;
+    }
+
+    pool->workers = OS_CALLOC(pool->max_threads, sizeof(struct threadpool_worker));
+    if (pool->workers == NULL) {
+        OS_LOGE(LOG_TAG, "Failed to allocate workers");
+        goto error;
+    }
+    for (unsigned int i = 0; i < pool->max_threads; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].rand = 2463534242U + i;
+        if (threadpool_deque_init(&pool->workers[i].deque, queue_size) != 0) {
+            OS_LOGE(LOG_TAG, "Failed to allocate worker deque");
+            goto error;
+        }
+    }
+
+    OS_FMUTEX_LOCK(&pool->mutex);
+    for (unsigned int i = 0; i < pool->min_threads; i++) {
+        if (threadpool_spawn_l(pool) != 0) {
+            OS_FMUTEX_UNLOCK(&pool->mutex);
+            os_threadpool_destroy(pool);
+            return NULL;
+        }
+    }
+    OS_FMUTEX_UNLOCK(&pool->mutex);
+    return pool;
+
+error:
+    if (pool->workers != NULL) {
+        for (unsigned int i = 0; i < pool->max_threads; i++) {
+            if (pool->workers[i].deque.jobs != NULL)
+                OS_FREE(pool->workers[i].deque.jobs);
+        }
+        OS_FREE(pool->workers);
+    }
+    if (pool->queue.cells != NULL)
+        OS_FREE(pool->queue.cells);
+    if (pool->thread_attr.name != NULL)
+        OS_FREE(pool->thread_attr.name);
+    OS_FCOND_DESTROY(&pool->drain_cond);
+    OS_FCOND_DESTROY(&pool->space_cond);
+    OS_FCOND_DESTROY(&pool->work_cond);
+    OS_FMUTEX_DESTROY(&pool->mutex);
+    OS_FREE(pool);
+    return NULL;
+}
+
+int os_threadpool_submit(os_threadpool_t pool, void (*fn)(void *arg), void *arg)
+{
+    return threadpool_post(pool, fn, arg);
+}
+
+static void threadpool_future_run(void *arg)
+{
+    struct os_future *future = (struct os_future *)arg;
+    void *result = future->fn(future->arg);
+
+    OS_FMUTEX_LOCK(&future->mutex);
+    future->result = result;
+    __atomic_store_n(&future->ready, true, __ATOMIC_RELEASE);
+    OS_FCOND_BROADCAST(&future->cond);
+    OS_FMUTEX_UNLOCK(&future->mutex);
+}
+
+os_future_t os_threadpool_async(os_threadpool_t pool, void *(*fn)(void *arg), void *arg)
+{
+    struct os_future *future = OS_CALLOC(1, sizeof(struct os_future));
+    if (future == NULL) {
+        OS_LOGE(LOG_TAG, "Failed to allocate future");
+        return NULL;
+    }
+    future->fn = fn;
+    future->arg = arg;
+    OS_FMUTEX_INIT(&future->mutex);
+    OS_FCOND_INIT(&future->cond);
+
+    if (threadpool_post(pool, threadpool_future_run, future) != 0) {
+        OS_FCOND_DESTROY(&future->cond);
+        OS_FMUTEX_DESTROY(&future->mutex);
+        OS_FREE(future);
+        return NULL;
+    }
+    return future;
+}
+
+bool os_future_ready(os_future_t future)
+{
+    return __atomic_load_n(&future->ready, __ATOMIC_ACQUIRE);
+}
+
+// On a worker, run other jobs until ready returns true or no job is found
+static void threadpool_help(bool (*ready)(void *arg), void *arg)
+{
+    struct threadpool_worker *worker = threadpool_current_worker();
+    struct threadpool_job job;
+
+    if (worker == NULL)
+        return;
+    while (!ready(arg) && threadpool_find_job(worker->pool, worker, &job, false))
+        threadpool_run_job(worker->pool, &job);
+}
+
+static bool threadpool_future_ready(void *arg)
+{
+    return os_future_ready((os_future_t)arg);
+}
+
+void *os_future_get(os_future_t future)
+{
+    void *result;
+
+    threadpool_help(threadpool_future_ready, future);
+
+    // the job is running on another thread if not ready yet
+    OS_FMUTEX_LOCK(&future->mutex);
+    while (!future->ready)
+        OS_FCOND_WAIT(&future->cond, &future->mutex);
+    result = future->result;
+    OS_FMUTEX_UNLOCK(&future->mutex);
+
+    OS_FCOND_DESTROY(&future->cond);
+    OS_FMUTEX_DESTROY(&future->mutex);
+    OS_FREE(future);
+    return result;
+}
+
+static void threadpool_range_put(struct threadpool_range *range)
+{
+    if (__atomic_sub_fetch(&range->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        OS_FCOND_DESTROY(&range->cond);
+        OS_FMUTEX_DESTROY(&range->mutex);
+        OS_FREE(range);
+    }
+}
+
+// Take chunks until none left, helpers may start after the whole range is done
+static void threadpool_range_run(struct threadpool_range *range)
+{
+    for (;;) {
+        size_t begin = __atomic_fetch_add(&range->next, range->grain, __ATOMIC_RELAXED);
+        if (begin >= range->end)
+            break;
+        size_t end = range->end - begin > range->grain ? begin + range->grain : range->end;
+        range->fn(begin, end, range->arg);
+
+        if (__atomic_sub_fetch(&range->chunks_left, 1, __ATOMIC_ACQ_REL) == 0) {
+            OS_FMUTEX_LOCK(&range->mutex);
+            range->done = true;
+            OS_FCOND_SIGNAL(&range->cond);
+            OS_FMUTEX_UNLOCK(&range->mutex);
+        }
+    }
+}
+
+static void threadpool_range_helper(void *arg)
+{
+    struct threadpool_range *range = (struct threadpool_range *)arg;
+    threadpool_range_run(range);
+    threadpool_range_put(range);
+}
+
+static bool threadpool_range_done(void *arg)
+{
+    struct threadpool_range *range = (struct threadpool_range *)arg;
+    return __atomic_load_n(&range->chunks_left, __ATOMIC_ACQUIRE) == 0;
+}
+
+void os_threadpool_parallel_for(os_threadpool_t pool, size_t begin, size_t end, size_t grain,
+                                void (*fn)(size_t begin, size_t end, void *arg), void *arg)
+{
+    struct threadpool_range *range;
+    unsigned int threads = __atomic_load_n(&pool->threads, __ATOMIC_RELAXED);
+    size_t count, chunks, helpers;
+
+    if (begin >= end)
+        return;
+    count = end - begin;
+    if (grain == 0)
+        grain = (count + threads * CHUNKS_PER_WORKER - 1) / (threads * CHUNKS_PER_WORKER);
+    chunks = (count + grain - 1) / grain;
+    helpers = chunks - 1 < threads ? chunks - 1 : threads;
+
+    range = helpers > 0 ? OS_CALLOC(1, sizeof(struct threadpool_range)) : NULL;
+    if (range == NULL) {
+        // one chunk or out of memory, run in caller
+        fn(begin, end, arg);
+        return;
+    }
+    range->fn = fn;
+    range->arg = arg;
+    range->end = end;
+    range->grain = grain;
+    range->next = begin;
+    range->chunks_left = chunks;
+    range->refs = 1 + helpers;
+    OS_FMUTEX_INIT(&range->mutex);
+    OS_FCOND_INIT(&range->cond);
+
+    for (size_t i = 0; i < helpers; i++) {
+        if (threadpool_post(pool, threadpool_range_helper, range) != 0)
+            threadpool_range_put(range); // stopping, caller does the chunks
+    }
+
+    threadpool_range_run(range);
+    threadpool_help(threadpool_range_done, range);
+
+    // the remaining chunks are running on other threads
+    OS_FMUTEX_LOCK(&range->mutex);
+    while (!range->done)
+        OS_FCOND_WAIT(&range->cond, &range->mutex);
+    OS_FMUTEX_UNLOCK(&range->mutex);
+    threadpool_range_put(range);
+}
+
+void os_threadpool_drain(os_threadpool_t pool)
+{
+    OS_FMUTEX_LOCK(&pool->mutex);
+    __atomic_add_fetch(&pool->drain_waiters, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&pool->pending, __ATOMIC_SEQ_CST) != 0)
+        OS_FCOND_WAIT(&pool->drain_cond, &pool->mutex);
+    __atomic_sub_fetch(&pool->drain_waiters, 1, __ATOMIC_SEQ_CST);
+    OS_FMUTEX_UNLOCK(&pool->mutex);
+}
+
+unsigned int os_threadpool_threads(os_threadpool_t pool)
+{
+    return __atomic_load_n(&pool->threads, __ATOMIC_RELAXED);
+}
+
+void os_threadpool_destroy(os_threadpool_t pool)
+{
+    __atomic_store_n(&pool->stopping, true, __ATOMIC_SEQ_CST);
+    os_threadpool_drain(pool);
+
+    OS_FMUTEX_LOCK(&pool->mutex);
+    OS_FCOND_BROADCAST(&pool->work_cond);
+    OS_FMUTEX_UNLOCK(&pool->mutex);
+
+    for (unsigned int i = 0; i < pool->max_threads; i++) {
+        struct threadpool_worker *worker = &pool->workers[i];
+        if (worker->thread_id != NULL)
+            OS_THREAD_JOIN(worker->thread_id, NULL);
+        OS_FREE(worker->deque.jobs);
+    }
+    OS_FREE(pool->workers);
+    OS_FREE(pool->queue.cells);
+    OS_FREE(pool->thread_attr.name);
+    OS_FCOND_DESTROY(&pool->drain_cond);
+    OS_FCOND_DESTROY(&pool->space_cond);
+    OS_FCOND_DESTROY(&pool->work_cond);
+    OS_FMUTEX_DESTROY(&pool->mutex);
+    OS_FREE(pool);
+}
@@ -0,0 +1,507 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <string.h>
+#include "cutils/common_list.h"
+#include "cutils/os_memory.h"
+#include "cutils/os_logger.h"
+#include "cutils/os_futex.h"
+#include "cutils/os_time.h"
+#include "cutils/pipeline.h"
+
+#define LOG_TAG "pipeline"
+
+#define DEFAULT_QUEUE_SIZE 64
+#define DEFAULT_STACKSIZE  4096
+
+struct pipeline_stage {
+    struct listnode listnode;
+    struct pipeline *pipeline;
+    struct pipeline_stage *next;
+    int index;
+    char *name;
+    pipeline_stage_cb handle;
+    void *arg;
+    bool ordered;
+    struct os_threadattr thread_attr;
+
+    // input queue and worker state, protected by mutex
+    os_fmutex_t mutex;
+    os_fcond_t not_empty;
+    os_fcond_t not_full;
+    os_fcond_t order_cond;
+    void **items;
+    unsigned int size;
+    unsigned int head;
+    unsigned int count;
+    unsigned int count_max;
+    unsigned long long ticket_in;  // ticket of next item taken from queue
+    unsigned long long ticket_out; // ticket allowed to leave the stage, for ordered stage
+    unsigned int workers;          // target number of workers
+    unsigned int running;          // workers running
+
+    // stats, updated by workers atomically
+    unsigned long long items_handled;
+    unsigned long long busy_us;
+    unsigned long long blocked_us;
+};
+
+struct pipeline {
+    char *name;
+    void (*free_cb)(void *item);
+    struct listnode stages;
+    unsigned int stage_count;
+    struct pipeline_stage *first;
+    bool started;
+    bool stopping;
+    unsigned long long stats_since;
+
+    os_fmutex_t mutex;
+    os_fcond_t cond;             // workers exited or pipeline drained
+    unsigned int running;        // workers running in all stages
+    unsigned long long inflight; // items pushed and not left yet
+    unsigned int drain_waiters;
+};
+
+static void *pipeline_worker_entry(void *arg);
+
+static struct pipeline_stage *pipeline_stage_at(struct pipeline *pipeline, int index)
+{
+    struct listnode *node;
+    list_for_each(node, &pipeline->stages) {
+        struct pipeline_stage *stage = node_to_item(node, struct pipeline_stage, listnode);
+        if (stage->index == index)
+            return stage;
+    }
+    return NULL;
+}
+
+static void pipeline_release(struct pipeline *pipeline, void *item)
+{
+    if (item != NULL && pipeline->free_cb != NULL)
+        pipeline->free_cb(item);
+}
+
+// An item left the pipeline: consumed by a stage, out of the last stage or dropped by stop
+static void pipeline_item_done(struct pipeline *pipeline)
+{
+    if (__atomic_sub_fetch(&pipeline->inflight, 1, __ATOMIC_SEQ_CST) == 0 &&
+        __atomic_load_n(&pipeline->drain_waiters, __ATOMIC_SEQ_CST) > 0) {
+        OS_FMUTEX_LOCK(&pipeline->mutex);
+        OS_FCOND_BROADCAST(&pipeline->cond);
+        OS_FMUTEX_UNLOCK(&pipeline->mutex);
+    }
+}
+
+/*
+ * Put item to input queue of stage, wait timeout_us for space (0 to wait
+ * forever), return -1 on timeout or stopping. blocked_us gets time waited.
+ */
+static int pipeline_queue_push(struct pipeline_stage *stage, void *item,
+                               unsigned long long timeout_us, unsigned long long *blocked_us)
+{
+    struct pipeline *pipeline = stage->pipeline;
+    unsigned long long start = 0, now;
+    int ret = 0;
+
+    OS_FMUTEX_LOCK(&stage->mutex);
+    while (stage->count == stage->size && !pipeline->stopping) {
+        now = OS_MONOTONIC_USEC();
+        if (start == 0)
+            start = now;
+        if (timeout_us == 0) {
+            OS_FCOND_WAIT(&stage->not_full, &stage->mutex);
+        }
+        else if (now - start >= timeout_us) {
+            break;
+        }
+        else {
+            OS_FCOND_TIMEDWAIT(&stage->not_full, &stage->mutex, timeout_us - (now - start));
+        }
+    }
+    if (stage->count < stage->size && !pipeline->stopping) {
+        stage->items[(stage->head + stage->count) % stage->size] = item;
+        stage->count++;
+        if (stage->count > stage->count_max)
+            stage->count_max = stage->count;
+        OS_FCOND_SIGNAL(&stage->not_empty);
+    }
+    else {
+        ret = -1;
+    }
+    OS_FMUTEX_UNLOCK(&stage->mutex);
+
+    if (start != 0 && blocked_us != NULL)
+        *blocked_us = OS_MONOTONIC_USEC() - start;
+    return ret;
+}
+
+// Pass item of ticket downstream, an ordered stage waits for the turn of ticket
+static void pipeline_stage_output(struct pipeline_stage *stage, unsigned long long ticket, void *item)
+{
+    struct pipeline *pipeline = stage->pipeline;
+    unsigned long long blocked_us = 0;
+
+    if (stage->ordered) {
+        OS_FMUTEX_LOCK(&stage->mutex);
+        while (stage->ticket_out != ticket && !pipeline->stopping)
+            OS_FCOND_WAIT(&stage->order_cond, &stage->mutex);
+        OS_FMUTEX_UNLOCK(&stage->mutex);
+    }
+
+    if (item == NULL) {
+        pipeline_item_done(pipeline);
+    }
+    else if (stage->next == NULL) {
+        pipeline_release(pipeline, item);
+        pipeline_item_done(pipeline);
+    }
+    else {
+        if (pipeline_queue_push(stage->next, item, 0, &blocked_us) != 0) {
+            // stopping
+            pipeline_release(pipeline, item);
+            pipeline_item_done(pipeline);
+        }
+        if (blocked_us > 0)
+            __atomic_add_fetch(&stage->blocked_us, blocked_us, __ATOMIC_RELAXED);
+    }
+
+    if (stage->ordered) {
+        OS_FMUTEX_LOCK(&stage->mutex);
+        stage->ticket_out++;
+        OS_FCOND_BROADCAST(&stage->order_cond);
+        OS_FMUTEX_UNLOCK(&stage->mutex);
+    }
+}
+
+static int pipeline_spawn_l(struct pipeline_stage *stage)
+{
+    struct pipeline *pipeline = stage->pipeline;
+
+    if (OS_THREAD_CREATE(&stage->thread_attr, pipeline_worker_entry, stage) == NULL) {
+        OS_LOGE(LOG_TAG, "[%s]: Failed to run worker of stage [%s]", pipeline->name, stage->name);
+        return -1;
+    }
+    stage->running++;
+    OS_FMUTEX_LOCK(&pipeline->mutex);
+    pipeline->running++;
+    OS_FMUTEX_UNLOCK(&pipeline->mutex);
+    return 0;
+}
+
+static void *pipeline_worker_entry(void *arg)
+{
+    struct pipeline_stage *stage = (struct pipeline_stage *)arg;
+    struct pipeline *pipeline = stage->pipeline;
+    unsigned long long ticket, start;
+    void *item;
+
+    for (;;) {
+        OS_FMUTEX_LOCK(&stage->mutex);
+        while (stage->count == 0 && !pipeline->stopping && stage->running <= stage->workers)
+            OS_FCOND_WAIT(&stage->not_empty, &stage->mutex);
+        if (pipeline->stopping || stage->running > stage->workers) {
+            stage->running--;
+            OS_FMUTEX_UNLOCK(&stage->mutex);
+            break;
+        }
+        item = stage->items[stage->head];
+        stage->head = (stage->head + 1) % stage->size;
+        stage->count--;
+        ticket = stage->ticket_in++;
+        OS_FCOND_SIGNAL(&stage->not_full);
+        OS_FMUTEX_UNLOCK(&stage->mutex);
+
+        start = OS_MONOTONIC_USEC();
+        item = stage->handle(item, stage->arg);
+        __atomic_add_fetch(&stage->busy_us, OS_MONOTONIC_USEC() - start, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&stage->items_handled, 1, __ATOMIC_RELAXED);
+
+        pipeline_stage_output(stage, ticket, item);
+    }
+
+    OS_FMUTEX_LOCK(&pipeline->mutex);
+    pipeline->running--;
+    OS_FCOND_BROADCAST(&pipeline->cond);
+    OS_FMUTEX_UNLOCK(&pipeline->mutex);
+    return NULL;
+}
+
+pipeline_t pipeline_create(const char *name, void (*free_cb)(void *item))
+{
+    struct pipeline *pipeline = OS_CALLOC(1, sizeof(struct pipeline));
+    if (pipeline == NULL) {
+        OS_LOGE(LOG_TAG, "Failed to allocate pipeline");
+        return NULL;
+    }
+
+    pipeline->name = OS_STRDUP(name != NULL ? name : "pipeline");
+    if (pipeline->name == NULL) {
+        OS_LOGE(LOG_TAG, "Failed to allocate pipeline name");
+        OS_FREE(pipeline);
+        return NULL;
+    }
+    pipeline->free_cb = free_cb;
+    list_init(&pipeline->stages);
+    OS_FMUTEX_INIT(&pipeline->mutex);
+    OS_FCOND_INIT(&pipeline->cond);
+    return pipeline;
+}
+
+int pipeline_add_stage(pipeline_t pipeline, struct pipeline_stage_attr *attr)
+{
+    struct pipeline_stage *stage;
+
+    if (pipeline->started || attr == NULL || attr->handle == NULL) {
+        OS_LOGE(LOG_TAG, "[%s]: Invalid stage or pipeline already started", pipeline->name);
+        return -1;
+    }
+
+    stage = OS_CALLOC(1, sizeof(struct pipeline_stage));
+    if (stage == NULL) {
+        OS_LOGE(LOG_TAG, "[%s]: Failed to allocate stage", pipeline->name);
+        return -1;
+    }
+    stage->size = attr->queue_size > 0 ? attr->queue_size : DEFAULT_QUEUE_SIZE;
+    stage->items = OS_CALLOC(stage->size, sizeof(void *));
+    stage->name = OS_STRDUP(attr->name != NULL ? attr->name : "stage");
+    if (stage->items == NULL || stage->name == NULL) {
+        OS_LOGE(LOG_TAG, "[%s]: Failed to allocate stage queue", pipeline->name);
+        if (stage->items != NULL)
+            OS_FREE(stage->items);
+        if (stage->name != NULL)
+            OS_FREE(stage->name);
+        OS_FREE(stage);
+        return -1;
+    }
+
+    stage->pipeline = pipeline;
+    stage->index = pipeline->stage_count;
+    stage->handle = attr->handle;
+    stage->arg = attr->arg;
+    stage->ordered = attr->ordered;
+    stage->workers = attr->workers > 0 ? attr->workers : 1;
+    stage->thread_attr.name = stage->name;
+    stage->thread_attr.priority = attr->priority;
+    stage->thread_attr.stacksize = DEFAULT_STACKSIZE;
+    stage->thread_attr.joinable = false;
+    stage->thread_attr.sched = attr->sched;
+    OS_FMUTEX_INIT(&stage->mutex);
+    OS_FCOND_INIT(&stage->not_empty);
+    OS_FCOND_INIT(&stage->not_full);
+    OS_FCOND_INIT(&stage->order_cond);
+
+    if (!list_empty(&pipeline->stages)) {
+        struct pipeline_stage *last = node_to_item(list_tail(&pipeline->stages), struct pipeline_stage, listnode);
+        last->next = stage;
+    }
+    else {
+        pipeline->first = stage;
+    }
+    list_add_tail(&pipeline->stages, &stage->listnode);
+    pipeline->stage_count++;
+    return stage->index;
+}
+
+int pipeline_start(pipeline_t pipeline)
+{
+    struct listnode *node;
+
+    if (pipeline->started || pipeline->first == NULL) {
+        OS_LOGE(LOG_TAG, "[%s]: No stage or already started", pipeline->name);
+        return -1;
+    }
+
+    pipeline->started = true;
+    pipeline->stopping = false;
+    pipeline->stats_since = OS_MONOTONIC_USEC();
+    list_for_each(node, &pipeline->stages) {
+        struct pipeline_stage *stage = node_to_item(node, struct pipeline_stage, listnode);
+        OS_FMUTEX_LOCK(&stage->mutex);
+        for (unsigned int i = 0; i < stage->workers; i++) {
+            if (pipeline_spawn_l(stage) != 0) {
+                OS_FMUTEX_UNLOCK(&stage->mutex);
+                pipeline_stop(pipeline);
+                return -1;
+            }
+        }
+        OS_FMUTEX_UNLOCK(&stage->mutex);
+    }
+    return 0;
+}
+
+int pipeline_push(pipeline_t pipeline, void *item, unsigned int timeout_ms)
+{
+    if (!pipeline->started)
+        return -1;
+
+    __atomic_add_fetch(&pipeline->inflight, 1, __ATOMIC_SEQ_CST);
+    if (pipeline_queue_push(pipeline->first, item, timeout_ms * 1000ULL, NULL) != 0) {
+        pipeline_item_done(pipeline);
+        return -1;
+    }
+    return 0;
+}
+
+void pipeline_drain(pipeline_t pipeline)
+{
+    OS_FMUTEX_LOCK(&pipeline->mutex);
+    __atomic_add_fetch(&pipeline->drain_waiters, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&pipeline->inflight, __ATOMIC_SEQ_CST) != 0 && pipeline->running > 0)
+        OS_FCOND_WAIT(&pipeline->cond, &pipeline->mutex);
+    __atomic_sub_fetch(&pipeline->drain_waiters, 1, __ATOMIC_SEQ_CST);
+    OS_FMUTEX_UNLOCK(&pipeline->mutex);
+}
+
+int pipeline_set_workers(pipeline_t pipeline, int index, unsigned int workers)
+{
+    struct pipeline_stage *stage = pipeline_stage_at(pipeline, index);
+    int ret = 0;
+
+    if (stage == NULL || workers == 0)
+        return -1;
+
+    OS_FMUTEX_LOCK(&stage->mutex);
+    stage->workers = workers;
+    if (pipeline->started && !pipeline->stopping) {
+        while (stage->running < stage->workers && ret == 0)
+            ret = pipeline_spawn_l(stage);
+        // extra workers see running > workers and exit
+        OS_FCOND_BROADCAST(&stage->not_empty);
+    }
+    OS_FMUTEX_UNLOCK(&stage->mutex);
+    return ret;
+}
+
+int pipeline_get_stats(pipeline_t pipeline, int index, struct pipeline_stage_stats *stats)
+{
+    struct pipeline_stage *stage = pipeline_stage_at(pipeline, index);
+    unsigned long long elapsed;
+
+    if (stage == NULL || stats == NULL)
+        return -1;
+
+    elapsed = OS_MONOTONIC_USEC() - pipeline->stats_since;
+    OS_FMUTEX_LOCK(&stage->mutex);
+    stats->name = stage->name;
+    stats->workers = stage->workers;
+    stats->queue_depth = stage->count;
+    stats->queue_depth_max = stage->count_max;
+    stats->queue_size = stage->size;
+    OS_FMUTEX_UNLOCK(&stage->mutex);
+    stats->items = __atomic_load_n(&stage->items_handled, __ATOMIC_RELAXED);
+    stats->busy_us = __atomic_load_n(&stage->busy_us, __ATOMIC_RELAXED);
+    stats->blocked_us = __atomic_load_n(&stage->blocked_us, __ATOMIC_RELAXED);
+    stats->items_per_sec = elapsed > 0 ? stats->items * 1000000ULL / elapsed : 0;
+    return 0;
+}
+
+void pipeline_reset_stats(pipeline_t pipeline)
+{
+    struct listnode *node;
+
+    list_for_each(node, &pipeline->stages) {
+        struct pipeline_stage *stage = node_to_item(node, struct pipeline_stage, listnode);
+        OS_FMUTEX_LOCK(&stage->mutex);
+        stage->count_max = stage->count;
+        OS_FMUTEX_UNLOCK(&stage->mutex);
+        __atomic_store_n(&stage->items_handled, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&stage->busy_us, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&stage->blocked_us, 0, __ATOMIC_RELAXED);
+    }
+    pipeline->stats_since = OS_MONOTONIC_USEC();
+}
+
+unsigned int pipeline_stage_count(pipeline_t pipeline)
+{
+    return pipeline->stage_count;
+}
+
+void pipeline_dump(pipeline_t pipeline)
+{
+    struct pipeline_stage_stats stats;
+
+    OS_LOGI(LOG_TAG, "Dump pipeline:");
+    OS_LOGI(LOG_TAG, " > name=[%s], inflight=[%llu]", pipeline->name,
+            __atomic_load_n(&pipeline->inflight, __ATOMIC_RELAXED));
+    for (unsigned int i = 0; i < pipeline->stage_count; i++) {
+        if (pipeline_get_stats(pipeline, i, &stats) != 0)
+            continue;
+        OS_LOGI(LOG_TAG, "   > [%u] [%s]: workers=[%u], items=[%llu], rate=[%llu]/s, busy=[%llu]ms, "
+                "blocked=[%llu]ms, queue=[%u/%u], max=[%u]",
+                i, stats.name, stats.workers, stats.items, stats.items_per_sec, stats.busy_us / 1000,
+                stats.blocked_us / 1000, stats.queue_depth, stats.queue_size, stats.queue_depth_max);
+    }
+}
+
+void pipeline_stop(pipeline_t pipeline)
+{
+    struct listnode *node;
+
+    if (!pipeline->started)
+        return;
+
+    __atomic_store_n(&pipeline->stopping, true, __ATOMIC_SEQ_CST);
+    list_for_each(node, &pipeline->stages) {
+        struct pipeline_stage *stage = node_to_item(node, struct pipeline_stage, listnode);
+        OS_FMUTEX_LOCK(&stage->mutex);
+        OS_FCOND_BROADCAST(&stage->not_empty);
+        OS_FCOND_BROADCAST(&stage->not_full);
+        OS_FCOND_BROADCAST(&stage->order_cond);
+        OS_FMUTEX_UNLOCK(&stage->mutex);
+    }
+
+    OS_FMUTEX_LOCK(&pipeline->mutex);
+    while (pipeline->running > 0)
+        OS_FCOND_WAIT(&pipeline->cond, &pipeline->mutex);
+    OS_FMUTEX_UNLOCK(&pipeline->mutex);
+
+    list_for_each(node, &pipeline->stages) {
+        struct pipeline_stage *stage = node_to_item(node, struct pipeline_stage, listnode);
+        while (stage->count > 0) {
+            pipeline_release(pipeline, stage->items[stage->head]);
+            pipeline_item_done(pipeline);
+            stage->head = (stage->head + 1) % stage->size;
+            stage->count--;
+        }
+        stage->ticket_in = stage->ticket_out = 0;
+    }
+    pipeline->started = false;
+}
+
+void pipeline_destroy(pipeline_t pipeline)
+{
+    struct listnode *node, *tmp;
+
+    pipeline_stop(pipeline);
+
+    list_for_each_safe(node, tmp, &pipeline->stages) {
+        struct pipeline_stage *stage = node_to_item(node, struct pipeline_stage, listnode);
+        list_remove(node);
+        OS_FCOND_DESTROY(&stage->order_cond);
+        OS_FCOND_DESTROY(&stage->not_full);
+        OS_FCOND_DESTROY(&stage->not_empty);
+        OS_FMUTEX_DESTROY(&stage->mutex);
+        OS_FREE(stage->items);
+        OS_FREE(stage->name);
+        OS_FREE(stage);
+    }
+    OS_FCOND_DESTROY(&pipeline->cond);
+    OS_FMUTEX_DESTROY(&pipeline->mutex);
+    OS_FREE(pipeline->name);
+    OS_FREE(pipeline);
+}
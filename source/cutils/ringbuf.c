@@ -30,6 +30,7 @@
 #include <stdbool.h>
 #include <string.h>
 #include "cutils/os_thread.h"
+#include "cutils/os_futex.h"
 #include "cutils/os_memory.h"
 #include "cutils/os_logger.h"
 #include "cutils/ringbuf.h"
@@ -43,16 +44,26 @@ struct ringbuf {
     int  fill_cnt;               /**< Number of filled slots */
     int  threshold_cnt;          /**< Number of threshold slots */
     int  size;                   /**< Buffer size */
-    os_cond_t can_read;
-    os_cond_t can_write;
-    os_mutex_t lock;
+    os_fcond_t can_read;
+    os_fcond_t can_write;
+    os_fmutex_t lock;
     bool abort_read;
     bool abort_write;
     bool is_done_write;          /**< To signal that we are done writing */
     bool unblock_reader_flag;    /**< To unblock instantly from rb_read */
     bool is_reach_threshold;
+    void (*notify)(void *arg);   /**< Reader readiness hook, see rb_set_notify() */
+    void *notify_arg;
 };
 
+// wake up blocked reader and the event driven one, called with rb->lock held
+static inline void rb_signal_reader_l(ringbuf_handle_t rb)
+{
+    OS_FCOND_SIGNAL(&rb->can_read);
+    if (rb->notify != NULL)
+        rb->notify(rb->notify_arg);
+}
+
 ringbuf_handle_t rb_create(int size)
 {
     ringbuf_handle_t rb;
@@ -60,17 +71,19 @@ ringbuf_handle_t rb_create(int size)
     bool _success =
         (
             (rb             = OS_CALLOC(1, sizeof(struct ringbuf))) &&
-            (buf            = OS_CALLOC(1, size))                &&
-            (rb->lock       = OS_THREAD_MUTEX_CREATE())          &&
-            (rb->can_read   = OS_THREAD_COND_CREATE())           &&
-            (rb->can_write  = OS_THREAD_COND_CREATE())
+            (buf            = OS_CALLOC(1, size))
         );
 
     if (!_success) {
-        rb_destroy(rb);
+        if (rb != NULL)
+            OS_FREE(rb);
         return NULL;
     }
 
+    OS_FMUTEX_INIT(&rb->lock);
+    OS_FCOND_INIT(&rb->can_read);
+    OS_FCOND_INIT(&rb->can_write);
+
     rb->p_o = rb->p_r = rb->p_w = buf;
     rb->size = size;
     rb->is_done_write = false;
@@ -86,26 +99,23 @@ void rb_destroy(ringbuf_handle_t rb)
         return;
     if (rb->p_o)
         OS_FREE(rb->p_o);
-    if (rb->can_read)
-        OS_THREAD_COND_DESTROY(rb->can_read);
-    if (rb->can_write)
-        OS_THREAD_COND_DESTROY(rb->can_write);
-    if (rb->lock)
-        OS_THREAD_MUTEX_DESTROY(rb->lock);
+    OS_FCOND_DESTROY(&rb->can_read);
+    OS_FCOND_DESTROY(&rb->can_write);
+    OS_FMUTEX_DESTROY(&rb->lock);
     OS_FREE(rb);
 }
 
 void rb_reset(ringbuf_handle_t rb)
 {
-    OS_THREAD_MUTEX_LOCK(rb->lock);
+    OS_FMUTEX_LOCK(&rb->lock);
     rb->p_r = rb->p_w = rb->p_o;
     rb->fill_cnt = 0;
     rb->is_done_write = false;
     rb->unblock_reader_flag = false;
     rb->abort_read = false;
     rb->abort_write = false;
-    OS_THREAD_COND_SIGNAL(rb->can_write);
-    OS_THREAD_MUTEX_UNLOCK(rb->lock);
+    OS_FCOND_SIGNAL(&rb->can_write);
+    OS_FMUTEX_UNLOCK(&rb->lock);
 }
 
 int rb_bytes_available(ringbuf_handle_t rb)
@@ -125,7 +135,7 @@ int rb_read(ringbuf_handle_t rb, char *buf, int buf_len, unsigned int timeout_ms
     int ret_val = 0;
 
     //take buffer lock
-    OS_THREAD_MUTEX_LOCK(rb->lock);
+    OS_FMUTEX_LOCK(&rb->lock);
 
     while (buf_len > 0) {
         if (rb->fill_cnt < buf_len) {
@@ -158,12 +168,12 @@ int rb_read(ringbuf_handle_t rb, char *buf, int buf_len, unsigned int timeout_ms
                 ret_val = RB_TIMEOUT;
                 goto read_err;
             }
-            OS_THREAD_COND_SIGNAL(rb->can_write);
+            OS_FCOND_SIGNAL(&rb->can_write);
             //wait till some data available to read
             if (timeout_ms == 0)
-                ret_val = OS_THREAD_COND_WAIT(rb->can_read, rb->lock);
+                ret_val = OS_FCOND_WAIT(&rb->can_read, &rb->lock);
             else
-                ret_val = OS_THREAD_COND_TIMEDWAIT(rb->can_read, rb->lock, timeout_ms*1000);
+                ret_val = OS_FCOND_TIMEDWAIT(&rb->can_read, &rb->lock, timeout_ms*1000);
             if (ret_val != 0) {
                 ret_val = RB_TIMEOUT;
                 goto read_err;
@@ -191,9 +201,9 @@ int rb_read(ringbuf_handle_t rb, char *buf, int buf_len, unsigned int timeout_ms
 
 read_err:
     if (total_read_size > 0) {
-        OS_THREAD_COND_SIGNAL(rb->can_write);
+        OS_FCOND_SIGNAL(&rb->can_write);
     }
-    OS_THREAD_MUTEX_UNLOCK(rb->lock);
+    OS_FMUTEX_UNLOCK(&rb->lock);
     if ((ret_val == RB_FAIL) || (ret_val == RB_ABORT)) {
         total_read_size = ret_val;
     }
@@ -207,7 +217,7 @@ int rb_write(ringbuf_handle_t rb, char *buf, int buf_len, unsigned int timeout_m
     int ret_val = 0;
 
     //take buffer lock
-    OS_THREAD_MUTEX_LOCK(rb->lock);
+    OS_FMUTEX_LOCK(&rb->lock);
 
     while (buf_len > 0) {
         write_size = rb_bytes_available(rb);
@@ -226,12 +236,12 @@ int rb_write(ringbuf_handle_t rb, char *buf, int buf_len, unsigned int timeout_m
                 rb->is_reach_threshold = true;
                 goto write_err;
             }
-            OS_THREAD_COND_SIGNAL(rb->can_read);
+            rb_signal_reader_l(rb);
             //wait till we have some empty space to write
             if (timeout_ms == 0)
-                ret_val = OS_THREAD_COND_WAIT(rb->can_write, rb->lock);
+                ret_val = OS_FCOND_WAIT(&rb->can_write, &rb->lock);
             else
-                ret_val = OS_THREAD_COND_TIMEDWAIT(rb->can_write, rb->lock, timeout_ms*1000);
+                ret_val = OS_FCOND_TIMEDWAIT(&rb->can_write, &rb->lock, timeout_ms*1000);
             if (ret_val != 0) {
                 ret_val = RB_TIMEOUT;
                 goto write_err;
@@ -262,9 +272,9 @@ int rb_write(ringbuf_handle_t rb, char *buf, int buf_len, unsigned int timeout_m
 
 write_err:
     if (rb->is_reach_threshold && total_write_size > 0) {
-        OS_THREAD_COND_SIGNAL(rb->can_read);
+        rb_signal_reader_l(rb);
     }
-    OS_THREAD_MUTEX_UNLOCK(rb->lock);
+    OS_FMUTEX_UNLOCK(&rb->lock);
     if ((ret_val == RB_FAIL) || (ret_val == RB_ABORT)) {
         total_write_size = ret_val;
     }
@@ -278,7 +288,7 @@ int rb_read_chunk(ringbuf_handle_t rb, char *buf, int size, unsigned int timeout
     int ret_val = 0;
 
     //take buffer lock
-    OS_THREAD_MUTEX_LOCK(rb->lock);
+    OS_FMUTEX_LOCK(&rb->lock);
 
 wait_filled:
     if (rb->fill_cnt < size) {
@@ -309,12 +319,12 @@ wait_filled:
             ret_val = RB_FAIL;
             goto read_done;
         }
-        OS_THREAD_COND_SIGNAL(rb->can_write);
+        OS_FCOND_SIGNAL(&rb->can_write);
         //wait till some data available to read
         if (timeout_ms == 0)
-            ret_val = OS_THREAD_COND_WAIT(rb->can_read, rb->lock);
+            ret_val = OS_FCOND_WAIT(&rb->can_read, &rb->lock);
         else
-            ret_val = OS_THREAD_COND_TIMEDWAIT(rb->can_read, rb->lock, timeout_ms*1000);
+            ret_val = OS_FCOND_TIMEDWAIT(&rb->can_read, &rb->lock, timeout_ms*1000);
         if (ret_val != 0) {
             ret_val = RB_TIMEOUT;
             goto read_done;
@@ -338,9 +348,9 @@ wait_filled:
 
 read_done:
     if (total_read_size > 0) {
-        OS_THREAD_COND_SIGNAL(rb->can_write);
+        OS_FCOND_SIGNAL(&rb->can_write);
     }
-    OS_THREAD_MUTEX_UNLOCK(rb->lock);
+    OS_FMUTEX_UNLOCK(&rb->lock);
     if ((ret_val == RB_FAIL) || (ret_val == RB_ABORT)) {
         total_read_size = ret_val;
     }
@@ -354,7 +364,7 @@ int rb_write_chunk(ringbuf_handle_t rb, char *buf, int size, unsigned int timeou
     int ret_val = 0;
 
     //take buffer lock
-    OS_THREAD_MUTEX_LOCK(rb->lock);
+    OS_FMUTEX_LOCK(&rb->lock);
 
 wait_available:
     if (rb_bytes_available(rb) < size) {
@@ -383,12 +393,12 @@ wait_available:
             rb->is_reach_threshold = true;
             goto write_done;
         }
-        OS_THREAD_COND_SIGNAL(rb->can_read);
+        rb_signal_reader_l(rb);
         //wait till we have some empty space to write
         if (timeout_ms == 0)
-            ret_val = OS_THREAD_COND_WAIT(rb->can_write, rb->lock);
+            ret_val = OS_FCOND_WAIT(&rb->can_write, &rb->lock);
         else
-            ret_val = OS_THREAD_COND_TIMEDWAIT(rb->can_write, rb->lock, timeout_ms*1000);
+            ret_val = OS_FCOND_TIMEDWAIT(&rb->can_write, &rb->lock, timeout_ms*1000);
         if (ret_val != 0) {
             ret_val = RB_TIMEOUT;
             goto write_done;
@@ -415,29 +425,175 @@ wait_available:
 
 write_done:
     if (rb->is_reach_threshold && total_write_size > 0) {
-        OS_THREAD_COND_SIGNAL(rb->can_read);
+        rb_signal_reader_l(rb);
     }
-    OS_THREAD_MUTEX_UNLOCK(rb->lock);
+    OS_FMUTEX_UNLOCK(&rb->lock);
     if ((ret_val == RB_FAIL) || (ret_val == RB_ABORT)) {
         total_write_size = ret_val;
     }
     return total_write_size > 0 ? total_write_size : ret_val;
 }
 
+#define RB_RECORD_WRAP_MARKER (-1)
+
+int rb_write_record(ringbuf_handle_t rb, char *buf, int len, unsigned int timeout_ms)
+{
+    int need = len + RB_RECORD_HEADER_SIZE;
+    int tail_len = 0;
+    int ret_val = 0;
+
+    if (len < 0 || need > rb->size)
+        return RB_FAIL;
+
+    //take buffer lock
+    OS_FMUTEX_LOCK(&rb->lock);
+
+    while (1) {
+        //rewind if empty, so any record that fits the buffer can be written contiguously
+        if (rb->fill_cnt == 0)
+            rb->p_r = rb->p_w = rb->p_o;
+
+        tail_len = rb->p_o + rb->size - rb->p_w;
+        if (tail_len >= need) {
+            if (rb_bytes_available(rb) >= need)
+                break;
+        }
+        else {
+            //record doesn't fit the tail, the tail will be skipped
+            if (rb_bytes_available(rb) >= tail_len + need)
+                break;
+        }
+
+        if (rb->is_done_write) {
+            ret_val = RB_DONE;
+            goto write_done;
+        }
+        if (rb->abort_write) {
+            ret_val = RB_ABORT;
+            goto write_done;
+        }
+        rb_signal_reader_l(rb);
+        //wait till we have enough contiguous space to write
+        if (timeout_ms == 0)
+            ret_val = OS_FCOND_WAIT(&rb->can_write, &rb->lock);
+        else
+            ret_val = OS_FCOND_TIMEDWAIT(&rb->can_write, &rb->lock, timeout_ms*1000);
+        if (ret_val != 0) {
+            ret_val = RB_TIMEOUT;
+            goto write_done;
+        }
+    }
+
+    if (tail_len < need) {
+        //reader skips the tail if it can't even hold a header, otherwise mark it
+        if (tail_len >= RB_RECORD_HEADER_SIZE) {
+            int marker = RB_RECORD_WRAP_MARKER;
+            memcpy(rb->p_w, &marker, RB_RECORD_HEADER_SIZE);
+        }
+        rb->fill_cnt += tail_len;
+        rb->p_w = rb->p_o;
+    }
+
+    memcpy(rb->p_w, &len, RB_RECORD_HEADER_SIZE);
+    memcpy(rb->p_w + RB_RECORD_HEADER_SIZE, buf, len);
+    rb->p_w += need;
+    rb->fill_cnt += need;
+    ret_val = len;
+
+    rb_signal_reader_l(rb);
+
+write_done:
+    OS_FMUTEX_UNLOCK(&rb->lock);
+    return ret_val;
+}
+
+// Skip wrap padding and wait until a record is at read pointer, return its length
+static int rb_record_front_l(ringbuf_handle_t rb, unsigned int timeout_ms)
+{
+    int tail_len, len;
+    int ret_val;
+
+    while (1) {
+        if (rb->fill_cnt > 0) {
+            tail_len = rb->p_o + rb->size - rb->p_r;
+            if (tail_len >= RB_RECORD_HEADER_SIZE) {
+                memcpy(&len, rb->p_r, RB_RECORD_HEADER_SIZE);
+                if (len != RB_RECORD_WRAP_MARKER)
+                    return len;
+            }
+            rb->p_r = rb->p_o;
+            rb->fill_cnt -= tail_len;
+            OS_FCOND_SIGNAL(&rb->can_write);
+            continue;
+        }
+
+        if (rb->is_done_write)
+            return RB_DONE;
+        if (rb->abort_read)
+            return RB_ABORT;
+        if (rb->unblock_reader_flag) {
+            //reader_unblock is nothing but forced timeout
+            return RB_TIMEOUT;
+        }
+        //wait till some record available to read
+        if (timeout_ms == 0)
+            ret_val = OS_FCOND_WAIT(&rb->can_read, &rb->lock);
+        else
+            ret_val = OS_FCOND_TIMEDWAIT(&rb->can_read, &rb->lock, timeout_ms*1000);
+        if (ret_val != 0)
+            return RB_TIMEOUT;
+    }
+}
+
+int rb_read_record(ringbuf_handle_t rb, char *buf, int len, unsigned int timeout_ms)
+{
+    int ret_val;
+
+    //take buffer lock
+    OS_FMUTEX_LOCK(&rb->lock);
+
+    ret_val = rb_record_front_l(rb, timeout_ms);
+    if (ret_val >= 0) {
+        if (ret_val > len) {
+            //leave the record in ringbuffer, caller may retry with a larger buffer
+            ret_val = RB_FAIL;
+        }
+        else {
+            memcpy(buf, rb->p_r + RB_RECORD_HEADER_SIZE, ret_val);
+            rb->p_r += ret_val + RB_RECORD_HEADER_SIZE;
+            rb->fill_cnt -= ret_val + RB_RECORD_HEADER_SIZE;
+            OS_FCOND_SIGNAL(&rb->can_write);
+        }
+    }
+
+    OS_FMUTEX_UNLOCK(&rb->lock);
+    return ret_val;
+}
+
+int rb_peek_record(ringbuf_handle_t rb, unsigned int timeout_ms)
+{
+    int ret_val;
+
+    OS_FMUTEX_LOCK(&rb->lock);
+    ret_val = rb_record_front_l(rb, timeout_ms);
+    OS_FMUTEX_UNLOCK(&rb->lock);
+    return ret_val;
+}
+
 static void rb_abort_read(ringbuf_handle_t rb)
 {
-    OS_THREAD_MUTEX_LOCK(rb->lock);
+    OS_FMUTEX_LOCK(&rb->lock);
     rb->abort_read = true;
-    OS_THREAD_COND_SIGNAL(rb->can_read);
-    OS_THREAD_MUTEX_UNLOCK(rb->lock);
+    rb_signal_reader_l(rb);
+    OS_FMUTEX_UNLOCK(&rb->lock);
 }
 
 static void rb_abort_write(ringbuf_handle_t rb)
 {
-    OS_THREAD_MUTEX_LOCK(rb->lock);
+    OS_FMUTEX_LOCK(&rb->lock);
     rb->abort_write = true;
-    OS_THREAD_COND_SIGNAL(rb->can_write);
-    OS_THREAD_MUTEX_UNLOCK(rb->lock);
+    OS_FCOND_SIGNAL(&rb->can_write);
+    OS_FMUTEX_UNLOCK(&rb->lock);
 }
 
 void rb_abort(ringbuf_handle_t rb)
@@ -453,26 +609,26 @@ bool rb_is_full(ringbuf_handle_t rb)
 
 void rb_done_write(ringbuf_handle_t rb)
 {
-    OS_THREAD_MUTEX_LOCK(rb->lock);
+    OS_FMUTEX_LOCK(&rb->lock);
     rb->is_done_write = true;
-    OS_THREAD_COND_SIGNAL(rb->can_read);
-    OS_THREAD_MUTEX_UNLOCK(rb->lock);
+    rb_signal_reader_l(rb);
+    OS_FMUTEX_UNLOCK(&rb->lock);
 }
 
 void rb_done_read(ringbuf_handle_t rb)
 {
-    OS_THREAD_MUTEX_LOCK(rb->lock);
+    OS_FMUTEX_LOCK(&rb->lock);
     rb->is_done_write = true;
-    OS_THREAD_COND_SIGNAL(rb->can_write);
-    OS_THREAD_MUTEX_UNLOCK(rb->lock);
+    OS_FCOND_SIGNAL(&rb->can_write);
+    OS_FMUTEX_UNLOCK(&rb->lock);
 }
 
 void rb_unblock_reader(ringbuf_handle_t rb)
 {
-    OS_THREAD_MUTEX_LOCK(rb->lock);
+    OS_FMUTEX_LOCK(&rb->lock);
     rb->unblock_reader_flag = true;
-    OS_THREAD_COND_SIGNAL(rb->can_read);
-    OS_THREAD_MUTEX_UNLOCK(rb->lock);
+    rb_signal_reader_l(rb);
+    OS_FMUTEX_UNLOCK(&rb->lock);
 }
 
 bool rb_is_done_write(ringbuf_handle_t rb)
@@ -487,9 +643,9 @@ int rb_get_size(ringbuf_handle_t rb)
 
 void rb_set_threshold(ringbuf_handle_t rb, int threshold)
 {
-    OS_THREAD_MUTEX_LOCK(rb->lock);
+    OS_FMUTEX_LOCK(&rb->lock);
     rb->threshold_cnt = threshold <= rb->size ? threshold : rb->size;
-    OS_THREAD_MUTEX_UNLOCK(rb->lock);
+    OS_FMUTEX_UNLOCK(&rb->lock);
 }
 
 int rb_get_threshold(ringbuf_handle_t rb)
@@ -501,3 +657,11 @@ bool rb_reach_threshold(ringbuf_handle_t rb)
 {
     return rb->is_reach_threshold;
 }
+
+void rb_set_notify(ringbuf_handle_t rb, void (*notify)(void *arg), void *arg)
+{
+    OS_FMUTEX_LOCK(&rb->lock);
+    rb->notify = notify;
+    rb->notify_arg = arg;
+    OS_FMUTEX_UNLOCK(&rb->lock);
+}
@@ -17,93 +17,412 @@
 #include <string.h>
 #include <stdarg.h>
 #include <stdbool.h>
-#include "cutils/common_list.h"
 #include "cutils/os_memory.h"
 #include "cutils/os_thread.h"
 #include "cutils/os_time.h"
 #include "cutils/os_logger.h"
+#include "cutils/msglooper.h"
 #include "cutils/sw_timer.h"
 
 #define LOG_TAG "timer"
 
+#define DEFAULT_SERVICE_PRIORITY  OS_THREAD_PRIO_SOFT_REALTIME
+#define DEFAULT_SERVICE_STACKSIZE 4096
+#define DEFAULT_HEAP_CAPACITY     16
+
+struct swtimer_callback {
+    void (*cb)();             // callback without argument, by swtimer_create()
+    void (*cb_arg)(void *arg);// callback with user context, by swtimer_create2()
+    void *arg;
+};
+
 struct swtimer {
-    os_thread_t thread_id;
-    os_mutex_t thread_mutex;
-    os_cond_t thread_cond;
-    void (*thread_cb)();
-    const char *thread_name;
-    bool thread_exit;
+    const char *name;
+    struct swtimer_callback callback;
+    mlooper_t looper;   // if set, callback is posted to looper instead of running on service thread
 
-    unsigned long period_ms;
+    unsigned long long period_us;
+    unsigned long long deadline; // absolute monotonic time of next expiry, advanced by period_us
     bool reload;
     bool started;
+    enum swtimer_overrun_policy policy;
+    unsigned int overrun;        // expiries skipped before current callback
+    unsigned long long catchup_until; // last missed deadline already counted in catch-up
+
+    struct swtimer_stats stats;
+    unsigned long long late_total_us;
+    bool destroy_pending; // destroyed by its own callback, free it after callback returns
+    int heap_index;       // index in service heap, -1 if not armed
 };
 
-static void *swtimer_thread_entry(void *arg)
+// All timers are driven by one service thread, which sleeps until the earliest
+// deadline of a min-heap of armed timers.
+struct swtimer_service {
+    os_thread_t thread_id;
+    const char *thread_name;
+    os_mutex_t mutex;
+    os_cond_t cond;      // wakeup service thread when the earliest deadline changes
+    os_cond_t idle_cond; // signal that callback of running timer has returned
+
+    struct swtimer **heap;
+    unsigned int heap_size;
+    unsigned int heap_capacity;
+    struct swtimer *running;
+};
+
+OS_MUTEX_DECLARE(g_service_mutex);
+static struct swtimer_service *g_service = NULL;
+static struct os_threadsched g_service_sched;
+static enum os_threadprio g_service_priority = DEFAULT_SERVICE_PRIORITY;
+
+static void swtimer_heap_swap(struct swtimer_service *svc, unsigned int i, unsigned int j)
 {
-    struct swtimer *timer = (struct swtimer *)arg;
+    struct swtimer *temp = svc->heap[i];
+    svc->heap[i] = svc->heap[j];
+    svc->heap[j] = temp;
+    svc->heap[i]->heap_index = i;
+    svc->heap[j]->heap_index = j;
+}
+
+static void swtimer_heap_up(struct swtimer_service *svc, unsigned int i)
+{
+    while (i > 0) {
+        unsigned int parent = (i - 1) / 2;
+        if (svc->heap[parent]->deadline <= svc->heap[i]->deadline)
+            break;
+        swtimer_heap_swap(svc, i, parent);
+        i = parent;
+    }
+}
+
+static void swtimer_heap_down(struct swtimer_service *svc, unsigned int i)
+{
+    while (true) {
+        unsigned int left = 2 * i + 1;
+        unsigned int right = left + 1;
+        unsigned int least = i;
+
+        if (left < svc->heap_size && svc->heap[left]->deadline < svc->heap[least]->deadline)
+            least = left;
+        if (right < svc->heap_size && svc->heap[right]->deadline < svc->heap[least]->deadline)
+            least = right;
+        if (least == i)
+            break;
+        swtimer_heap_swap(svc, i, least);
+        i = least;
+    }
+}
+
+static int swtimer_heap_insert_l(struct swtimer_service *svc, struct swtimer *timer)
+{
+    if (svc->heap_size == svc->heap_capacity) {
+        unsigned int capacity = svc->heap_capacity * 2;
+        struct swtimer **heap = OS_REALLOC(svc->heap, capacity * sizeof(struct swtimer *));
+        if (heap == NULL) {
+            OS_LOGE(LOG_TAG, "Failed to grow timer heap");
+            return -1;
+        }
+        svc->heap = heap;
+        svc->heap_capacity = capacity;
+    }
+
+    timer->heap_index = svc->heap_size;
+    svc->heap[svc->heap_size++] = timer;
+    swtimer_heap_up(svc, timer->heap_index);
+
+    // wakeup service thread if the earliest deadline is changed
+    if (timer->heap_index == 0)
+        OS_THREAD_COND_SIGNAL(svc->cond);
+    return 0;
+}
+
+static void swtimer_heap_remove_l(struct swtimer_service *svc, struct swtimer *timer)
+{
+    unsigned int i = timer->heap_index;
+
+    if (timer->heap_index < 0)
+        return;
+
+    svc->heap_size--;
+    if (i != svc->heap_size) {
+        swtimer_heap_swap(svc, i, svc->heap_size);
+        swtimer_heap_down(svc, i);
+        swtimer_heap_up(svc, i);
+    }
+    timer->heap_index = -1;
+}
+
+static void swtimer_callback_run(struct swtimer_callback *callback)
+{
+    if (callback->cb_arg != NULL)
+        callback->cb_arg(callback->arg);
+    else
+        callback->cb();
+}
+
+static void swtimer_looper_handle(struct message *msg)
+{
+    swtimer_callback_run((struct swtimer_callback *)msg->data);
+}
+
+static void swtimer_looper_free(struct message *msg)
+{
+    OS_FREE(msg->data);
+}
+
+static void swtimer_dispatch(struct swtimer *timer)
+{
+    struct message *msg;
+    struct swtimer_callback *callback;
+
+    if (timer->looper == NULL) {
+        swtimer_callback_run(&timer->callback);
+        return;
+    }
+
+    // the message carries a copy of callback, so it outlives the timer
+    callback = OS_MALLOC(sizeof(struct swtimer_callback));
+    if (callback == NULL) {
+        OS_LOGE(LOG_TAG, "[%s]: Failed to allocate timer event", timer->name);
+        return;
+    }
+    *callback = timer->callback;
+
+    msg = message_obtain2(0, 0, 0, callback, 0, swtimer_looper_handle, swtimer_looper_free, NULL);
+    if (msg == NULL) {
+        OS_FREE(callback);
+        return;
+    }
+    mlooper_post_message(timer->looper, msg);
+}
+
+// Account lateness and apply overrun policy to a timer that is expiring at now
+static void swtimer_expire_l(struct swtimer *timer, unsigned long long now)
+{
+    unsigned long long late = now - timer->deadline;
+    unsigned long long missed = 0;
+
+    timer->stats.expire_count++;
+    timer->stats.late_last_us = late;
+    if (late > timer->stats.late_max_us)
+        timer->stats.late_max_us = late;
+    timer->late_total_us += late;
+
+    __atomic_store_n(&timer->overrun, 0, __ATOMIC_RELAXED);
+    if (!timer->reload || timer->period_us == 0 || late < timer->period_us)
+        return;
+
+    missed = late / timer->period_us;
+
+    switch (timer->policy) {
+    case SWTIMER_OVERRUN_CATCHUP: {
+        // keep deadline, the missed expiries fire back to back, and each of the
+        // catch-up expiries sees the same missed deadlines, count only new ones
+        unsigned long long target = timer->deadline + missed * timer->period_us;
+        unsigned long long counted = timer->catchup_until > timer->deadline ?
+                                     timer->catchup_until : timer->deadline;
+        if (target > counted) {
+            timer->stats.overrun_count += (target - counted) / timer->period_us;
+            timer->catchup_until = target;
+        }
+        break;
+    }
+    case SWTIMER_OVERRUN_REPORT:
+        timer->stats.overrun_count += missed;
+        __atomic_store_n(&timer->overrun, missed > 0xffffffff ? 0xffffffff : (unsigned int)missed,
+                         __ATOMIC_RELAXED);
+        timer->deadline += missed * timer->period_us;
+        break;
+    case SWTIMER_OVERRUN_SKIP:
+    default:
+        timer->stats.overrun_count += missed;
+        timer->deadline += missed * timer->period_us;
+        break;
+    }
+}
+
+static void swtimer_free(struct swtimer *timer)
+{
+    OS_FREE(timer->name);
+    OS_FREE(timer);
+}
+
+static void *swtimer_service_entry(void *arg)
+{
+    struct swtimer_service *svc = (struct swtimer_service *)arg;
+    struct swtimer *timer;
     unsigned long long now = 0;
-    unsigned long long escape = 0;
-    unsigned long long wait = 0;
-    unsigned long long period_us = timer->period_ms * 1000;
 
-    OS_LOGD(LOG_TAG, "[%s]: Entry timer thread: thread_id=[%p]", timer->thread_name, timer->thread_id);
+    OS_LOGD(LOG_TAG, "Entry timer service thread: thread_id=[%p]", OS_THREAD_SELF());
 
-    OS_THREAD_SET_NAME(timer->thread_id, timer->thread_name);
+    // thread_id may not be assigned yet by the creator
+    OS_THREAD_SET_NAME(OS_THREAD_SELF(), svc->thread_name);
 
-    while (!timer->thread_exit) {
-        OS_THREAD_MUTEX_LOCK(timer->thread_mutex);
+    OS_THREAD_MUTEX_LOCK(svc->mutex);
 
-        while (!timer->started && !timer->thread_exit)
-            OS_THREAD_COND_WAIT(timer->thread_cond, timer->thread_mutex);
+    while (true) {
+        while (svc->heap_size == 0)
+            OS_THREAD_COND_WAIT(svc->cond, svc->mutex);
 
-        if (timer->thread_exit) {
-            OS_THREAD_MUTEX_UNLOCK(timer->thread_mutex);
-            break;
+        timer = svc->heap[0];
+        now = OS_MONOTONIC_USEC();
+        if (timer->deadline > now) {
+            OS_THREAD_COND_TIMEDWAIT(svc->cond, svc->mutex, timer->deadline - now);
+            continue;
         }
 
-        wait = period_us - escape;
-        OS_THREAD_COND_TIMEDWAIT(timer->thread_cond, timer->thread_mutex, wait);
+        swtimer_heap_remove_l(svc, timer);
+        swtimer_expire_l(timer, now);
+        svc->running = timer;
 
-        if (timer->started) {
-            now = OS_MONOTONIC_USEC();
+        OS_THREAD_MUTEX_UNLOCK(svc->mutex);
+        swtimer_dispatch(timer);
+        OS_THREAD_MUTEX_LOCK(svc->mutex);
 
-            timer->thread_cb();
+        svc->running = NULL;
+        OS_THREAD_COND_BROADCAST(svc->idle_cond);
 
-            escape = OS_MONOTONIC_USEC() - now;
+        if (timer->destroy_pending) {
+            swtimer_free(timer);
+            continue;
+        }
 
+        // timer may be stopped or restarted by callback
+        if (timer->started && timer->heap_index < 0) {
             if (timer->reload) {
-                if (escape >= period_us) {
-                    OS_LOGE(LOG_TAG, "[%s]: Handler timecost more than timer period, stop timer", timer->thread_name);
+                // anchor to absolute deadline, so jitter and callback timecost don't accumulate
+                timer->deadline += timer->period_us;
+                if (swtimer_heap_insert_l(svc, timer) != 0)
                     timer->started = false;
-                    escape = 0;
-                }
             }
             else {
                 timer->started = false;
-                escape = 0;
             }
         }
-        else {
-            escape = 0;
+    }
+
+    OS_THREAD_MUTEX_UNLOCK(svc->mutex);
+    return NULL;
+}
+
+static struct swtimer_service *swtimer_service_init()
+{
+    if (g_service == NULL) {
+        if (g_service_mutex != NULL)
+            OS_THREAD_MUTEX_LOCK(g_service_mutex);
+
+        if (g_service == NULL) {
+            struct os_threadattr attr  = {
+                .name = "timer_service",
+                .priority = g_service_priority,
+                .stacksize = DEFAULT_SERVICE_STACKSIZE,
+                .joinable = false,
+                .sched = g_service_sched,
+            };
+
+            g_service = OS_CALLOC(1, sizeof(struct swtimer_service));
+            if (g_service == NULL) {
+                OS_LOGE(LOG_TAG, "Failed to create timer service instance");
+                if (g_service_mutex != NULL)
+                    OS_THREAD_MUTEX_UNLOCK(g_service_mutex);
+                return NULL;
+            }
+
+            g_service->mutex = OS_THREAD_MUTEX_CREATE();
+            if (g_service->mutex == NULL) {
+                OS_LOGE(LOG_TAG, "Failed to create timer service mutex");
+                goto error;
+            }
+
+            g_service->cond = OS_THREAD_COND_CREATE();
+            if (g_service->cond == NULL) {
+                OS_LOGE(LOG_TAG, "Failed to create timer service cond");
+                goto error;
+            }
+
+            g_service->idle_cond = OS_THREAD_COND_CREATE();
+            if (g_service->idle_cond == NULL) {
+                OS_LOGE(LOG_TAG, "Failed to create timer service idle_cond");
+                goto error;
+            }
+
+            g_service->heap = OS_CALLOC(DEFAULT_HEAP_CAPACITY, sizeof(struct swtimer *));
+            if (g_service->heap == NULL) {
+                OS_LOGE(LOG_TAG, "Failed to allocate timer heap");
+                goto error;
+            }
+            g_service->heap_capacity = DEFAULT_HEAP_CAPACITY;
+            g_service->heap_size = 0;
+            g_service->thread_name = attr.name;
+
+            g_service->thread_id = OS_THREAD_CREATE(&attr, swtimer_service_entry, g_service);
+            if (g_service->thread_id == NULL) {
+                OS_LOGE(LOG_TAG, "Failed to run timer service thread");
+                goto error;
+            }
         }
 
-        OS_THREAD_MUTEX_UNLOCK(timer->thread_mutex);
+        if (g_service_mutex != NULL)
+            OS_THREAD_MUTEX_UNLOCK(g_service_mutex);
     }
+    return g_service;
+
+error:
+    if (g_service->heap != NULL)
+        OS_FREE(g_service->heap);
+
+    if (g_service->idle_cond != NULL)
+        OS_THREAD_COND_DESTROY(g_service->idle_cond);
+
+    if (g_service->cond != NULL)
+        OS_THREAD_COND_DESTROY(g_service->cond);
 
-    OS_LOGD(LOG_TAG, "[%s]: Leave timer thread: thread_id=[%p]", timer->thread_name, timer->thread_id);
+    if (g_service->mutex != NULL)
+        OS_THREAD_MUTEX_DESTROY(g_service->mutex);
+
+    OS_FREE(g_service);
+    g_service = NULL;
+
+    if (g_service_mutex != NULL)
+        OS_THREAD_MUTEX_UNLOCK(g_service_mutex);
     return NULL;
 }
 
-swtimer_t swtimer_create(struct swtimer_attr *attr, void (*swtimer_callback)())
+int swtimer_service_sched(const struct os_threadsched *sched, enum os_threadprio priority)
+{
+    int ret = 0;
+
+    if (g_service_mutex != NULL)
+        OS_THREAD_MUTEX_LOCK(g_service_mutex);
+
+    if (g_service == NULL) {
+        g_service_sched = *sched;
+        g_service_priority = priority;
+    }
+    else {
+        OS_LOGE(LOG_TAG, "Timer service is already running");
+        ret = -1;
+    }
+
+    if (g_service_mutex != NULL)
+        OS_THREAD_MUTEX_UNLOCK(g_service_mutex);
+    return ret;
+}
+
+static swtimer_t swtimer_create_l(struct swtimer_attr *attr, struct swtimer_callback *callback)
 {
     struct swtimer *timer = NULL;
-    struct os_threadattr thread_attr = {
-        .name = attr && attr->name ? attr->name : "timer",
-        .priority = OS_THREAD_PRIO_SOFT_REALTIME,
-        .stacksize = 1024,
-        .joinable = true,
-    };
+
+    // a zero period reload timer would be due again at once and spin the service
+    if (attr->reload && attr->period_ms == 0) {
+        OS_LOGE(LOG_TAG, "Invalid period_ms 0 for reload timer");
+        return NULL;
+    }
+
+    if (swtimer_service_init() == NULL) {
+        OS_LOGE(LOG_TAG, "Can't create timer without timer service");
+        return NULL;
+    }
 
     timer = OS_CALLOC(1, sizeof(struct swtimer));
     if (timer == NULL) {
@@ -111,67 +430,124 @@ swtimer_t swtimer_create(struct swtimer_attr *attr, void (*swtimer_callback)())
         return NULL;
     }
 
-    timer->thread_mutex = OS_THREAD_MUTEX_CREATE();
-    if (timer->thread_mutex == NULL) {
-        OS_LOGE(LOG_TAG, "Failed to create thread_mutex");
-        goto error;
-    }
+    timer->name = OS_STRDUP(attr->name ? attr->name : "timer");
+    timer->callback = *callback;
+    timer->looper = NULL;
+    timer->period_us = (unsigned long long)attr->period_ms * 1000;
+    timer->reload = attr->reload;
+    timer->started = false;
+    timer->destroy_pending = false;
+    timer->heap_index = -1;
+    timer->policy = SWTIMER_OVERRUN_SKIP;
+    return timer;
+}
 
-    timer->thread_cond = OS_THREAD_COND_CREATE();
-    if (timer->thread_cond == NULL) {
-        OS_LOGE(LOG_TAG, "Failed to create thread_cond");
-        goto error;
+swtimer_t swtimer_create(struct swtimer_attr *attr, void (*swtimer_callback)())
+{
+    struct swtimer_callback callback = {
+        .cb = swtimer_callback,
+        .cb_arg = NULL,
+        .arg = NULL,
+    };
+
+    if (attr == NULL || swtimer_callback == NULL) {
+        OS_LOGE(LOG_TAG, "Invalid timer attr or callback");
+        return NULL;
     }
+    return swtimer_create_l(attr, &callback);
+}
+
+swtimer_t swtimer_create2(struct swtimer_attr *attr, void (*swtimer_callback)(void *arg), void *arg)
+{
+    struct swtimer_callback callback = {
+        .cb = NULL,
+        .cb_arg = swtimer_callback,
+        .arg = arg,
+    };
 
     if (attr == NULL || swtimer_callback == NULL) {
         OS_LOGE(LOG_TAG, "Invalid timer attr or callback");
-        goto error;
+        return NULL;
     }
+    return swtimer_create_l(attr, &callback);
+}
 
-    timer->thread_name = OS_STRDUP(thread_attr.name);
-    timer->thread_cb = swtimer_callback;
-    timer->thread_exit = false;
+int swtimer_set_looper(swtimer_t timer, mlooper_t looper)
+{
+    struct swtimer_service *svc = g_service;
 
-    timer->period_ms = attr->period_ms;
-    timer->reload = attr->reload;
-    timer->started = false;
+    OS_THREAD_MUTEX_LOCK(svc->mutex);
+    timer->looper = looper;
+    OS_THREAD_MUTEX_UNLOCK(svc->mutex);
+    return 0;
+}
 
-    timer->thread_id = OS_THREAD_CREATE(&thread_attr, swtimer_thread_entry, timer);
-    if (timer->thread_id == NULL) {
-        OS_LOGE(LOG_TAG, "[%s]: Failed to run thread timer", timer->thread_name);
-        goto error;
-    }
+int swtimer_set_overrun_policy(swtimer_t timer, enum swtimer_overrun_policy policy)
+{
+    struct swtimer_service *svc = g_service;
 
-    return timer;
+    OS_THREAD_MUTEX_LOCK(svc->mutex);
+    timer->policy = policy;
+    OS_THREAD_MUTEX_UNLOCK(svc->mutex);
+    return 0;
+}
 
-error:
-    if (timer->thread_cond != NULL)
-        OS_THREAD_COND_DESTROY(timer->thread_cond);
-    if (timer->thread_mutex != NULL)
-        OS_THREAD_MUTEX_DESTROY(timer->thread_mutex);
-    OS_FREE(timer);
-    return NULL;
+unsigned int swtimer_get_overrun(swtimer_t timer)
+{
+    // written by service thread under its lock, read here from the callback
+    return __atomic_load_n(&timer->overrun, __ATOMIC_RELAXED);
+}
+
+int swtimer_get_stats(swtimer_t timer, struct swtimer_stats *stats)
+{
+    struct swtimer_service *svc = g_service;
+
+    OS_THREAD_MUTEX_LOCK(svc->mutex);
+    *stats = timer->stats;
+    stats->late_avg_us = timer->stats.expire_count > 0 ?
+                         timer->late_total_us / timer->stats.expire_count : 0;
+    OS_THREAD_MUTEX_UNLOCK(svc->mutex);
+    return 0;
+}
+
+void swtimer_reset_stats(swtimer_t timer)
+{
+    struct swtimer_service *svc = g_service;
+
+    OS_THREAD_MUTEX_LOCK(svc->mutex);
+    memset(&timer->stats, 0x0, sizeof(timer->stats));
+    timer->late_total_us = 0;
+    OS_THREAD_MUTEX_UNLOCK(svc->mutex);
 }
 
 int swtimer_start(swtimer_t timer)
 {
-    OS_THREAD_MUTEX_LOCK(timer->thread_mutex);
+    struct swtimer_service *svc = g_service;
+    int ret;
 
-    timer->started = true;
-    OS_THREAD_COND_SIGNAL(timer->thread_cond);
+    OS_THREAD_MUTEX_LOCK(svc->mutex);
 
-    OS_THREAD_MUTEX_UNLOCK(timer->thread_mutex);
-    return 0;
+    // restart timer if it's already active
+    swtimer_heap_remove_l(svc, timer);
+    timer->deadline = OS_MONOTONIC_USEC() + timer->period_us;
+    timer->catchup_until = 0;
+    ret = swtimer_heap_insert_l(svc, timer);
+    timer->started = (ret == 0);
+
+    OS_THREAD_MUTEX_UNLOCK(svc->mutex);
+    return ret;
 }
 
 int swtimer_stop(swtimer_t timer)
 {
-    OS_THREAD_MUTEX_LOCK(timer->thread_mutex);
+    struct swtimer_service *svc = g_service;
+
+    OS_THREAD_MUTEX_LOCK(svc->mutex);
 
     timer->started = false;
-    OS_THREAD_COND_SIGNAL(timer->thread_cond);
+    swtimer_heap_remove_l(svc, timer);
 
-    OS_THREAD_MUTEX_UNLOCK(timer->thread_mutex);
+    OS_THREAD_MUTEX_UNLOCK(svc->mutex);
     return 0;
 }
 
@@ -182,21 +558,25 @@ bool swtimer_is_active(swtimer_t timer)
 
 void swtimer_destroy(swtimer_t timer)
 {
-    {
-        OS_THREAD_MUTEX_LOCK(timer->thread_mutex);
+    struct swtimer_service *svc = g_service;
 
-        timer->started = false;
-        timer->thread_exit = true;
-        OS_THREAD_COND_SIGNAL(timer->thread_cond);
+    OS_THREAD_MUTEX_LOCK(svc->mutex);
 
-        OS_THREAD_MUTEX_UNLOCK(timer->thread_mutex);
+    timer->started = false;
+    swtimer_heap_remove_l(svc, timer);
+
+    if (svc->running == timer) {
+        if (svc->thread_id == OS_THREAD_SELF()) {
+            // destroyed by its own callback, service thread frees it after callback returns
+            timer->destroy_pending = true;
+            OS_THREAD_MUTEX_UNLOCK(svc->mutex);
+            return;
+        }
+        while (svc->running == timer)
+            OS_THREAD_COND_WAIT(svc->idle_cond, svc->mutex);
     }
 
-    OS_THREAD_JOIN(timer->thread_id, NULL);
+    OS_THREAD_MUTEX_UNLOCK(svc->mutex);
 
-    OS_THREAD_MUTEX_DESTROY(timer->thread_mutex);
-    OS_THREAD_COND_DESTROY(timer->thread_cond);
-
-    OS_FREE(timer->thread_name);
-    OS_FREE(timer);
+    swtimer_free(timer);
 }
@@ -24,20 +24,39 @@
 #include "cutils/os_logger.h"
 #include "cutils/sw_watchdog.h"
 
+#if !defined(OS_FREERTOS) && !defined(OS_ANDROID) && (defined(__GLIBC__) || defined(__APPLE__))
+#define SWWATCHDOG_BACKTRACE
+#include <signal.h>
+#include <execinfo.h>
+#endif
+
 #define LOG_TAG "watchdog"
 
-#define DEFAULT_TICK_MS 100
-#define DEFAULT_MIN_TIMEOUT_MS (10 * DEFAULT_TICK_MS)
+#define DEFAULT_MIN_TIMEOUT_MS 10
+#define DEADLINE_NEVER (~0ULL)
+
+#if defined(SWWATCHDOG_BACKTRACE)
+#ifndef SWWATCHDOG_DUMP_SIGNAL
+#define SWWATCHDOG_DUMP_SIGNAL SIGUSR2
+#endif
+#define DUMP_MAX_FRAMES 64
+#define DUMP_WAIT_MS    100
+#define DUMP_BUSY       0x1U // signal handler is filling frames
+#define DUMP_DONE       0x2U // frames are filled
+#endif
 
 struct swwatchdog {
-    struct listnode list;
+    struct listnode armed; // nodes sorted by deadline, earliest first
     os_thread_t thread_id;
     const char *thread_name;
-    os_mutex_t mutex;
+    os_mutex_t mutex;      // protect armed list, not taken by feed, nor by stop
     os_cond_t cond;
+    os_mutex_t dump_mutex; // held while a thread is signalled for backtrace, stop waits it
+    os_cond_t idle_cond;   // broadcast when busy is cleared
+    struct swwatchdog_node *busy; // dumped without mutex, destroy waits until it's cleared
 
-    unsigned long tick; // ms
-    unsigned int active_num;
+    unsigned long long sleep_until; // deadline the thread sleeps until, read atomically by start
+    bool diagnostic;
 };
 
 struct swwatchdog_node {
@@ -45,10 +64,20 @@ struct swwatchdog_node {
     unsigned long long timeout_ms;
     void (*timeout_cb)(void *data);
     void *data;
-
-    bool active;
-    unsigned long long count;
-
+    void (*dump_cb)(void *data); // log owner's state on timeout in diagnostic mode
+    void *dump_data;
+    os_thread_t watched;         // thread that called swwatchdog_start(), NULL once stopped
+    bool dumping;                // watched is being signalled, stop waits it on dump_mutex
+
+    // monotonic time of last start/feed, 0 if not active. it's accessed
+    // atomically, so owner thread never contends with watchdog thread
+    unsigned long long fed_us;
+
+    // armed list is rescheduled lazily: feed/stop only touch fed_us, and the
+    // thread moves the node when its queued deadline is reached. queued
+    // deadline is never later than the real one as fed_us only increases
+    bool queued;
+    unsigned long long deadline;
     struct listnode listnode;
 };
 
@@ -64,66 +93,194 @@ static void default_timeout_cb(void *data)
     //*ptr = 0; // make crash
 }
 
-static bool swwatchdog_check_node_l(swwatch_t node)
+#if defined(SWWATCHDOG_BACKTRACE)
+// Preallocated, stuck thread fills it in signal handler, only one dump at a time.
+// state is the token of the open request (low bits DUMP_xxx), 0 if none, so a
+// late signal of a timed out request can't fill frames of the next one
+static struct {
+    void *frames[DUMP_MAX_FRAMES];
+    int depth;
+    pthread_t target;
+    unsigned int state;
+} g_dump;
+static unsigned int g_dump_seq = 0;
+
+static void swwatchdog_dump_handler(int sig)
+{
+    unsigned int state = __atomic_load_n(&g_dump.state, __ATOMIC_ACQUIRE);
+
+    if (state == 0 || (state & (DUMP_BUSY | DUMP_DONE)) != 0 ||
+        !pthread_equal(__atomic_load_n(&g_dump.target, __ATOMIC_RELAXED), pthread_self()))
+        return;
+    // claim the request, fails if it's withdrawn or replaced meanwhile
+    if (!__atomic_compare_exchange_n(&g_dump.state, &state, state | DUMP_BUSY, false,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        return;
+    g_dump.depth = backtrace(g_dump.frames, DUMP_MAX_FRAMES);
+    __atomic_store_n(&g_dump.state, state | DUMP_DONE, __ATOMIC_RELEASE);
+}
+
+// Called with wd->dump_mutex held and node->dumping set, so the watched
+// thread can't return from swwatchdog_stop() and exit while it's signalled
+static void swwatchdog_dump_backtrace(struct swwatchdog_node *node)
+{
+    char **symbols;
+    int wait_ms = 0;
+    os_thread_t watched;
+    unsigned int token, state;
+
+    // stopped already, the thread may be gone
+    watched = __atomic_load_n(&node->watched, __ATOMIC_SEQ_CST);
+    if (watched == NULL) {
+        OS_LOGF(LOG_TAG, "Thread[%s] stopped before backtrace", node->name);
+        return;
+    }
+
+    // only the watchdog thread dumps, no need to sync the sequence
+    do {
+        token = ++g_dump_seq << 2;
+    } while (token == 0);
+    __atomic_store_n(&g_dump.target, (pthread_t)watched, __ATOMIC_RELAXED);
+    __atomic_store_n(&g_dump.state, token, __ATOMIC_RELEASE);
+    if (pthread_kill((pthread_t)watched, SWWATCHDOG_DUMP_SIGNAL) != 0) {
+        OS_LOGE(LOG_TAG, "Thread[%s] failed to signal for backtrace", node->name);
+        __atomic_store_n(&g_dump.state, 0, __ATOMIC_RELEASE);
+        return;
+    }
+
+    while ((state = __atomic_load_n(&g_dump.state, __ATOMIC_ACQUIRE)) != (token | DUMP_DONE)) {
+        // thread may block the signal, or be in uninterruptible sleep. Withdraw
+        // the request unless the handler has claimed it, then it finishes soon
+        if (wait_ms++ >= DUMP_WAIT_MS && state == token &&
+            __atomic_compare_exchange_n(&g_dump.state, &state, 0, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            OS_LOGE(LOG_TAG, "Thread[%s] didn't respond to backtrace request", node->name);
+            return;
+        }
+        OS_THREAD_SLEEP_MSEC(1);
+    }
+
+    OS_LOGF(LOG_TAG, "Thread[%s] backtrace:", node->name);
+    symbols = backtrace_symbols(g_dump.frames, g_dump.depth);
+    // skip the frames of signal handler
+    for (int i = 2; i < g_dump.depth; i++)
+        OS_LOGF(LOG_TAG, "  #%02d %s", i - 2, symbols != NULL ? symbols[i] : "??");
+    free(symbols);
+    __atomic_store_n(&g_dump.state, 0, __ATOMIC_RELEASE);
+}
+#endif
+
+// Called with wd->mutex held, which is dropped while dumping, so starting,
+// feeding and stopping other nodes don't wait for a slow dump
+static void swwatchdog_dump_l(struct swwatchdog *wd, struct swwatchdog_node *node)
+{
+    void (*dump_cb)(void *data) = node->dump_cb;
+    void *dump_data = node->dump_data;
+
+    wd->busy = node;
+    OS_THREAD_MUTEX_UNLOCK(wd->mutex);
+
+    if (dump_cb != NULL)
+        dump_cb(dump_data);
+
+#if defined(SWWATCHDOG_BACKTRACE)
+    // pairs with swwatchdog_stop(): either stop sees dumping and waits on
+    // dump_mutex, or the dump sees watched cleared and doesn't signal
+    __atomic_store_n(&node->dumping, true, __ATOMIC_SEQ_CST);
+    OS_THREAD_MUTEX_LOCK(wd->dump_mutex);
+    swwatchdog_dump_backtrace(node);
+    OS_THREAD_MUTEX_UNLOCK(wd->dump_mutex);
+    __atomic_store_n(&node->dumping, false, __ATOMIC_SEQ_CST);
+#endif
+
+    OS_THREAD_MUTEX_LOCK(wd->mutex);
+    wd->busy = NULL;
+    OS_THREAD_COND_BROADCAST(wd->idle_cond);
+}
+
+static unsigned long long swwatchdog_now_us()
+{
+    unsigned long long now = OS_MONOTONIC_USEC();
+    return now != 0 ? now : 1; // 0 is reserved for inactive
+}
+
+static void swwatchdog_enqueue_l(struct swwatchdog *wd, struct swwatchdog_node *node, unsigned long long deadline)
 {
-    struct swwatchdog *wd = g_watchdog;
     struct listnode *item;
 
-    list_for_each(item, &wd->list) {
+    node->deadline = deadline;
+    list_for_each_reverse(item, &wd->armed) {
         struct swwatchdog_node *temp = node_to_item(item, struct swwatchdog_node, listnode);
-        if (temp == node)
-            return true;
+        if (temp->deadline <= deadline)
+            break;
     }
-
-    return false;
+    // insert after item, list_add_tail() on a node inserts before it
+    list_add_tail(item->next, &node->listnode);
+    __atomic_store_n(&node->queued, true, __ATOMIC_SEQ_CST);
 }
 
 static void *swwatchdog_thread_entry(void *arg)
 {
     struct swwatchdog *wd = (struct swwatchdog *)arg;
     struct swwatchdog_node *node;
-    struct listnode *item, *tmp;
-    bool timeout;
+    struct listnode *item;
+    unsigned long long fed, now;
 
-    OS_LOGD(LOG_TAG, "Entry watchdog thread: thread_id=[%p]", wd->thread_id);
+    OS_LOGD(LOG_TAG, "Entry watchdog thread: thread_id=[%p]", OS_THREAD_SELF());
 
-    OS_THREAD_SET_NAME(wd->thread_id, wd->thread_name);
+    // thread_id may not be assigned yet by the creator
+    OS_THREAD_SET_NAME(OS_THREAD_SELF(), wd->thread_name);
 
-    while (true) {
-        OS_THREAD_SLEEP_MSEC(wd->tick);
-
-        OS_THREAD_MUTEX_LOCK(wd->mutex);
+    OS_THREAD_MUTEX_LOCK(wd->mutex);
 
-        while (wd->active_num == 0)
-            OS_THREAD_COND_WAIT(wd->cond, wd->mutex);
+    while (true) {
+        now = swwatchdog_now_us();
 
-        list_for_each_safe(item, tmp, &wd->list) {
+        while (!list_empty(&wd->armed)) {
+            item = list_head(&wd->armed);
             node = node_to_item(item, struct swwatchdog_node, listnode);
-            timeout = false;
+            if (node->deadline > now)
+                break;
 
-            if (node->active) {
-                if (node->count > node->timeout_ms) {
+            list_remove(item);
+            // clear queued before reading fed_us, pairs with swwatchdog_start(),
+            // so either the thread sees the new fed_us or start sees !queued
+            __atomic_store_n(&node->queued, false, __ATOMIC_SEQ_CST);
+            fed = __atomic_load_n(&node->fed_us, __ATOMIC_SEQ_CST);
+
+            while (fed != 0) {
+                if (fed + node->timeout_ms * 1000 > now) {
+                    // fed or restarted since queued, reschedule
+                    swwatchdog_enqueue_l(wd, node, fed + node->timeout_ms * 1000);
+                    break;
+                }
+                // disarm the node unless it's fed or restarted meanwhile
+                if (__atomic_compare_exchange_n(&node->fed_us, &fed, 0, false,
+                                                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
                     OS_LOGF(LOG_TAG, "Thread[%s] timeout, bited by watchdog", node->name);
-                    timeout = true;
+                    if (wd->diagnostic)
+                        swwatchdog_dump_l(wd, node);
+                    if (node->timeout_cb != NULL)
+                        node->timeout_cb(node->data);
+                    else
+                        default_timeout_cb(node);
+                    break;
                 }
-                node->count += wd->tick;
-            }
-
-            if (timeout) {
-                if (node->timeout_cb != NULL)
-                    node->timeout_cb(node->data);
-                else
-                    default_timeout_cb(node);
-
-                list_remove(item);
-                OS_FREE(node);
-                wd->active_num--;
             }
         }
 
-        OS_THREAD_MUTEX_UNLOCK(wd->mutex);
+        if (list_empty(&wd->armed)) {
+            __atomic_store_n(&wd->sleep_until, DEADLINE_NEVER, __ATOMIC_SEQ_CST);
+            OS_THREAD_COND_WAIT(wd->cond, wd->mutex);
+        }
+        else {
+            node = node_to_item(list_head(&wd->armed), struct swwatchdog_node, listnode);
+            __atomic_store_n(&wd->sleep_until, node->deadline, __ATOMIC_SEQ_CST);
+            OS_THREAD_COND_TIMEDWAIT(wd->cond, wd->mutex, node->deadline - now);
+        }
     }
 
+    OS_THREAD_MUTEX_UNLOCK(wd->mutex);
     return NULL;
 }
 
@@ -161,8 +318,20 @@ static struct swwatchdog *swwatchdog_init()
                 goto error;
             }
 
-            g_watchdog->tick = DEFAULT_TICK_MS;
-            g_watchdog->active_num = 0;
+            g_watchdog->dump_mutex = OS_THREAD_MUTEX_CREATE();
+            if (g_watchdog->dump_mutex == NULL) {
+                OS_LOGE(LOG_TAG, "Failed to create watchdog dump mutex");
+                goto error;
+            }
+
+            g_watchdog->idle_cond = OS_THREAD_COND_CREATE();
+            if (g_watchdog->idle_cond == NULL) {
+                OS_LOGE(LOG_TAG, "Failed to create watchdog idle cond");
+                goto error;
+            }
+
+            g_watchdog->sleep_until = DEADLINE_NEVER;
+            list_init(&g_watchdog->armed);
             g_watchdog->thread_name = attr.name;
 
             g_watchdog->thread_id = OS_THREAD_CREATE(&attr, swwatchdog_thread_entry, g_watchdog);
@@ -170,8 +339,6 @@ static struct swwatchdog *swwatchdog_init()
                 OS_LOGE(LOG_TAG, "Failed to run watchdog thread");
                 goto error;
             }
-
-            list_init(&g_watchdog->list);
         }
 
         if (g_watchdog_mutex != NULL)
@@ -180,6 +347,12 @@ static struct swwatchdog *swwatchdog_init()
     return g_watchdog;
 
 error:
+    if (g_watchdog->idle_cond != NULL)
+        OS_THREAD_COND_DESTROY(g_watchdog->idle_cond);
+
+    if (g_watchdog->dump_mutex != NULL)
+        OS_THREAD_MUTEX_DESTROY(g_watchdog->dump_mutex);
+
     if (g_watchdog->cond != NULL)
         OS_THREAD_COND_DESTROY(g_watchdog->cond);
 
@@ -219,106 +392,138 @@ swwatch_t swwatchdog_create(const char *name, unsigned long long timeout_ms, voi
     node->timeout_ms = timeout_ms;
     node->timeout_cb = timeout_cb;
     node->data = arg;
-
-    OS_THREAD_MUTEX_LOCK(wd->mutex);
-
-    list_add_tail(&wd->list, &node->listnode);
-
-    OS_THREAD_MUTEX_UNLOCK(wd->mutex);
+    node->fed_us = 0;
+    node->queued = false;
+    list_init(&node->listnode);
     return node;
 }
 
 int swwatchdog_start(swwatch_t node)
 {
     struct swwatchdog *wd = g_watchdog;
-    if (wd == NULL)
+    unsigned long long now, deadline;
+
+    if (wd == NULL || node == NULL)
         return -1;
 
-    OS_THREAD_MUTEX_LOCK(wd->mutex);
+    now = swwatchdog_now_us();
+    deadline = now + node->timeout_ms * 1000;
+    __atomic_store_n(&node->watched, OS_THREAD_SELF(), __ATOMIC_SEQ_CST);
+    __atomic_store_n(&node->fed_us, now, __ATOMIC_SEQ_CST);
 
-    if (!swwatchdog_check_node_l(node)) {
-        OS_LOGE(LOG_TAG, "Can't find node[%p] in watchdog list", node);
-        OS_THREAD_MUTEX_UNLOCK(wd->mutex);
-        return -1;
-    }
+    // still queued, the thread will reschedule it to the new deadline
+    if (__atomic_load_n(&node->queued, __ATOMIC_SEQ_CST))
+        return 0;
 
-    if (!node->active) {
-        node->active = true;
-        wd->active_num++;
-        OS_THREAD_COND_SIGNAL(wd->cond);
+    OS_THREAD_MUTEX_LOCK(wd->mutex);
+    if (!node->queued) {
+        swwatchdog_enqueue_l(wd, node, deadline);
+        if (deadline < wd->sleep_until)
+            OS_THREAD_COND_SIGNAL(wd->cond);
     }
+    OS_THREAD_MUTEX_UNLOCK(wd->mutex);
+    return 0;
+}
+
+int swwatchdog_set_dump_cb(swwatch_t node, void (*dump_cb)(void *arg), void *arg)
+{
+    struct swwatchdog *wd = g_watchdog;
+
+    if (wd == NULL || node == NULL)
+        return -1;
 
+    OS_THREAD_MUTEX_LOCK(wd->mutex);
+    node->dump_cb = dump_cb;
+    node->dump_data = arg;
     OS_THREAD_MUTEX_UNLOCK(wd->mutex);
     return 0;
 }
 
-int swwatchdog_feed(swwatch_t node)
+int swwatchdog_set_diagnostic(bool enable)
 {
+    struct swwatchdog *wd = swwatchdog_init();
 
-    struct swwatchdog *wd = g_watchdog;
     if (wd == NULL)
         return -1;
 
     OS_THREAD_MUTEX_LOCK(wd->mutex);
 
-    if (!swwatchdog_check_node_l(node)) {
-        OS_LOGE(LOG_TAG, "Can't find node[%p] in watchdog list", node);
-        OS_THREAD_MUTEX_UNLOCK(wd->mutex);
-        return -1;
-    }
+#if defined(SWWATCHDOG_BACKTRACE)
+    if (enable && !wd->diagnostic) {
+        struct sigaction sa;
+        void *warmup[1];
 
-    if (node->active)
-        node->count = 0;
+        // first backtrace() loads libgcc and allocates, make it safe in signal handler
+        backtrace(warmup, 1);
+
+        memset(&sa, 0x0, sizeof(sa));
+        sa.sa_handler = swwatchdog_dump_handler;
+        sigemptyset(&sa.sa_mask);
+        sa.sa_flags = SA_RESTART;
+        sigaction(SWWATCHDOG_DUMP_SIGNAL, &sa, NULL);
+    }
+#endif
+    wd->diagnostic = enable;
 
     OS_THREAD_MUTEX_UNLOCK(wd->mutex);
     return 0;
 }
 
-int swwatchdog_stop(swwatch_t node)
+int swwatchdog_feed(swwatch_t node)
 {
-    struct swwatchdog *wd = g_watchdog;
-    if (wd == NULL)
+    unsigned long long fed;
+
+    if (node == NULL)
         return -1;
 
-    OS_THREAD_MUTEX_LOCK(wd->mutex);
+    // only feed active node, don't revive the node stopped concurrently
+    fed = __atomic_load_n(&node->fed_us, __ATOMIC_ACQUIRE);
+    while (fed != 0) {
+        if (__atomic_compare_exchange_n(&node->fed_us, &fed, swwatchdog_now_us(), false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            break;
+    }
+    return 0;
+}
 
-    if (!swwatchdog_check_node_l(node)) {
-        OS_LOGE(LOG_TAG, "Can't find node[%p] in watchdog list", node);
-        OS_THREAD_MUTEX_UNLOCK(wd->mutex);
+int swwatchdog_stop(swwatch_t node)
+{
+    struct swwatchdog *wd = g_watchdog;
+
+    if (node == NULL)
         return -1;
-    }
 
-    if (node->active) {
-        node->active = false;
-        wd->active_num--;
+    __atomic_store_n(&node->fed_us, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&node->watched, NULL, __ATOMIC_SEQ_CST);
+    // the thread is being signalled for backtrace, wait until the dump is done,
+    // dump_mutex is only taken here in that rare case
+    if (__atomic_load_n(&node->dumping, __ATOMIC_SEQ_CST) && wd != NULL) {
+        OS_THREAD_MUTEX_LOCK(wd->dump_mutex);
+        OS_THREAD_MUTEX_UNLOCK(wd->dump_mutex);
     }
-    node->count = 0;
-
-    OS_THREAD_MUTEX_UNLOCK(wd->mutex);
     return 0;
 }
 
 void swwatchdog_destroy(swwatch_t node)
 {
     struct swwatchdog *wd = g_watchdog;
-    struct listnode *item;
 
-    if (wd == NULL)
+    if (wd == NULL || node == NULL)
         return;
 
     OS_THREAD_MUTEX_LOCK(wd->mutex);
 
-    list_for_each(item, &wd->list) {
-        struct swwatchdog_node *temp = node_to_item(item, struct swwatchdog_node, listnode);
-        if (temp == node) {
-            if (temp->active)
-                wd->active_num--;
+    __atomic_store_n(&node->watched, NULL, __ATOMIC_SEQ_CST);
+    // being dumped without mutex, wait until it's done
+    while (wd->busy == node)
+        OS_THREAD_COND_WAIT(wd->idle_cond, wd->mutex);
 
-            list_remove(item);
-            OS_FREE(temp);
-            break;
-        }
+    if (node->queued) {
+        list_remove(&node->listnode);
+        node->queued = false;
     }
 
     OS_THREAD_MUTEX_UNLOCK(wd->mutex);
+
+    OS_FREE(node);
 }
@@ -0,0 +1,369 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <stdbool.h>
+#include "cutils/common_list.h"
+#include "cutils/os_memory.h"
+#include "cutils/os_thread.h"
+#include "cutils/os_time.h"
+#include "cutils/os_logger.h"
+#include "cutils/msglooper.h"
+#include "cutils/sw_timer.h"
+#include "cutils/timer_wheel.h"
+
+#define LOG_TAG "timerwheel"
+
+#define DEFAULT_SLOT_COUNT 512
+
+struct timerwheel {
+    const char *name;
+    struct listnode *slots;
+    unsigned int slot_mask;
+    unsigned long long tick_us;
+    unsigned long long start_us; // monotonic time of tick 0
+    unsigned long long current;  // all timers expire at or before current tick are fired
+    unsigned long active_num;
+
+    struct listnode expired;     // timers to fire, twtimer_stop() may remove them
+    swtimer_t ticker;            // only started when active_num > 0
+    mlooper_t looper;            // ticks are posted to looper if set
+    bool destroyed;              // ticks still queued on looper return at once
+    bool ticking;                // twheel_tick() runs, it releases the wheel if destroyed meanwhile
+    os_mutex_t mutex;
+};
+
+static unsigned long long twheel_now_tick(struct timerwheel *wheel)
+{
+    return (OS_MONOTONIC_USEC() - wheel->start_us) / wheel->tick_us;
+}
+
+static void twheel_release(struct timerwheel *wheel, mlooper_t looper);
+
+static void twheel_tick(void *arg)
+{
+    struct timerwheel *wheel = (struct timerwheel *)arg;
+    struct twtimer *timer;
+    struct listnode *item, *tmp, *slot;
+    unsigned long long target, steps, i;
+    mlooper_t looper;
+    bool release;
+
+    OS_THREAD_MUTEX_LOCK(wheel->mutex);
+
+    if (wheel->destroyed) {
+        OS_THREAD_MUTEX_UNLOCK(wheel->mutex);
+        return;
+    }
+    wheel->ticking = true;
+
+    target = twheel_now_tick(wheel);
+    steps = target - wheel->current;
+    // every slot is visited once at most, timers in further rounds stay
+    if (steps > wheel->slot_mask + 1)
+        steps = wheel->slot_mask + 1;
+
+    for (i = 1; i <= steps; i++) {
+        slot = &wheel->slots[(wheel->current + i) & wheel->slot_mask];
+        list_for_each_safe(item, tmp, slot) {
+            timer = node_to_item(item, struct twtimer, listnode);
+            if (timer->expires <= target) {
+                list_remove(item);
+                list_add_tail(&wheel->expired, item);
+            }
+        }
+    }
+    wheel->current = target;
+
+    while (!wheel->destroyed && !list_empty(&wheel->expired)) {
+        item = list_head(&wheel->expired);
+        timer = node_to_item(item, struct twtimer, listnode);
+        list_remove(item);
+        list_init(item);
+        timer->active = false;
+        wheel->active_num--;
+
+        OS_THREAD_MUTEX_UNLOCK(wheel->mutex);
+        timer->cb(timer->arg);
+        OS_THREAD_MUTEX_LOCK(wheel->mutex);
+    }
+
+    if (!wheel->destroyed && wheel->active_num == 0)
+        swtimer_stop(wheel->ticker);
+
+    // a callback destroyed the wheel, it's released once nothing here touches it
+    wheel->ticking = false;
+    release = wheel->destroyed;
+    looper = wheel->looper;
+    OS_THREAD_MUTEX_UNLOCK(wheel->mutex);
+
+    if (release)
+        twheel_release(wheel, looper);
+}
+
+static void twheel_free(struct timerwheel *wheel)
+{
+    OS_THREAD_MUTEX_DESTROY(wheel->mutex);
+    OS_FREE(wheel->slots);
+    OS_FREE(wheel->name);
+    OS_FREE(wheel);
+}
+
+static void twheel_release_handle(struct message *msg)
+{
+    // freed by twheel_release_free(), which runs even if looper is stopped
+}
+
+static void twheel_release_free(struct message *msg)
+{
+    twheel_free((struct timerwheel *)msg->data);
+}
+
+static void twheel_release(struct timerwheel *wheel, mlooper_t looper)
+{
+    struct message *msg;
+
+    if (looper == NULL) {
+        twheel_free(wheel);
+        return;
+    }
+
+    // ticks posted before are still queued on looper and point to the wheel,
+    // free it by a message queued behind them
+    msg = message_obtain2(0, 0, 0, wheel, 0, twheel_release_handle, twheel_release_free, NULL);
+    if (msg == NULL) {
+        OS_LOGE(LOG_TAG, "[%s]: Failed to allocate release message, leak wheel", wheel->name);
+        return;
+    }
+    mlooper_post_message(looper, msg);
+}
+
+twheel_t twheel_create(const char *name, unsigned long tick_ms, unsigned int slot_count)
+{
+    struct timerwheel *wheel;
+    struct swtimer_attr attr;
+    unsigned int count = 1;
+
+    if (tick_ms == 0) {
+        OS_LOGE(LOG_TAG, "Invalid tick_ms");
+        return NULL;
+    }
+
+    if (slot_count == 0)
+        slot_count = DEFAULT_SLOT_COUNT;
+    while (count < slot_count)
+        count <<= 1;
+
+    wheel = OS_CALLOC(1, sizeof(struct timerwheel));
+    if (wheel == NULL) {
+        OS_LOGE(LOG_TAG, "Failed to allocate timer wheel");
+        return NULL;
+    }
+
+    wheel->name = OS_STRDUP(name ? name : "timerwheel");
+
+    wheel->mutex = OS_THREAD_MUTEX_CREATE();
+    if (wheel->mutex == NULL) {
+        OS_LOGE(LOG_TAG, "[%s]: Failed to create wheel mutex", wheel->name);
+        goto error;
+    }
+
+    wheel->slots = OS_MALLOC(count * sizeof(struct listnode));
+    if (wheel->slots == NULL) {
+        OS_LOGE(LOG_TAG, "[%s]: Failed to allocate wheel slots", wheel->name);
+        goto error;
+    }
+    for (unsigned int i = 0; i < count; i++)
+        list_init(&wheel->slots[i]);
+    list_init(&wheel->expired);
+
+    attr.name = wheel->name;
+    attr.period_ms = tick_ms;
+    attr.reload = true;
+    wheel->ticker = swtimer_create2(&attr, twheel_tick, wheel);
+    if (wheel->ticker == NULL) {
+        OS_LOGE(LOG_TAG, "[%s]: Failed to create wheel ticker", wheel->name);
+        goto error;
+    }
+
+    wheel->slot_mask = count - 1;
+    wheel->tick_us = (unsigned long long)tick_ms * 1000;
+    wheel->start_us = OS_MONOTONIC_USEC();
+    wheel->current = 0;
+    wheel->active_num = 0;
+    return wheel;
+
+error:
+    if (wheel->slots != NULL)
+        OS_FREE(wheel->slots);
+    if (wheel->mutex != NULL)
+        OS_THREAD_MUTEX_DESTROY(wheel->mutex);
+    OS_FREE(wheel->name);
+    OS_FREE(wheel);
+    return NULL;
+}
+
+void twheel_destroy(twheel_t wheel)
+{
+    struct twtimer *timer;
+    struct listnode *item, *tmp;
+    mlooper_t looper;
+    bool ticking;
+
+    // wait ticker callback returns, then no more ticks are run or posted,
+    // called by a timer callback, the ticker is destroyed after it returns
+    swtimer_destroy(wheel->ticker);
+
+    OS_THREAD_MUTEX_LOCK(wheel->mutex);
+
+    wheel->destroyed = true;
+    wheel->ticker = NULL;
+    looper = wheel->looper;
+
+    for (unsigned int i = 0; i <= wheel->slot_mask; i++) {
+        list_for_each_safe(item, tmp, &wheel->slots[i]) {
+            timer = node_to_item(item, struct twtimer, listnode);
+            list_remove(item);
+            list_init(item);
+            timer->active = false;
+        }
+    }
+    list_for_each_safe(item, tmp, &wheel->expired) {
+        timer = node_to_item(item, struct twtimer, listnode);
+        list_remove(item);
+        list_init(item);
+        timer->active = false;
+    }
+    wheel->active_num = 0;
+    // a tick still running (this callback's own, or one on looper) releases it as it returns
+    ticking = wheel->ticking;
+
+    OS_THREAD_MUTEX_UNLOCK(wheel->mutex);
+
+    if (!ticking)
+        twheel_release(wheel, looper);
+}
+
+int twheel_set_looper(twheel_t wheel, mlooper_t looper)
+{
+    int ret;
+
+    OS_THREAD_MUTEX_LOCK(wheel->mutex);
+    ret = swtimer_set_looper(wheel->ticker, looper);
+    if (ret == 0 && looper != NULL)
+        wheel->looper = looper; // the last looper ticks were posted to, keep it after reset to NULL
+    OS_THREAD_MUTEX_UNLOCK(wheel->mutex);
+    return ret;
+}
+
+void twtimer_init(struct twtimer *timer, void (*cb)(void *arg), void *arg)
+{
+    list_init(&timer->listnode);
+    timer->cb = cb;
+    timer->arg = arg;
+    timer->wheel = NULL;
+    timer->expires = 0;
+    timer->ticks = 0;
+    timer->active = false;
+}
+
+static void twtimer_add_l(struct timerwheel *wheel, struct twtimer *timer)
+{
+    unsigned long long now = twheel_now_tick(wheel);
+
+    if (wheel->active_num++ == 0) {
+        // ticker is stopped when idle, nothing to catch up
+        wheel->current = now;
+        swtimer_start(wheel->ticker);
+    }
+
+    timer->expires = now + timer->ticks;
+    timer->active = true;
+    list_add_tail(&wheel->slots[timer->expires & wheel->slot_mask], &timer->listnode);
+}
+
+static void twtimer_remove_l(struct timerwheel *wheel, struct twtimer *timer)
+{
+    list_remove(&timer->listnode);
+    list_init(&timer->listnode);
+    timer->active = false;
+    wheel->active_num--;
+}
+
+int twtimer_start(twheel_t wheel, struct twtimer *timer, unsigned long timeout_ms)
+{
+    unsigned long long ticks = ((unsigned long long)timeout_ms * 1000 + wheel->tick_us - 1) / wheel->tick_us;
+
+    if (timer->wheel != NULL && timer->wheel != wheel) {
+        OS_LOGE(LOG_TAG, "[%s]: Can't start timer that belongs to another wheel", wheel->name);
+        return -1;
+    }
+
+    OS_THREAD_MUTEX_LOCK(wheel->mutex);
+
+    if (timer->active)
+        twtimer_remove_l(wheel, timer);
+
+    timer->wheel = wheel;
+    timer->ticks = ticks > 0 ? ticks : 1;
+    twtimer_add_l(wheel, timer);
+
+    OS_THREAD_MUTEX_UNLOCK(wheel->mutex);
+    return 0;
+}
+
+int twtimer_stop(struct twtimer *timer)
+{
+    struct timerwheel *wheel = timer->wheel;
+
+    if (wheel == NULL)
+        return -1;
+
+    OS_THREAD_MUTEX_LOCK(wheel->mutex);
+
+    if (timer->active) {
+        twtimer_remove_l(wheel, timer);
+        if (wheel->active_num == 0)
+            swtimer_stop(wheel->ticker);
+    }
+
+    OS_THREAD_MUTEX_UNLOCK(wheel->mutex);
+    return 0;
+}
+
+int twtimer_reset(struct twtimer *timer)
+{
+    struct timerwheel *wheel = timer->wheel;
+
+    if (wheel == NULL) {
+        OS_LOGE(LOG_TAG, "Can't reset timer that has never been started");
+        return -1;
+    }
+
+    OS_THREAD_MUTEX_LOCK(wheel->mutex);
+
+    if (timer->active)
+        twtimer_remove_l(wheel, timer);
+    twtimer_add_l(wheel, timer);
+
+    OS_THREAD_MUTEX_UNLOCK(wheel->mutex);
+    return 0;
+}
+
+bool twtimer_is_active(struct twtimer *timer)
+{
+    return timer->active;
+}
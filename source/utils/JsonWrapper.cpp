@@ -208,7 +208,7 @@ bool JsonWrapper::toFile(const std::string& filePath) const
     if (p) {
         fwrite(p, strlen(p), 1, f);
         fclose(f);
-        free(p);
+        cJSON_free(p);
         return true;
     }
 
@@ -227,7 +227,7 @@ std::string JsonWrapper::toString(bool formatted) const
     if (!json)
         return "";
     std::string result(json);
-    free(json);
+    cJSON_free(json);
     return result;
 }
 
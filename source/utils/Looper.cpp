@@ -103,6 +103,7 @@ void Message::recycle()
 
 Looper::Looper(const char *name)
     : mLooperName(name ? name : "Looper"),
+      mLoopThread(NULL),
       mExitPending(false),
       mRunning(false)
 {
@@ -121,6 +122,11 @@ Looper::~Looper()
 
 void Looper::loop()
 {
+    struct os_threadinfo *thread = OS_THREAD_INFO();
+    void *outer = thread->handler_looper;
+    thread->handler_looper = this;
+    __atomic_store_n(&mLoopThread, OS_THREAD_SELF(), __ATOMIC_RELEASE);
+
     OS_LOGD(TAG, "[%s]: Entry looper thread", mLooperName.c_str());
 
     {
@@ -174,9 +180,26 @@ void Looper::loop()
         mStateMutex.condBroadcast();
     }
 
+    __atomic_store_n(&mLoopThread, (os_thread_t)NULL, __ATOMIC_RELEASE);
+    thread->handler_looper = outer;
+
     OS_LOGD(TAG, "[%s]: Leave looper thread", mLooperName.c_str());
 }
 
+Looper *Looper::myLooper()
+{
+    return static_cast<Looper *>(OS_THREAD_INFO()->handler_looper);
+}
+
+bool Looper::isCurrentThread()
+{
+#if defined(OS_THREAD_INFO_SHARED)
+    return __atomic_load_n(&mLoopThread, __ATOMIC_ACQUIRE) == OS_THREAD_SELF();
+#else
+    return OS_THREAD_INFO()->handler_looper == this;
+#endif
+}
+
 void Looper::quit()
 {
     Mutex::Autolock _l(mStateMutex);
@@ -185,6 +208,8 @@ void Looper::quit()
         mExitPending = true;
         mMsgMutex.condSignal();
     }
+    // wake up senders waiting in waitSyncDone()
+    mStateMutex.condBroadcast();
 }
 
 void Looper::quitSafely()
@@ -195,6 +220,7 @@ void Looper::quitSafely()
         mExitPending = true;
         mMsgMutex.condSignal();
     }
+    mStateMutex.condBroadcast();
     while (mRunning == true) {
         OS_LOGV(TAG, "[%s]: mStateMutex condWait, waiting", mLooperName.c_str());
         mStateMutex.condWait();
@@ -218,6 +244,45 @@ bool Looper::isRunning()
     return mRunning;
 }
 
+void Looper::signalSyncDone(bool *done)
+{
+    Mutex::Autolock _l(mStateMutex);
+    *done = true;
+    mStateMutex.condBroadcast();
+}
+
+bool Looper::waitSyncDone(HandlerCallback *handlerCallback, bool *done)
+{
+    Message *dropped = NULL;
+    {
+        Mutex::Autolock _l(mStateMutex);
+        while (!*done) {
+            // a looper not started yet handles it once loop() runs, a quitting one
+            // drops it unless it's being handled
+            if (mExitPending) {
+                Mutex::Autolock _l(mMsgMutex);
+                std::list<Message *>::iterator it;
+                for (it = mMsgList.begin(); it != mMsgList.end(); it++) {
+                    if ((*it)->handlerCallback == handlerCallback) {
+                        dropped = *it;
+                        mMsgList.erase(it);
+                        break;
+                    }
+                }
+                if (dropped)
+                    break;
+            }
+            mStateMutex.condWait();
+        }
+    }
+
+    if (dropped) {
+        dropped->recycle();
+        return false;
+    }
+    return true;
+}
+
 bool Looper::postMessage(Message *msg)
 {
     return postMessageDelay(msg, 0);
@@ -401,6 +466,61 @@ bool Handler::postMessageDelay(Message *msg, unsigned long delayMs)
     return false;
 }
 
+// Forwards the message to the handler and wakes up the sender
+class Handler::SyncCall : public HandlerCallback {
+public:
+    SyncCall(Handler *handler, Looper *looper) : mHandler(handler), mLooper(looper), mDone(false) {}
+    virtual ~SyncCall() {}
+
+    virtual void onHandle(Message *msg) {
+        mHandler->onHandle(msg);
+        // the sender may leave once done, let recycle() free data by the handler
+        msg->handlerCallback = mHandler;
+        mLooper->signalSyncDone(&mDone);
+    }
+    virtual void onFree(Message *msg) {
+        mHandler->onFree(msg);
+    }
+
+    // False if the looper quits before handling it, then the message is removed
+    bool wait() {
+        return mLooper->waitSyncDone(this, &mDone);
+    }
+
+private:
+    Handler *mHandler;
+    Looper *mLooper;
+    bool mDone; // guarded by state mutex of the looper
+};
+
+bool Handler::sendMessage(Message *msg)
+{
+    if (msg == NULL)
+        return false;
+    if (mLooper == NULL) {
+        OS_LOGE(TAG, "No looper, discard message what=%d", msg->what);
+        msg->recycle();
+        return false;
+    }
+
+    if (mLooper->isCurrentThread()) {
+        // posting to ourselves and waiting would deadlock
+        msg->handlerCallback = this;
+        onHandle(msg);
+        msg->recycle();
+        return true;
+    }
+
+    SyncCall call(this, mLooper);
+    msg->handlerCallback = &call;
+    if (!mLooper->postMessage(msg)) {
+        msg->handlerCallback = NULL;
+        msg->recycle();
+        return false;
+    }
+    return call.wait();
+}
+
 bool Handler::postMessageFront(Message *msg)
 {
     if (msg) {
@@ -444,6 +564,7 @@ HandlerThread::HandlerThread(const char *name, enum os_threadprio priority, unsi
       mThreadName(name ? name : "HandlerThread"),
       mThreadPriority(priority),
       mThreadStacksize(stacksize),
+      mThreadSched(),
       mRunning(false)
 {
     OS_NEW(mLooper, Looper, mThreadName.c_str());
@@ -469,6 +590,12 @@ void *HandlerThread::threadEntry(void *arg)
     return NULL;
 }
 
+void HandlerThread::setThreadSched(const struct os_threadsched &sched)
+{
+    Mutex::Autolock _l(mThreadMutex);
+    mThreadSched = sched;
+}
+
 bool HandlerThread::run()
 {
     Mutex::Autolock _l(mThreadMutex);
@@ -483,6 +610,7 @@ bool HandlerThread::run()
         .priority = mThreadPriority,
         .stacksize = mThreadStacksize,
         .joinable = false,
+        .sched = mThreadSched,
     };
     mThreadId = OS_THREAD_CREATE(&attr, threadEntry, this);
     if (mThreadId != NULL){
@@ -505,7 +633,7 @@ void HandlerThread::requestExitAndWait()
 {
     Mutex::Autolock _l(mThreadMutex);
 
-    if (mThreadId == OS_THREAD_SELF()) {
+    if (mLooper->isCurrentThread()) {
         OS_LOGW(TAG,
                 "Thread (%p:%s): don't call requestExitAndWait() from this "
                 "Thread object's thread. Maybe deadlock!",
@@ -27,6 +27,17 @@
 #include "utils/Namespace.h"
 #include "SharedBuffer.h"
 
+#if defined(ENABLE_MEMORY_POOL)
+#include "cutils/mem_pool.h"
+#define sb_malloc  mempool_malloc
+#define sb_realloc mempool_realloc
+#define sb_free    mempool_free
+#else
+#define sb_malloc  malloc
+#define sb_realloc realloc
+#define sb_free    free
+#endif
+
 // ---------------------------------------------------------------------------
 
 SYSUTILS_NAMESPACE_BEGIN
@@ -38,7 +49,7 @@ SharedBuffer* SharedBuffer::alloc(size_t size)
     OS_FATAL_IF((size >= (SIZE_MAX - sizeof(SharedBuffer))),
         LOG_TAG, "Invalid buffer size %zu", size);
 
-    SharedBuffer* sb = static_cast<SharedBuffer *>(malloc(sizeof(SharedBuffer) + size));
+    SharedBuffer* sb = static_cast<SharedBuffer *>(sb_malloc(sizeof(SharedBuffer) + size));
     if (sb) {
         // Should be std::atomic_init(&sb->mRefs, 1);
         // But that generates a warning with some compilers.
@@ -52,7 +63,7 @@ SharedBuffer* SharedBuffer::alloc(size_t size)
 
 void SharedBuffer::dealloc(const SharedBuffer* released)
 {
-    free(const_cast<SharedBuffer*>(released));
+    sb_free(const_cast<SharedBuffer*>(released));
 }
 
 SharedBuffer* SharedBuffer::edit() const
@@ -78,7 +89,7 @@ SharedBuffer* SharedBuffer::editResize(size_t newSize) const
         OS_FATAL_IF((newSize >= (SIZE_MAX - sizeof(SharedBuffer))),
             LOG_TAG, "Invalid buffer size %zu", newSize);
 
-        buf = static_cast<SharedBuffer *>(realloc((void *)buf, sizeof(SharedBuffer) + newSize));
+        buf = static_cast<SharedBuffer *>(sb_realloc((void *)buf, sizeof(SharedBuffer) + newSize));
         if (buf != NULL) {
             buf->mSize = newSize;
             return buf;
@@ -123,7 +134,7 @@ int32_t SharedBuffer::release(uint32_t flags) const
                 && (atomic_thread_fence(std::memory_order_acquire), true))) {
         mRefs.store(0, std::memory_order_relaxed);
         if ((flags & eKeepStorage) == 0) {
-            free(const_cast<SharedBuffer*>(this));
+            sb_free(const_cast<SharedBuffer*>(this));
         }
     }
     return prev;
@@ -25,6 +25,7 @@ SYSUTILS_NAMESPACE_BEGIN
 
 Thread::Thread()
     :   mThread(NULL),
+        mSched(),
         mExitPending(false),
         mRunning(false)
 {
@@ -39,6 +40,12 @@ bool Thread::readyToRun()
     return true;
 }
 
+void Thread::setThreadSched(const struct os_threadsched &sched)
+{
+    Mutex::Autolock _l(mLock);
+    mSched = sched;
+}
+
 bool Thread::run(const char *name, enum os_threadprio priority, unsigned int stack)
 {
     Mutex::Autolock _l(mLock);
@@ -59,12 +66,12 @@ bool Thread::run(const char *name, enum os_threadprio priority, unsigned int sta
         .priority = priority,
         .stacksize = stack,
         .joinable = false,
+        .sched = mSched,
     };
     mThread = OS_THREAD_CREATE(&attr, _threadLoop, this);
-    if (mThread != NULL) {
-        OS_THREAD_SET_NAME(mThread, name);
+    // named by OS_THREAD_CREATE(), the detached thread may already be gone here
+    if (mThread != NULL)
         mRunning = true;
-    }
 
     return mRunning;
 }
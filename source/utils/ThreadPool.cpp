@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "cutils/os_logger.h"
+#include "cutils/os_memory.h"
+#include "utils/ThreadPool.h"
+
+#define TAG "ThreadPool"
+
+SYSUTILS_NAMESPACE_BEGIN
+
+ThreadPool::ThreadPool(const char *name, unsigned int minThreads, unsigned int maxThreads)
+{
+    struct os_threadpool_attr attr = {
+        .name = name != NULL ? name : "ThreadPool",
+        .min_threads = minThreads,
+        .max_threads = maxThreads,
+        .idle_timeout_ms = 0,
+        .queue_size = 0,
+        .priority = OS_THREAD_PRIO_NORMAL,
+        .stacksize = 0,
+        .sched = {},
+    };
+    mPool = os_threadpool_create(&attr);
+    OS_ASSERT(mPool != NULL, TAG, "Failed to create thread pool");
+}
+
+ThreadPool::ThreadPool(struct os_threadpool_attr *attr)
+{
+    mPool = os_threadpool_create(attr);
+    OS_ASSERT(mPool != NULL, TAG, "Failed to create thread pool");
+}
+
+ThreadPool::~ThreadPool()
+{
+    if (mPool != NULL)
+        os_threadpool_destroy(mPool);
+}
+
+void ThreadPool::postEntry(void *arg)
+{
+    std::function<void()> *task = static_cast<std::function<void()> *>(arg);
+    (*task)();
+    OS_DELETE(task);
+}
+
+bool ThreadPool::post(const std::function<void()> &task)
+{
+    std::function<void()> *copy;
+    OS_NEW(copy, std::function<void()>, task);
+    if (os_threadpool_submit(mPool, postEntry, copy) != 0) {
+        OS_DELETE(copy);
+        return false;
+    }
+    return true;
+}
+
+void ThreadPool::rangeEntry(size_t begin, size_t end, void *arg)
+{
+    const std::function<void(size_t, size_t)> *fn = static_cast<const std::function<void(size_t, size_t)> *>(arg);
+    (*fn)(begin, end);
+}
+
+void ThreadPool::parallelFor(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)> &fn)
+{
+    os_threadpool_parallel_for(mPool, begin, end, grain, rangeEntry, (void *)&fn);
+}
+
+void ThreadPool::drain()
+{
+    os_threadpool_drain(mPool);
+}
+
+unsigned int ThreadPool::threads()
+{
+    return os_threadpool_threads(mPool);
+}
+
+SYSUTILS_NAMESPACE_END
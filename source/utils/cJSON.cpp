@@ -58,6 +58,11 @@
 
 #include "utils/Namespace.h"
 #include "utils/cJSON.h"
+#if defined(ENABLE_MEMORY_ARENA)
+#include "cutils/os_arena.h"
+#elif defined(ENABLE_MEMORY_POOL)
+#include "cutils/mem_pool.h"
+#endif
 
 SYSUTILS_NAMESPACE_BEGIN
 
@@ -173,6 +178,15 @@ static void * CJSON_CDECL internal_realloc(void *pointer, size_t size)
 {
     return realloc(pointer, size);
 }
+#elif defined(ENABLE_MEMORY_ARENA)
+/* allocate from the arena of current scope, see cutils/os_arena.h */
+#define internal_malloc os_arena_scoped_malloc
+#define internal_free os_arena_scoped_free
+#define internal_realloc os_arena_scoped_realloc
+#elif defined(ENABLE_MEMORY_POOL)
+#define internal_malloc mempool_malloc
+#define internal_free mempool_free
+#define internal_realloc mempool_realloc
 #else
 #define internal_malloc malloc
 #define internal_free free
@@ -210,9 +224,9 @@ CJSON_PUBLIC(void) cJSON_InitHooks(cJSON_Hooks* hooks)
     if (hooks == NULL)
     {
         /* Reset hooks */
-        global_hooks.allocate = malloc;
-        global_hooks.deallocate = free;
-        global_hooks.reallocate = realloc;
+        global_hooks.allocate = internal_malloc;
+        global_hooks.deallocate = internal_free;
+        global_hooks.reallocate = internal_realloc;
         return;
     }
 
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include "cutils/os_logger.h"
+#include "cutils/os_thread.h"
+#include "cutils/os_time.h"
+#include "cutils/msgqueue.h"
+#include "cutils/ringbuf.h"
+#include "utils/Looper.h"
+#include "utils/Coroutine.h"
+
+#define LOG_TAG "Coroutine_test"
+
+using namespace sysutils;
+
+#if defined(SYSUTILS_COROUTINE)
+
+#define FLOW_COUNT  1000
+#define ITEM_COUNT  100
+
+static int g_flows_done = 0;
+static long long g_flows_sum = 0;
+static int g_mqueue_sum = 0;
+static int g_ringbuf_sum = 0;
+static bool g_mqueue_done = false;
+static bool g_ringbuf_done = false;
+
+static Task<int> delayedAdd(int a, int b)
+{
+    co_await sleepFor(10 + a % 50);
+    co_return a + b;
+}
+
+// many flows on a single looper thread, each one sleeps and hops without a thread of its own
+static Task<void> flow(Looper *looper, int id)
+{
+    int value = co_await delayedAdd(id, 1);
+    co_await looper->schedule();
+    g_flows_sum += value;
+    g_flows_done++;
+}
+
+static Task<void> mqueueReader(mqueue_t queue)
+{
+    for (int i = 0; i < ITEM_COUNT; i++) {
+        int value = 0;
+        if (co_await asyncReceive(queue, &value) == 0)
+            g_mqueue_sum += value;
+    }
+    g_mqueue_done = true;
+}
+
+static Task<void> ringbufReader(ringbuf_handle_t rb)
+{
+    while (1) {
+        int value = 0;
+        int ret = co_await asyncRead(rb, (char *)&value, sizeof(value));
+        if (ret != sizeof(value))
+            break;
+        g_ringbuf_sum += value;
+    }
+    g_ringbuf_done = true;
+}
+
+static void *writerEntry(void *arg)
+{
+    mqueue_t queue = ((mqueue_t *)arg)[0];
+    ringbuf_handle_t rb = ((ringbuf_handle_t *)arg)[1];
+    for (int i = 1; i <= ITEM_COUNT; i++) {
+        while (mqueue_send(queue, (char *)&i, 0) != 0)
+            OS_THREAD_SLEEP_MSEC(1);
+        rb_write(rb, (char *)&i, sizeof(i), 0);
+        if (i % 10 == 0)
+            OS_THREAD_SLEEP_MSEC(5);
+    }
+    rb_done_write(rb);
+    return NULL;
+}
+
+int main()
+{
+    HandlerThread thread("coroutine");
+    thread.run();
+    Looper *looper = thread.getLooper();
+
+    unsigned long long start = OS_MONOTONIC_USEC();
+    for (int i = 0; i < FLOW_COUNT; i++)
+        spawn(looper, flow(looper, i));
+    while (__atomic_load_n(&g_flows_done, __ATOMIC_ACQUIRE) < FLOW_COUNT)
+        OS_THREAD_SLEEP_MSEC(10);
+    OS_LOGI(LOG_TAG, "%d flows on one looper: sum=[%lld] expect [%lld], cost [%llu]ms",
+            FLOW_COUNT, g_flows_sum, (long long)FLOW_COUNT * (FLOW_COUNT + 1) / 2,
+            (OS_MONOTONIC_USEC() - start) / 1000);
+
+    mqueue_t queue = mqueue_create(sizeof(int), 16);
+    ringbuf_handle_t rb = rb_create(64);
+    void *handles[2] = { queue, rb };
+    spawn(looper, mqueueReader(queue));
+    spawn(looper, ringbufReader(rb));
+
+    struct os_threadattr attr = {
+        .name = "writer",
+        .priority = OS_THREAD_PRIO_NORMAL,
+        .stacksize = 4096,
+        .joinable = true,
+    };
+    os_thread_t writer = OS_THREAD_CREATE(&attr, writerEntry, handles);
+    OS_THREAD_JOIN(writer, NULL);
+    while (!__atomic_load_n(&g_mqueue_done, __ATOMIC_ACQUIRE) ||
+           !__atomic_load_n(&g_ringbuf_done, __ATOMIC_ACQUIRE))
+        OS_THREAD_SLEEP_MSEC(10);
+    OS_LOGI(LOG_TAG, "awaited mqueue: sum=[%d], ringbuf: sum=[%d], expect [%d]",
+            g_mqueue_sum, g_ringbuf_sum, ITEM_COUNT * (ITEM_COUNT + 1) / 2);
+
+    thread.requestExitAndWait();
+    rb_destroy(rb);
+    mqueue_destroy(queue);
+    return 0;
+}
+
+#else
+
+int main()
+{
+    OS_LOGW(LOG_TAG, "Coroutine needs a C++20 compiler");
+    return 0;
+}
+
+#endif
@@ -22,6 +22,7 @@ public:
     void postMessage(Message *msg);
     void postMessageDelay(Message *msg, unsigned long delayMs);
     void postMessageFront(Message *msg);
+    bool sendMessage(Message *msg);
     void removeMessage(int what);
 
     void dump();
@@ -48,6 +49,10 @@ LooperTest::~LooperTest()
 void LooperTest::onHandle(Message *msg)
 {
     OS_LOGI(LOG_TAG, "Handle message: what=%d, str=%s", msg->what, msg->data);
+    if (msg->what == 1) {
+        // on the looper thread, handled inline before sendMessage() returns
+        mHandler->sendMessage(Message::obtain(3, OS_STRDUP("sendMessage(msg8) from looper thread")));
+    }
 }
 
 void LooperTest::onFree(Message *msg)
@@ -71,6 +76,11 @@ void LooperTest::postMessageFront(Message *msg)
     mHandler->postMessageFront(msg);
 }
 
+bool LooperTest::sendMessage(Message *msg)
+{
+    return mHandler->sendMessage(msg);
+}
+
 void LooperTest::removeMessage(int what)
 {
     mHandler->removeMessage(what);
@@ -81,6 +91,66 @@ void LooperTest::dump()
     mHandler->dump();
 }
 
+class SyncCallTest : public HandlerCallback {
+public:
+    explicit SyncCallTest(Looper *looper) : mLooper(looper) {}
+
+    virtual void onHandle(Message *msg) {
+        OS_LOGI(LOG_TAG, "Handle sync message: what=%d", msg->what);
+        if (msg->what == 10) {
+            // quit while a sync message is queued behind this one
+            OS_THREAD_SLEEP_MSEC(50);
+            mLooper->quit();
+        }
+    }
+    virtual void onFree(Message *msg) {}
+
+    static void *loopEntry(void *arg) {
+        Looper *looper = static_cast<Looper *>(arg);
+        OS_THREAD_SLEEP_MSEC(50);
+        looper->loop();
+        return NULL;
+    }
+
+private:
+    Looper *mLooper;
+};
+
+// sendMessage() before loop() starts waits for it, after quit() fails at once
+static bool syncCallTest()
+{
+    Looper *looper;
+    Handler *handler;
+    SyncCallTest *callback;
+    struct os_threadattr attr = {
+        .name = "SyncCallTest",
+        .priority = OS_THREAD_PRIO_NORMAL,
+        .stacksize = 1024,
+        .joinable = true,
+        .sched = {},
+    };
+    bool early, queued, late;
+
+    OS_NEW(looper, Looper, "SyncCallTest");
+    OS_NEW(callback, SyncCallTest, looper);
+    OS_NEW(handler, Handler, looper, callback);
+
+    os_thread_t tid = OS_THREAD_CREATE(&attr, SyncCallTest::loopEntry, looper);
+    early = handler->sendMessage(Message::obtain(9));
+    handler->postMessage(Message::obtain(10));
+    queued = handler->sendMessage(Message::obtain(11));
+    OS_THREAD_JOIN(tid, NULL);
+    late = handler->sendMessage(Message::obtain(12));
+
+    OS_LOGI(LOG_TAG, "sendMessage() before loop: [%s], quit behind: [%s], after quit: [%s], expect [true/false/false]",
+            early ? "true" : "false", queued ? "true" : "false", late ? "true" : "false");
+
+    OS_DELETE(handler);
+    OS_DELETE(callback);
+    OS_DELETE(looper);
+    return early && !queued && !late;
+}
+
 int main()
 {
     LooperTest *looperTest;
@@ -110,12 +180,19 @@ int main()
     looperTest->removeMessage(-1);
     looperTest->dump();
 
+    Message *msg9 = Message::obtain(4, OS_STRDUP("sendMessage(msg9)"));
+    bool handled = looperTest->sendMessage(msg9); // wait until msg3~msg5 and msg9 handled
+    OS_LOGI(LOG_TAG, "sendMessage(msg9) returned: handled=%s", handled ? "true" : "false");
+
     //OS_LOGW(LOG_TAG, "-->Dump class after post message");
     //OS_CLASS_DUMP();
 
     sleep(3);
     OS_DELETE(looperTest);
 
+    if (!syncCallTest())
+        return -1;
+
     //OS_LOGW(LOG_TAG, "-->Dump class after delete looper");
     //OS_CLASS_DUMP();
     return 0;
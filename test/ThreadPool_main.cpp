@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "cutils/os_logger.h"
+#include "cutils/os_thread.h"
+#include "utils/ThreadPool.h"
+
+#define LOG_TAG "ThreadPool_test"
+
+using namespace sysutils;
+
+static int fib(ThreadPool &pool, int n)
+{
+    if (n < 10)
+        return n < 2 ? n : fib(pool, n - 1) + fib(pool, n - 2);
+    // nested submit and get inside a task, the waiting worker runs other tasks
+    ThreadPoolFuture<int> left = pool.submit<int>([&pool, n]() { return fib(pool, n - 1); });
+    int right = fib(pool, n - 2);
+    return left.get() + right;
+}
+
+int main()
+{
+    // elastic pool: 2 workers, up to 4 when busy, extra workers exit after 200ms idle
+    struct os_threadpool_attr attr = {
+        .name = "elastic_pool",
+        .min_threads = 2,
+        .max_threads = 4,
+        .idle_timeout_ms = 200,
+    };
+    ThreadPool pool(&attr);
+    int counter = 0;
+
+    for (int i = 0; i < 100; i++)
+        pool.post([&counter]() { __atomic_add_fetch(&counter, 1, __ATOMIC_RELAXED); });
+    pool.drain();
+    OS_LOGI(LOG_TAG, "posted tasks: counter=[%d] expect [100]", counter);
+
+    ThreadPoolFuture<std::string> hello = pool.submit<std::string>([]() { return std::string("hello"); });
+    OS_LOGI(LOG_TAG, "future: [%s]", hello.get().c_str());
+
+    ThreadPoolFuture<int> result = pool.submit<int>([&pool]() { return fib(pool, 20); });
+    OS_LOGI(LOG_TAG, "nested futures: fib(20)=[%d] expect [6765], workers=[%u]", result.get(), pool.threads());
+
+    std::vector<int> values(100000, 1);
+    long long sum = 0;
+    pool.parallelFor(0, values.size(), 1000, [&values, &sum](size_t begin, size_t end) {
+        long long local = 0;
+        for (size_t i = begin; i < end; i++)
+            local += values[i];
+        __atomic_add_fetch(&sum, local, __ATOMIC_RELAXED);
+    });
+    OS_LOGI(LOG_TAG, "parallelFor: sum=[%lld] expect [100000]", sum);
+
+    OS_THREAD_SLEEP_MSEC(500);
+    OS_LOGI(LOG_TAG, "after idle: workers=[%u] expect [2]", pool.threads());
+    return 0;
+}
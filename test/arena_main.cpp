@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <string.h>
+#include "cutils/os_memory.h"
+#include "cutils/os_logger.h"
+#include "cutils/os_time.h"
+#include "cutils/os_arena.h"
+#include "utils/Namespace.h"
+#include "utils/cJSON.h"
+
+#define LOG_TAG "arena_test"
+
+#define REQUEST_COUNT 20000
+#define ROUND_COUNT   5
+
+SYSUTILS_NAMESPACE_USING
+
+static const char *request =
+    "{\"cmd\":\"set_volume\",\"seq\":1024,\"params\":{\"stream\":\"music\",\"level\":12,"
+    "\"ramp\":[0,2,4,6,8,10,12],\"tags\":[\"a\",\"b\",\"c\",\"d\"]}}";
+
+static int g_alloc_count = 0;
+
+static void *count_malloc(size_t size)
+{
+    g_alloc_count++;
+    return os_arena_scoped_malloc(size);
+}
+
+// parse the command, build the reply and print it
+static int handle_request()
+{
+    cJSON *cmd = cJSON_Parse(request);
+    cJSON *reply = cJSON_CreateObject();
+    int len = 0;
+
+    cJSON_AddStringToObject(reply, "cmd", cJSON_GetObjectItem(cmd, "cmd")->valuestring);
+    cJSON_AddNumberToObject(reply, "seq", cJSON_GetObjectItem(cmd, "seq")->valuedouble);
+    cJSON_AddItemToObject(reply, "params", cJSON_Duplicate(cJSON_GetObjectItem(cmd, "params"), true));
+    cJSON_AddStringToObject(reply, "result", "ok");
+
+    char *out = cJSON_PrintUnformatted(reply);
+    if (out != NULL)
+        len = strlen(out);
+
+    cJSON_free(out);
+    cJSON_Delete(reply);
+    cJSON_Delete(cmd);
+    return len;
+}
+
+// build a status report of many small items, allocation bound as no number is parsed or printed
+static int handle_report()
+{
+    cJSON *report = cJSON_CreateObject();
+    cJSON *streams = cJSON_AddArrayToObject(report, "streams");
+
+    for (int i = 0; i < 16; i++) {
+        cJSON *stream = cJSON_CreateObject();
+        cJSON_AddStringToObject(stream, "name", "music");
+        cJSON_AddStringToObject(stream, "state", "playing");
+        cJSON_AddBoolToObject(stream, "muted", false);
+        cJSON_AddItemToArray(streams, stream);
+    }
+
+    int count = cJSON_GetArraySize(streams);
+    cJSON_Delete(report);
+    return count;
+}
+
+// with arena every request is run in scope and reset after
+static unsigned long long run_round(int (*handle)(), os_arena_t arena, size_t *used)
+{
+    unsigned long long start = OS_MONOTONIC_USEC();
+
+    for (int i = 0; i < REQUEST_COUNT; i++) {
+        if (arena != NULL) {
+            os_arena_t prev = os_arena_scope_enter(arena);
+            handle();
+            os_arena_scope_leave(prev);
+            *used = os_arena_used(arena);
+            os_arena_reset(arena);
+        }
+        else {
+            handle();
+        }
+    }
+    return OS_MONOTONIC_USEC() - start;
+}
+
+static void bench(const char *name, int (*handle)())
+{
+    cJSON_Hooks count_hooks = { count_malloc, os_arena_scoped_free };
+    cJSON_Hooks hooks = { os_arena_scoped_malloc, os_arena_scoped_free };
+    unsigned long long heap_cost = ~0ULL, arena_cost = ~0ULL, cost;
+    os_arena_t arena;
+    size_t used = 0;
+
+    cJSON_InitHooks(&count_hooks);
+    g_alloc_count = 0;
+    handle();
+
+    // no scope: tagged heap blocks. Rounds are interleaved and the best is
+    // taken, so warm up and cpu frequency don't favor either
+    cJSON_InitHooks(&hooks);
+    arena = os_arena_create(0);
+    for (int r = 0; r < ROUND_COUNT; r++) {
+        cost = run_round(handle, NULL, NULL);
+        if (cost < heap_cost)
+            heap_cost = cost;
+        cost = run_round(handle, arena, &used);
+        if (cost < arena_cost)
+            arena_cost = cost;
+    }
+    os_arena_destroy(arena);
+
+    cJSON_InitHooks(NULL);
+
+    OS_LOGI(LOG_TAG, "%s: [%d] requests: heap [%llu]us, arena [%llu]us, [%d] allocations and [%lu] Bytes per request",
+            name, REQUEST_COUNT, heap_cost, arena_cost, g_alloc_count, (unsigned long)used);
+}
+
+int main()
+{
+    bench("request", handle_request);
+    bench("report", handle_report);
+    return 0;
+}
@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+#include "cutils/os_logger.h"
+#include "cutils/os_memory.h"
+#include "cutils/os_thread.h"
+#include "cutils/os_time.h"
+#include "cutils/common_list.h"
+
+#define LOG_TAG "lockfree"
+
+#define PRODUCERS       4
+#define CONSUMERS       4
+#define ITEMS_PER_THREAD 200000
+#define TOTAL_ITEMS     (PRODUCERS * ITEMS_PER_THREAD)
+#define RING_SIZE       1024
+
+struct item {
+    int producer;
+    int seq;
+    int seen;
+    struct lfnode node;
+};
+
+static struct item *g_items;
+static struct lfstack g_stack;
+static struct mpscq g_queue;
+static struct mpmc_ring g_ring;
+static struct mpmc_cell g_cells[RING_SIZE];
+static int g_taken;
+static int g_errors;
+
+static struct item *producer_items(long producer)
+{
+    return g_items + producer * ITEMS_PER_THREAD;
+}
+
+static void take_item(struct item *item)
+{
+    if (__atomic_add_fetch(&item->seen, 1, __ATOMIC_RELAXED) != 1)
+        __atomic_add_fetch(&g_errors, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&g_taken, 1, __ATOMIC_RELEASE);
+}
+
+static bool all_taken()
+{
+    return __atomic_load_n(&g_taken, __ATOMIC_ACQUIRE) >= TOTAL_ITEMS;
+}
+
+static void *stack_push_routine(void *arg)
+{
+    struct item *items = producer_items((long)arg);
+    for (int i = 0; i < ITEMS_PER_THREAD; i++)
+        lfstack_push(&g_stack, &items[i].node);
+    return NULL;
+}
+
+static void *stack_pop_routine(void *arg)
+{
+    while (!all_taken()) {
+        struct lfnode *node = lfstack_pop(&g_stack);
+        if (node == NULL) {
+            sched_yield();
+            continue;
+        }
+        take_item(node_to_item(node, struct item, node));
+    }
+    return NULL;
+}
+
+static void *stack_pop_all_routine(void *arg)
+{
+    while (!all_taken()) {
+        struct lfnode *node = lfstack_pop_all(&g_stack);
+        if (node == NULL) {
+            sched_yield();
+            continue;
+        }
+        while (node != NULL) {
+            struct lfnode *next = node->next;
+            take_item(node_to_item(node, struct item, node));
+            node = next;
+        }
+    }
+    return NULL;
+}
+
+static void *mpscq_push_routine(void *arg)
+{
+    struct item *items = producer_items((long)arg);
+    for (int i = 0; i < ITEMS_PER_THREAD; i++)
+        mpscq_push(&g_queue, &items[i].node);
+    return NULL;
+}
+
+static void *mpscq_pop_routine(void *arg)
+{
+    int last_seq[PRODUCERS];
+
+    for (int i = 0; i < PRODUCERS; i++)
+        last_seq[i] = -1;
+    while (!all_taken()) {
+        struct lfnode *node = mpscq_pop(&g_queue);
+        if (node == NULL) {
+            sched_yield();
+            continue;
+        }
+        struct item *item = node_to_item(node, struct item, node);
+        // FIFO per producer
+        if (item->seq <= last_seq[item->producer])
+            __atomic_add_fetch(&g_errors, 1, __ATOMIC_RELAXED);
+        last_seq[item->producer] = item->seq;
+        take_item(item);
+    }
+    return NULL;
+}
+
+static void *ring_push_routine(void *arg)
+{
+    struct item *items = producer_items((long)arg);
+    for (int i = 0; i < ITEMS_PER_THREAD; i++) {
+        while (!mpmc_ring_push(&g_ring, &items[i].node))
+            sched_yield();
+    }
+    return NULL;
+}
+
+static void *ring_pop_routine(void *arg)
+{
+    while (!all_taken()) {
+        struct lfnode *node = mpmc_ring_pop(&g_ring);
+        if (node == NULL) {
+            sched_yield();
+            continue;
+        }
+        take_item(node_to_item(node, struct item, node));
+    }
+    return NULL;
+}
+
+static void reset_items()
+{
+    for (long p = 0; p < PRODUCERS; p++) {
+        struct item *items = producer_items(p);
+        for (int i = 0; i < ITEMS_PER_THREAD; i++) {
+            items[i].producer = (int)p;
+            items[i].seq = i;
+            items[i].seen = 0;
+        }
+    }
+    g_taken = 0;
+    g_errors = 0;
+}
+
+static void run_case(const char *name, void *(*producer)(void *), int consumers, void *(*consumer)(void *))
+{
+    struct os_threadattr attr = {
+        .name = "lockfree",
+        .priority = OS_THREAD_PRIO_NORMAL,
+        .stacksize = 4096,
+        .joinable = true,
+    };
+    os_thread_t threads[PRODUCERS + CONSUMERS];
+    unsigned long long start;
+    int count = 0;
+
+    reset_items();
+    start = OS_MONOTONIC_USEC();
+    for (long i = 0; i < consumers; i++)
+        threads[count++] = OS_THREAD_CREATE(&attr, consumer, (void *)i);
+    for (long i = 0; i < PRODUCERS; i++)
+        threads[count++] = OS_THREAD_CREATE(&attr, producer, (void *)i);
+    for (int i = 0; i < count; i++)
+        OS_THREAD_JOIN(threads[i], NULL);
+
+    OS_LOGI(LOG_TAG, "%-24s: %d producers, %d consumers, [%llu]ns/item, taken=[%d] expect [%d], errors=[%d]",
+            name, PRODUCERS, consumers, (OS_MONOTONIC_USEC() - start) * 1000 / TOTAL_ITEMS,
+            g_taken, TOTAL_ITEMS, g_errors);
+    if (g_taken != TOTAL_ITEMS)
+        g_errors++;
+}
+
+int main()
+{
+    int errors = 0;
+
+    g_items = OS_CALLOC(TOTAL_ITEMS, sizeof(struct item));
+    if (g_items == NULL)
+        return -1;
+
+    lfstack_init(&g_stack);
+    run_case("lfstack push/pop", stack_push_routine, 1, stack_pop_routine);
+    errors += g_errors;
+    run_case("lfstack push/pop_all", stack_push_routine, 2, stack_pop_all_routine);
+    errors += g_errors;
+
+    mpscq_init(&g_queue);
+    run_case("mpscq push/pop", mpscq_push_routine, 1, mpscq_pop_routine);
+    errors += g_errors;
+    if (!mpscq_empty(&g_queue))
+        errors++;
+
+    mpmc_ring_init(&g_ring, g_cells, RING_SIZE);
+    run_case("mpmc_ring push/pop", ring_push_routine, CONSUMERS, ring_pop_routine);
+    errors += g_errors;
+    if (mpmc_ring_count(&g_ring) != 0)
+        errors++;
+
+    OS_FREE(g_items);
+    OS_LOGI(LOG_TAG, "%s", errors == 0 ? "PASS" : "FAIL");
+    return errors == 0 ? 0 : 1;
+}
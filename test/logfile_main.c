@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "cutils/os_logger.h"
+#include "cutils/os_thread.h"
+
+#define LOG_TAG "logfile_test"
+
+// Built with ENABLE_LOG_SAVE, files are written to a temporary directory
+static char g_dir[64];
+static int g_errors = 0;
+
+#define CHECK(cond, format, ...) do {                                  \
+        if (!(cond)) {                                                 \
+            fprintf(stderr, "FAIL %s:%d: " format "\n", __FUNCTION__,  \
+                    __LINE__, ##__VA_ARGS__);                          \
+            g_errors++;                                                \
+        }                                                              \
+    } while (0)
+
+static long file_size(const char *prefix, int index)
+{
+    char path[192];
+    struct stat st;
+
+    if (index == 0)
+        snprintf(path, sizeof(path), "%s/%s.txt", g_dir, prefix);
+    else
+        snprintf(path, sizeof(path), "%s/%s.%d.txt", g_dir, prefix, index);
+    return stat(path, &st) == 0 ? (long)st.st_size : -1;
+}
+
+static char *file_read(const char *prefix, long *size)
+{
+    char path[192];
+    FILE *fp;
+    char *data;
+
+    snprintf(path, sizeof(path), "%s/%s.txt", g_dir, prefix);
+    *size = file_size(prefix, 0);
+    if (*size < 0 || (fp = fopen(path, "r")) == NULL)
+        return NULL;
+    data = calloc(1, *size + 1);
+    if (data != NULL && fread(data, 1, *size, fp) != (size_t)*size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(fp);
+    return data;
+}
+
+static void rotate_size_test()
+{
+    struct os_logger_file_attr attr = {
+        .path = g_dir,
+        .prefix = "size",
+        .limit_size = 4096,
+        .keep_count = 2,
+        .flush_interval_ms = 0,
+        .crash_safe = false,
+    };
+
+    os_logger_file_config(true, &attr);
+    // ~12KB of lines, rotated several times, only 2 old files are kept
+    for (int i = 0; i < 100; i++)
+        OS_LOGI(LOG_TAG, "size rotation line [%03d] ................................................", i);
+    os_logger_file_config(false, NULL);
+
+    for (int i = 0; i <= 2; i++) {
+        long size = file_size("size", i);
+        CHECK(size > 0 && size <= 4096, "size.%d.txt size [%ld]", i, size);
+    }
+    CHECK(file_size("size", 3) < 0, "size.3.txt beyond keep_count exists");
+}
+
+static void rotate_age_test()
+{
+    struct os_logger_file_attr attr = {
+        .path = g_dir,
+        .prefix = "age",
+        .limit_size = 64 * 1024,
+        .rotate_sec = 1,
+        .keep_count = 3,
+        .flush_interval_ms = 0,
+        .crash_safe = false,
+    };
+
+    os_logger_file_config(true, &attr);
+    OS_LOGI(LOG_TAG, "age rotation first line");
+    OS_THREAD_SLEEP_MSEC(1100);
+    OS_LOGI(LOG_TAG, "age rotation second line");
+    os_logger_file_config(false, NULL);
+
+    CHECK(file_size("age", 1) > 0, "age.1.txt not rotated by age");
+    CHECK(file_size("age", 0) > 0, "age.txt missing");
+    CHECK(file_size("age", 2) < 0, "age.2.txt rotated too often");
+}
+
+static void crash_safe_test()
+{
+    struct os_logger_file_attr attr = {
+        .path = g_dir,
+        .prefix = "crash",
+        .limit_size = 64 * 1024,
+        .keep_count = 1,
+        .flush_interval_ms = 0,
+        .crash_safe = true,
+    };
+    long size;
+    char *data;
+
+    os_logger_file_config(true, &attr);
+    for (int i = 0; i < 10; i++)
+        OS_LOGI(LOG_TAG, "crash safe line [%d]", i);
+    // while open, the mapped file keeps its preallocated size
+    size = file_size("crash", 0);
+    CHECK(size == 64 * 1024, "open crash.txt size [%ld]", size);
+    os_logger_file_config(false, NULL);
+
+    // closing cuts off the zeros behind the last line
+    data = file_read("crash", &size);
+    CHECK(data != NULL && size > 0 && size < 64 * 1024, "closed crash.txt size [%ld]", size);
+    if (data != NULL && size > 0) {
+        CHECK(memchr(data, '\0', size) == NULL, "crash.txt has zeros left");
+        CHECK(data[size - 1] == '\n', "crash.txt doesn't end with a line");
+        CHECK(strstr(data, "crash safe line [9]") != NULL, "crash.txt lost the last line");
+    }
+    free(data);
+}
+
+static void flush_interval_test()
+{
+    struct os_logger_file_attr attr = {
+        .path = g_dir,
+        .prefix = "flush",
+        .limit_size = 64 * 1024,
+        .keep_count = 1,
+        .flush_interval_ms = 60 * 1000,
+        .crash_safe = false,
+    };
+
+    os_logger_file_config(true, &attr);
+    OS_LOGI(LOG_TAG, "buffered line");
+    // no async writer, an idle file is only flushed by the next write or os_logger_flush()
+    CHECK(file_size("flush", 0) == 0, "flush.txt written before interval");
+    os_logger_flush();
+    CHECK(file_size("flush", 0) > 0, "flush.txt not flushed by os_logger_flush()");
+    os_logger_file_config(false, NULL);
+}
+
+int main()
+{
+    char cmd[96];
+
+    snprintf(g_dir, sizeof(g_dir), "/tmp/logfile_XXXXXX");
+    if (mkdtemp(g_dir) == NULL)
+        return -1;
+
+    rotate_size_test();
+    rotate_age_test();
+    crash_safe_test();
+    flush_interval_test();
+
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", g_dir);
+    if (system(cmd) != 0)
+        fprintf(stderr, "Failed to remove [%s]\n", g_dir);
+
+    fprintf(stderr, "%s\n", g_errors == 0 ? "PASS" : "FAIL");
+    return g_errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "cutils/os_logger.h"
+#include "cutils/os_thread.h"
+#include "cutils/os_time.h"
+
+#define LOG_TAG "logger_test"
+
+// Run with stdout redirected, e.g. ./logger > /dev/null, the summary is printed to stderr
+#define THREAD_COUNT 4
+#define LINE_COUNT   50000
+
+static void *log_routine(void *arg)
+{
+    unsigned long long *cost_us = (unsigned long long *)arg;
+    unsigned long long start = OS_MONOTONIC_USEC();
+
+    for (int i = 0; i < LINE_COUNT; i++)
+        OS_LOGD(LOG_TAG, "line [%d] from handler, value=[%d], name=[%s]", i, i * 7, "looper");
+
+    *cost_us = OS_MONOTONIC_USEC() - start;
+    return NULL;
+}
+
+static void log_bench(const char *mode)
+{
+    struct os_threadattr attr = {
+        .name = "log_bench",
+        .priority = OS_THREAD_PRIO_NORMAL,
+        .stacksize = 8192,
+        .joinable = true,
+    };
+    os_thread_t threads[THREAD_COUNT];
+    unsigned long long cost_us[THREAD_COUNT];
+    unsigned long long total = 0;
+
+    for (int i = 0; i < THREAD_COUNT; i++)
+        threads[i] = OS_THREAD_CREATE(&attr, log_routine, &cost_us[i]);
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        OS_THREAD_JOIN(threads[i], NULL);
+        total += cost_us[i];
+    }
+    os_logger_flush();
+
+    fprintf(stderr, "%-24s: %d threads x %d lines, caller cost [%llu]ns/line, dropped [%llu]\n",
+            mode, THREAD_COUNT, LINE_COUNT,
+            total * 1000 / (THREAD_COUNT * LINE_COUNT), os_logger_dropped());
+}
+
+#define CHECK_TAG   "logger_check"
+#define CHECK_COUNT 32
+
+static char check_expect[CHECK_COUNT][256];
+static int check_count = 0;
+static const char *volatile check_null = NULL;
+
+// the same spec formatted by the writer thread from a deferred record and by snprintf
+#define CHECK_FORMAT(fmt, ...) do {                                                     \
+        snprintf(check_expect[check_count], sizeof(check_expect[0]), fmt, ##__VA_ARGS__); \
+        OS_LOGD(CHECK_TAG, "case[%d]<" fmt ">", check_count, ##__VA_ARGS__);              \
+        check_count++;                                                                  \
+    } while (0)
+
+static int deferred_check()
+{
+    char unterminated[4] = { 'a', 'b', 'c', 'd' };
+    char line[1024], marker[32];
+    int n1 = 0, errors = 0, found = 0;
+    int saved_stdout;
+    FILE *capture = tmpfile();
+
+    if (capture == NULL)
+        return -1;
+    fflush(stdout);
+    saved_stdout = dup(STDOUT_FILENO);
+    dup2(fileno(capture), STDOUT_FILENO);
+
+    os_logger_async_start(NULL);
+    os_logger_set_deferred(CHECK_TAG, true);
+    CHECK_FORMAT("%*d|%-*d", 6, 42, -6, 42);
+    CHECK_FORMAT("%-5.*s|%.*s", 3, "abcdef", -1, "abc");
+    CHECK_FORMAT("%.*s|%.2s", 4, unterminated, unterminated);
+    CHECK_FORMAT("%hhd|%hu", (char)300, (unsigned short)70000);
+    CHECK_FORMAT("%zu|%zd", (size_t)12345, (ssize_t)-12345);
+    CHECK_FORMAT("%p|%p", (void *)&n1, (void *)NULL);
+    CHECK_FORMAT("%lld|%llx|%lu", -1234567890123LL, 0xdeadbeefcafeULL, 4000000000UL);
+    CHECK_FORMAT("%.3f|%10.2e|%g", 3.14159, -12345.678, 0.0001);
+    CHECK_FORMAT("%c|%3c", 'x', 'y');
+    CHECK_FORMAT("100%%|%d%%", 50);
+    CHECK_FORMAT("%s|%.3s|%10s", check_null, check_null, check_null);
+    // not deferred, formatted by the caller
+    CHECK_FORMAT("%d%n|%d", 12345, &n1, 6);
+    CHECK_FORMAT("%Lf", (long double)2.5);
+    os_logger_flush();
+    os_logger_set_deferred(CHECK_TAG, false);
+    os_logger_async_stop();
+
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+
+    rewind(capture);
+    while (fgets(line, sizeof(line), capture) != NULL) {
+        for (int i = 0; i < check_count; i++) {
+            snprintf(marker, sizeof(marker), "case[%d]<", i);
+            char *begin = strstr(line, marker);
+            char *end = strrchr(line, '>');
+            if (begin == NULL || end == NULL)
+                continue;
+            begin += strlen(marker);
+            *end = '\0';
+            found++;
+            if (strcmp(begin, check_expect[i]) != 0) {
+                fprintf(stderr, "deferred case[%d]: [%s], expect [%s]\n", i, begin, check_expect[i]);
+                errors++;
+            }
+            break;
+        }
+    }
+    fclose(capture);
+
+    fprintf(stderr, "%-24s: %d/%d specs match vsnprintf\n", "deferred format check",
+            found - errors, check_count);
+    return (errors == 0 && found == check_count) ? 0 : -1;
+}
+
+int main()
+{
+    struct os_logger_async_attr attr = {
+        .ring_size = 256 * 1024,
+        .flush_interval_ms = 10,
+        .full_policy = OS_LOGGER_FULL_BLOCK,
+    };
+
+    if (deferred_check() != 0)
+        return -1;
+
+    log_bench("sync");
+
+    os_logger_async_start(&attr);
+    log_bench("async (block when full)");
+    os_logger_async_stop();
+
+    attr.full_policy = OS_LOGGER_FULL_DROP;
+    os_logger_async_start(&attr);
+    log_bench("async (drop when full)");
+
+    os_logger_set_deferred(LOG_TAG, true);
+    log_bench("async (deferred format)");
+    os_logger_set_deferred(LOG_TAG, false);
+    os_logger_async_stop();
+
+    os_logger_set_level(LOG_TAG, OS_LOG_INFO);
+    log_bench("disabled tag");
+    os_logger_set_level(LOG_TAG, OS_LOG_VERBOSE);
+
+    os_logger_set_ratelimit(LOG_TAG, 1000, 100);
+    log_bench("rate limited 1000/s");
+    os_logger_set_ratelimit(LOG_TAG, 0, 0);
+    return 0;
+}
@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "cutils/os_memory.h"
+#include "cutils/os_logger.h"
+#include "cutils/os_thread.h"
+#include "cutils/os_time.h"
+
+// built with ENABLE_MEMORY_LEAK_DETECT or ENABLE_MEMORY_POOL, compares
+// OS_MALLOC/OS_FREE to malloc/free
+#define LOG_TAG "memory_bench"
+
+#define THREAD_COUNT 4
+#define LIVE_COUNT   20000
+#define ROUND_COUNT  10
+
+struct bench_arg {
+    bool tracked; // use OS_MALLOC/OS_FREE
+    unsigned long long cost_us;
+};
+
+static void *bench_thread_entry(void *arg)
+{
+    struct bench_arg *bench = (struct bench_arg *)arg;
+    void **blocks = calloc(LIVE_COUNT, sizeof(void *));
+    unsigned int seed = (unsigned int)(uintptr_t)arg;
+    unsigned long long start = OS_MONOTONIC_USEC();
+
+    for (int round = 0; round < ROUND_COUNT; round++) {
+        for (int i = 0; i < LIVE_COUNT; i++) {
+            size_t size = 16 + (rand_r(&seed) % 256);
+            blocks[i] = bench->tracked ? OS_MALLOC(size) : malloc(size);
+        }
+        // free in random order, the list used to search from tail
+        for (int i = 0; i < LIVE_COUNT; i++) {
+            int j = rand_r(&seed) % LIVE_COUNT;
+            void *tmp = blocks[i];
+            blocks[i] = blocks[j];
+            blocks[j] = tmp;
+        }
+        for (int i = 0; i < LIVE_COUNT; i++) {
+            if (bench->tracked)
+                OS_FREE(blocks[i]);
+            else
+                free(blocks[i]);
+        }
+    }
+
+    bench->cost_us = OS_MONOTONIC_USEC() - start;
+    free(blocks);
+    return NULL;
+}
+
+static double bench_run(bool tracked)
+{
+    struct os_threadattr attr = {
+        .name = "memory_bench",
+        .priority = OS_THREAD_PRIO_NORMAL,
+        .stacksize = 4096,
+        .joinable = true,
+    };
+    struct bench_arg args[THREAD_COUNT];
+    os_thread_t threads[THREAD_COUNT];
+    unsigned long long cost = 0;
+
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        args[i].tracked = tracked;
+        threads[i] = OS_THREAD_CREATE(&attr, bench_thread_entry, &args[i]);
+    }
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        OS_THREAD_JOIN(threads[i], NULL);
+        if (args[i].cost_us > cost)
+            cost = args[i].cost_us;
+    }
+
+    // alloc + free pairs per second
+    return (double)THREAD_COUNT * LIVE_COUNT * ROUND_COUNT / cost * 1000000;
+}
+
+int main()
+{
+    double untracked = bench_run(false);
+    double tracked = bench_run(true);
+
+    OS_LOGI(LOG_TAG, "[%d] threads, [%d] live blocks per thread:", THREAD_COUNT, LIVE_COUNT);
+    OS_LOGI(LOG_TAG, "  malloc/free:       [%.0f] ops/s", untracked);
+    OS_LOGI(LOG_TAG, "  OS_MALLOC/OS_FREE: [%.0f] ops/s, [%.2f]x of malloc/free", tracked, tracked / untracked);
+
+#if defined(ENABLE_MEMORY_LEAK_DETECT)
+    {
+        // heap growth report: which call site grows between two snapshots
+        struct mem_snapshot *prev = memory_debug_snapshot();
+        void *leaks[16];
+        for (int i = 0; i < 16; i++)
+            leaks[i] = OS_MALLOC(1024);
+        struct mem_snapshot *cur = memory_debug_snapshot();
+        struct mem_snapshot *diff = memory_debug_snapshot_diff(prev, cur);
+        char *json = memory_debug_snapshot_json(diff, false);
+
+        memory_debug_snapshot_dump(cur, 5);
+        OS_LOGI(LOG_TAG, "growth: %s", json);
+
+        free(json);
+        memory_debug_snapshot_free(diff);
+        memory_debug_snapshot_free(cur);
+        memory_debug_snapshot_free(prev);
+        for (int i = 0; i < 16; i++)
+            OS_FREE(leaks[i]);
+    }
+#endif
+
+    OS_MEMORY_DUMP();
+    return 0;
+}
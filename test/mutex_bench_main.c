@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <string.h>
+#include "cutils/os_logger.h"
+#include "cutils/os_thread.h"
+#include "cutils/os_futex.h"
+#include "cutils/os_time.h"
+
+#define LOG_TAG "mutex_bench"
+
+#define UNCONTENDED_LOOPS 10000000
+#define CONTENDED_THREADS 4
+#define CONTENDED_LOOPS   1000000
+#define PINGPONG_ROUNDS   100000
+
+static os_mutex_t g_mutex;
+static os_cond_t g_cond;
+static os_fmutex_t g_fmutex = OS_FMUTEX_INITIALIZER;
+static os_fcond_t g_fcond;
+static unsigned long g_counter;
+static int g_turn;
+static os_fmutex_t g_park_mutex = OS_FMUTEX_INITIALIZER;
+static os_fcond_t g_park_cond;
+static bool g_park_exit;
+
+// glibc skips the atomic in pthread locks while the process has one thread,
+// keep an idle thread alive so uncontended locks are measured as in real use
+static void *parked_routine(void *arg)
+{
+    OS_FMUTEX_LOCK(&g_park_mutex);
+    while (!g_park_exit)
+        OS_FCOND_WAIT(&g_park_cond, &g_park_mutex);
+    OS_FMUTEX_UNLOCK(&g_park_mutex);
+    return NULL;
+}
+
+static void *pthread_contended_routine(void *arg)
+{
+    for (int i = 0; i < CONTENDED_LOOPS; i++) {
+        OS_THREAD_MUTEX_LOCK(g_mutex);
+        g_counter++;
+        OS_THREAD_MUTEX_UNLOCK(g_mutex);
+    }
+    return NULL;
+}
+
+static void *futex_contended_routine(void *arg)
+{
+    for (int i = 0; i < CONTENDED_LOOPS; i++) {
+        OS_FMUTEX_LOCK(&g_fmutex);
+        g_counter++;
+        OS_FMUTEX_UNLOCK(&g_fmutex);
+    }
+    return NULL;
+}
+
+// ping-pong between two threads, each waits its turn on the cond
+static void *pthread_pingpong_routine(void *arg)
+{
+    int me = (int)(long)arg;
+    OS_THREAD_MUTEX_LOCK(g_mutex);
+    for (int i = 0; i < PINGPONG_ROUNDS; i++) {
+        while (g_turn != me)
+            OS_THREAD_COND_WAIT(g_cond, g_mutex);
+        g_turn = !me;
+        OS_THREAD_COND_SIGNAL(g_cond);
+    }
+    OS_THREAD_MUTEX_UNLOCK(g_mutex);
+    return NULL;
+}
+
+static void *futex_pingpong_routine(void *arg)
+{
+    int me = (int)(long)arg;
+    OS_FMUTEX_LOCK(&g_fmutex);
+    for (int i = 0; i < PINGPONG_ROUNDS; i++) {
+        while (g_turn != me)
+            OS_FCOND_WAIT(&g_fcond, &g_fmutex);
+        g_turn = !me;
+        OS_FCOND_SIGNAL(&g_fcond);
+    }
+    OS_FMUTEX_UNLOCK(&g_fmutex);
+    return NULL;
+}
+
+static unsigned long long run_threads(int count, void *(*routine)(void *))
+{
+    struct os_threadattr attr = {
+        .name = "mutex_bench",
+        .priority = OS_THREAD_PRIO_NORMAL,
+        .stacksize = 4096,
+        .joinable = true,
+    };
+    os_thread_t threads[CONTENDED_THREADS];
+    unsigned long long start = OS_MONOTONIC_USEC();
+
+    for (long i = 0; i < count; i++)
+        threads[i] = OS_THREAD_CREATE(&attr, routine, (void *)i);
+    for (int i = 0; i < count; i++)
+        OS_THREAD_JOIN(threads[i], NULL);
+    return OS_MONOTONIC_USEC() - start;
+}
+
+int main()
+{
+    struct os_threadattr attr = {
+        .name = "parked",
+        .priority = OS_THREAD_PRIO_NORMAL,
+        .stacksize = 4096,
+        .joinable = true,
+    };
+    unsigned long long start, pthread_us, futex_us;
+    os_thread_t parked;
+
+    g_mutex = OS_THREAD_MUTEX_CREATE();
+    g_cond = OS_THREAD_COND_CREATE();
+    OS_FCOND_INIT(&g_fcond);
+    OS_FCOND_INIT(&g_park_cond);
+    parked = OS_THREAD_CREATE(&attr, parked_routine, NULL);
+
+    start = OS_MONOTONIC_USEC();
+    for (int i = 0; i < UNCONTENDED_LOOPS; i++) {
+        OS_THREAD_MUTEX_LOCK(g_mutex);
+        g_counter++;
+        OS_THREAD_MUTEX_UNLOCK(g_mutex);
+    }
+    pthread_us = OS_MONOTONIC_USEC() - start;
+    start = OS_MONOTONIC_USEC();
+    for (int i = 0; i < UNCONTENDED_LOOPS; i++) {
+        OS_FMUTEX_LOCK(&g_fmutex);
+        g_counter++;
+        OS_FMUTEX_UNLOCK(&g_fmutex);
+    }
+    futex_us = OS_MONOTONIC_USEC() - start;
+    OS_LOGI(LOG_TAG, "uncontended lock/unlock: pthread [%llu]ns, futex [%llu]ns",
+            pthread_us * 1000 / UNCONTENDED_LOOPS, futex_us * 1000 / UNCONTENDED_LOOPS);
+
+    OS_FMUTEX_LOCK(&g_park_mutex);
+    g_park_exit = true;
+    OS_FCOND_SIGNAL(&g_park_cond);
+    OS_FMUTEX_UNLOCK(&g_park_mutex);
+    OS_THREAD_JOIN(parked, NULL);
+
+    g_counter = 0;
+    pthread_us = run_threads(CONTENDED_THREADS, pthread_contended_routine);
+    futex_us = run_threads(CONTENDED_THREADS, futex_contended_routine);
+    OS_LOGI(LOG_TAG, "%d threads contended lock/unlock: pthread [%llu]ns, futex [%llu]ns, counter=[%lu] expect [%d]",
+            CONTENDED_THREADS,
+            pthread_us * 1000 / (CONTENDED_THREADS * CONTENDED_LOOPS),
+            futex_us * 1000 / (CONTENDED_THREADS * CONTENDED_LOOPS),
+            g_counter, 2 * CONTENDED_THREADS * CONTENDED_LOOPS);
+
+    g_turn = 0;
+    pthread_us = run_threads(2, pthread_pingpong_routine);
+    g_turn = 0;
+    futex_us = run_threads(2, futex_pingpong_routine);
+    OS_LOGI(LOG_TAG, "cond ping-pong round trip: pthread [%llu]ns, futex [%llu]ns",
+            pthread_us * 1000 / PINGPONG_ROUNDS, futex_us * 1000 / PINGPONG_ROUNDS);
+
+    OS_FCOND_DESTROY(&g_park_cond);
+    OS_FMUTEX_DESTROY(&g_park_mutex);
+    OS_FCOND_DESTROY(&g_fcond);
+    OS_FMUTEX_DESTROY(&g_fmutex);
+    OS_THREAD_COND_DESTROY(g_cond);
+    OS_THREAD_MUTEX_DESTROY(g_mutex);
+    return 0;
+}
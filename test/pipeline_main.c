@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <string.h>
+#include "cutils/os_logger.h"
+#include "cutils/os_memory.h"
+#include "cutils/os_thread.h"
+#include "cutils/os_time.h"
+#include "cutils/pipeline.h"
+
+#define LOG_TAG "pipeline_test"
+
+#define FRAME_COUNT   400
+#define FRAME_SAMPLES 256
+
+struct frame {
+    unsigned int seq;
+    short samples[FRAME_SAMPLES];
+};
+
+static unsigned int g_next_seq;
+static unsigned int g_out_of_order;
+
+static void *decode_stage(void *item, void *arg)
+{
+    struct frame *frame = (struct frame *)item;
+    for (int i = 0; i < FRAME_SAMPLES; i++)
+        frame->samples[i] = (short)(frame->seq + i);
+    OS_THREAD_SLEEP_USEC(200);
+    return frame;
+}
+
+// the slow stage, simulates waiting on a DSP for 1ms per frame
+static void *effect_stage(void *item, void *arg)
+{
+    struct frame *frame = (struct frame *)item;
+    for (int i = 0; i < FRAME_SAMPLES; i++)
+        frame->samples[i] /= 2;
+    OS_THREAD_SLEEP_USEC(1000);
+    return frame;
+}
+
+static void *sink_stage(void *item, void *arg)
+{
+    struct frame *frame = (struct frame *)item;
+    if (frame->seq != g_next_seq)
+        g_out_of_order++;
+    g_next_seq = frame->seq + 1;
+    OS_FREE(frame);
+    return NULL;
+}
+
+static void frame_free(void *item)
+{
+    OS_FREE(item);
+}
+
+static unsigned long long feed(pipeline_t pipeline, unsigned int first)
+{
+    unsigned long long start = OS_MONOTONIC_USEC();
+    for (unsigned int i = 0; i < FRAME_COUNT; i++) {
+        struct frame *frame = OS_MALLOC(sizeof(struct frame));
+        frame->seq = first + i;
+        // blocks when the first queue is full, backpressure from the slow stage
+        pipeline_push(pipeline, frame, 0);
+    }
+    pipeline_drain(pipeline);
+    return OS_MONOTONIC_USEC() - start;
+}
+
+int main()
+{
+    struct pipeline_stage_attr decode = {
+        .name = "decode",
+        .handle = decode_stage,
+        .queue_size = 8,
+        .priority = OS_THREAD_PRIO_NORMAL,
+    };
+    struct pipeline_stage_attr effect = {
+        .name = "effect",
+        .handle = effect_stage,
+        .workers = 1,
+        .ordered = true,
+        .queue_size = 8,
+        .priority = OS_THREAD_PRIO_NORMAL,
+    };
+    struct pipeline_stage_attr sink = {
+        .name = "sink",
+        .handle = sink_stage,
+        .queue_size = 8,
+        .priority = OS_THREAD_PRIO_NORMAL,
+    };
+    pipeline_t pipeline;
+    unsigned long long elapsed;
+    int effect_index;
+
+    pipeline = pipeline_create("audio", frame_free);
+    pipeline_add_stage(pipeline, &decode);
+    effect_index = pipeline_add_stage(pipeline, &effect);
+    pipeline_add_stage(pipeline, &sink);
+    pipeline_start(pipeline);
+
+    elapsed = feed(pipeline, 0);
+    OS_LOGI(LOG_TAG, "effect x1: [%d] frames in [%llu]ms", FRAME_COUNT, elapsed / 1000);
+    pipeline_dump(pipeline);
+
+    // effect is the bottleneck (decode blocked on it), scale it without touching threads
+    pipeline_set_workers(pipeline, effect_index, 4);
+    pipeline_reset_stats(pipeline);
+    elapsed = feed(pipeline, FRAME_COUNT);
+    OS_LOGI(LOG_TAG, "effect x4: [%d] frames in [%llu]ms, out of order [%u]",
+            FRAME_COUNT, elapsed / 1000, g_out_of_order);
+    pipeline_dump(pipeline);
+
+    pipeline_destroy(pipeline);
+    return 0;
+}
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <string.h>
+#include "cutils/os_memory.h"
+#include "cutils/os_logger.h"
+#include "cutils/os_thread.h"
+#include "cutils/ringbuf.h"
+
+#define LOG_TAG "ringbuf_test"
+
+#define RINGBUF_SIZE        (16*1024)
+#define RECORD_MIN_SIZE     20
+#define RECORD_MAX_SIZE     (8*1024)
+#define RECORD_COUNT        1000
+
+static ringbuf_handle_t rb = NULL;
+
+static int record_size(int index)
+{
+    return RECORD_MIN_SIZE + (index * 7919) % (RECORD_MAX_SIZE - RECORD_MIN_SIZE);
+}
+
+static void *record_write_thread(void *arg)
+{
+    char *record = OS_MALLOC(RECORD_MAX_SIZE);
+
+    for (int i = 0; i < RECORD_COUNT; i++) {
+        int len = record_size(i);
+        memset(record, i & 0xff, len);
+        if (rb_write_record(rb, record, len, 0) != len) {
+            OS_LOGE(LOG_TAG, "Failed to write record[%d]", i);
+            break;
+        }
+    }
+
+    rb_done_write(rb);
+    OS_FREE(record);
+    return NULL;
+}
+
+int main()
+{
+    char *record = NULL;
+    int count = 0;
+    int len;
+
+    rb = rb_create(RINGBUF_SIZE);
+    record = OS_MALLOC(RECORD_MAX_SIZE);
+    if (rb == NULL || record == NULL) {
+        OS_LOGE(LOG_TAG, "Failed to allocate ringbuf");
+        goto error;
+    }
+
+    {
+        struct os_threadattr attr = {
+            .name = "record_write",
+            .priority = OS_THREAD_PRIO_NORMAL,
+            .stacksize = 1024,
+            .joinable = false,
+        };
+        OS_THREAD_CREATE(&attr, record_write_thread, NULL);
+    }
+
+    while (true) {
+        len = rb_peek_record(rb, 1000);
+        if (len < 0)
+            break;
+        if (rb_read_record(rb, record, 0, 0) != RB_FAIL && len > 0) {
+            OS_LOGE(LOG_TAG, "Record[%d] consumed by a too small buffer", count);
+            break;
+        }
+
+        len = rb_read_record(rb, record, RECORD_MAX_SIZE, 0);
+        if (len != record_size(count)) {
+            OS_LOGE(LOG_TAG, "Record[%d] size mismatch: %d != %d", count, len, record_size(count));
+            break;
+        }
+        for (int i = 0; i < len; i++) {
+            if (record[i] != (char)(count & 0xff)) {
+                OS_LOGE(LOG_TAG, "Record[%d] torn at offset %d", count, i);
+                goto error;
+            }
+        }
+        count++;
+    }
+
+    if (count == RECORD_COUNT)
+        OS_LOGI(LOG_TAG, "Succeed to read %d records", count);
+    else
+        OS_LOGE(LOG_TAG, "Failed to read records, only %d of %d", count, RECORD_COUNT);
+
+error:
+    if (record != NULL)
+        OS_FREE(record);
+    if (rb != NULL)
+        rb_destroy(rb);
+    return 0;
+}
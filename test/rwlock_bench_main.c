@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "cutils/os_logger.h"
+#include "cutils/os_thread.h"
+#include "cutils/os_futex.h"
+#include "cutils/os_time.h"
+
+#define LOG_TAG "rwlock_bench"
+
+#define MAX_READERS      64
+#define RUN_MSEC         200
+#define WRITE_INTERVAL_US 1000
+
+enum bench_lock {
+    BENCH_FMUTEX = 0,
+    BENCH_PTHREAD_RWLOCK,
+    BENCH_OS_RWLOCK,
+    BENCH_SEQLOCK,
+    BENCH_MAX,
+};
+
+static const char *g_lock_name[BENCH_MAX] = {
+    "fmutex", "pthread rwlock", "os_rwlock", "seqlock",
+};
+
+// small config snapshot, check is always ~version so torn reads are detected
+struct bench_config {
+    unsigned long version;
+    unsigned long values[6];
+    unsigned long check;
+};
+
+static struct bench_config g_config;
+static os_fmutex_t g_fmutex = OS_FMUTEX_INITIALIZER;
+static pthread_rwlock_t g_pthread_rwlock = PTHREAD_RWLOCK_INITIALIZER;
+static os_rwlock_t g_rwlock = OS_RWLOCK_INITIALIZER;
+static os_seqlock_t g_seqlock;
+static enum bench_lock g_lock;
+static bool g_stop;
+static unsigned long long g_reads;
+static unsigned long long g_writes;
+static unsigned long long g_torn;
+
+static void config_read(struct bench_config *config)
+{
+    switch (g_lock) {
+    case BENCH_FMUTEX:
+        OS_FMUTEX_LOCK(&g_fmutex);
+        *config = g_config;
+        OS_FMUTEX_UNLOCK(&g_fmutex);
+        break;
+    case BENCH_PTHREAD_RWLOCK:
+        pthread_rwlock_rdlock(&g_pthread_rwlock);
+        *config = g_config;
+        pthread_rwlock_unlock(&g_pthread_rwlock);
+        break;
+    case BENCH_OS_RWLOCK:
+        OS_RWLOCK_RDLOCK(&g_rwlock);
+        *config = g_config;
+        OS_RWLOCK_UNLOCK(&g_rwlock);
+        break;
+    case BENCH_SEQLOCK:
+        OS_SEQLOCK_READ(&g_seqlock, config, &g_config, sizeof(*config));
+        break;
+    default:
+        break;
+    }
+}
+
+static void config_update(const struct bench_config *config)
+{
+    switch (g_lock) {
+    case BENCH_FMUTEX:
+        OS_FMUTEX_LOCK(&g_fmutex);
+        g_config = *config;
+        OS_FMUTEX_UNLOCK(&g_fmutex);
+        break;
+    case BENCH_PTHREAD_RWLOCK:
+        pthread_rwlock_wrlock(&g_pthread_rwlock);
+        g_config = *config;
+        pthread_rwlock_unlock(&g_pthread_rwlock);
+        break;
+    case BENCH_OS_RWLOCK:
+        OS_RWLOCK_WRLOCK(&g_rwlock);
+        g_config = *config;
+        OS_RWLOCK_UNLOCK(&g_rwlock);
+        break;
+    case BENCH_SEQLOCK:
+        OS_SEQLOCK_WRITE(&g_seqlock, &g_config, config, sizeof(g_config));
+        break;
+    default:
+        break;
+    }
+}
+
+static void *reader_routine(void *arg)
+{
+    struct bench_config config;
+    unsigned long long reads = 0, torn = 0;
+
+    while (!__atomic_load_n(&g_stop, __ATOMIC_RELAXED)) {
+        config_read(&config);
+        if (config.check != ~config.version || config.values[5] != config.version)
+            torn++;
+        reads++;
+    }
+    __atomic_add_fetch(&g_reads, reads, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&g_torn, torn, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+static void *writer_routine(void *arg)
+{
+    struct bench_config config;
+    unsigned long long writes = 0;
+
+    memset(&config, 0, sizeof(config));
+    while (!__atomic_load_n(&g_stop, __ATOMIC_RELAXED)) {
+        config.version++;
+        for (int i = 0; i < 6; i++)
+            config.values[i] = config.version;
+        config.check = ~config.version;
+        config_update(&config);
+        writes++;
+        usleep(WRITE_INTERVAL_US);
+    }
+    __atomic_add_fetch(&g_writes, writes, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+static void run_bench(enum bench_lock lock, int readers)
+{
+    struct os_threadattr attr = {
+        .name = "rwlock_bench",
+        .priority = OS_THREAD_PRIO_NORMAL,
+        .stacksize = 4096,
+        .joinable = true,
+    };
+    os_thread_t threads[MAX_READERS + 1];
+
+    g_lock = lock;
+    g_stop = false;
+    g_reads = g_writes = g_torn = 0;
+    memset(&g_config, 0, sizeof(g_config));
+    g_config.check = ~0UL;
+
+    threads[0] = OS_THREAD_CREATE(&attr, writer_routine, NULL);
+    for (int i = 1; i <= readers; i++)
+        threads[i] = OS_THREAD_CREATE(&attr, reader_routine, NULL);
+    usleep(RUN_MSEC * 1000);
+    __atomic_store_n(&g_stop, true, __ATOMIC_RELAXED);
+    for (int i = 0; i <= readers; i++)
+        OS_THREAD_JOIN(threads[i], NULL);
+
+    OS_LOGI(LOG_TAG, "%-14s readers=[%2d]: reads [%6llu]K/s, writes [%4llu]/s, torn [%llu]",
+            g_lock_name[lock], readers, g_reads / RUN_MSEC, g_writes * 1000 / RUN_MSEC, g_torn);
+}
+
+int main()
+{
+    OS_SEQLOCK_INIT(&g_seqlock);
+
+    // one writer updates the config every WRITE_INTERVAL_US while the readers spin on it
+    for (int readers = 1; readers <= MAX_READERS; readers *= 2) {
+        for (int lock = 0; lock < BENCH_MAX; lock++)
+            run_bench((enum bench_lock)lock, readers);
+    }
+
+    OS_SEQLOCK_DESTROY(&g_seqlock);
+    return 0;
+}
@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <string.h>
+#include "cutils/os_memory.h"
+#include "cutils/os_logger.h"
+#include "cutils/os_thread.h"
+#include "cutils/msglooper.h"
+#include "cutils/sw_timer.h"
+
+#define LOG_TAG "swtimer_test"
+
+#define TIMER_COUNT 200
+
+static int periodic_count = 0;
+static int oneshot_count = 0;
+static int looper_count = 0;
+static int control_count = 0;
+static swtimer_t control = NULL;
+
+static void periodic_callback()
+{
+    periodic_count++;
+}
+
+static void oneshot_callback()
+{
+    oneshot_count++;
+}
+
+static void looper_callback()
+{
+    looper_count++;
+}
+
+static void control_callback()
+{
+    // overrun the 5ms period once, the missed expiries are reported
+    if (control_count++ == 50)
+        OS_THREAD_SLEEP_MSEC(12);
+    if (swtimer_get_overrun(control) > 0)
+        OS_LOGW(LOG_TAG, "control loop overrun [%u] expiries", swtimer_get_overrun(control));
+}
+
+int main()
+{
+    struct swtimer_attr attr;
+    struct os_threadattr looper_attr = {
+        .name = "swtimer_looper",
+        .priority = OS_THREAD_PRIO_NORMAL,
+        .stacksize = 1024,
+        .joinable = true,
+    };
+    struct os_threadsched looper_sched = { .cpumask = 0x1 }; // pin looper on cpu 0
+    struct os_threadsched service_sched = { .policy = OS_THREAD_POLICY_FIFO };
+    swtimer_t timers[TIMER_COUNT];
+    swtimer_t oneshot, looper_timer;
+    mlooper_t looper;
+
+    // real-time timer service if permitted, otherwise it runs with a warning
+    swtimer_service_sched(&service_sched, OS_THREAD_PRIO_SOFT_REALTIME);
+
+    attr.name = "periodic";
+    attr.period_ms = 10;
+    attr.reload = true;
+    for (int i = 0; i < TIMER_COUNT; i++) {
+        timers[i] = swtimer_create(&attr, periodic_callback);
+        swtimer_start(timers[i]);
+    }
+
+    attr.name = "oneshot";
+    attr.period_ms = 100;
+    attr.reload = false;
+    oneshot = swtimer_create(&attr, oneshot_callback);
+    swtimer_start(oneshot);
+
+    looper = mlooper_create(&looper_attr, NULL, NULL);
+    mlooper_set_sched(looper, &looper_sched);
+    mlooper_start(looper);
+    attr.name = "looper";
+    attr.period_ms = 50;
+    attr.reload = true;
+    looper_timer = swtimer_create(&attr, looper_callback);
+    swtimer_set_looper(looper_timer, looper);
+    swtimer_start(looper_timer);
+
+    attr.name = "control";
+    attr.period_ms = 5;
+    attr.reload = true;
+    control = swtimer_create(&attr, control_callback);
+    swtimer_set_overrun_policy(control, SWTIMER_OVERRUN_REPORT);
+    swtimer_start(control);
+
+    OS_THREAD_SLEEP_MSEC(1000);
+
+    {
+        struct swtimer_stats stats;
+        swtimer_get_stats(control, &stats);
+        OS_LOGI(LOG_TAG, "control loop: expire=[%llu], overrun=[%llu], late last/max/avg=[%llu/%llu/%llu]us",
+                stats.expire_count, stats.overrun_count,
+                stats.late_last_us, stats.late_max_us, stats.late_avg_us);
+        swtimer_destroy(control);
+    }
+
+    for (int i = 0; i < TIMER_COUNT; i++)
+        swtimer_destroy(timers[i]);
+    swtimer_destroy(oneshot);
+    swtimer_destroy(looper_timer);
+    mlooper_destroy(looper);
+
+    OS_LOGI(LOG_TAG, "%d periodic timers fired [%d] times, expect about [%d]",
+            TIMER_COUNT, periodic_count, TIMER_COUNT * 100);
+    OS_LOGI(LOG_TAG, "oneshot timer fired [%d] times, expect [1]", oneshot_count);
+    OS_LOGI(LOG_TAG, "looper timer fired [%d] times, expect about [20]", looper_count);
+    return 0;
+}
@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "cutils/os_logger.h"
+#include "cutils/os_memory.h"
+#include "cutils/os_thread.h"
+#include "cutils/os_threadpool.h"
+
+#define LOG_TAG "threadpool_bench"
+
+#define LATENCY_ROUNDS    2000
+#define THROUGHPUT_TASKS  1000000
+#define FIB_N             24
+#define FIB_CUTOFF        12
+#define ARRAY_SIZE        (8 * 1024 * 1024)
+
+static os_threadpool_t g_pool;
+static unsigned long long g_done;
+static unsigned long long g_start_ns;
+
+static unsigned long long now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void latency_task(void *arg)
+{
+    unsigned long long *latency = (unsigned long long *)arg;
+    *latency += now_ns() - g_start_ns;
+    __atomic_store_n(&g_done, 1, __ATOMIC_RELEASE);
+}
+
+// submit to start latency, idle pool (workers sleeping) or busy (workers still spinning)
+static unsigned long long bench_latency(bool idle)
+{
+    unsigned long long latency = 0;
+    for (int i = 0; i < LATENCY_ROUNDS; i++) {
+        if (idle)
+            OS_THREAD_SLEEP_MSEC(1);
+        __atomic_store_n(&g_done, 0, __ATOMIC_RELAXED);
+        g_start_ns = now_ns();
+        os_threadpool_submit(g_pool, latency_task, &latency);
+        while (!__atomic_load_n(&g_done, __ATOMIC_ACQUIRE))
+            ;
+    }
+    return latency / LATENCY_ROUNDS;
+}
+
+static void empty_task(void *arg)
+{
+    __atomic_add_fetch(&g_done, 1, __ATOMIC_RELAXED);
+}
+
+static void spawn_task(void *arg)
+{
+    // tasks spawned by a task go to the worker deque, other workers steal them
+    long count = (long)arg;
+    for (long i = 0; i < count; i++)
+        os_threadpool_submit(g_pool, empty_task, NULL);
+}
+
+static void *fib_task(void *arg)
+{
+    long n = (long)arg;
+    if (n < FIB_CUTOFF) {
+        long a = 0, b = 1;
+        for (long i = 0; i < n; i++) {
+            long t = a + b;
+            a = b;
+            b = t;
+        }
+        return (void *)a;
+    }
+    os_future_t left = os_threadpool_async(g_pool, fib_task, (void *)(n - 1));
+    long right = (long)fib_task((void *)(n - 2));
+    return (void *)((long)os_future_get(left) + right);
+}
+
+static void sum_range(size_t begin, size_t end, void *arg)
+{
+    unsigned int *array = (unsigned int *)arg;
+    unsigned long long sum = 0;
+    for (size_t i = begin; i < end; i++)
+        sum += array[i] * 3 + 1;
+    __atomic_add_fetch(&g_done, sum, __ATOMIC_RELAXED);
+}
+
+int main()
+{
+    struct os_threadpool_attr attr = {
+        .name = "bench_pool",
+        .min_threads = 0, // number of cpus
+    };
+    unsigned long long start, elapsed, serial;
+    unsigned int *array;
+
+    g_pool = os_threadpool_create(&attr);
+    if (g_pool == NULL)
+        return -1;
+    OS_LOGI(LOG_TAG, "workers: [%u]", os_threadpool_threads(g_pool));
+
+    OS_LOGI(LOG_TAG, "spawn latency: idle pool [%llu]ns, busy pool [%llu]ns",
+            bench_latency(true), bench_latency(false));
+
+    g_done = 0;
+    start = now_ns();
+    for (long i = 0; i < THROUGHPUT_TASKS; i++)
+        os_threadpool_submit(g_pool, empty_task, NULL);
+    os_threadpool_drain(g_pool);
+    elapsed = now_ns() - start;
+    OS_LOGI(LOG_TAG, "external submit: [%d] tasks in [%llu]ms, [%llu]ns per task, done=[%llu]",
+            THROUGHPUT_TASKS, elapsed / 1000000, elapsed / THROUGHPUT_TASKS, g_done);
+
+    g_done = 0;
+    start = now_ns();
+    for (long i = 0; i < 100; i++)
+        os_threadpool_submit(g_pool, spawn_task, (void *)(long)(THROUGHPUT_TASKS / 100));
+    os_threadpool_drain(g_pool);
+    elapsed = now_ns() - start;
+    OS_LOGI(LOG_TAG, "worker submit: [%d] tasks in [%llu]ms, [%llu]ns per task, done=[%llu]",
+            THROUGHPUT_TASKS, elapsed / 1000000, elapsed / THROUGHPUT_TASKS, g_done);
+
+    start = now_ns();
+    long fib = (long)os_future_get(os_threadpool_async(g_pool, fib_task, (void *)(long)FIB_N));
+    elapsed = now_ns() - start;
+    OS_LOGI(LOG_TAG, "fib(%d) with futures: [%ld] in [%llu]us", FIB_N, fib, elapsed / 1000);
+
+    array = OS_MALLOC(ARRAY_SIZE * sizeof(unsigned int));
+    if (array != NULL) {
+        for (size_t i = 0; i < ARRAY_SIZE; i++)
+            array[i] = (unsigned int)i;
+        g_done = 0;
+        start = now_ns();
+        sum_range(0, ARRAY_SIZE, array);
+        serial = now_ns() - start;
+        unsigned long long expect = g_done;
+        g_done = 0;
+        start = now_ns();
+        os_threadpool_parallel_for(g_pool, 0, ARRAY_SIZE, 0, sum_range, array);
+        elapsed = now_ns() - start;
+        OS_LOGI(LOG_TAG, "parallel_for over [%d] items: serial [%llu]us, parallel [%llu]us, %s",
+                ARRAY_SIZE, serial / 1000, elapsed / 1000, g_done == expect ? "sum ok" : "SUM MISMATCH");
+        OS_FREE(array);
+    }
+
+    os_threadpool_destroy(g_pool);
+    return 0;
+}
@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <string.h>
+#include "cutils/os_memory.h"
+#include "cutils/os_logger.h"
+#include "cutils/os_thread.h"
+#include "cutils/os_time.h"
+#include "cutils/msglooper.h"
+#include "cutils/timer_wheel.h"
+
+#define LOG_TAG "timerwheel_test"
+
+#define CONN_COUNT 10000
+
+struct connection {
+    int id;
+    struct twtimer idle_timer;
+};
+
+static int timeout_count = 0;
+static int looper_fired = 0;
+
+static void connection_idle_timeout(void *arg)
+{
+    timeout_count++;
+}
+
+static void looper_timeout(void *arg)
+{
+    looper_fired++;
+}
+
+static void looper_block(struct message *msg)
+{
+    OS_THREAD_SLEEP_MSEC(50);
+}
+
+// destroy a looper driven wheel while its ticks are queued behind a busy message
+static int looper_destroy_test()
+{
+    struct os_threadattr attr = {
+        .name = "wheel_looper",
+        .priority = OS_THREAD_PRIO_NORMAL,
+        .stacksize = 4096,
+        .joinable = true,
+    };
+    struct twtimer timers[10];
+    mlooper_t looper;
+    twheel_t wheel;
+    int fired;
+
+    looper = mlooper_create(&attr, NULL, NULL);
+    if (looper == NULL)
+        return -1;
+    mlooper_start(looper);
+
+    wheel = twheel_create("looper_wheel", 1, 0);
+    if (wheel == NULL)
+        return -1;
+    twheel_set_looper(wheel, looper);
+    for (int i = 0; i < 10; i++) {
+        twtimer_init(&timers[i], looper_timeout, NULL);
+        twtimer_start(wheel, &timers[i], 5 + i * 5);
+    }
+
+    mlooper_post_message(looper, message_obtain2(0, 0, 0, NULL, 0, looper_block, NULL, NULL));
+    OS_THREAD_SLEEP_MSEC(30);
+    OS_LOGI(LOG_TAG, "destroy wheel with [%d] messages queued on looper", mlooper_message_count(looper));
+    twheel_destroy(wheel);
+    fired = looper_fired;
+
+    OS_THREAD_SLEEP_MSEC(100);
+    mlooper_stop(looper);
+    mlooper_destroy(looper);
+
+    OS_LOGI(LOG_TAG, "looper wheel fired [%d] times after destroy, expect [0]", looper_fired - fired);
+    return looper_fired == fired ? 0 : -1;
+}
+
+static twheel_t callback_wheel = NULL;
+static int callback_fired = 0;
+
+static void callback_destroy_timeout(void *arg)
+{
+    callback_fired++;
+    twheel_destroy(callback_wheel);
+}
+
+// destroy the wheel from its own timer callback on timer service thread
+static int callback_destroy_test()
+{
+    struct twtimer timers[2];
+
+    callback_wheel = twheel_create("callback_wheel", 1, 0);
+    if (callback_wheel == NULL)
+        return -1;
+    // both expire on the same tick, the second is dropped by destroy
+    for (int i = 0; i < 2; i++) {
+        twtimer_init(&timers[i], callback_destroy_timeout, NULL);
+        twtimer_start(callback_wheel, &timers[i], 10);
+    }
+
+    OS_THREAD_SLEEP_MSEC(100);
+    OS_LOGI(LOG_TAG, "callback wheel fired [%d] times, expect [1]", callback_fired);
+    return callback_fired == 1 ? 0 : -1;
+}
+
+int main()
+{
+    struct connection *conns;
+    twheel_t wheel;
+    unsigned long long start, cost;
+
+    wheel = twheel_create("conn_idle", 10, 0);
+    if (wheel == NULL)
+        return -1;
+
+    conns = OS_CALLOC(CONN_COUNT, sizeof(struct connection));
+    if (conns == NULL)
+        return -1;
+
+    start = OS_MONOTONIC_USEC();
+    for (int i = 0; i < CONN_COUNT; i++) {
+        conns[i].id = i;
+        twtimer_init(&conns[i].idle_timer, connection_idle_timeout, &conns[i]);
+        twtimer_start(wheel, &conns[i].idle_timer, 200 + (i % 100) * 10);
+    }
+    cost = OS_MONOTONIC_USEC() - start;
+    OS_LOGI(LOG_TAG, "started [%d] timers in [%llu]us", CONN_COUNT, cost);
+
+    // traffic on even connections resets the idle timer, odd ones are closed
+    OS_THREAD_SLEEP_MSEC(100);
+    start = OS_MONOTONIC_USEC();
+    for (int i = 0; i < CONN_COUNT; i++) {
+        if (i % 2 == 0)
+            twtimer_reset(&conns[i].idle_timer);
+        else
+            twtimer_stop(&conns[i].idle_timer);
+    }
+    cost = OS_MONOTONIC_USEC() - start;
+    OS_LOGI(LOG_TAG, "reset/stopped [%d] timers in [%llu]us", CONN_COUNT, cost);
+
+    OS_THREAD_SLEEP_MSEC(1500);
+
+    OS_LOGI(LOG_TAG, "idle timeout fired [%d] times, expect [%d]", timeout_count, CONN_COUNT / 2);
+
+    twheel_destroy(wheel);
+    OS_FREE(conns);
+    if (timeout_count != CONN_COUNT / 2)
+        return -1;
+
+    if (callback_destroy_test() != 0)
+        return -1;
+    return looper_destroy_test();
+}